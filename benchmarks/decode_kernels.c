@@ -0,0 +1,196 @@
+/**
+ * @file decode_kernels.c
+ * @brief Throughput of the bit-unpacking and dictionary decode kernels
+ *
+ * Unpacks a buffer of random bit-packed fields at every width from 1 to 32
+ * bits, then gathers random dictionary entries at every fixed type width,
+ * once per kernel level the CPU supports. Results are in GB/s of decoded
+ * output (32-bit values for unpacking, entries for gathers), with the data
+ * sized to stay in cache so the kernels rather than memory are measured.
+ *
+ * Usage: decode_kernels [values] [rounds]
+ */
+
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 199309L
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "retldb/storage.h"
+#include "storage/unpack.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+#define DICTIONARY_ENTRIES 4096  // Entries in the gathered dictionary
+
+static const char* level_names[] = { "scalar", "avx2", "avx512" };
+
+/**
+ * @brief Get a monotonic timestamp
+ *
+ * @return Nanoseconds since an arbitrary point
+ */
+static uint64_t now_ns(void) {
+#ifdef _WIN32
+    LARGE_INTEGER counter, frequency;
+    QueryPerformanceCounter(&counter);
+    QueryPerformanceFrequency(&frequency);
+    return (uint64_t)((double)counter.QuadPart * 1e9 / (double)frequency.QuadPart);
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+/**
+ * @brief Advance a xorshift64 generator
+ *
+ * @param state The generator state (non-zero)
+ * @return The next pseudo-random value
+ */
+static uint64_t next_random(uint64_t* state) {
+    uint64_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    *state = x;
+    return x;
+}
+
+/**
+ * @brief Time unpacking one bit width
+ *
+ * @param packed Random bytes, enough for count fields of 32 bits plus spare
+ * @param packed_size Bytes of packed
+ * @param count Number of fields
+ * @param bits Bits per field
+ * @param rounds Times to unpack everything
+ * @param out Receives the values
+ * @return Decoded GB/s
+ */
+static double time_unpack(const uint8_t* packed, size_t packed_size, size_t count, unsigned bits,
+                          size_t rounds, uint32_t* out) {
+    unpack_bits(packed, packed_size, 0, count, bits, out);
+    uint64_t start = now_ns();
+    for (size_t r = 0; r < rounds; r++) {
+        for (size_t i = 0; i < count; i += UNPACK_BLOCK) {
+            size_t n = count - i < UNPACK_BLOCK ? count - i : UNPACK_BLOCK;
+            unpack_bits(packed, packed_size, i, n, bits, out + i);
+        }
+    }
+    uint64_t elapsed = now_ns() - start;
+    return (double)(count * rounds * sizeof(uint32_t)) / (double)(elapsed ? elapsed : 1);
+}
+
+/**
+ * @brief Time gathering dictionary entries of one width
+ *
+ * @param dict The entries, with spare bytes after them
+ * @param width Bytes per entry
+ * @param indexes Random entry indexes
+ * @param count Number of indexes
+ * @param rounds Times to gather everything
+ * @param out Receives the values
+ * @return Decoded GB/s, negative if the gather failed
+ */
+static double time_gather(const uint8_t* dict, size_t width, const uint32_t* indexes,
+                          size_t count, size_t rounds, uint8_t* out) {
+    if (unpack_gather(dict, DICTIONARY_ENTRIES, width, indexes, count, out) != 0) {
+        return -1.0;
+    }
+    uint64_t start = now_ns();
+    for (size_t r = 0; r < rounds; r++) {
+        for (size_t i = 0; i < count; i += UNPACK_BLOCK) {
+            size_t n = count - i < UNPACK_BLOCK ? count - i : UNPACK_BLOCK;
+            unpack_gather(dict, DICTIONARY_ENTRIES, width, indexes + i, n, out + i * width);
+        }
+    }
+    uint64_t elapsed = now_ns() - start;
+    return (double)(count * rounds * width) / (double)(elapsed ? elapsed : 1);
+}
+
+/**
+ * @brief Main entry point for the decode kernel benchmark
+ */
+int main(int argc, char** argv) {
+    size_t count = argc > 1 ? (size_t)strtoul(argv[1], NULL, 10) : 65536;
+    size_t rounds = argc > 2 ? (size_t)strtoul(argv[2], NULL, 10) : 200;
+    if (count == 0 || rounds == 0) {
+        printf("Usage: %s [values] [rounds]\n", argv[0]);
+        return 1;
+    }
+    
+    // Random bytes are valid fields at every width
+    size_t packed_size = count * sizeof(uint32_t) + 16;
+    size_t dict_size = DICTIONARY_ENTRIES * sizeof(uint64_t) + 8;
+    uint8_t* packed = (uint8_t*)malloc(packed_size);
+    uint8_t* dict = (uint8_t*)malloc(dict_size);
+    uint32_t* indexes = (uint32_t*)malloc(count * sizeof(uint32_t));
+    uint8_t* out = (uint8_t*)malloc(count * sizeof(uint64_t));
+    if (!packed || !dict || !indexes || !out) {
+        free(packed);
+        free(dict);
+        free(indexes);
+        free(out);
+        return 1;
+    }
+    uint64_t state = 0x9e3779b97f4a7c15ULL;
+    for (size_t i = 0; i < packed_size; i++) {
+        packed[i] = (uint8_t)next_random(&state);
+    }
+    for (size_t i = 0; i < dict_size; i++) {
+        dict[i] = (uint8_t)next_random(&state);
+    }
+    for (size_t i = 0; i < count; i++) {
+        indexes[i] = (uint32_t)(next_random(&state) % DICTIONARY_ENTRIES);
+    }
+    
+    uint32_t best = segment_kernel_level();
+    uint32_t levels = best + 1;
+    printf("%zu values x %zu rounds, kernels up to %s (GB/s of decoded output)\n\n", count,
+           rounds, level_names[best]);
+    
+    printf("%-10s", "bits");
+    for (uint32_t level = 0; level < levels; level++) {
+        printf("  %8s", level_names[level]);
+    }
+    printf("\n");
+    for (unsigned bits = 1; bits <= 32; bits++) {
+        printf("%-10u", bits);
+        for (uint32_t level = 0; level < levels; level++) {
+            segment_set_kernel_level(level);
+            printf("  %8.2f", time_unpack(packed, packed_size, count, bits, rounds,
+                                          (uint32_t*)out));
+        }
+        printf("\n");
+    }
+    
+    printf("\n%-10s", "gather");
+    for (uint32_t level = 0; level < levels; level++) {
+        printf("  %8s", level_names[level]);
+    }
+    printf("\n");
+    for (size_t width = 1; width <= 8; width *= 2) {
+        printf("%zu-byte    ", width);
+        for (uint32_t level = 0; level < levels; level++) {
+            segment_set_kernel_level(level);
+            printf("  %8.2f", time_gather(dict, width, indexes, count, rounds, out));
+        }
+        printf("\n");
+    }
+    
+    segment_set_kernel_level(best);
+    free(packed);
+    free(dict);
+    free(indexes);
+    free(out);
+    return 0;
+}
@@ -47,17 +47,40 @@ typedef struct {
     int nullable;         /**< Whether the column can be NULL */
 } retldb_column_def_t;
 
+/**
+ * @brief Segment file listed in the catalog
+ */
+typedef struct {
+    const char* filename; /**< File name, relative to the database directory */
+    uint64_t id;          /**< Segment id, unique within the database */
+    uint64_t rows;        /**< Number of rows */
+    uint64_t bytes;       /**< Size of the file */
+} retldb_segment_info_t;
+
 /**
  * @brief Create a new database
  *
+ * Creates the directory if needed and writes an empty catalog. The new
+ * database is returned open, holding the writer lease.
+ *
  * @param path Path to the database directory
  * @param db Pointer to store the database handle
- * @return retldb_error_t Error code
+ * @return retldb_error_t Error code, RETLDB_ERROR_ALREADY_EXISTS if the
+ *         directory already holds a database
  */
 retldb_error_t retldb_db_create(const char* path, retldb_db_t** db);
 
 /**
- * @brief Open an existing database
+ * @brief Flags for retldb_db_open_flags()
+ */
+#define RETLDB_OPEN_READ_ONLY 0x01 /**< Open as one of any number of readers, alongside the writer */
+#define RETLDB_OPEN_EXCLUSIVE 0x02 /**< Open as the writer and shut out readers too */
+#define RETLDB_OPEN_WAIT      0x04 /**< Wait for conflicting opens to close instead of failing */
+
+/**
+ * @brief Open an existing database as its writer
+ *
+ * Same as retldb_db_open_flags() with no flags.
  *
  * @param path Path to the database directory
  * @param db Pointer to store the database handle
@@ -65,6 +88,35 @@ retldb_error_t retldb_db_create(const char* path, retldb_db_t** db);
  */
 retldb_error_t retldb_db_open(const char* path, retldb_db_t** db);
 
+/**
+ * @brief Open a database as its writer, as a reader, or exclusively
+ *
+ * Access is coordinated through advisory locks on files in the database
+ * directory, so it holds across processes. With no flags the caller takes
+ * the writer lease: one writer at a time, creating the directory and an
+ * empty catalog if they are missing, while readers keep serving the files
+ * already published. RETLDB_OPEN_READ_ONLY takes a shared reader lock
+ * instead and needs an existing catalog, and
+ * RETLDB_OPEN_EXCLUSIVE takes the lease and keeps readers out, for
+ * maintenance that must not run under them. The locks are released by
+ * retldb_db_close() or when the process exits.
+ *
+ * @param path Path to the database directory
+ * @param flags RETLDB_OPEN_* flags
+ * @param db Pointer to store the database handle
+ * @return retldb_error_t Error code, RETLDB_ERROR_BUSY if a conflicting
+ *         open holds the database and RETLDB_OPEN_WAIT is not set
+ */
+retldb_error_t retldb_db_open_flags(const char* path, int flags, retldb_db_t** db);
+
+/**
+ * @brief Check whether a database was opened read-only
+ *
+ * @param db Database handle
+ * @return Non-zero for a read-only database, zero otherwise
+ */
+int retldb_db_is_read_only(const retldb_db_t* db);
+
 /**
  * @brief Close a database
  *
@@ -73,6 +125,205 @@ retldb_error_t retldb_db_open(const char* path, retldb_db_t** db);
  */
 retldb_error_t retldb_db_close(retldb_db_t* db);
 
+/**
+ * @brief Give a database its own buffer pool
+ *
+ * The pool's budget is the database's memory quota: pages of other
+ * databases never evict its pages, and its pages never evict theirs. The
+ * pool is written back and destroyed when the database is closed.
+ *
+ * @param db Database handle
+ * @param config Pool configuration
+ * @return retldb_error_t Error code
+ */
+retldb_error_t retldb_db_create_buffer_pool(retldb_db_t* db, const buffer_config_t* config);
+
+/**
+ * @brief Attach a database to a pool shared with other databases
+ *
+ * Databases sharing a pool (e.g. those of one tenant) share its quota. The
+ * caller keeps ownership; the pool cannot be destroyed while attached.
+ *
+ * @param db Database handle
+ * @param pool Pool handle from buffer_pool_create()
+ * @return retldb_error_t Error code
+ */
+retldb_error_t retldb_db_attach_buffer_pool(retldb_db_t* db, void* pool);
+
+/**
+ * @brief Get the buffer pool of a database
+ *
+ * @param db Database handle
+ * @return Pool handle, NULL if the database uses the default pool
+ */
+void* retldb_db_buffer_pool(retldb_db_t* db);
+
+/**
+ * @brief Get the catalog generation a database was opened at or last committed
+ *
+ * @param db Database handle
+ * @return Generation, 0 on error
+ */
+uint64_t retldb_db_generation(const retldb_db_t* db);
+
+/**
+ * @brief Get the number of tables in the catalog
+ *
+ * @param db Database handle
+ * @return Number of tables
+ */
+size_t retldb_db_table_count(const retldb_db_t* db);
+
+/**
+ * @brief Get the name of a table
+ *
+ * Names returned by the catalog functions stay valid until the database
+ * is closed.
+ *
+ * @param db Database handle
+ * @param index Table index, below retldb_db_table_count()
+ * @return The name, NULL if the index is out of range
+ */
+const char* retldb_db_table_name(const retldb_db_t* db, size_t index);
+
+/**
+ * @brief Get the columns of a table
+ *
+ * @param db Database handle
+ * @param table Table name
+ * @param columns Receives the column definitions
+ * @param num_columns Receives the number of columns
+ * @return retldb_error_t Error code
+ */
+retldb_error_t retldb_db_table_columns(const retldb_db_t* db, const char* table,
+                                       const retldb_column_def_t** columns, size_t* num_columns);
+
+/**
+ * @brief Get the number of partitions of a table
+ *
+ * @param db Database handle
+ * @param table Table name
+ * @param count Receives the number of partitions
+ * @return retldb_error_t Error code
+ */
+retldb_error_t retldb_db_partition_count(const retldb_db_t* db, const char* table, size_t* count);
+
+/**
+ * @brief Get the name of a partition
+ *
+ * @param db Database handle
+ * @param table Table name
+ * @param index Partition index
+ * @return The name, NULL if the table does not exist or the index is out of range
+ */
+const char* retldb_db_partition_name(const retldb_db_t* db, const char* table, size_t index);
+
+/**
+ * @brief Get the number of segments in a partition
+ *
+ * @param db Database handle
+ * @param table Table name
+ * @param partition Partition name
+ * @param count Receives the number of segments
+ * @return retldb_error_t Error code
+ */
+retldb_error_t retldb_db_segment_count(const retldb_db_t* db, const char* table,
+                                       const char* partition, size_t* count);
+
+/**
+ * @brief Describe a segment of a partition
+ *
+ * @param db Database handle
+ * @param table Table name
+ * @param partition Partition name
+ * @param index Segment index
+ * @param info Filled with the segment
+ * @return retldb_error_t Error code
+ */
+retldb_error_t retldb_db_segment_info(const retldb_db_t* db, const char* table,
+                                      const char* partition, size_t index,
+                                      retldb_segment_info_t* info);
+
+/**
+ * @brief Get an open handle for a segment file
+ *
+ * Segment files are opened on first use, not when the database is opened,
+ * and kept in the database's open file cache.
+ *
+ * @param db Database handle
+ * @param table Table name
+ * @param partition Partition name
+ * @param index Segment index
+ * @param file Receives a file handle for file_pread() and friends
+ * @return retldb_error_t Error code
+ */
+retldb_error_t retldb_db_segment_acquire(retldb_db_t* db, const char* table,
+                                         const char* partition, size_t index, void** file);
+
+/**
+ * @brief Release a handle obtained from retldb_db_segment_acquire()
+ *
+ * @param db Database handle
+ * @param file The file handle
+ * @return retldb_error_t Error code
+ */
+retldb_error_t retldb_db_segment_release(retldb_db_t* db, void* file);
+
+/**
+ * @brief Add a table to the catalog
+ *
+ * Catalog changes are kept in memory until retldb_db_commit() and are
+ * lost if the database is closed first. Only the writer may make them.
+ *
+ * @param db Database handle
+ * @param name Table name
+ * @param columns Column definitions
+ * @param num_columns Number of columns (at least one)
+ * @return retldb_error_t Error code
+ */
+retldb_error_t retldb_db_create_table(retldb_db_t* db, const char* name,
+                                      const retldb_column_def_t* columns, size_t num_columns);
+
+/**
+ * @brief Add a segment file to a partition, creating the partition if needed
+ *
+ * @param db Database handle
+ * @param table Table name
+ * @param partition Partition name
+ * @param filename Segment file, relative to the database directory
+ * @param rows Number of rows in the segment
+ * @param bytes Size of the segment file
+ * @param id Receives the segment id (may be NULL)
+ * @return retldb_error_t Error code
+ */
+retldb_error_t retldb_db_add_segment(retldb_db_t* db, const char* table, const char* partition,
+                                     const char* filename, uint64_t rows, uint64_t bytes,
+                                     uint64_t* id);
+
+/**
+ * @brief Remove a partition and its segments from the catalog
+ *
+ * The segment files themselves are left for the caller to delete once the
+ * change is committed.
+ *
+ * @param db Database handle
+ * @param table Table name
+ * @param partition Partition name
+ * @return retldb_error_t Error code
+ */
+retldb_error_t retldb_db_drop_partition(retldb_db_t* db, const char* table, const char* partition);
+
+/**
+ * @brief Publish catalog changes as a new generation
+ *
+ * The catalog file is replaced atomically, so readers opening the database
+ * see either the previous generation or this one in full.
+ *
+ * @param db Database handle
+ * @return retldb_error_t Error code
+ */
+retldb_error_t retldb_db_commit(retldb_db_t* db);
+
 /**
  * @brief Create a new schema
  *
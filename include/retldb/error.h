@@ -22,6 +22,7 @@ typedef enum {
     RETLDB_ERROR_NOT_FOUND,         /**< Requested item not found */
     RETLDB_ERROR_ALREADY_EXISTS,    /**< Item already exists */
     RETLDB_ERROR_NOT_SUPPORTED,     /**< Operation not supported */
+    RETLDB_ERROR_BUSY,              /**< Resource held by another user */
     RETLDB_ERROR_UNKNOWN            /**< Unknown error */
 } retldb_error_t;
 
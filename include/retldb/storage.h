@@ -2,16 +2,40 @@
  * @file storage.h
  * @brief Storage module for rETL DB
  */
-
+ 
 #ifndef RETLDB_STORAGE_H
 #define RETLDB_STORAGE_H
 
 #include <stddef.h>
+#include <stdint.h>
+
+#include "retldb/error.h"
+#include "retldb/types.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+/**
+ * @brief Flags for file_open_flags()
+ */
+#define FILE_READ     0x01 /**< Open for reading */
+#define FILE_WRITE    0x02 /**< Open for writing */
+#define FILE_CREATE   0x04 /**< Create the file if it does not exist */
+#define FILE_TRUNCATE 0x08 /**< Truncate the file to zero length */
+#define FILE_DIRECT   0x10 /**< Bypass the page cache where the file system allows it */
+#define FILE_APPEND   0x20 /**< Write at the end of the file, whatever the offset */
+
+/**
+ * @brief Scatter/gather segment for file_preadv() and file_pwritev()
+ * 
+ * Laid out like POSIX struct iovec, so vectors pass to the kernel as is.
+ */
+typedef struct {
+    void* base;   /**< Start of the segment */
+    size_t len;   /**< Length of the segment */
+} file_iovec_t;
+
 /**
  * @brief Initialize file operations
  * 
@@ -27,9 +51,34 @@ int file_init(void);
  */
 int file_create(const char* filename);
 
+/**
+ * @brief Open a file with FILE_* flags
+ * 
+ * Handles wrap a native descriptor (a Win32 handle on Windows) that is not
+ * inherited by child processes. There is no file position and no user-space
+ * buffering: all I/O is positioned, so many threads can read one handle at
+ * once without contending.
+ * 
+ * With FILE_DIRECT, reads and writes skip the page cache. Their buffers,
+ * offsets and lengths must then be multiples of file_alignment(). File
+ * systems that refuse direct I/O get a buffered handle instead; check
+ * file_alignment() to tell.
+ * 
+ * @param filename The name of the file to open
+ * @param flags FILE_READ and/or FILE_WRITE, plus FILE_CREATE, FILE_TRUNCATE, FILE_DIRECT,
+ *              FILE_APPEND
+ * @return File handle on success, NULL on failure
+ */
+void* file_open_flags(const char* filename, int flags);
+
 /**
  * @brief Open an existing file
  * 
+ * The mode is read like fopen()'s ("r", "w", "a", optionally with "+";
+ * "b" and "t" are ignored) and the result is a file_open_flags() handle.
+ * Append mode opens with FILE_APPEND: writes go to the end of the file and
+ * their offset is ignored.
+ * 
  * @param filename The name of the file to open
  * @param mode The mode to open the file in
  * @return File handle on success, NULL on failure
@@ -44,6 +93,307 @@ void* file_open(const char* filename, const char* mode);
  */
 int file_close(void* file);
 
+/**
+ * @brief Read from a file at an offset
+ * 
+ * Short reads are retried, so fewer than len bytes means end of file.
+ * 
+ * @param file The file handle
+ * @param buf Destination buffer
+ * @param len Number of bytes to read
+ * @param offset Offset in the file
+ * @return Number of bytes read, -1 on failure
+ */
+long long file_pread(void* file, void* buf, size_t len, uint64_t offset);
+
+/**
+ * @brief Write to a file at an offset
+ * 
+ * Short writes are retried until everything is written.
+ * 
+ * @param file The file handle
+ * @param buf Source buffer
+ * @param len Number of bytes to write
+ * @param offset Offset in the file
+ * @return Number of bytes written (always len), -1 on failure
+ */
+long long file_pwrite(void* file, const void* buf, size_t len, uint64_t offset);
+
+/**
+ * @brief Read into a scatter list at an offset with one request
+ * 
+ * Like preadv(): the result may be short, and callers resume from there.
+ * 
+ * @param file The file handle
+ * @param iov The segments to fill
+ * @param iovcnt Number of segments
+ * @param offset Offset in the file
+ * @return Number of bytes read (0 at end of file), -1 on failure
+ */
+long long file_preadv(void* file, const file_iovec_t* iov, int iovcnt, uint64_t offset);
+
+/**
+ * @brief Write a gather list at an offset with one request
+ * 
+ * Like pwritev(): the result may be short, and callers resume from there.
+ * 
+ * @param file The file handle
+ * @param iov The segments to write
+ * @param iovcnt Number of segments
+ * @param offset Offset in the file
+ * @return Number of bytes written, -1 on failure
+ */
+long long file_pwritev(void* file, const file_iovec_t* iov, int iovcnt, uint64_t offset);
+
+/**
+ * @brief Reserve disk space for a range without changing the file size
+ * 
+ * Later writes into the range cannot fail for lack of space and land in
+ * contiguous extents. Where the file system cannot preallocate this is a
+ * no-op.
+ * 
+ * @param file The file handle
+ * @param offset Start of the range
+ * @param length Length of the range
+ * @return 0 on success, non-zero on failure
+ */
+int file_allocate(void* file, uint64_t offset, uint64_t length);
+
+/**
+ * @brief Flush a file's data to disk
+ * 
+ * Uses fdatasync() where available: metadata that is not needed to read
+ * the data back, such as timestamps, may stay behind.
+ * 
+ * @param file The file handle
+ * @return 0 on success, non-zero on failure
+ */
+int file_sync(void* file);
+
+/**
+ * @brief Set the size of a file
+ * 
+ * @param file The file handle
+ * @param size The new size
+ * @return 0 on success, non-zero on failure
+ */
+int file_truncate(void* file, uint64_t size);
+
+/**
+ * @brief Get the size of a file
+ * 
+ * @param file The file handle
+ * @param size Set to the size in bytes
+ * @return 0 on success, non-zero on failure
+ */
+int file_size(void* file, uint64_t* size);
+
+/**
+ * @brief Get the alignment I/O on a file must respect
+ * 
+ * @param file The file handle
+ * @return The alignment for direct I/O, 1 for buffered handles, 0 on failure
+ */
+size_t file_alignment(const void* file);
+
+/**
+ * @brief Get the POSIX descriptor behind a file handle
+ * 
+ * For handing to system interfaces the file layer does not wrap, such as
+ * io_uring. The descriptor stays owned by the handle.
+ * 
+ * @param file The file handle
+ * @return The descriptor, -1 on failure and always on Windows
+ */
+int file_descriptor(const void* file);
+
+/**
+ * @brief Flags for file_lock()
+ */
+#define FILE_LOCK_SHARED    0x01 /**< Shared lock; any number of holders */
+#define FILE_LOCK_EXCLUSIVE 0x02 /**< Exclusive lock; a single holder */
+#define FILE_LOCK_WAIT      0x04 /**< Block until the lock is granted */
+
+/**
+ * @brief Take an advisory lock on a file, creating the file if needed
+ * 
+ * The lock belongs to the returned handle: a second file_lock() on the same
+ * file conflicts with it even within the same process, and it lasts until
+ * file_unlock() or process exit.
+ * 
+ * @param filename The lock file
+ * @param flags FILE_LOCK_SHARED or FILE_LOCK_EXCLUSIVE, optionally with FILE_LOCK_WAIT
+ * @param lock Receives the lock handle on success
+ * @return RETLDB_OK, RETLDB_ERROR_BUSY if another holder conflicts and
+ *         FILE_LOCK_WAIT is not set, or another error code
+ */
+retldb_error_t file_lock(const char* filename, int flags, void** lock);
+
+/**
+ * @brief Release a lock taken with file_lock()
+ * 
+ * @param lock The lock handle
+ * @return 0 on success, non-zero on failure
+ */
+int file_unlock(void* lock);
+
+/**
+ * @brief Flush a directory's entries (creations, renames) to disk
+ * 
+ * A no-op on Windows, where renames are flushed as they happen.
+ * 
+ * @param dirname The directory
+ * @return 0 on success, non-zero on failure
+ */
+int file_sync_directory(const char* dirname);
+
+/**
+ * @brief Time spent in each step of a staged file replacement
+ */
+typedef struct {
+    uint64_t bytes;              /**< Bytes written */
+    uint64_t write_us;           /**< Time spent writing the temporary file */
+    uint64_t sync_us;            /**< Time spent flushing it to disk */
+    uint64_t rename_us;          /**< Time spent renaming it over the target */
+    uint64_t dir_sync_us;        /**< Time spent flushing the directory */
+} file_stage_stats_t;
+
+/**
+ * @brief Start writing a replacement for a file
+ * 
+ * Data goes to a temporary file next to the target, written through a
+ * large buffer. file_stage_commit() makes it durable and renames it over
+ * the target in one atomic step, so readers and crashes see either the
+ * whole old file or the whole new one.
+ * 
+ * @param filename The file to replace (or create)
+ * @param flags 0, or FILE_DIRECT to write the temporary file with direct I/O
+ * @return Stage handle on success, NULL on failure
+ */
+void* file_stage_open(const char* filename, int flags);
+
+/**
+ * @brief Append data to a staged file
+ * 
+ * @param stage The stage handle
+ * @param buf The data
+ * @param len Number of bytes
+ * @return 0 on success, non-zero on failure (the commit will then fail too)
+ */
+int file_stage_write(void* stage, const void* buf, size_t len);
+
+/**
+ * @brief Make a staged file durable and atomically put it in place
+ * 
+ * Flushes the buffer, syncs the temporary file, renames it over the target
+ * and syncs the directory. On failure before the rename the temporary file
+ * is removed and the target is untouched.
+ * 
+ * @param stage The stage handle, freed whatever the outcome
+ * @param stats Filled with bytes written and time per step, may be NULL
+ * @return 0 on success, non-zero on failure
+ */
+int file_stage_commit(void* stage, file_stage_stats_t* stats);
+
+/**
+ * @brief Abandon a staged file, leaving the target untouched
+ * 
+ * @param stage The stage handle, freed
+ * @return 0 on success, non-zero on failure
+ */
+int file_stage_abort(void* stage);
+
+/**
+ * @brief Get the name of a stage's temporary file
+ * 
+ * @param stage The stage handle
+ * @return The temporary file name, NULL on failure
+ */
+const char* file_stage_path(const void* stage);
+
+/**
+ * @brief Open file cache statistics
+ */
+typedef struct {
+    uint64_t hits;               /**< Acquisitions served by an already open file */
+    uint64_t misses;             /**< Acquisitions that had to open the file */
+    uint64_t evictions;          /**< Idle files closed to stay within capacity */
+    size_t open;                 /**< Files currently open */
+    size_t pinned;               /**< Open files currently acquired */
+    size_t capacity;             /**< Files kept open before idle ones are closed */
+} file_cache_stats_t;
+
+/**
+ * @brief Create a cache of open files
+ * 
+ * Keeps recently used files open across acquisitions and closes the least
+ * recently used idle ones once more than capacity files are open. Acquired
+ * files are never closed under their users, so the cache can briefly go
+ * over capacity when that many are in use at once.
+ * 
+ * @param capacity Files to keep open, 0 for half the process descriptor limit
+ * @param flags FILE_* flags to open files with (FILE_READ if 0)
+ * @return Cache handle on success, NULL on failure
+ */
+void* file_cache_create(size_t capacity, int flags);
+
+/**
+ * @brief Destroy a cache of open files, closing them
+ * 
+ * @param cache The cache handle
+ * @return 0 on success, non-zero if files are still acquired (the cache is kept)
+ */
+int file_cache_destroy(void* cache);
+
+/**
+ * @brief Get an open handle for a file, opening it on a miss
+ * 
+ * @param cache The cache handle
+ * @param filename The file
+ * @return File handle for file_pread() and friends, valid until
+ *         file_cache_release(); NULL on failure. Do not file_close() it.
+ */
+void* file_cache_acquire(void* cache, const char* filename);
+
+/**
+ * @brief Release a file handle obtained from file_cache_acquire()
+ * 
+ * @param cache The cache handle
+ * @param file The file handle
+ * @return 0 on success, non-zero if the handle is not acquired from this cache
+ */
+int file_cache_release(void* cache, void* file);
+
+/**
+ * @brief Drop a file from the cache, e.g. before deleting or replacing it
+ * 
+ * An idle file is closed at once; one still acquired is closed when its
+ * last user releases it. Later acquisitions open the file afresh.
+ * 
+ * @param cache The cache handle
+ * @param filename The file
+ * @return 0 on success (including when the file is not cached), non-zero on failure
+ */
+int file_cache_evict(void* cache, const char* filename);
+
+/**
+ * @brief Change how many files a cache keeps open
+ * 
+ * @param cache The cache handle
+ * @param capacity Files to keep open, 0 for half the process descriptor limit
+ * @return 0 on success, non-zero on failure
+ */
+int file_cache_set_capacity(void* cache, size_t capacity);
+
+/**
+ * @brief Get open file cache statistics
+ * 
+ * @param cache The cache handle
+ * @param stats Filled with the current counters
+ * @return 0 on success, non-zero on failure
+ */
+int file_cache_stats(void* cache, file_cache_stats_t* stats);
+
 /**
  * @brief Initialize memory mapping subsystem
  * 
@@ -51,9 +401,25 @@ int file_close(void* file);
  */
 int mmap_init(void);
 
+/**
+ * @brief Get the alignment required of mapping offsets
+ * 
+ * This is the page size on POSIX systems and the allocation granularity
+ * (usually 64 KiB) on Windows.
+ * 
+ * @return The mapping granularity in bytes
+ */
+size_t mmap_granularity(void);
+
 /**
  * @brief Map a file into memory
  * 
+ * Mappings are shared: mapping a window that is already mapped, with the
+ * same file identity (device and inode, not name), offset, size,
+ * protection and hints, returns the live handle with one more reference
+ * instead of a new mapping. Each call is still paired with one
+ * mmap_unmap(). This holds for mmap_file_range() and mmap_file_hinted() too.
+ * 
  * @param filename The name of the file to map
  * @param size The size of the mapping (0 for whole file)
  * @param read_only Whether the mapping should be read-only
@@ -62,76 +428,1135 @@ int mmap_init(void);
 void* mmap_file(const char* filename, size_t size, int read_only);
 
 /**
- * @brief Get the address of the mapped memory
+ * @brief Map a window of a file into memory
+ * 
+ * Only the window takes address space, so a single column chunk can be
+ * mapped out of a large segment. Bytes of the window past the end of the
+ * file must not be touched until the file has grown to cover them.
+ * 
+ * @param filename The name of the file to map
+ * @param offset File offset of the window (a multiple of mmap_granularity())
+ * @param size The size of the window (0 for the rest of the file)
+ * @param read_only Whether the mapping should be read-only
+ * @return Handle to the mapped window, NULL on failure
+ */
+void* mmap_file_range(const char* filename, uint64_t offset, size_t size, int read_only);
+
+/**
+ * @brief Access pattern hints for mapped ranges
+ */
+typedef enum {
+    MMAP_ADVICE_NORMAL = 0,  /**< Default read-ahead */
+    MMAP_ADVICE_SEQUENTIAL,  /**< Scanned front to back: read ahead aggressively */
+    MMAP_ADVICE_RANDOM,      /**< Point lookups: no read-ahead */
+    MMAP_ADVICE_WILLNEED,    /**< Needed soon: start reading it in now */
+    MMAP_ADVICE_DONTNEED     /**< Not needed soon: its pages may be dropped */
+} mmap_advice_t;
+
+/**
+ * @brief Flags for mmap_file_hinted()
+ */
+#define MMAP_POPULATE   0x1 /**< Fault the whole window in at open (MAP_POPULATE) */
+#define MMAP_LOCK       0x2 /**< Keep the window resident (mlock), e.g. a hot index */
+#define MMAP_HUGE_PAGES 0x4 /**< Ask for huge pages (MADV_HUGEPAGE; MAP_HUGETLB with MMAP_PRELOAD) */
+#define MMAP_PRELOAD    0x8 /**< Copy the window into anonymous memory at open; read-only */
+
+/**
+ * @brief Map a window of a file with an access pattern hint
+ * 
+ * The hint covers the whole window and, like MMAP_LOCK, is applied again
+ * whenever mmap_remap() resizes it. Index files used for point lookups
+ * suit MMAP_ADVICE_RANDOM with MMAP_POPULATE | MMAP_LOCK; column scans
+ * suit MMAP_ADVICE_SEQUENTIAL.
+ * 
+ * Large hot indexes lose lookup time to TLB misses. MMAP_HUGE_PAGES asks
+ * the kernel to back the window with transparent huge pages. For a file
+ * mapping that is only a hint, and most kernels ignore it: Linux honours
+ * it only on tmpfs mounted with huge pages, or for read-only mappings on
+ * kernels built with CONFIG_READ_ONLY_THP_FOR_FS. mmap_page_size() tells
+ * whether it took effect.
+ * 
+ * MMAP_PRELOAD instead copies the window into anonymous memory at open.
+ * Combined with MMAP_HUGE_PAGES, the copy goes on explicit huge pages
+ * (MAP_HUGETLB) when some are reserved and on transparent ones
+ * otherwise, which anonymous memory does get. Without MMAP_HUGE_PAGES it
+ * uses regular pages. The copy is a snapshot: it requires read_only, and
+ * later writes to the file are not seen through it.
+ * 
+ * @param filename The name of the file to map
+ * @param offset File offset of the window (a multiple of mmap_granularity())
+ * @param size The size of the window (0 for the rest of the file)
+ * @param read_only Whether the mapping should be read-only
+ * @param advice Access pattern hint for the whole window
+ * @param flags Any of MMAP_POPULATE, MMAP_LOCK, MMAP_HUGE_PAGES and MMAP_PRELOAD
+ * @return Handle to the mapped window, NULL on failure (including a failed lock)
+ */
+void* mmap_file_hinted(const char* filename, uint64_t offset, size_t size, int read_only,
+                       mmap_advice_t advice, int flags);
+
+/**
+ * @brief Give the kernel an access pattern hint for part of a window
+ * 
+ * Unlike the open-time hint, this is not kept across mmap_remap().
+ * MMAP_ADVICE_DONTNEED never loses data: dirty pages of a shared mapping
+ * stay in the page cache until written back.
  * 
  * @param handle The memory-mapped file handle
- * @return Pointer to the mapped memory, NULL on failure
+ * @param offset Offset of the range within the window (rounded down to a page)
+ * @param length Length of the range (0 for the rest of the window)
+ * @param advice The hint
+ * @return 0 on success, non-zero on failure
  */
-void* mmap_get_addr(void* handle);
+int mmap_advise(void* handle, size_t offset, size_t length, mmap_advice_t advice);
 
 /**
- * @brief Get the size of the mapped memory
+ * @brief Lock a window in memory or release the lock
+ * 
+ * Locking may fail when it would exceed the process's locked memory limit.
+ * Locks are counted on the window: a shared one stays locked until every
+ * lock taken on it, including MMAP_LOCK's at open, has been released.
  * 
  * @param handle The memory-mapped file handle
- * @return Size of the mapped memory, 0 on failure
+ * @param lock Non-zero to lock, zero to unlock
+ * @return 0 on success, non-zero on failure (including an unlock without a lock)
  */
-size_t mmap_get_size(void* handle);
+int mmap_lock(void* handle, int lock);
 
 /**
- * @brief Unmap a memory-mapped file
+ * @brief Grow or shrink a mapped window
+ * 
+ * The window keeps its file offset but may move in memory: call
+ * mmap_get_addr() again afterwards, and drop pointers into the old window.
+ * A window shared by several holders, or retired by a fault, cannot be
+ * resized; map the new size instead.
  * 
  * @param handle The memory-mapped file handle
- * @return 0 on success, non-zero on failure
+ * @param size The new window size (0 for the rest of the file)
+ * @return 0 on success, non-zero on failure (including a shared window)
  */
-int mmap_unmap(void* handle);
+int mmap_remap(void* handle, size_t size);
 
 /**
- * @brief Initialize the buffer pool
+ * @brief Callback that reads a mapped window in place
  * 
- * @param capacity Maximum number of buffers in the pool
- * @param buffer_size Size of each buffer
- * @return 0 on success, non-zero on failure
+ * @param data Start of the window
+ * @param size Size of the window
+ * @param arg The argument given to mmap_guarded()
  */
-int buffer_init(size_t capacity, size_t buffer_size);
+typedef void (*mmap_reader_fn)(const void* data, size_t size, void* arg);
 
 /**
- * @brief Clean up the buffer pool
+ * @brief Read a window in place with faults turned into errors
  * 
- * @return 0 on success, non-zero on failure
+ * Touching a mapped page whose file data is gone (the file was truncated)
+ * or unreadable (an I/O error) raises SIGBUS, which would kill the
+ * process. Inside fn such a fault instead abandons fn and returns
+ * RETLDB_ERROR_CORRUPT_DATA for truncation or RETLDB_ERROR_IO otherwise,
+ * and retires the window: it leaves the mapping cache, its pages read as
+ * zero from then on, and later guarded reads return the same error. Drop
+ * the handle with mmap_unmap() and map the file again.
+ * 
+ * fn must not take locks or allocate, since a fault skips the rest of it.
+ * On POSIX the first call installs a SIGBUS handler that passes faults
+ * outside guarded reads on to the handler it replaced. On Windows, reads
+ * are guarded only in MSVC builds.
+ * 
+ * @param handle The memory-mapped file handle
+ * @param fn Called with the window's address and size
+ * @param arg Passed through to fn
+ * @return RETLDB_OK, or the error that retired the window
  */
-int buffer_cleanup(void);
+retldb_error_t mmap_guarded(void* handle, mmap_reader_fn fn, void* arg);
 
 /**
- * @brief Get a buffer from the pool
+ * @brief Copy bytes out of a window with faults turned into errors
  * 
- * @param filename The filename associated with the buffer
- * @param offset The offset in the file
- * @return Buffer handle on success, NULL on failure
+ * Like mmap_guarded(), for callers that want a copy rather than zero-copy
+ * access.
+ * 
+ * @param handle The memory-mapped file handle
+ * @param offset Offset of the range within the window
+ * @param dest Destination buffer
+ * @param length Bytes to copy
+ * @return RETLDB_OK, RETLDB_ERROR_INVALID_ARGUMENT for a range outside the
+ *         window, or the error that retired the window
  */
-void* buffer_get(const char* filename, size_t offset);
+retldb_error_t mmap_read(void* handle, size_t offset, void* dest, size_t length);
 
 /**
- * @brief Mark a buffer as dirty
+ * @brief Check whether a window was retired by a fault
  * 
- * @param buffer The buffer handle
- * @return 0 on success, non-zero on failure
+ * @param handle The memory-mapped file handle
+ * @return The error that retired it, RETLDB_OK if it is healthy
  */
-int buffer_mark_dirty(void* buffer);
+retldb_error_t mmap_fault_error(const void* handle);
 
 /**
- * @brief Flush a dirty buffer to disk
+ * @brief Get the address of the mapped memory
  * 
- * @param buffer The buffer handle
- * @return 0 on success, non-zero on failure
+ * @param handle The memory-mapped file handle
+ * @return Pointer to the mapped memory, NULL on failure
  */
-int buffer_flush(void* buffer);
+void* mmap_get_addr(const void* handle);
 
 /**
- * @brief Flush all dirty buffers
+ * @brief Get the size of the mapped memory
+ * 
+ * @param handle The memory-mapped file handle
+ * @return Size of the mapped memory, 0 on failure
+ */
+size_t mmap_get_size(const void* handle);
+
+/**
+ * @brief Get the size of the pages backing a window
  * 
+ * Reports the huge page size for a preloaded copy on explicit huge pages,
+ * and, on Linux, for an MMAP_HUGE_PAGES window that transparent huge pages
+ * back at least in part (which may happen some time after mapping).
+ * 
+ * @param handle The memory-mapped file handle
+ * @return Page size in bytes, 0 on failure
+ */
+size_t mmap_page_size(const void* handle);
+
+/**
+ * @brief Get the file offset of a mapped window
+ * 
+ * @param handle The memory-mapped file handle
+ * @return Offset of the first mapped byte, 0 on failure
+ */
+uint64_t mmap_get_offset(const void* handle);
+
+/**
+ * @brief Unmap a memory-mapped file
+ * 
+ * Drops one reference; the window is unmapped when the last one goes.
+ * 
+ * @param handle The memory-mapped file handle
  * @return 0 on success, non-zero on failure
  */
-int buffer_flush_all(void);
+int mmap_unmap(void* handle);
+
+/**
+ * @brief Buffer replacement policies
+ */
+typedef enum {
+    BUFFER_POLICY_LRU = 0,   /**< Plain least-recently-used */
+    BUFFER_POLICY_2Q         /**< Scan-resistant 2Q (probation FIFO, ghost history, hot LRU) */
+} buffer_policy_t;
+
+/**
+ * @brief Access hints for buffer lookups
+ */
+typedef enum {
+    BUFFER_ACCESS_NORMAL = 0, /**< Regular access, eligible for caching as hot */
+    BUFFER_ACCESS_ONCE        /**< Page is used once (e.g. a sequential scan), evict it first */
+} buffer_access_t;
+
+/**
+ * @brief Backends for asynchronous prefetch reads
+ */
+typedef enum {
+    BUFFER_IO_AUTO = 0,       /**< io_uring where the kernel allows it, threads otherwise */
+    BUFFER_IO_THREADS         /**< Always use a small pool of reader threads */
+} buffer_io_t;
+
+/**
+ * @brief Most page size classes a pool can hold, including buffer_size
+ */
+#define BUFFER_MAX_CLASSES 4
+
+/**
+ * @brief Buffer pool configuration
+ *
+ * The pool's memory budget is capacity * buffer_size bytes, shared by every
+ * page size class; a page of any class may be evicted to make room for a
+ * page of another.
+ */
+typedef struct {
+    size_t capacity;          /**< Maximum number of buffer_size buffers in the pool */
+    size_t buffer_size;       /**< Default page size, used by files without a size class */
+    size_t page_classes[BUFFER_MAX_CLASSES - 1]; /**< Additional page sizes (0 ends the list) */
+    buffer_policy_t policy;   /**< Replacement policy */
+    size_t num_shards;        /**< Number of independently locked shards (0 for automatic) */
+    int huge_pages;           /**< Back the frame arena with transparent huge pages when available */
+    int direct_io;            /**< Bypass the OS page cache (buffer_size must be a multiple of 4096) */
+    size_t readahead;         /**< Pages to read ahead of sequential access (0 disables, capped at capacity / 4) */
+    unsigned io_depth;        /**< Maximum prefetch reads in flight (0 prefetches synchronously) */
+    buffer_io_t io_backend;   /**< Backend for prefetch reads */
+    unsigned dirty_high;      /**< Dirty percentage of the pool that wakes the background cleaner (0 disables it) */
+    unsigned dirty_low;       /**< Dirty percentage the cleaner writes down to (below dirty_high, 0 for half of it) */
+    size_t clean_rate;        /**< Most pages the cleaner writes per second (0 for unlimited) */
+} buffer_config_t;
+
+/**
+ * @brief Number of buckets in the miss latency histogram
+ */
+#define BUFFER_LATENCY_BUCKETS 32
+
+/**
+ * @brief Buffer pool statistics
+ *
+ * Counters accumulate from pool initialization or the last
+ * buffer_stats_reset(). Bucket i of the latency histogram counts misses
+ * served (or failed) in [2^i, 2^(i+1)) microseconds; bucket 0 also counts
+ * faster ones and the last bucket everything slower.
+ */
+typedef struct {
+    uint64_t hits;            /**< Lookups served from the pool */
+    uint64_t misses;          /**< Lookups that had to read the page, failed or not */
+    uint64_t errors;          /**< Misses that failed: no frame, or a read or write-back error */
+    uint64_t evictions;       /**< Pages evicted to free a frame */
+    uint64_t dirty_writes;    /**< Dirty pages written back, by any path */
+    uint64_t read_bytes;      /**< Bytes read from files, including prefetch */
+    uint64_t write_bytes;     /**< Bytes written to files */
+    uint64_t pin_waits;       /**< Lookups that waited for another thread to release a frame */
+    uint64_t miss_latency[BUFFER_LATENCY_BUCKETS]; /**< Miss service time histogram */
+    size_t capacity;          /**< Maximum number of buffer_size buffers in the pool */
+    size_t resident;          /**< Buffers currently holding a page */
+    size_t memory_budget;     /**< Bytes of page memory the pool may use */
+    size_t memory_used;       /**< Bytes of page memory holding pages */
+    size_t dirty_bytes;       /**< Bytes of page memory currently dirty */
+} buffer_stats_t;
+
+/**
+ * @brief Fill a buffer pool configuration with default values
+ * 
+ * @param config The configuration to fill
+ */
+void buffer_config_default(buffer_config_t* config);
+
+/**
+ * @brief Initialize the default buffer pool from a configuration
+ * 
+ * Address space for every frame is reserved up front as page-aligned
+ * arenas, so page misses never allocate. Memory is only backed as frames
+ * are used, and never beyond the budget however many size classes the
+ * pool has.
+ * 
+ * @param config The pool configuration
+ * @return 0 on success, non-zero on failure
+ */
+int buffer_init_config(const buffer_config_t* config);
+
+/**
+ * @brief Initialize the default buffer pool
+ * 
+ * Uses the default configuration (LRU replacement, automatic sharding).
+ * 
+ * @param capacity Maximum number of buffers in the pool
+ * @param buffer_size Size of each buffer
+ * @return 0 on success, non-zero on failure
+ */
+int buffer_init(size_t capacity, size_t buffer_size);
+
+/**
+ * @brief Clean up the default buffer pool
+ * 
+ * Dirty buffers are written back before they are released. Fails, leaving
+ * the pool intact, while databases are attached to it.
+ * 
+ * @return 0 on success, non-zero on failure
+ */
+int buffer_cleanup(void);
+
+/**
+ * @brief Create a buffer pool
+ * 
+ * Pools are independent: each has its own memory budget, replacement
+ * state, cleaner and statistics, so pages of one pool never evict pages of
+ * another. The buffer_* functions without a pool argument use the default
+ * pool set up by buffer_init(). A file should be cached by one pool at a
+ * time.
+ * 
+ * @param config The pool configuration
+ * @return Pool handle on success, NULL on failure
+ */
+void* buffer_pool_create(const buffer_config_t* config);
+
+/**
+ * @brief Write back and destroy a buffer pool
+ * 
+ * Fails, leaving the pool intact, while databases are attached to it.
+ * 
+ * @param pool The pool handle
+ * @return 0 on success, non-zero on failure
+ */
+int buffer_pool_destroy(void* pool);
+
+/**
+ * @brief Register a user of a pool, keeping it from being destroyed
+ * 
+ * @param pool The pool handle
+ * @return 0 on success, non-zero on failure
+ */
+int buffer_pool_attach(void* pool);
+
+/**
+ * @brief Drop a user registered with buffer_pool_attach()
+ * 
+ * @param pool The pool handle
+ * @return 0 on success, non-zero on failure
+ */
+int buffer_pool_detach(void* pool);
+
+/**
+ * @brief Get a buffer from a pool; see buffer_get_hint()
+ * 
+ * @param pool The pool handle
+ * @param filename The filename associated with the buffer
+ * @param offset The offset in the file
+ * @param hint How the caller expects to use the page
+ * @return Pinned buffer handle on success, NULL on failure
+ */
+void* buffer_pool_get(void* pool, const char* filename, size_t offset, buffer_access_t hint);
+
+/**
+ * @brief Start reading a byte range into a pool; see buffer_prefetch()
+ * 
+ * @param pool The pool handle
+ * @param filename The file to read
+ * @param offset Offset of the first byte
+ * @param len Number of bytes
+ * @return 0 on success, non-zero on failure
+ */
+int buffer_pool_prefetch(void* pool, const char* filename, size_t offset, size_t len);
+
+/**
+ * @brief Look up a resident page of a pool; see buffer_peek()
+ * 
+ * @param pool The pool handle
+ * @param filename The filename associated with the buffer
+ * @param offset The offset in the file
+ * @param version Pointer to store the version to validate against
+ * @return Buffer handle, NULL if the page is not resident or is being written
+ */
+void* buffer_pool_peek(void* pool, const char* filename, size_t offset, uint64_t* version);
+
+/**
+ * @brief Choose the page size for a file in a pool; see buffer_set_page_size()
+ * 
+ * @param pool The pool handle
+ * @param filename The file
+ * @param page_size The page size for the file
+ * @return 0 on success, non-zero on failure
+ */
+int buffer_pool_set_page_size(void* pool, const char* filename, size_t page_size);
+
+/**
+ * @brief Flush all dirty buffers of a pool
+ * 
+ * The writes happen without blocking lookups. Pages exclusively latched
+ * at the time are left dirty rather than waited for.
+ * 
+ * @param pool The pool handle
+ * @return 0 on success, RETLDB_ERROR_BUSY if a latched page was left dirty,
+ *         other non-zero on failure
+ */
+int buffer_pool_flush_all(void* pool);
+
+/**
+ * @brief Take a snapshot of a pool's statistics; see buffer_stats_snapshot()
+ * 
+ * @param pool The pool handle
+ * @param stats The statistics to fill
+ * @return 0 on success, non-zero on failure
+ */
+int buffer_pool_stats_snapshot(void* pool, buffer_stats_t* stats);
+
+/**
+ * @brief Reset a pool's statistics counters to zero
+ * 
+ * @param pool The pool handle
+ * @return 0 on success, non-zero on failure
+ */
+int buffer_pool_stats_reset(void* pool);
+
+/**
+ * @brief Choose the page size for a file
+ * 
+ * Every page of the file is then cached, read and written in units of
+ * page_size, which must be buffer_size or one of the configured page
+ * classes. The size can only be changed before the file is first accessed
+ * through the pool.
+ * 
+ * @param filename The file
+ * @param page_size The page size for the file
+ * @return 0 on success, non-zero on failure
+ */
+int buffer_set_page_size(const char* filename, size_t page_size);
+
+/**
+ * @brief Get a buffer from the pool
+ * 
+ * On a miss the page is read from the file; bytes past the end of the file
+ * (or of a file that does not exist yet) read as zeros.
+ * 
+ * The returned buffer is pinned: it cannot be evicted until it is released
+ * with buffer_unpin(). Concurrent requests for the same page share a single
+ * read. Fails if every frame in the page's shard is pinned.
+ * 
+ * @param filename The filename associated with the buffer
+ * @param offset The offset in the file
+ * @return Pinned buffer handle on success, NULL on failure
+ */
+void* buffer_get(const char* filename, size_t offset);
+
+/**
+ * @brief Get a buffer from the pool with an access hint
+ * 
+ * Pages fetched with BUFFER_ACCESS_ONCE are placed where they are evicted
+ * first and are never promoted by that access, so a large scan cannot push
+ * hot pages out of the pool.
+ * 
+ * @param filename The filename associated with the buffer
+ * @param offset The offset in the file
+ * @param hint How the caller expects to use the page
+ * @return Pinned buffer handle on success, NULL on failure
+ */
+void* buffer_get_hint(const char* filename, size_t offset, buffer_access_t hint);
+
+/**
+ * @brief Start reading a byte range of a file into the pool
+ * 
+ * Returns without waiting for the reads, which are kept in flight together
+ * so the device sees a deep queue; a later buffer_get() of a page still
+ * being read waits for that read. Pages that are already resident are left
+ * alone, and dirty pages are never written back to make room, so the range
+ * may be only partially loaded.
+ * 
+ * @param filename The file to read
+ * @param offset Offset of the first byte
+ * @param len Number of bytes
+ * @return 0 on success, non-zero on failure
+ */
+int buffer_prefetch(const char* filename, size_t offset, size_t len);
+
+/**
+ * @brief Add a pin to a buffer
+ * 
+ * Only a buffer the caller already holds pinned can be pinned again; each
+ * pin needs its own buffer_unpin().
+ * 
+ * @param buffer The buffer handle
+ * @return 0 on success, non-zero on failure
+ */
+int buffer_pin(void* buffer);
+
+/**
+ * @brief Release a pin on a buffer
+ * 
+ * The handle must not be used once its last pin is released.
+ * 
+ * @param buffer The buffer handle
+ * @return 0 on success, non-zero on failure (including an unpinned buffer)
+ */
+int buffer_unpin(void* buffer);
+
+/**
+ * @brief Acquire a buffer's latch in shared mode
+ * 
+ * Pins only keep a page resident; latches order access to its contents.
+ * Any number of readers may hold the shared latch at once.
+ * 
+ * @param buffer The pinned buffer handle
+ * @return 0 on success, non-zero on failure
+ */
+int buffer_latch_shared(void* buffer);
+
+/**
+ * @brief Release a buffer's shared latch
+ * 
+ * @param buffer The buffer handle
+ * @return 0 on success, non-zero on failure
+ */
+int buffer_unlatch_shared(void* buffer);
+
+/**
+ * @brief Acquire a buffer's latch in exclusive mode
+ * 
+ * Excludes all other latch holders and fails any optimistic read that
+ * overlaps the critical section.
+ * 
+ * @param buffer The pinned buffer handle
+ * @return 0 on success, non-zero on failure
+ */
+int buffer_latch_exclusive(void* buffer);
+
+/**
+ * @brief Release a buffer's exclusive latch
+ * 
+ * @param buffer The buffer handle
+ * @return 0 on success, non-zero on failure
+ */
+int buffer_unlatch_exclusive(void* buffer);
+
+/**
+ * @brief Look up a resident page for an optimistic read
+ * 
+ * Neither pins nor latches the page and never reads from disk. The caller
+ * may copy out of the frame and must then confirm the copy with
+ * buffer_validate(); a failed validation means the copy may be torn and
+ * must be discarded.
+ * 
+ * @param filename The filename associated with the buffer
+ * @param offset The offset in the file
+ * @param version Pointer to store the page version
+ * @return Buffer handle, NULL if the page is not resident or is being modified
+ */
+void* buffer_peek(const char* filename, size_t offset, uint64_t* version);
+
+/**
+ * @brief Validate an optimistic read
+ * 
+ * @param buffer The buffer handle returned by buffer_peek()
+ * @param version The version returned by buffer_peek()
+ * @return 1 if the page is unchanged since buffer_peek(), 0 otherwise
+ */
+int buffer_validate(void* buffer, uint64_t version);
+
+/**
+ * @brief Get the data of a buffer
+ * 
+ * @param buffer The buffer handle
+ * @return Pointer to the page data, NULL on failure
+ */
+void* buffer_get_data(void* buffer);
+
+/**
+ * @brief Get the size of a buffer
+ * 
+ * @param buffer The buffer handle
+ * @return Size of the page data, 0 on failure
+ */
+size_t buffer_get_size(void* buffer);
+
+/**
+ * @brief Mark a buffer as dirty
+ * 
+ * @param buffer The buffer handle
+ * @return 0 on success, non-zero on failure
+ */
+int buffer_mark_dirty(void* buffer);
+
+/**
+ * @brief Flush a dirty buffer to disk
+ * 
+ * The caller must hold a pin. A buffer that is exclusively latched, by
+ * the caller or by anyone else, is not written; release the latch first.
+ * 
+ * @param buffer The buffer handle
+ * @return 0 on success, RETLDB_ERROR_BUSY if the buffer is exclusively
+ *         latched, other non-zero on failure
+ */
+int buffer_flush(void* buffer);
+
+/**
+ * @brief Flush all dirty buffers
+ * 
+ * Adjacent dirty pages of the same file are written with a single
+ * vectored write. Pages exclusively latched at the time are left dirty
+ * rather than waited for.
+ * 
+ * @return 0 on success, RETLDB_ERROR_BUSY if a latched page was left dirty,
+ *         other non-zero on failure
+ */
+int buffer_flush_all(void);
+
+/**
+ * @brief Take a snapshot of the pool statistics
+ * 
+ * Counters are read without stopping other threads, so a snapshot taken
+ * under load may be off by the operations in flight.
+ * 
+ * @param stats The statistics to fill
+ * @return 0 on success, non-zero on failure
+ */
+int buffer_stats_snapshot(buffer_stats_t* stats);
+
+/**
+ * @brief Reset the pool statistics counters to zero
+ * 
+ * @return 0 on success, non-zero on failure
+ */
+int buffer_stats_reset(void);
+
+/**
+ * @brief Default alignment of column chunks in a segment file
+ */
+#define SEGMENT_DEFAULT_ALIGNMENT 4096
+
+/**
+ * @brief Chunk encodings
+ */
+#define SEGMENT_ENCODING_PLAIN       0 /**< Validity bitmap (if any nulls), then values as written */
+#define SEGMENT_ENCODING_DICTIONARY  1 /**< Distinct values, then a bit-packed index per row */
+#define SEGMENT_ENCODING_RLE         2 /**< Runs of equal fixed-width values */
+#define SEGMENT_ENCODING_BITPACK     3 /**< Integers as bit-packed offsets from their minimum */
+#define SEGMENT_ENCODING_DELTA       4 /**< Integers as bit-packed differences to the previous one */
+#define SEGMENT_ENCODING_DELTA_DELTA 5 /**< Integers as bit-packed changes of the difference (timestamps) */
+#define SEGMENT_ENCODING_AUTO      255 /**< Writer only: pick per chunk from sampled statistics */
+
+/**
+ * @brief Chunk compression codecs
+ */
+#define SEGMENT_COMPRESSION_NONE   0 /**< Stored as encoded */
+#define SEGMENT_COMPRESSION_LZ4    1 /**< LZ4 block */
+#define SEGMENT_COMPRESSION_SNAPPY 2 /**< Snappy block */
+
+/**
+ * @brief Column of a segment file
+ */
+typedef struct {
+    const char* name;            /**< Column name */
+    retldb_type_t type;          /**< Scalar type (not NULL, ARRAY, MAP or STRUCT) */
+    int nullable;                /**< Whether values can be null */
+} segment_column_t;
+
+/**
+ * @brief Values of one column for a run of rows
+ * 
+ * Fixed-width values are packed in values. STRING and BINARY values are
+ * stored back to back in values, value i spanning offsets[i] up to
+ * offsets[i + 1]. Bit i of validity (least significant bit first) is set
+ * when value i is present; a NULL validity means no value is null.
+ */
+typedef struct {
+    const void* values;          /**< Fixed-width values, or bytes of variable-length values */
+    const uint32_t* offsets;     /**< rows + 1 offsets into values for STRING and BINARY */
+    const uint8_t* validity;     /**< Presence bitmap, NULL when nothing is null */
+} segment_vector_t;
+
+/**
+ * @brief Where a column chunk lives and how it is stored
+ */
+typedef struct {
+    uint64_t offset;             /**< File offset, a multiple of the segment's alignment */
+    uint64_t size;               /**< Stored bytes */
+    uint64_t rows;               /**< Values in the chunk (the row group's rows) */
+    uint64_t null_count;         /**< Null values */
+    uint64_t encoded_size;       /**< Bytes once decompressed (size if uncompressed) */
+    uint64_t decoded_size;       /**< Bytes of the chunk decoded to the PLAIN encoding */
+    uint32_t encoding;           /**< SEGMENT_ENCODING_* */
+    uint32_t compression;        /**< SEGMENT_COMPRESSION_* */
+    uint64_t checksum;           /**< Checksum of the stored bytes */
+} segment_chunk_t;
+
+/**
+ * @brief Bytes a segment reader has read
+ */
+typedef struct {
+    uint64_t footer_bytes;       /**< Header, trailer and footer bytes read at open */
+    uint64_t chunk_bytes;        /**< Chunk bytes read by segment_read_chunk() */
+    uint64_t chunks_read;        /**< Calls to segment_read_chunk() that succeeded */
+} segment_stats_t;
+
+/**
+ * @brief Get the width of a fixed-width type in a segment
+ * 
+ * @param type The type
+ * @return Bytes per value, 0 for STRING and BINARY or unsupported types
+ */
+size_t segment_type_width(retldb_type_t type);
+
+/**
+ * @brief Start writing a segment file
+ * 
+ * Segment files are immutable columnar files. Rows are written in row
+ * groups; each column of a row group is a separate chunk starting at an
+ * aligned offset, so a reader can fetch or map exactly the columns it
+ * needs. A footer indexes every chunk. The file is staged and appears
+ * under its name only when segment_writer_finish() succeeds.
+ * 
+ * @param filename The segment file
+ * @param columns The columns
+ * @param num_columns Number of columns
+ * @param alignment Chunk alignment, a power of two of at least 8 (0 for
+ *        SEGMENT_DEFAULT_ALIGNMENT); use mmap_granularity() or more to map chunks
+ * @return Writer handle on success, NULL on failure
+ */
+void* segment_writer_create(const char* filename, const segment_column_t* columns,
+                            size_t num_columns, size_t alignment);
+
+/**
+ * @brief Choose how a column's chunks are encoded
+ * 
+ * Every column starts out as SEGMENT_ENCODING_AUTO, which samples each
+ * chunk to pick the encoding likely to store it smallest. A forced
+ * encoding that does not suit a chunk (a dictionary with too many
+ * distinct values) falls back to PLAIN for that chunk.
+ * 
+ * @param writer The writer handle
+ * @param column Column index
+ * @param encoding SEGMENT_ENCODING_*, including SEGMENT_ENCODING_AUTO
+ * @return 0 on success, non-zero if the encoding cannot store the column's type
+ */
+int segment_writer_set_encoding(void* writer, size_t column, uint32_t encoding);
+
+/**
+ * @brief Choose how a column's chunks are compressed
+ * 
+ * Compression applies to the encoded chunk as a single block. Columns
+ * start out uncompressed; a chunk that does not get smaller is stored
+ * uncompressed whatever the choice.
+ * 
+ * @param writer The writer handle
+ * @param column Column index
+ * @param compression SEGMENT_COMPRESSION_*
+ * @return 0 on success, non-zero for an unknown codec
+ */
+int segment_writer_set_compression(void* writer, size_t column, uint32_t compression);
+
+/**
+ * @brief Write one row group
+ * 
+ * @param writer The writer handle
+ * @param columns One vector per column, in column order
+ * @param rows Number of rows in the group (at least one)
+ * @return 0 on success, non-zero on failure (the writer must then be aborted)
+ */
+int segment_writer_append(void* writer, const segment_vector_t* columns, size_t rows);
+
+/**
+ * @brief Write the footer and publish the segment file
+ * 
+ * @param writer The writer handle, freed whatever the outcome
+ * @param file_size Receives the size of the file (may be NULL)
+ * @return 0 on success, non-zero on failure
+ */
+int segment_writer_finish(void* writer, uint64_t* file_size);
+
+/**
+ * @brief Abandon a segment file being written
+ * 
+ * @param writer The writer handle, freed
+ * @return 0 on success, non-zero on failure
+ */
+int segment_writer_abort(void* writer);
+
+/**
+ * @brief Open a segment file and load its footer
+ * 
+ * Reads the header, the trailer and the footer, and verifies the footer's
+ * checksum. No column data is read.
+ * 
+ * @param filename The segment file
+ * @return Segment handle on success, NULL on failure
+ */
+void* segment_open(const char* filename);
+
+/**
+ * @brief Close a segment file
+ * 
+ * @param segment The segment handle
+ * @return 0 on success, non-zero on failure
+ */
+int segment_close(void* segment);
+
+/**
+ * @brief Get the number of rows in a segment
+ * 
+ * @param segment The segment handle
+ * @return Number of rows
+ */
+uint64_t segment_row_count(const void* segment);
+
+/**
+ * @brief Get the number of row groups in a segment
+ * 
+ * @param segment The segment handle
+ * @return Number of row groups
+ */
+size_t segment_row_group_count(const void* segment);
+
+/**
+ * @brief Get the rows of a row group
+ * 
+ * @param segment The segment handle
+ * @param row_group Row group index
+ * @param first_row Receives the index of the group's first row in the segment (may be NULL)
+ * @param rows Receives the number of rows in the group
+ * @return 0 on success, non-zero on failure
+ */
+int segment_row_group(const void* segment, size_t row_group, uint64_t* first_row, uint64_t* rows);
+
+/**
+ * @brief Get the number of columns in a segment
+ * 
+ * @param segment The segment handle
+ * @return Number of columns
+ */
+size_t segment_column_count(const void* segment);
+
+/**
+ * @brief Get a column of a segment
+ * 
+ * @param segment The segment handle
+ * @param column Column index
+ * @return The column, NULL if the index is out of range
+ */
+const segment_column_t* segment_column(const void* segment, size_t column);
+
+/**
+ * @brief Find a column by name
+ * 
+ * @param segment The segment handle
+ * @param name The column name
+ * @return Column index, -1 if there is no such column
+ */
+int segment_find_column(const void* segment, const char* name);
+
+/**
+ * @brief Describe a column chunk
+ * 
+ * @param segment The segment handle
+ * @param row_group Row group index
+ * @param column Column index
+ * @param chunk Filled with the chunk
+ * @return 0 on success, non-zero on failure
+ */
+int segment_chunk(const void* segment, size_t row_group, size_t column, segment_chunk_t* chunk);
+
+/**
+ * @brief Read a column chunk and verify its checksum
+ * 
+ * @param segment The segment handle
+ * @param row_group Row group index
+ * @param column Column index
+ * @param buf Receives the chunk; at least segment_chunk() size bytes
+ * @return 0 on success, non-zero on failure
+ */
+int segment_read_chunk(void* segment, size_t row_group, size_t column, void* buf);
+
+/**
+ * @brief Get the scratch space segment_decode_chunk() needs for a chunk
+ * 
+ * @param chunk The chunk, as filled by segment_chunk()
+ * @return Bytes of scratch, 0 for a PLAIN uncompressed chunk
+ */
+size_t segment_scratch_size(const segment_chunk_t* chunk);
+
+/**
+ * @brief Decode a column chunk into a vector
+ * 
+ * The vector points into data and scratch, which must stay valid while it
+ * is used. Works on bytes from segment_read_chunk() as well as on a mapping
+ * of the chunk's range. PLAIN uncompressed chunks are used in place; other
+ * chunks are decompressed and decoded into scratch.
+ * 
+ * @param segment The segment handle
+ * @param row_group Row group index
+ * @param column Column index
+ * @param data The chunk's stored bytes
+ * @param scratch At least segment_scratch_size() bytes, 8-byte aligned (may
+ *        be NULL when that is 0)
+ * @param vector Filled with the values
+ * @return 0 on success, non-zero if the chunk is malformed
+ */
+int segment_decode_chunk(const void* segment, size_t row_group, size_t column,
+                         const void* data, void* scratch, segment_vector_t* vector);
+
+/**
+ * @brief Get the bytes a segment reader has read so far
+ * 
+ * @param segment The segment handle
+ * @param stats Filled with the counters
+ * @return 0 on success, non-zero on failure
+ */
+int segment_stats(const void* segment, segment_stats_t* stats);
+
+/**
+ * @brief Get a fingerprint of a segment's contents
+ * 
+ * The checksum of the footer, which covers the position and checksum of
+ * every chunk: segments with equal fingerprints hold the same data.
+ * 
+ * @param segment The segment handle
+ * @return The fingerprint, 0 on failure
+ */
+uint64_t segment_fingerprint(const void* segment);
+
+/**
+ * @brief Bytes of the bounds kept in a zone map
+ */
+#define SEGMENT_ZONE_BYTES 32
+
+/**
+ * @brief Zone map flags
+ */
+#define SEGMENT_ZONE_BOUNDS        0x1 /**< min and max are set (some value is present and not NaN) */
+#define SEGMENT_ZONE_ASCENDING     0x2 /**< Present values never decrease from row to row */
+#define SEGMENT_ZONE_DESCENDING    0x4 /**< Present values never increase from row to row */
+#define SEGMENT_ZONE_MAX_TRUNCATED 0x8 /**< max is the first SEGMENT_ZONE_BYTES of a longer value */
+
+/**
+ * @brief Statistics of the values of a column chunk or a whole column
+ * 
+ * Written with the segment and loaded with its footer, so scans can rule
+ * out chunks without reading them. Fixed-width bounds hold a value of the
+ * column's type; STRING and BINARY bounds hold up to SEGMENT_ZONE_BYTES
+ * leading bytes, which is still a lower bound for min, but makes max only
+ * a prefix of the largest value when SEGMENT_ZONE_MAX_TRUNCATED is set.
+ * Floating-point NaNs count as present but are left out of the bounds, the
+ * sort order and the distinct count.
+ */
+typedef struct {
+    uint64_t null_count;             /**< Null values */
+    uint64_t distinct;               /**< Estimated distinct present values (exact up to 256) */
+    uint32_t flags;                  /**< SEGMENT_ZONE_* */
+    uint32_t min_size;               /**< Bytes of min */
+    uint32_t max_size;               /**< Bytes of max */
+    uint8_t min[SEGMENT_ZONE_BYTES]; /**< Smallest present value */
+    uint8_t max[SEGMENT_ZONE_BYTES]; /**< Largest present value, or its prefix */
+} segment_zone_t;
+
+/**
+ * @brief Get the zone map of a column chunk
+ * 
+ * Every row group keeps one per column, so this is also the row group's
+ * zone map for that column.
+ * 
+ * @param segment The segment handle
+ * @param row_group Row group index
+ * @param column Column index
+ * @param zone Filled with the statistics
+ * @return 0 on success, non-zero on failure
+ */
+int segment_chunk_zone(const void* segment, size_t row_group, size_t column,
+                       segment_zone_t* zone);
+
+/**
+ * @brief Get the zone map of a column over the whole segment
+ * 
+ * Sorted flags hold only if the column is sorted across row groups too.
+ * 
+ * @param segment The segment handle
+ * @param column Column index
+ * @param zone Filled with the statistics
+ * @return 0 on success, non-zero on failure
+ */
+int segment_column_zone(const void* segment, size_t column, segment_zone_t* zone);
+
+/**
+ * @brief Check whether a zone may hold a value in a range
+ * 
+ * Bounds are inclusive and given like the values of a vector of the type:
+ * one fixed-width value, or the bytes of a STRING or BINARY value. Passing
+ * the same value as both bounds checks a point lookup.
+ * 
+ * @param zone The zone map
+ * @param type The column type
+ * @param low Smallest value wanted, NULL for no lower bound
+ * @param low_size Bytes of low (ignored for fixed-width types)
+ * @param high Largest value wanted, NULL for no upper bound
+ * @param high_size Bytes of high (ignored for fixed-width types)
+ * @return 1 if a present value may be in the range, 0 if none is, -1 on
+ *         invalid arguments
+ */
+int segment_zone_may_match(const segment_zone_t* zone, retldb_type_t type, const void* low,
+                           size_t low_size, const void* high, size_t high_size);
+
+/**
+ * @brief Instruction sets of the bit-unpacking and dictionary decode kernels
+ */
+#define SEGMENT_KERNEL_SCALAR 0 /**< Portable C */
+#define SEGMENT_KERNEL_AVX2   1 /**< AVX2 (x86-64) */
+#define SEGMENT_KERNEL_AVX512 2 /**< AVX-512 F and BW (x86-64) */
+
+/**
+ * @brief Get the instruction set segment decoding uses
+ * 
+ * The best one the CPU supports, found on first use, unless lowered with
+ * segment_set_kernel_level().
+ * 
+ * @return SEGMENT_KERNEL_*
+ */
+uint32_t segment_kernel_level(void);
+
+/**
+ * @brief Choose the instruction set segment decoding uses
+ * 
+ * Applies to the whole process; meant for benchmarks and for ruling out
+ * the vector kernels when chasing a problem.
+ * 
+ * @param level SEGMENT_KERNEL_*, at most what the CPU supports
+ * @return 0 on success, non-zero if the CPU lacks the instructions
+ */
+int segment_set_kernel_level(uint32_t level);
+
+/**
+ * @brief Decoded chunk cache statistics
+ */
+typedef struct {
+    uint64_t hits;               /**< Acquisitions served from the cache */
+    uint64_t misses;             /**< Acquisitions that read and decoded the chunk */
+    uint64_t evictions;          /**< Idle chunks dropped to stay within capacity */
+    size_t entries;              /**< Chunks cached */
+    size_t pinned;               /**< Chunks with outstanding acquisitions */
+    size_t bytes;                /**< Bytes held by cached chunks */
+    size_t capacity;             /**< Bytes kept before idle chunks are dropped */
+} chunk_cache_stats_t;
+
+/**
+ * @brief Create a cache of decoded column chunks
+ * 
+ * The cache sits in front of chunk reads: a hot chunk is read, verified,
+ * decompressed and decoded once, and later lookups get the decoded values
+ * straight from memory. Chunks are keyed by segment_fingerprint(), so any
+ * number of open segments can share one cache.
+ * 
+ * @param capacity Bytes to keep, 0 for a default of 256 MiB
+ * @return Cache handle on success, NULL on failure
+ */
+void* chunk_cache_create(size_t capacity);
+
+/**
+ * @brief Destroy a decoded chunk cache
+ * 
+ * @param cache The cache handle
+ * @return 0 on success, non-zero if chunks are still acquired (the cache is kept)
+ */
+int chunk_cache_destroy(void* cache);
+
+/**
+ * @brief Get the decoded values of a chunk, loading them on a miss
+ * 
+ * @param cache The cache handle
+ * @param segment The segment handle
+ * @param row_group Row group index
+ * @param column Column index
+ * @param vector Filled with the values, valid until chunk_cache_release()
+ * @return Handle pinning the chunk, NULL on failure
+ */
+const void* chunk_cache_acquire(void* cache, void* segment, size_t row_group, size_t column,
+                                segment_vector_t* vector);
+
+/**
+ * @brief Release a chunk obtained from chunk_cache_acquire()
+ * 
+ * @param cache The cache handle
+ * @param chunk The handle returned by chunk_cache_acquire()
+ * @return 0 on success, non-zero on failure
+ */
+int chunk_cache_release(void* cache, const void* chunk);
+
+/**
+ * @brief Change the capacity of a decoded chunk cache
+ * 
+ * @param cache The cache handle
+ * @param capacity Bytes to keep (idle chunks over it are dropped at once)
+ * @return 0 on success, non-zero on failure
+ */
+int chunk_cache_set_capacity(void* cache, size_t capacity);
+
+/**
+ * @brief Get decoded chunk cache statistics
+ * 
+ * @param cache The cache handle
+ * @param stats Filled with the current counters
+ * @return 0 on success, non-zero on failure
+ */
+int chunk_cache_stats(void* cache, chunk_cache_stats_t* stats);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,103 @@
+/**
+ * @file checksum.c
+ * @brief Implementation of the checksum used by rETL DB file formats
+ */
+
+#include <string.h>
+#include <stdint.h>
+
+#include "common/checksum.h"
+
+/**
+ * @brief Rotate left
+ */
+static uint64_t rotl64(uint64_t x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+/**
+ * @brief Mix one 64-bit lane (XXH64 round)
+ */
+static uint64_t checksum_round(uint64_t acc, uint64_t input) {
+    acc += input * 0xC2B2AE3D27D4EB4FULL;
+    acc = rotl64(acc, 31);
+    return acc * 0x9E3779B185EBCA87ULL;
+}
+
+/**
+ * @brief Fold a lane into the hash (XXH64 merge)
+ */
+static uint64_t checksum_merge(uint64_t hash, uint64_t lane) {
+    hash ^= checksum_round(0, lane);
+    return hash * 0x9E3779B185EBCA87ULL + 0x85EBCA77C2B2AE63ULL;
+}
+
+/**
+ * @brief Checksum a byte range (XXH64)
+ *
+ * @param data The bytes
+ * @param len Number of bytes
+ * @return 64-bit checksum
+ */
+uint64_t checksum64(const void* data, size_t len) {
+    const uint64_t p1 = 0x9E3779B185EBCA87ULL;
+    const uint64_t p2 = 0xC2B2AE3D27D4EB4FULL;
+    const uint64_t p3 = 0x165667B19E3779F9ULL;
+    const uint64_t p4 = 0x85EBCA77C2B2AE63ULL;
+    const uint64_t p5 = 0x27D4EB2F165667C5ULL;
+    const unsigned char* p = (const unsigned char*)data;
+    const unsigned char* end = p + len;
+    uint64_t hash;
+    uint64_t word;
+    
+    if (len >= 32) {
+        uint64_t v1 = p1 + p2;
+        uint64_t v2 = p2;
+        uint64_t v3 = 0;
+        uint64_t v4 = 0 - p1;
+        while (end - p >= 32) {
+            memcpy(&word, p, 8);
+            v1 = checksum_round(v1, word);
+            memcpy(&word, p + 8, 8);
+            v2 = checksum_round(v2, word);
+            memcpy(&word, p + 16, 8);
+            v3 = checksum_round(v3, word);
+            memcpy(&word, p + 24, 8);
+            v4 = checksum_round(v4, word);
+            p += 32;
+        }
+        hash = rotl64(v1, 1) + rotl64(v2, 7) + rotl64(v3, 12) + rotl64(v4, 18);
+        hash = checksum_merge(hash, v1);
+        hash = checksum_merge(hash, v2);
+        hash = checksum_merge(hash, v3);
+        hash = checksum_merge(hash, v4);
+    } else {
+        hash = p5;
+    }
+    hash += (uint64_t)len;
+    
+    while (end - p >= 8) {
+        memcpy(&word, p, 8);
+        hash ^= checksum_round(0, word);
+        hash = rotl64(hash, 27) * p1 + p4;
+        p += 8;
+    }
+    if (end - p >= 4) {
+        uint32_t half;
+        memcpy(&half, p, 4);
+        hash ^= (uint64_t)half * p1;
+        hash = rotl64(hash, 23) * p2 + p3;
+        p += 4;
+    }
+    while (p < end) {
+        hash ^= (uint64_t)*p++ * p5;
+        hash = rotl64(hash, 11) * p1;
+    }
+    
+    hash ^= hash >> 33;
+    hash *= p2;
+    hash ^= hash >> 29;
+    hash *= p3;
+    hash ^= hash >> 32;
+    return hash;
+}
@@ -0,0 +1,24 @@
+/**
+ * @file checksum.h
+ * @brief Internal checksum for rETL DB file formats
+ *
+ * XXH64 with a zero seed: fast enough to verify files at memory speed and
+ * strong enough to catch torn writes and bit rot. Not for adversaries.
+ */
+
+#ifndef RETLDB_CHECKSUM_H
+#define RETLDB_CHECKSUM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Checksum a byte range
+ *
+ * @param data The bytes
+ * @param len Number of bytes
+ * @return 64-bit checksum
+ */
+uint64_t checksum64(const void* data, size_t len);
+
+#endif /* RETLDB_CHECKSUM_H */
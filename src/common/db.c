@@ -3,59 +3,258 @@
  * @brief Implementation of database operations for rETL DB
  */
 
+/* Define _POSIX_C_SOURCE to make strdup available */
+#define _POSIX_C_SOURCE 200809L
+
 #include "retldb.h"
+#include "common/manifest.h"
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#include <direct.h>
+#ifndef S_ISDIR
+#define S_ISDIR(mode) (((mode) & _S_IFMT) == _S_IFDIR)
+#endif
+#endif
+
+#define DB_LOCK_FILE "LOCK"             // Held exclusively by the single writer
+#define DB_READERS_FILE "READERS"       // Held shared by readers, exclusively by exclusive opens
+#define DB_MANIFEST_FILE "MANIFEST"     // Catalog of tables, partitions and segments
+
+/**
+ * @brief What opening does when the directory holds no database yet
+ */
+typedef enum {
+    DB_OPEN_EXISTING,    // Fail with RETLDB_ERROR_NOT_FOUND
+    DB_OPEN_OR_CREATE,   // Write an empty catalog
+    DB_CREATE_NEW        // Write an empty catalog; fail if there already is one
+} db_open_mode_t;
 
 /**
  * @brief Database structure
  */
 struct retldb_db_t {
     char* path;
-    // Add more fields as needed
+    int flags;           // RETLDB_OPEN_* flags the database was opened with
+    void* lease;         // Writer lease on DB_LOCK_FILE, NULL for readers
+    void* readers;       // Lock on DB_READERS_FILE, NULL for plain writers
+    manifest_t* catalog; // Catalog as loaded, plus uncommitted changes
+    void* files;         // Open file cache for segment files
+    void* pool;          // Buffer pool, NULL for the default pool
+    int owns_pool;       // Whether the pool is destroyed with the database
 };
 
 /**
- * @brief Create a new database
+ * @brief Build the name of a file in the database directory
  *
- * @param path Path to the database directory
- * @param db Pointer to store the database handle
+ * @param path The database directory
+ * @param name The file name within it
+ * @return The joined name (free with free()), NULL on failure
+ */
+static char* db_file(const char* path, const char* name) {
+    size_t len = strlen(path) + strlen(name) + 2;
+    char* filename = (char*)malloc(len);
+    if (filename) {
+        snprintf(filename, len, "%s/%s", path, name);
+    }
+    return filename;
+}
+
+/**
+ * @brief Lock a file in the database directory
+ *
+ * @param path The database directory
+ * @param name The lock file name
+ * @param flags FILE_LOCK_* flags
+ * @param lock Receives the lock handle
  * @return retldb_error_t Error code
  */
-retldb_error_t retldb_db_create(const char* path, retldb_db_t** db) {
-    if (!path || !db) {
-        return RETLDB_ERROR_INVALID_ARGUMENT;
+static retldb_error_t lock_in_directory(const char* path, const char* name, int flags, void** lock) {
+    char* filename = db_file(path, name);
+    if (!filename) {
+        return RETLDB_ERROR_OUT_OF_MEMORY;
     }
     
-    // Placeholder implementation
-    *db = NULL;
-    return RETLDB_ERROR_NOT_SUPPORTED;
+    retldb_error_t result = file_lock(filename, flags, lock);
+    free(filename);
+    return result;
 }
 
 /**
- * @brief Open an existing database
+ * @brief Make sure the database directory exists
+ *
+ * @param path The database directory
+ * @param create Whether a missing directory is created
+ * @return retldb_error_t Error code
+ */
+static retldb_error_t ensure_directory(const char* path, int create) {
+    struct stat sb;
+    if (stat(path, &sb) == 0) {
+        return S_ISDIR(sb.st_mode) ? RETLDB_OK : RETLDB_ERROR_INVALID_ARGUMENT;
+    }
+    if (!create) {
+        return RETLDB_ERROR_NOT_FOUND;
+    }
+    
+#ifdef _WIN32
+    int result = _mkdir(path);
+#else
+    int result = mkdir(path, 0755);
+#endif
+    return result == 0 || errno == EEXIST ? RETLDB_OK : RETLDB_ERROR_IO;
+}
+
+/**
+ * @brief Load the catalog, or write an empty one
+ *
+ * @param db The database, holding its locks
+ * @param mode What to do when there is no catalog yet
+ * @return retldb_error_t Error code
+ */
+static retldb_error_t load_catalog(retldb_db_t* db, db_open_mode_t mode) {
+    char* filename = db_file(db->path, DB_MANIFEST_FILE);
+    if (!filename) {
+        return RETLDB_ERROR_OUT_OF_MEMORY;
+    }
+    
+    retldb_error_t result = manifest_load(filename, &db->catalog);
+    if (result == RETLDB_OK && mode == DB_CREATE_NEW) {
+        result = RETLDB_ERROR_ALREADY_EXISTS;
+    } else if (result == RETLDB_ERROR_NOT_FOUND && mode != DB_OPEN_EXISTING) {
+        // Publish generation 1 right away so readers can open the database
+        db->catalog = manifest_create();
+        result = db->catalog ? manifest_save(db->catalog, filename) : RETLDB_ERROR_OUT_OF_MEMORY;
+    }
+    
+    free(filename);
+    return result;
+}
+
+/**
+ * @brief Release everything a database holds
+ *
+ * @param db The database
+ * @return retldb_error_t Error code
+ */
+static retldb_error_t free_db(retldb_db_t* db) {
+    retldb_error_t result = RETLDB_OK;
+    
+    // Segment files still acquired are a caller bug; keep the cache rather than close them
+    if (db->files && file_cache_destroy(db->files) != 0) {
+        result = RETLDB_ERROR_BUSY;
+    }
+    manifest_free(db->catalog);
+    
+    // Give up the locks only once everything else is done
+    if (db->readers && file_unlock(db->readers) != 0) {
+        result = RETLDB_ERROR_IO;
+    }
+    if (db->lease && file_unlock(db->lease) != 0) {
+        result = RETLDB_ERROR_IO;
+    }
+    
+    // Free resources
+    free(db->path);
+    free(db);
+    
+    return result;
+}
+
+/**
+ * @brief Lock a database directory and load its catalog
  *
  * @param path Path to the database directory
+ * @param flags RETLDB_OPEN_* flags
+ * @param mode What to do when there is no catalog yet
  * @param db Pointer to store the database handle
  * @return retldb_error_t Error code
  */
-retldb_error_t retldb_db_open(const char* path, retldb_db_t** db) {
-    if (!path || !db) {
+static retldb_error_t open_database(const char* path, int flags, db_open_mode_t mode,
+                                    retldb_db_t** db) {
+    if (!path || !db ||
+        ((flags & RETLDB_OPEN_READ_ONLY) && (flags & RETLDB_OPEN_EXCLUSIVE))) {
         return RETLDB_ERROR_INVALID_ARGUMENT;
     }
     
-    // Placeholder implementation
-    retldb_db_t* new_db = (retldb_db_t*)malloc(sizeof(retldb_db_t));
+    retldb_error_t result = ensure_directory(path, mode != DB_OPEN_EXISTING);
+    if (result != RETLDB_OK) {
+        return result;
+    }
+    
+    retldb_db_t* new_db = (retldb_db_t*)calloc(1, sizeof(retldb_db_t));
     if (!new_db) {
         return RETLDB_ERROR_OUT_OF_MEMORY;
     }
     
     // Initialize the database
-    new_db->path = NULL;
+    new_db->path = strdup(path);
+    new_db->flags = flags;
+    new_db->files = file_cache_create(0, FILE_READ);
+    if (!new_db->path || !new_db->files) {
+        free_db(new_db);
+        return RETLDB_ERROR_OUT_OF_MEMORY;
+    }
+    
+    // Writers take the lease before the reader lock, so waiting opens cannot deadlock
+    int wait = (flags & RETLDB_OPEN_WAIT) ? FILE_LOCK_WAIT : 0;
+    if (!(flags & RETLDB_OPEN_READ_ONLY)) {
+        result = lock_in_directory(path, DB_LOCK_FILE, FILE_LOCK_EXCLUSIVE | wait, &new_db->lease);
+    }
+    if (result == RETLDB_OK && (flags & (RETLDB_OPEN_READ_ONLY | RETLDB_OPEN_EXCLUSIVE))) {
+        int lock_mode = (flags & RETLDB_OPEN_EXCLUSIVE) ? FILE_LOCK_EXCLUSIVE : FILE_LOCK_SHARED;
+        result = lock_in_directory(path, DB_READERS_FILE, lock_mode | wait, &new_db->readers);
+    }
+    if (result == RETLDB_OK) {
+        result = load_catalog(new_db, mode);
+    }
+    if (result != RETLDB_OK) {
+        free_db(new_db);
+        return result;
+    }
     
     *db = new_db;
     return RETLDB_OK;
 }
 
+/**
+ * @brief Create a new database
+ *
+ * @param path Path to the database directory
+ * @param db Pointer to store the database handle
+ * @return retldb_error_t Error code
+ */
+retldb_error_t retldb_db_create(const char* path, retldb_db_t** db) {
+    return open_database(path, 0, DB_CREATE_NEW, db);
+}
+
+/**
+ * @brief Open an existing database
+ *
+ * @param path Path to the database directory
+ * @param db Pointer to store the database handle
+ * @return retldb_error_t Error code
+ */
+retldb_error_t retldb_db_open(const char* path, retldb_db_t** db) {
+    return retldb_db_open_flags(path, 0, db);
+}
+
+/**
+ * @brief Open a database as its writer, as a reader, or exclusively
+ *
+ * @param path Path to the database directory
+ * @param flags RETLDB_OPEN_* flags
+ * @param db Pointer to store the database handle
+ * @return retldb_error_t Error code
+ */
+retldb_error_t retldb_db_open_flags(const char* path, int flags, retldb_db_t** db) {
+    return open_database(path, flags,
+                         (flags & RETLDB_OPEN_READ_ONLY) ? DB_OPEN_EXISTING : DB_OPEN_OR_CREATE, db);
+}
+
 /**
  * @brief Close a database
  *
@@ -67,8 +266,403 @@ retldb_error_t retldb_db_close(retldb_db_t* db) {
         return RETLDB_ERROR_INVALID_ARGUMENT;
     }
     
-    // Free resources
-    free(db);
+    retldb_error_t result = RETLDB_OK;
+    
+    // Release the buffer pool, writing back what the database left dirty
+    if (db->pool) {
+        buffer_pool_detach(db->pool);
+        if (db->owns_pool && buffer_pool_destroy(db->pool) != 0) {
+            result = RETLDB_ERROR_IO;
+        }
+    }
+    
+    retldb_error_t freed = free_db(db);
+    return result != RETLDB_OK ? result : freed;
+}
+
+/**
+ * @brief Give a database its own buffer pool
+ *
+ * @param db Database handle
+ * @param config Pool configuration
+ * @return retldb_error_t Error code
+ */
+retldb_error_t retldb_db_create_buffer_pool(retldb_db_t* db, const buffer_config_t* config) {
+    if (!db || !config) {
+        return RETLDB_ERROR_INVALID_ARGUMENT;
+    }
+    
+    if (db->pool) {
+        return RETLDB_ERROR_ALREADY_EXISTS;
+    }
+    
+    void* pool = buffer_pool_create(config);
+    if (!pool) {
+        return RETLDB_ERROR_INVALID_ARGUMENT; // Rejected configuration, or out of memory
+    }
+    
+    buffer_pool_attach(pool);
+    db->pool = pool;
+    db->owns_pool = 1;
+    return RETLDB_OK;
+}
+
+/**
+ * @brief Attach a database to a pool shared with other databases
+ *
+ * @param db Database handle
+ * @param pool Pool handle from buffer_pool_create()
+ * @return retldb_error_t Error code
+ */
+retldb_error_t retldb_db_attach_buffer_pool(retldb_db_t* db, void* pool) {
+    if (!db || !pool) {
+        return RETLDB_ERROR_INVALID_ARGUMENT;
+    }
     
+    if (db->pool) {
+        return RETLDB_ERROR_ALREADY_EXISTS;
+    }
+    
+    buffer_pool_attach(pool);
+    db->pool = pool;
+    db->owns_pool = 0;
     return RETLDB_OK;
 }
+
+/**
+ * @brief Get the buffer pool of a database
+ *
+ * @param db Database handle
+ * @return Pool handle, NULL if the database uses the default pool
+ */
+void* retldb_db_buffer_pool(retldb_db_t* db) {
+    return db ? db->pool : NULL;
+}
+
+/**
+ * @brief Check whether a database was opened read-only
+ *
+ * @param db Database handle
+ * @return Non-zero for a read-only database, zero otherwise
+ */
+int retldb_db_is_read_only(const retldb_db_t* db) {
+    return db ? (db->flags & RETLDB_OPEN_READ_ONLY) != 0 : 0;
+}
+
+/**
+ * @brief Get the catalog generation a database was opened at or last committed
+ *
+ * @param db Database handle
+ * @return Generation, 0 on error
+ */
+uint64_t retldb_db_generation(const retldb_db_t* db) {
+    return db ? manifest_generation(db->catalog) : 0;
+}
+
+/**
+ * @brief Get the number of tables in the catalog
+ *
+ * @param db Database handle
+ * @return Number of tables
+ */
+size_t retldb_db_table_count(const retldb_db_t* db) {
+    return db ? manifest_table_count(db->catalog) : 0;
+}
+
+/**
+ * @brief Get the name of a table
+ *
+ * @param db Database handle
+ * @param index Table index
+ * @return The name, NULL if the index is out of range
+ */
+const char* retldb_db_table_name(const retldb_db_t* db, size_t index) {
+    return db ? manifest_table_name(db->catalog, index) : NULL;
+}
+
+/**
+ * @brief Find a table and, optionally, one of its partitions
+ *
+ * @param db Database handle
+ * @param table Table name
+ * @param partition Partition name, NULL to look up only the table
+ * @param table_index Receives the table index
+ * @param partition_index Receives the partition index (may be NULL without a partition)
+ * @return retldb_error_t Error code
+ */
+static retldb_error_t find_in_catalog(const retldb_db_t* db, const char* table,
+                                      const char* partition, size_t* table_index,
+                                      size_t* partition_index) {
+    if (!db || !table) {
+        return RETLDB_ERROR_INVALID_ARGUMENT;
+    }
+    
+    retldb_error_t result = manifest_find_table(db->catalog, table, table_index);
+    if (result == RETLDB_OK && partition) {
+        result = manifest_find_partition(db->catalog, *table_index, partition, partition_index);
+    }
+    return result;
+}
+
+/**
+ * @brief Get the columns of a table
+ *
+ * @param db Database handle
+ * @param table Table name
+ * @param columns Receives the column definitions
+ * @param num_columns Receives the number of columns
+ * @return retldb_error_t Error code
+ */
+retldb_error_t retldb_db_table_columns(const retldb_db_t* db, const char* table,
+                                       const retldb_column_def_t** columns, size_t* num_columns) {
+    if (!columns || !num_columns) {
+        return RETLDB_ERROR_INVALID_ARGUMENT;
+    }
+    
+    size_t t;
+    retldb_error_t result = find_in_catalog(db, table, NULL, &t, NULL);
+    if (result == RETLDB_OK) {
+        *columns = manifest_table_columns(db->catalog, t, num_columns);
+    }
+    return result;
+}
+
+/**
+ * @brief Get the number of partitions of a table
+ *
+ * @param db Database handle
+ * @param table Table name
+ * @param count Receives the number of partitions
+ * @return retldb_error_t Error code
+ */
+retldb_error_t retldb_db_partition_count(const retldb_db_t* db, const char* table, size_t* count) {
+    if (!count) {
+        return RETLDB_ERROR_INVALID_ARGUMENT;
+    }
+    
+    size_t t;
+    retldb_error_t result = find_in_catalog(db, table, NULL, &t, NULL);
+    if (result == RETLDB_OK) {
+        *count = manifest_partition_count(db->catalog, t);
+    }
+    return result;
+}
+
+/**
+ * @brief Get the name of a partition
+ *
+ * @param db Database handle
+ * @param table Table name
+ * @param index Partition index
+ * @return The name, NULL if the table does not exist or the index is out of range
+ */
+const char* retldb_db_partition_name(const retldb_db_t* db, const char* table, size_t index) {
+    size_t t;
+    if (find_in_catalog(db, table, NULL, &t, NULL) != RETLDB_OK) {
+        return NULL;
+    }
+    
+    return manifest_partition_name(db->catalog, t, index);
+}
+
+/**
+ * @brief Get the number of segments in a partition
+ *
+ * @param db Database handle
+ * @param table Table name
+ * @param partition Partition name
+ * @param count Receives the number of segments
+ * @return retldb_error_t Error code
+ */
+retldb_error_t retldb_db_segment_count(const retldb_db_t* db, const char* table,
+                                       const char* partition, size_t* count) {
+    if (!partition || !count) {
+        return RETLDB_ERROR_INVALID_ARGUMENT;
+    }
+    
+    size_t t, p;
+    retldb_error_t result = find_in_catalog(db, table, partition, &t, &p);
+    if (result == RETLDB_OK) {
+        *count = manifest_segment_count(db->catalog, t, p);
+    }
+    return result;
+}
+
+/**
+ * @brief Describe a segment of a partition
+ *
+ * @param db Database handle
+ * @param table Table name
+ * @param partition Partition name
+ * @param index Segment index
+ * @param info Filled with the segment
+ * @return retldb_error_t Error code
+ */
+retldb_error_t retldb_db_segment_info(const retldb_db_t* db, const char* table,
+                                      const char* partition, size_t index,
+                                      retldb_segment_info_t* info) {
+    if (!partition || !info) {
+        return RETLDB_ERROR_INVALID_ARGUMENT;
+    }
+    
+    size_t t, p;
+    retldb_error_t result = find_in_catalog(db, table, partition, &t, &p);
+    if (result == RETLDB_OK) {
+        result = manifest_segment(db->catalog, t, p, index, info);
+    }
+    return result;
+}
+
+/**
+ * @brief Get an open handle for a segment file
+ *
+ * @param db Database handle
+ * @param table Table name
+ * @param partition Partition name
+ * @param index Segment index
+ * @param file Receives a file handle
+ * @return retldb_error_t Error code
+ */
+retldb_error_t retldb_db_segment_acquire(retldb_db_t* db, const char* table,
+                                         const char* partition, size_t index, void** file) {
+    if (!file) {
+        return RETLDB_ERROR_INVALID_ARGUMENT;
+    }
+    
+    retldb_segment_info_t info;
+    retldb_error_t result = retldb_db_segment_info(db, table, partition, index, &info);
+    if (result != RETLDB_OK) {
+        return result;
+    }
+    
+    char* filename = db_file(db->path, info.filename);
+    if (!filename) {
+        return RETLDB_ERROR_OUT_OF_MEMORY;
+    }
+    
+    *file = file_cache_acquire(db->files, filename);
+    free(filename);
+    return *file ? RETLDB_OK : RETLDB_ERROR_IO;
+}
+
+/**
+ * @brief Release a handle obtained from retldb_db_segment_acquire()
+ *
+ * @param db Database handle
+ * @param file The file handle
+ * @return retldb_error_t Error code
+ */
+retldb_error_t retldb_db_segment_release(retldb_db_t* db, void* file) {
+    if (!db || !file) {
+        return RETLDB_ERROR_INVALID_ARGUMENT;
+    }
+    
+    return file_cache_release(db->files, file) == 0 ? RETLDB_OK : RETLDB_ERROR_INVALID_ARGUMENT;
+}
+
+/**
+ * @brief Check that a database may change its catalog
+ *
+ * @param db Database handle
+ * @return RETLDB_OK for the writer, an error code otherwise
+ */
+static retldb_error_t check_writer(const retldb_db_t* db) {
+    if (!db) {
+        return RETLDB_ERROR_INVALID_ARGUMENT;
+    }
+    
+    return (db->flags & RETLDB_OPEN_READ_ONLY) ? RETLDB_ERROR_NOT_SUPPORTED : RETLDB_OK;
+}
+
+/**
+ * @brief Add a table to the catalog
+ *
+ * @param db Database handle
+ * @param name Table name
+ * @param columns Column definitions
+ * @param num_columns Number of columns
+ * @return retldb_error_t Error code
+ */
+retldb_error_t retldb_db_create_table(retldb_db_t* db, const char* name,
+                                      const retldb_column_def_t* columns, size_t num_columns) {
+    retldb_error_t result = check_writer(db);
+    if (result != RETLDB_OK) {
+        return result;
+    }
+    
+    return manifest_add_table(db->catalog, name, columns, num_columns);
+}
+
+/**
+ * @brief Add a segment file to a partition, creating the partition if needed
+ *
+ * @param db Database handle
+ * @param table Table name
+ * @param partition Partition name
+ * @param filename Segment file, relative to the database directory
+ * @param rows Number of rows in the segment
+ * @param bytes Size of the segment file
+ * @param id Receives the segment id (may be NULL)
+ * @return retldb_error_t Error code
+ */
+retldb_error_t retldb_db_add_segment(retldb_db_t* db, const char* table, const char* partition,
+                                     const char* filename, uint64_t rows, uint64_t bytes,
+                                     uint64_t* id) {
+    size_t t;
+    retldb_error_t result = check_writer(db);
+    if (result == RETLDB_OK) {
+        result = find_in_catalog(db, table, NULL, &t, NULL);
+    }
+    if (result != RETLDB_OK) {
+        return result;
+    }
+    
+    return manifest_add_segment(db->catalog, t, partition, filename, rows, bytes, id);
+}
+
+/**
+ * @brief Remove a partition and its segments from the catalog
+ *
+ * @param db Database handle
+ * @param table Table name
+ * @param partition Partition name
+ * @return retldb_error_t Error code
+ */
+retldb_error_t retldb_db_drop_partition(retldb_db_t* db, const char* table, const char* partition) {
+    if (!partition) {
+        return RETLDB_ERROR_INVALID_ARGUMENT;
+    }
+    
+    size_t t, p;
+    retldb_error_t result = check_writer(db);
+    if (result == RETLDB_OK) {
+        result = find_in_catalog(db, table, partition, &t, &p);
+    }
+    if (result != RETLDB_OK) {
+        return result;
+    }
+    
+    return manifest_drop_partition(db->catalog, t, p);
+}
+
+/**
+ * @brief Publish catalog changes as a new generation
+ *
+ * @param db Database handle
+ * @return retldb_error_t Error code
+ */
+retldb_error_t retldb_db_commit(retldb_db_t* db) {
+    retldb_error_t result = check_writer(db);
+    if (result != RETLDB_OK) {
+        return result;
+    }
+    
+    char* filename = db_file(db->path, DB_MANIFEST_FILE);
+    if (!filename) {
+        return RETLDB_ERROR_OUT_OF_MEMORY;
+    }
+    
+    result = manifest_save(db->catalog, filename);
+    free(filename);
+    return result;
+}
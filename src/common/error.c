@@ -12,6 +12,7 @@ static const char* error_messages[] = {
     "Item not found",               /* RETLDB_ERROR_NOT_FOUND */
     "Item already exists",          /* RETLDB_ERROR_ALREADY_EXISTS */
     "Operation not supported",      /* RETLDB_ERROR_NOT_SUPPORTED */
+    "Resource busy",                /* RETLDB_ERROR_BUSY */
     "Unknown error"                 /* RETLDB_ERROR_UNKNOWN */
 };
 
@@ -0,0 +1,895 @@
+/**
+ * @file manifest.c
+ * @brief Implementation of the database catalog for rETL DB
+ *
+ * File layout (native byte order; a reader with the other byte order sees
+ * a bad version and rejects the file):
+ *
+ *   manifest_header_t
+ *   manifest_table_rec_t[table_count]
+ *   manifest_column_rec_t[column_count]
+ *   manifest_partition_rec_t[partition_count]
+ *   manifest_segment_rec_t[segment_count]
+ *   strings_size bytes of NUL-terminated names
+ *
+ * Every record is a multiple of 8 bytes, so the records of a mapped file
+ * can be used in place. Names are stored as offsets into the string area.
+ */
+
+/* Define _POSIX_C_SOURCE to make strdup available */
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <errno.h>
+#include <sys/stat.h>
+
+#include "common/manifest.h"
+#include "common/checksum.h"
+
+#define MANIFEST_MAGIC "RETLDBMF"       // First 8 bytes of every manifest
+#define MANIFEST_VERSION 1              // Bumped on incompatible layout changes
+
+/**
+ * @brief Manifest file header
+ */
+typedef struct {
+    char magic[8];               // MANIFEST_MAGIC
+    uint32_t version;            // MANIFEST_VERSION
+    uint32_t header_size;        // sizeof(manifest_header_t)
+    uint64_t generation;         // Incremented by every save
+    uint64_t next_segment_id;    // Id the next added segment gets
+    uint64_t file_size;          // Size of the whole file
+    uint32_t table_count;        // Table records
+    uint32_t column_count;       // Column records, all tables together
+    uint32_t partition_count;    // Partition records, all tables together
+    uint32_t reserved;           // Zero
+    uint64_t segment_count;      // Segment records, all partitions together
+    uint64_t strings_size;       // Bytes of names after the records
+    uint64_t body_checksum;      // Checksum of everything after the header
+    uint64_t header_checksum;    // Checksum of the header up to this field
+} manifest_header_t;
+
+/**
+ * @brief Table record
+ */
+typedef struct {
+    uint64_t name;               // Offset of the name in the string area
+    uint32_t column_first;       // First column record
+    uint32_t column_count;       // Number of column records
+    uint32_t partition_first;    // First partition record
+    uint32_t partition_count;    // Number of partition records
+} manifest_table_rec_t;
+
+/**
+ * @brief Column record
+ */
+typedef struct {
+    uint64_t name;               // Offset of the name in the string area
+    uint32_t type;               // retldb_type_t
+    uint32_t nullable;           // Whether the column can be NULL
+} manifest_column_rec_t;
+
+/**
+ * @brief Partition record
+ */
+typedef struct {
+    uint64_t name;               // Offset of the name in the string area
+    uint64_t segment_first;      // First segment record
+    uint64_t segment_count;      // Number of segment records
+} manifest_partition_rec_t;
+
+/**
+ * @brief Segment record
+ */
+typedef struct {
+    uint64_t name;               // Offset of the file name in the string area
+    uint64_t id;                 // Segment id
+    uint64_t rows;               // Number of rows
+    uint64_t bytes;              // Size of the file
+} manifest_segment_rec_t;
+
+/**
+ * @brief Partition in memory
+ *
+ * A loaded partition points at its segment records in the mapping; the
+ * first edit copies them into segments.
+ */
+typedef struct {
+    const char* name;                         // Partition name
+    const manifest_segment_rec_t* records;    // Mapped segment records, NULL once copied
+    retldb_segment_info_t* segments;          // Segments on the heap
+    size_t segment_count;                     // Number of segments
+    size_t segment_capacity;                  // Capacity of segments
+} manifest_partition_t;
+
+/**
+ * @brief Table in memory
+ */
+typedef struct {
+    const char* name;                         // Table name
+    retldb_column_def_t* columns;             // Columns
+    size_t column_count;                      // Number of columns
+    manifest_partition_t* partitions;         // Partitions
+    size_t partition_count;                   // Number of partitions
+    size_t partition_capacity;                // Capacity of partitions
+} manifest_table_t;
+
+/**
+ * @brief Manifest structure
+ */
+struct manifest {
+    void* map;                   // Mapping of the loaded file, NULL if never loaded
+    const char* strings;         // String area of the mapping
+    uint64_t strings_size;       // Size of the string area
+    uint64_t generation;         // Generation loaded or last saved
+    uint64_t next_segment_id;    // Id the next added segment gets
+    manifest_table_t* tables;    // Tables
+    size_t table_count;          // Number of tables
+    size_t table_capacity;       // Capacity of tables
+    char** owned;                // Names added by edits, freed with the manifest
+    size_t owned_count;          // Number of owned names
+    size_t owned_capacity;       // Capacity of owned
+};
+
+/**
+ * @brief Grow an array to hold at least one more element
+ *
+ * @param array The array
+ * @param capacity Its capacity, updated
+ * @param count Elements in use
+ * @param size Size of one element
+ * @return 0 on success, non-zero on failure
+ */
+static int grow(void** array, size_t* capacity, size_t count, size_t size) {
+    if (count < *capacity) {
+        return 0;
+    }
+    
+    size_t new_capacity = *capacity ? *capacity * 2 : 8;
+    void* grown = realloc(*array, new_capacity * size);
+    if (!grown) {
+        return -1;
+    }
+    
+    *array = grown;
+    *capacity = new_capacity;
+    return 0;
+}
+
+/**
+ * @brief Copy a name onto the heap for the lifetime of the manifest
+ *
+ * @param manifest The manifest
+ * @param name The name
+ * @return The copy, NULL on failure
+ */
+static const char* own_name(manifest_t* manifest, const char* name) {
+    if (grow((void**)&manifest->owned, &manifest->owned_capacity, manifest->owned_count,
+             sizeof(char*)) != 0) {
+        return NULL;
+    }
+    
+    char* copy = strdup(name);
+    if (copy) {
+        manifest->owned[manifest->owned_count++] = copy;
+    }
+    return copy;
+}
+
+/**
+ * @brief Resolve a name in the mapped string area
+ *
+ * The area is known to end with a NUL, so any offset inside it starts a
+ * terminated string.
+ *
+ * @param manifest The manifest
+ * @param offset Offset of the name
+ * @return The name, NULL if the offset is out of range
+ */
+static const char* mapped_name(const manifest_t* manifest, uint64_t offset) {
+    return offset < manifest->strings_size ? manifest->strings + offset : NULL;
+}
+
+/**
+ * @brief Create an empty manifest (generation 0, nothing saved yet)
+ *
+ * @return The manifest, NULL on failure
+ */
+manifest_t* manifest_create(void) {
+    manifest_t* manifest = (manifest_t*)calloc(1, sizeof(manifest_t));
+    if (manifest) {
+        manifest->next_segment_id = 1;
+    }
+    return manifest;
+}
+
+/**
+ * @brief Free a manifest
+ *
+ * @param manifest The manifest
+ */
+void manifest_free(manifest_t* manifest) {
+    if (!manifest) {
+        return;
+    }
+    
+    for (size_t t = 0; t < manifest->table_count; t++) {
+        manifest_table_t* table = &manifest->tables[t];
+        for (size_t p = 0; p < table->partition_count; p++) {
+            free(table->partitions[p].segments);
+        }
+        free(table->partitions);
+        free(table->columns);
+    }
+    free(manifest->tables);
+    
+    for (size_t i = 0; i < manifest->owned_count; i++) {
+        free(manifest->owned[i]);
+    }
+    free(manifest->owned);
+    
+    if (manifest->map) {
+        mmap_unmap(manifest->map);
+    }
+    free(manifest);
+}
+
+/**
+ * @brief Check a mapped manifest file and build its tables
+ *
+ * @param manifest The manifest, with map set
+ * @return RETLDB_OK, RETLDB_ERROR_CORRUPT_DATA or RETLDB_ERROR_OUT_OF_MEMORY
+ */
+static retldb_error_t index_mapping(manifest_t* manifest) {
+    const char* base = (const char*)mmap_get_addr(manifest->map);
+    uint64_t size = mmap_get_size(manifest->map);
+    manifest_header_t header;
+    if (!base || size < sizeof(header)) {
+        return RETLDB_ERROR_CORRUPT_DATA;
+    }
+    
+    memcpy(&header, base, sizeof(header));
+    if (memcmp(header.magic, MANIFEST_MAGIC, sizeof(header.magic)) != 0 ||
+        header.version != MANIFEST_VERSION || header.header_size != sizeof(header) ||
+        header.header_checksum != checksum64(&header, offsetof(manifest_header_t, header_checksum)) ||
+        header.file_size != size) {
+        return RETLDB_ERROR_CORRUPT_DATA;
+    }
+    
+    // Counts are covered by the header checksum, but still bound them before multiplying
+    uint64_t body = size - sizeof(header);
+    if (header.segment_count > body / sizeof(manifest_segment_rec_t) ||
+        (uint64_t)header.table_count * sizeof(manifest_table_rec_t) +
+        (uint64_t)header.column_count * sizeof(manifest_column_rec_t) +
+        (uint64_t)header.partition_count * sizeof(manifest_partition_rec_t) +
+        header.segment_count * sizeof(manifest_segment_rec_t) + header.strings_size != body ||
+        checksum64(base + sizeof(header), (size_t)body) != header.body_checksum) {
+        return RETLDB_ERROR_CORRUPT_DATA;
+    }
+    
+    const manifest_table_rec_t* tables = (const manifest_table_rec_t*)(base + sizeof(header));
+    const manifest_column_rec_t* columns = (const manifest_column_rec_t*)(tables + header.table_count);
+    const manifest_partition_rec_t* partitions =
+        (const manifest_partition_rec_t*)(columns + header.column_count);
+    const manifest_segment_rec_t* segments =
+        (const manifest_segment_rec_t*)(partitions + header.partition_count);
+    manifest->strings = (const char*)(segments + header.segment_count);
+    manifest->strings_size = header.strings_size;
+    manifest->generation = header.generation;
+    manifest->next_segment_id = header.next_segment_id;
+    if (header.strings_size > 0 && manifest->strings[header.strings_size - 1] != '\0') {
+        return RETLDB_ERROR_CORRUPT_DATA;
+    }
+    
+    if (header.table_count > 0) {
+        manifest->tables = (manifest_table_t*)calloc(header.table_count, sizeof(manifest_table_t));
+        if (!manifest->tables) {
+            return RETLDB_ERROR_OUT_OF_MEMORY;
+        }
+        manifest->table_capacity = header.table_count;
+    }
+    
+    for (uint32_t t = 0; t < header.table_count; t++) {
+        const manifest_table_rec_t* rec = &tables[t];
+        manifest_table_t* table = &manifest->tables[t];
+        manifest->table_count++;
+        table->name = mapped_name(manifest, rec->name);
+        if (!table->name || rec->column_count == 0 ||
+            (uint64_t)rec->column_first + rec->column_count > header.column_count ||
+            (uint64_t)rec->partition_first + rec->partition_count > header.partition_count) {
+            return RETLDB_ERROR_CORRUPT_DATA;
+        }
+        
+        table->columns = (retldb_column_def_t*)malloc(rec->column_count * sizeof(retldb_column_def_t));
+        if (!table->columns) {
+            return RETLDB_ERROR_OUT_OF_MEMORY;
+        }
+        for (uint32_t c = 0; c < rec->column_count; c++) {
+            const manifest_column_rec_t* column = &columns[rec->column_first + c];
+            table->columns[c].name = mapped_name(manifest, column->name);
+            table->columns[c].type = (retldb_type_t)column->type;
+            table->columns[c].nullable = column->nullable != 0;
+            table->column_count++;
+            if (!table->columns[c].name || column->type > RETLDB_TYPE_STRUCT) {
+                return RETLDB_ERROR_CORRUPT_DATA;
+            }
+        }
+        
+        if (rec->partition_count > 0) {
+            table->partitions = (manifest_partition_t*)calloc(rec->partition_count,
+                                                              sizeof(manifest_partition_t));
+            if (!table->partitions) {
+                return RETLDB_ERROR_OUT_OF_MEMORY;
+            }
+            table->partition_capacity = rec->partition_count;
+        }
+        for (uint32_t p = 0; p < rec->partition_count; p++) {
+            const manifest_partition_rec_t* partition = &partitions[rec->partition_first + p];
+            manifest_partition_t* entry = &table->partitions[p];
+            table->partition_count++;
+            entry->name = mapped_name(manifest, partition->name);
+            if (!entry->name || partition->segment_first > header.segment_count ||
+                partition->segment_count > header.segment_count - partition->segment_first) {
+                return RETLDB_ERROR_CORRUPT_DATA;
+            }
+            
+            // Segment records stay in the mapping until the partition is edited
+            entry->records = segments + partition->segment_first;
+            entry->segment_count = (size_t)partition->segment_count;
+        }
+    }
+    
+    return RETLDB_OK;
+}
+
+/**
+ * @brief Load a manifest file
+ *
+ * @param filename The manifest file
+ * @param manifest Receives the manifest
+ * @return RETLDB_OK, RETLDB_ERROR_NOT_FOUND if the file does not exist,
+ *         RETLDB_ERROR_CORRUPT_DATA if it fails verification, or another error
+ */
+retldb_error_t manifest_load(const char* filename, manifest_t** manifest) {
+    if (!filename || !manifest) {
+        return RETLDB_ERROR_INVALID_ARGUMENT;
+    }
+    
+    struct stat sb;
+    if (stat(filename, &sb) != 0) {
+        return errno == ENOENT ? RETLDB_ERROR_NOT_FOUND : RETLDB_ERROR_IO;
+    }
+    if ((uint64_t)sb.st_size < sizeof(manifest_header_t)) {
+        return RETLDB_ERROR_CORRUPT_DATA;
+    }
+    
+    manifest_t* loaded = manifest_create();
+    if (!loaded) {
+        return RETLDB_ERROR_OUT_OF_MEMORY;
+    }
+    
+    // One read-only mapping; the file is only ever replaced by rename, never rewritten
+    loaded->map = mmap_file_hinted(filename, 0, 0, 1, MMAP_ADVICE_WILLNEED, 0);
+    if (!loaded->map) {
+        manifest_free(loaded);
+        return RETLDB_ERROR_IO;
+    }
+    
+    retldb_error_t result = index_mapping(loaded);
+    if (result != RETLDB_OK) {
+        manifest_free(loaded);
+        return result;
+    }
+    
+    *manifest = loaded;
+    return RETLDB_OK;
+}
+
+/**
+ * @brief Append a name to the string area being written
+ *
+ * @param strings The string area
+ * @param used Bytes used so far, updated
+ * @param name The name
+ * @return Offset of the name
+ */
+static uint64_t put_name(char* strings, uint64_t* used, const char* name) {
+    uint64_t offset = *used;
+    size_t len = strlen(name) + 1;
+    memcpy(strings + offset, name, len);
+    *used += len;
+    return offset;
+}
+
+/**
+ * @brief Write the manifest as the next generation, atomically replacing the file
+ *
+ * @param manifest The manifest
+ * @param filename The manifest file
+ * @return retldb_error_t Error code (the generation is unchanged on failure)
+ */
+retldb_error_t manifest_save(manifest_t* manifest, const char* filename) {
+    if (!manifest || !filename) {
+        return RETLDB_ERROR_INVALID_ARGUMENT;
+    }
+    
+    // Size everything first so the file is built in one buffer
+    manifest_header_t header;
+    memset(&header, 0, sizeof(header));
+    uint64_t strings_size = 0;
+    for (size_t t = 0; t < manifest->table_count; t++) {
+        const manifest_table_t* table = &manifest->tables[t];
+        header.column_count += (uint32_t)table->column_count;
+        header.partition_count += (uint32_t)table->partition_count;
+        strings_size += strlen(table->name) + 1;
+        for (size_t c = 0; c < table->column_count; c++) {
+            strings_size += strlen(table->columns[c].name) + 1;
+        }
+        for (size_t p = 0; p < table->partition_count; p++) {
+            header.segment_count += table->partitions[p].segment_count;
+            strings_size += strlen(table->partitions[p].name) + 1;
+            for (size_t s = 0; s < table->partitions[p].segment_count; s++) {
+                retldb_segment_info_t info;
+                retldb_error_t result = manifest_segment(manifest, t, p, s, &info);
+                if (result != RETLDB_OK) {
+                    return result;
+                }
+                strings_size += strlen(info.filename) + 1;
+            }
+        }
+    }
+    
+    memcpy(header.magic, MANIFEST_MAGIC, sizeof(header.magic));
+    header.version = MANIFEST_VERSION;
+    header.header_size = sizeof(header);
+    header.generation = manifest->generation + 1;
+    header.next_segment_id = manifest->next_segment_id;
+    header.table_count = (uint32_t)manifest->table_count;
+    header.strings_size = strings_size;
+    header.file_size = sizeof(header) +
+                       manifest->table_count * sizeof(manifest_table_rec_t) +
+                       header.column_count * sizeof(manifest_column_rec_t) +
+                       header.partition_count * sizeof(manifest_partition_rec_t) +
+                       header.segment_count * sizeof(manifest_segment_rec_t) + strings_size;
+    
+    char* buffer = (char*)calloc(1, (size_t)header.file_size);
+    if (!buffer) {
+        return RETLDB_ERROR_OUT_OF_MEMORY;
+    }
+    
+    manifest_table_rec_t* tables = (manifest_table_rec_t*)(buffer + sizeof(header));
+    manifest_column_rec_t* columns = (manifest_column_rec_t*)(tables + header.table_count);
+    manifest_partition_rec_t* partitions = (manifest_partition_rec_t*)(columns + header.column_count);
+    manifest_segment_rec_t* segments = (manifest_segment_rec_t*)(partitions + header.partition_count);
+    char* strings = (char*)(segments + header.segment_count);
+    uint64_t used = 0;
+    uint32_t column_next = 0;
+    uint32_t partition_next = 0;
+    uint64_t segment_next = 0;
+    
+    for (size_t t = 0; t < manifest->table_count; t++) {
+        const manifest_table_t* table = &manifest->tables[t];
+        tables[t].name = put_name(strings, &used, table->name);
+        tables[t].column_first = column_next;
+        tables[t].column_count = (uint32_t)table->column_count;
+        tables[t].partition_first = partition_next;
+        tables[t].partition_count = (uint32_t)table->partition_count;
+        
+        for (size_t c = 0; c < table->column_count; c++) {
+            manifest_column_rec_t* column = &columns[column_next++];
+            column->name = put_name(strings, &used, table->columns[c].name);
+            column->type = (uint32_t)table->columns[c].type;
+            column->nullable = table->columns[c].nullable != 0;
+        }
+        
+        for (size_t p = 0; p < table->partition_count; p++) {
+            manifest_partition_rec_t* partition = &partitions[partition_next++];
+            partition->name = put_name(strings, &used, table->partitions[p].name);
+            partition->segment_first = segment_next;
+            partition->segment_count = table->partitions[p].segment_count;
+            for (size_t s = 0; s < table->partitions[p].segment_count; s++) {
+                // Records were read once already while sizing, so this cannot fail
+                retldb_segment_info_t info;
+                memset(&info, 0, sizeof(info));
+                manifest_segment(manifest, t, p, s, &info);
+                manifest_segment_rec_t* segment = &segments[segment_next++];
+                segment->name = put_name(strings, &used, info.filename);
+                segment->id = info.id;
+                segment->rows = info.rows;
+                segment->bytes = info.bytes;
+            }
+        }
+    }
+    
+    header.body_checksum = checksum64(buffer + sizeof(header), (size_t)(header.file_size - sizeof(header)));
+    header.header_checksum = checksum64(&header, offsetof(manifest_header_t, header_checksum));
+    memcpy(buffer, &header, sizeof(header));
+    
+    // Readers see the old generation or the new one, never a mix
+    retldb_error_t result = RETLDB_ERROR_IO;
+    void* stage = file_stage_open(filename, 0);
+    if (stage) {
+        if (file_stage_write(stage, buffer, (size_t)header.file_size) == 0 &&
+            file_stage_commit(stage, NULL) == 0) {
+            manifest->generation = header.generation;
+            result = RETLDB_OK;
+        } else {
+            file_stage_abort(stage);
+        }
+    }
+    
+    free(buffer);
+    return result;
+}
+
+/**
+ * @brief Get the generation of a manifest
+ *
+ * @param manifest The manifest
+ * @return Generation of the last load or save, 0 if never saved
+ */
+uint64_t manifest_generation(const manifest_t* manifest) {
+    return manifest ? manifest->generation : 0;
+}
+
+/**
+ * @brief Get the number of tables
+ *
+ * @param manifest The manifest
+ * @return Number of tables
+ */
+size_t manifest_table_count(const manifest_t* manifest) {
+    return manifest ? manifest->table_count : 0;
+}
+
+/**
+ * @brief Get the name of a table
+ *
+ * @param manifest The manifest
+ * @param table Table index
+ * @return The name, NULL if the index is out of range
+ */
+const char* manifest_table_name(const manifest_t* manifest, size_t table) {
+    if (!manifest || table >= manifest->table_count) {
+        return NULL;
+    }
+    
+    return manifest->tables[table].name;
+}
+
+/**
+ * @brief Find a table by name
+ *
+ * @param manifest The manifest
+ * @param name The table name
+ * @param table Receives the table index
+ * @return RETLDB_OK or RETLDB_ERROR_NOT_FOUND
+ */
+retldb_error_t manifest_find_table(const manifest_t* manifest, const char* name, size_t* table) {
+    if (!manifest || !name || !table) {
+        return RETLDB_ERROR_INVALID_ARGUMENT;
+    }
+    
+    for (size_t t = 0; t < manifest->table_count; t++) {
+        if (strcmp(manifest->tables[t].name, name) == 0) {
+            *table = t;
+            return RETLDB_OK;
+        }
+    }
+    
+    return RETLDB_ERROR_NOT_FOUND;
+}
+
+/**
+ * @brief Get the columns of a table
+ *
+ * @param manifest The manifest
+ * @param table Table index
+ * @param count Receives the number of columns
+ * @return The columns, NULL if the index is out of range
+ */
+const retldb_column_def_t* manifest_table_columns(const manifest_t* manifest, size_t table,
+                                                  size_t* count) {
+    if (!manifest || table >= manifest->table_count || !count) {
+        return NULL;
+    }
+    
+    *count = manifest->tables[table].column_count;
+    return manifest->tables[table].columns;
+}
+
+/**
+ * @brief Get the number of partitions of a table
+ *
+ * @param manifest The manifest
+ * @param table Table index
+ * @return Number of partitions, 0 if the index is out of range
+ */
+size_t manifest_partition_count(const manifest_t* manifest, size_t table) {
+    if (!manifest || table >= manifest->table_count) {
+        return 0;
+    }
+    
+    return manifest->tables[table].partition_count;
+}
+
+/**
+ * @brief Get the name of a partition
+ *
+ * @param manifest The manifest
+ * @param table Table index
+ * @param partition Partition index
+ * @return The name, NULL if an index is out of range
+ */
+const char* manifest_partition_name(const manifest_t* manifest, size_t table, size_t partition) {
+    if (partition >= manifest_partition_count(manifest, table)) {
+        return NULL;
+    }
+    
+    return manifest->tables[table].partitions[partition].name;
+}
+
+/**
+ * @brief Find a partition by name
+ *
+ * @param manifest The manifest
+ * @param table Table index
+ * @param name The partition name
+ * @param partition Receives the partition index
+ * @return RETLDB_OK or RETLDB_ERROR_NOT_FOUND
+ */
+retldb_error_t manifest_find_partition(const manifest_t* manifest, size_t table,
+                                       const char* name, size_t* partition) {
+    if (!manifest || !name || !partition) {
+        return RETLDB_ERROR_INVALID_ARGUMENT;
+    }
+    
+    size_t count = manifest_partition_count(manifest, table);
+    for (size_t p = 0; p < count; p++) {
+        if (strcmp(manifest->tables[table].partitions[p].name, name) == 0) {
+            *partition = p;
+            return RETLDB_OK;
+        }
+    }
+    
+    return RETLDB_ERROR_NOT_FOUND;
+}
+
+/**
+ * @brief Get the number of segments in a partition
+ *
+ * @param manifest The manifest
+ * @param table Table index
+ * @param partition Partition index
+ * @return Number of segments, 0 if an index is out of range
+ */
+size_t manifest_segment_count(const manifest_t* manifest, size_t table, size_t partition) {
+    if (partition >= manifest_partition_count(manifest, table)) {
+        return 0;
+    }
+    
+    return manifest->tables[table].partitions[partition].segment_count;
+}
+
+/**
+ * @brief Describe a segment
+ *
+ * @param manifest The manifest
+ * @param table Table index
+ * @param partition Partition index
+ * @param segment Segment index
+ * @param info Filled with the segment; its file name lives as long as the manifest
+ * @return RETLDB_OK, RETLDB_ERROR_NOT_FOUND for an index out of range,
+ *         or RETLDB_ERROR_CORRUPT_DATA for a bad record
+ */
+retldb_error_t manifest_segment(const manifest_t* manifest, size_t table, size_t partition,
+                                size_t segment, retldb_segment_info_t* info) {
+    if (!info) {
+        return RETLDB_ERROR_INVALID_ARGUMENT;
+    }
+    if (segment >= manifest_segment_count(manifest, table, partition)) {
+        return RETLDB_ERROR_NOT_FOUND;
+    }
+    
+    const manifest_partition_t* entry = &manifest->tables[table].partitions[partition];
+    if (!entry->records) {
+        *info = entry->segments[segment];
+        return RETLDB_OK;
+    }
+    
+    // Mapped records are checked when first read rather than at load
+    const manifest_segment_rec_t* rec = &entry->records[segment];
+    info->filename = mapped_name(manifest, rec->name);
+    info->id = rec->id;
+    info->rows = rec->rows;
+    info->bytes = rec->bytes;
+    return info->filename ? RETLDB_OK : RETLDB_ERROR_CORRUPT_DATA;
+}
+
+/**
+ * @brief Add a table
+ *
+ * @param manifest The manifest
+ * @param name The table name
+ * @param columns The columns
+ * @param num_columns Number of columns (at least one)
+ * @return retldb_error_t Error code
+ */
+retldb_error_t manifest_add_table(manifest_t* manifest, const char* name,
+                                  const retldb_column_def_t* columns, size_t num_columns) {
+    if (!manifest || !name || !*name || !columns || num_columns == 0) {
+        return RETLDB_ERROR_INVALID_ARGUMENT;
+    }
+    
+    for (size_t c = 0; c < num_columns; c++) {
+        if (!columns[c].name || !*columns[c].name ||
+            (int)columns[c].type < 0 || columns[c].type > RETLDB_TYPE_STRUCT) {
+            return RETLDB_ERROR_INVALID_ARGUMENT;
+        }
+        for (size_t other = 0; other < c; other++) {
+            if (strcmp(columns[other].name, columns[c].name) == 0) {
+                return RETLDB_ERROR_INVALID_ARGUMENT;
+            }
+        }
+    }
+    
+    size_t existing;
+    if (manifest_find_table(manifest, name, &existing) == RETLDB_OK) {
+        return RETLDB_ERROR_ALREADY_EXISTS;
+    }
+    
+    if (grow((void**)&manifest->tables, &manifest->table_capacity, manifest->table_count,
+             sizeof(manifest_table_t)) != 0) {
+        return RETLDB_ERROR_OUT_OF_MEMORY;
+    }
+    
+    manifest_table_t table;
+    memset(&table, 0, sizeof(table));
+    table.name = own_name(manifest, name);
+    table.columns = (retldb_column_def_t*)malloc(num_columns * sizeof(retldb_column_def_t));
+    if (!table.name || !table.columns) {
+        free(table.columns);
+        return RETLDB_ERROR_OUT_OF_MEMORY;
+    }
+    
+    for (size_t c = 0; c < num_columns; c++) {
+        table.columns[c] = columns[c];
+        table.columns[c].nullable = columns[c].nullable != 0;
+        table.columns[c].name = own_name(manifest, columns[c].name);
+        if (!table.columns[c].name) {
+            free(table.columns);
+            return RETLDB_ERROR_OUT_OF_MEMORY;
+        }
+    }
+    table.column_count = num_columns;
+    
+    manifest->tables[manifest->table_count++] = table;
+    return RETLDB_OK;
+}
+
+/**
+ * @brief Move a partition's segments from the mapping onto the heap
+ *
+ * @param manifest The manifest
+ * @param partition The partition
+ * @return retldb_error_t Error code
+ */
+static retldb_error_t thaw_partition(const manifest_t* manifest, manifest_partition_t* partition) {
+    if (!partition->records) {
+        return RETLDB_OK;
+    }
+    
+    size_t count = partition->segment_count;
+    retldb_segment_info_t* segments = NULL;
+    if (count > 0) {
+        segments = (retldb_segment_info_t*)malloc(count * sizeof(retldb_segment_info_t));
+        if (!segments) {
+            return RETLDB_ERROR_OUT_OF_MEMORY;
+        }
+    }
+    
+    for (size_t s = 0; s < count; s++) {
+        const manifest_segment_rec_t* rec = &partition->records[s];
+        segments[s].filename = mapped_name(manifest, rec->name);
+        segments[s].id = rec->id;
+        segments[s].rows = rec->rows;
+        segments[s].bytes = rec->bytes;
+        if (!segments[s].filename) {
+            free(segments);
+            return RETLDB_ERROR_CORRUPT_DATA;
+        }
+    }
+    
+    partition->records = NULL;
+    partition->segments = segments;
+    partition->segment_capacity = count;
+    return RETLDB_OK;
+}
+
+/**
+ * @brief Add a segment file to a partition, creating the partition if needed
+ *
+ * @param manifest The manifest
+ * @param table Table index
+ * @param partition The partition name
+ * @param filename The segment file, relative to the database directory
+ * @param rows Number of rows in the segment
+ * @param bytes Size of the segment file
+ * @param id Receives the segment's id, unique within the database (may be NULL)
+ * @return retldb_error_t Error code
+ */
+retldb_error_t manifest_add_segment(manifest_t* manifest, size_t table, const char* partition,
+                                    const char* filename, uint64_t rows, uint64_t bytes,
+                                    uint64_t* id) {
+    if (!manifest || table >= manifest->table_count || !partition || !*partition ||
+        !filename || !*filename) {
+        return RETLDB_ERROR_INVALID_ARGUMENT;
+    }
+    
+    manifest_table_t* entry = &manifest->tables[table];
+    size_t index;
+    if (manifest_find_partition(manifest, table, partition, &index) != RETLDB_OK) {
+        if (grow((void**)&entry->partitions, &entry->partition_capacity, entry->partition_count,
+                 sizeof(manifest_partition_t)) != 0) {
+            return RETLDB_ERROR_OUT_OF_MEMORY;
+        }
+        
+        manifest_partition_t created;
+        memset(&created, 0, sizeof(created));
+        created.name = own_name(manifest, partition);
+        if (!created.name) {
+            return RETLDB_ERROR_OUT_OF_MEMORY;
+        }
+        index = entry->partition_count;
+        entry->partitions[entry->partition_count++] = created;
+    }
+    
+    manifest_partition_t* target = &entry->partitions[index];
+    retldb_error_t result = thaw_partition(manifest, target);
+    if (result != RETLDB_OK) {
+        return result;
+    }
+    if (grow((void**)&target->segments, &target->segment_capacity, target->segment_count,
+             sizeof(retldb_segment_info_t)) != 0) {
+        return RETLDB_ERROR_OUT_OF_MEMORY;
+    }
+    
+    retldb_segment_info_t* segment = &target->segments[target->segment_count];
+    segment->filename = own_name(manifest, filename);
+    if (!segment->filename) {
+        return RETLDB_ERROR_OUT_OF_MEMORY;
+    }
+    segment->id = manifest->next_segment_id++;
+    segment->rows = rows;
+    segment->bytes = bytes;
+    target->segment_count++;
+    
+    if (id) {
+        *id = segment->id;
+    }
+    return RETLDB_OK;
+}
+
+/**
+ * @brief Remove a partition and its segments
+ *
+ * @param manifest The manifest
+ * @param table Table index
+ * @param partition Partition index
+ * @return retldb_error_t Error code
+ */
+retldb_error_t manifest_drop_partition(manifest_t* manifest, size_t table, size_t partition) {
+    if (partition >= manifest_partition_count(manifest, table)) {
+        return RETLDB_ERROR_NOT_FOUND;
+    }
+    
+    manifest_table_t* entry = &manifest->tables[table];
+    free(entry->partitions[partition].segments);
+    memmove(&entry->partitions[partition], &entry->partitions[partition + 1],
+            (entry->partition_count - partition - 1) * sizeof(manifest_partition_t));
+    entry->partition_count--;
+    return RETLDB_OK;
+}
@@ -0,0 +1,198 @@
+/**
+ * @file manifest.h
+ * @brief Internal database catalog for rETL DB
+ *
+ * The manifest lists a database's tables, their columns, their partitions
+ * and the segment files of each partition. It lives in a single versioned,
+ * checksummed file that is replaced atomically on every commit. Loading it
+ * maps the file once and verifies it; segment records are left in the
+ * mapping and read only when a partition is looked at, so opening a
+ * database costs the same whether it references ten segments or 100k.
+ */
+
+#ifndef RETLDB_MANIFEST_H
+#define RETLDB_MANIFEST_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "retldb.h"
+
+/**
+ * @brief Manifest handle
+ */
+typedef struct manifest manifest_t;
+
+/**
+ * @brief Create an empty manifest (generation 0, nothing saved yet)
+ *
+ * @return The manifest, NULL on failure
+ */
+manifest_t* manifest_create(void);
+
+/**
+ * @brief Load a manifest file
+ *
+ * @param filename The manifest file
+ * @param manifest Receives the manifest
+ * @return RETLDB_OK, RETLDB_ERROR_NOT_FOUND if the file does not exist,
+ *         RETLDB_ERROR_CORRUPT_DATA if it fails verification, or another error
+ */
+retldb_error_t manifest_load(const char* filename, manifest_t** manifest);
+
+/**
+ * @brief Write the manifest as the next generation, atomically replacing the file
+ *
+ * @param manifest The manifest
+ * @param filename The manifest file
+ * @return retldb_error_t Error code (the generation is unchanged on failure)
+ */
+retldb_error_t manifest_save(manifest_t* manifest, const char* filename);
+
+/**
+ * @brief Free a manifest
+ *
+ * @param manifest The manifest
+ */
+void manifest_free(manifest_t* manifest);
+
+/**
+ * @brief Get the generation of a manifest
+ *
+ * @param manifest The manifest
+ * @return Generation of the last load or save, 0 if never saved
+ */
+uint64_t manifest_generation(const manifest_t* manifest);
+
+/**
+ * @brief Get the number of tables
+ *
+ * @param manifest The manifest
+ * @return Number of tables
+ */
+size_t manifest_table_count(const manifest_t* manifest);
+
+/**
+ * @brief Get the name of a table
+ *
+ * @param manifest The manifest
+ * @param table Table index
+ * @return The name, NULL if the index is out of range
+ */
+const char* manifest_table_name(const manifest_t* manifest, size_t table);
+
+/**
+ * @brief Find a table by name
+ *
+ * @param manifest The manifest
+ * @param name The table name
+ * @param table Receives the table index
+ * @return RETLDB_OK or RETLDB_ERROR_NOT_FOUND
+ */
+retldb_error_t manifest_find_table(const manifest_t* manifest, const char* name, size_t* table);
+
+/**
+ * @brief Get the columns of a table
+ *
+ * @param manifest The manifest
+ * @param table Table index
+ * @param count Receives the number of columns
+ * @return The columns, NULL if the index is out of range
+ */
+const retldb_column_def_t* manifest_table_columns(const manifest_t* manifest, size_t table,
+                                                  size_t* count);
+
+/**
+ * @brief Get the number of partitions of a table
+ *
+ * @param manifest The manifest
+ * @param table Table index
+ * @return Number of partitions, 0 if the index is out of range
+ */
+size_t manifest_partition_count(const manifest_t* manifest, size_t table);
+
+/**
+ * @brief Get the name of a partition
+ *
+ * @param manifest The manifest
+ * @param table Table index
+ * @param partition Partition index
+ * @return The name, NULL if an index is out of range
+ */
+const char* manifest_partition_name(const manifest_t* manifest, size_t table, size_t partition);
+
+/**
+ * @brief Find a partition by name
+ *
+ * @param manifest The manifest
+ * @param table Table index
+ * @param name The partition name
+ * @param partition Receives the partition index
+ * @return RETLDB_OK or RETLDB_ERROR_NOT_FOUND
+ */
+retldb_error_t manifest_find_partition(const manifest_t* manifest, size_t table,
+                                       const char* name, size_t* partition);
+
+/**
+ * @brief Get the number of segments in a partition
+ *
+ * @param manifest The manifest
+ * @param table Table index
+ * @param partition Partition index
+ * @return Number of segments, 0 if an index is out of range
+ */
+size_t manifest_segment_count(const manifest_t* manifest, size_t table, size_t partition);
+
+/**
+ * @brief Describe a segment
+ *
+ * @param manifest The manifest
+ * @param table Table index
+ * @param partition Partition index
+ * @param segment Segment index
+ * @param info Filled with the segment; its file name lives as long as the manifest
+ * @return RETLDB_OK, RETLDB_ERROR_NOT_FOUND for an index out of range,
+ *         or RETLDB_ERROR_CORRUPT_DATA for a bad record
+ */
+retldb_error_t manifest_segment(const manifest_t* manifest, size_t table, size_t partition,
+                                size_t segment, retldb_segment_info_t* info);
+
+/**
+ * @brief Add a table
+ *
+ * @param manifest The manifest
+ * @param name The table name
+ * @param columns The columns
+ * @param num_columns Number of columns (at least one)
+ * @return retldb_error_t Error code
+ */
+retldb_error_t manifest_add_table(manifest_t* manifest, const char* name,
+                                  const retldb_column_def_t* columns, size_t num_columns);
+
+/**
+ * @brief Add a segment file to a partition, creating the partition if needed
+ *
+ * @param manifest The manifest
+ * @param table Table index
+ * @param partition The partition name
+ * @param filename The segment file, relative to the database directory
+ * @param rows Number of rows in the segment
+ * @param bytes Size of the segment file
+ * @param id Receives the segment's id, unique within the database (may be NULL)
+ * @return retldb_error_t Error code
+ */
+retldb_error_t manifest_add_segment(manifest_t* manifest, size_t table, const char* partition,
+                                    const char* filename, uint64_t rows, uint64_t bytes,
+                                    uint64_t* id);
+
+/**
+ * @brief Remove a partition and its segments
+ *
+ * @param manifest The manifest
+ * @param table Table index
+ * @param partition Partition index
+ * @return retldb_error_t Error code
+ */
+retldb_error_t manifest_drop_partition(manifest_t* manifest, size_t table, size_t partition);
+
+#endif /* RETLDB_MANIFEST_H */
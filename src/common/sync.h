@@ -0,0 +1,497 @@
+/**
+ * @file sync.h
+ * @brief Internal synchronization primitives for rETL DB
+ *
+ * Thin wrappers over pthreads (or SRW locks on Windows) so that storage
+ * modules can lock without sprinkling platform conditionals everywhere.
+ */
+
+#ifndef RETLDB_SYNC_H
+#define RETLDB_SYNC_H
+
+#include <stdint.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#endif
+
+/**
+ * @brief Storage class for per-thread variables
+ */
+#ifdef _MSC_VER
+#define RETLDB_THREAD_LOCAL __declspec(thread)
+#else
+#define RETLDB_THREAD_LOCAL __thread
+#endif
+
+/**
+ * @brief Mutual exclusion lock
+ */
+typedef struct {
+#ifdef _WIN32
+    SRWLOCK lock;            // Slim reader/writer lock used exclusively
+#else
+    pthread_mutex_t lock;    // POSIX mutex
+#endif
+} retldb_mutex_t;
+
+/**
+ * @brief Initialize a mutex
+ *
+ * @param mutex The mutex to initialize
+ * @return 0 on success, non-zero on failure
+ */
+static inline int retldb_mutex_init(retldb_mutex_t* mutex) {
+#ifdef _WIN32
+    InitializeSRWLock(&mutex->lock);
+    return 0;
+#else
+    return pthread_mutex_init(&mutex->lock, NULL);
+#endif
+}
+
+/**
+ * @brief Destroy a mutex
+ *
+ * @param mutex The mutex to destroy
+ */
+static inline void retldb_mutex_destroy(retldb_mutex_t* mutex) {
+#ifdef _WIN32
+    (void)mutex; // SRW locks need no cleanup
+#else
+    pthread_mutex_destroy(&mutex->lock);
+#endif
+}
+
+/**
+ * @brief Acquire a mutex
+ *
+ * @param mutex The mutex to lock
+ */
+static inline void retldb_mutex_lock(retldb_mutex_t* mutex) {
+#ifdef _WIN32
+    AcquireSRWLockExclusive(&mutex->lock);
+#else
+    pthread_mutex_lock(&mutex->lock);
+#endif
+}
+
+/**
+ * @brief Release a mutex
+ *
+ * @param mutex The mutex to unlock
+ */
+static inline void retldb_mutex_unlock(retldb_mutex_t* mutex) {
+#ifdef _WIN32
+    ReleaseSRWLockExclusive(&mutex->lock);
+#else
+    pthread_mutex_unlock(&mutex->lock);
+#endif
+}
+
+/**
+ * @brief Condition variable, always used with a retldb_mutex_t
+ */
+typedef struct {
+#ifdef _WIN32
+    CONDITION_VARIABLE cond;     // Win32 condition variable
+#else
+    pthread_cond_t cond;         // POSIX condition variable
+#endif
+} retldb_cond_t;
+
+/**
+ * @brief Initialize a condition variable
+ *
+ * @param cond The condition variable to initialize
+ * @return 0 on success, non-zero on failure
+ */
+static inline int retldb_cond_init(retldb_cond_t* cond) {
+#ifdef _WIN32
+    InitializeConditionVariable(&cond->cond);
+    return 0;
+#else
+    return pthread_cond_init(&cond->cond, NULL);
+#endif
+}
+
+/**
+ * @brief Destroy a condition variable
+ *
+ * @param cond The condition variable to destroy
+ */
+static inline void retldb_cond_destroy(retldb_cond_t* cond) {
+#ifdef _WIN32
+    (void)cond; // Condition variables need no cleanup
+#else
+    pthread_cond_destroy(&cond->cond);
+#endif
+}
+
+/**
+ * @brief Atomically release a mutex and wait to be woken
+ *
+ * Wake-ups may be spurious; callers re-check their condition in a loop.
+ *
+ * @param cond The condition variable to wait on
+ * @param mutex The mutex held by the caller, held again on return
+ */
+static inline void retldb_cond_wait(retldb_cond_t* cond, retldb_mutex_t* mutex) {
+#ifdef _WIN32
+    SleepConditionVariableSRW(&cond->cond, &mutex->lock, INFINITE, 0);
+#else
+    pthread_cond_wait(&cond->cond, &mutex->lock);
+#endif
+}
+
+/**
+ * @brief Wait to be woken, giving up after a timeout
+ *
+ * @param cond The condition variable to wait on
+ * @param mutex The mutex held by the caller, held again on return
+ * @param timeout_ms Longest time to wait in milliseconds
+ */
+static inline void retldb_cond_timedwait(retldb_cond_t* cond, retldb_mutex_t* mutex,
+                                         unsigned timeout_ms) {
+#ifdef _WIN32
+    SleepConditionVariableSRW(&cond->cond, &mutex->lock, timeout_ms, 0);
+#else
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += timeout_ms / 1000;
+    deadline.tv_nsec += (long)(timeout_ms % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+    pthread_cond_timedwait(&cond->cond, &mutex->lock, &deadline);
+#endif
+}
+
+/**
+ * @brief Wake one waiter
+ *
+ * @param cond The condition variable
+ */
+static inline void retldb_cond_signal(retldb_cond_t* cond) {
+#ifdef _WIN32
+    WakeConditionVariable(&cond->cond);
+#else
+    pthread_cond_signal(&cond->cond);
+#endif
+}
+
+/**
+ * @brief Wake every waiter
+ *
+ * @param cond The condition variable
+ */
+static inline void retldb_cond_broadcast(retldb_cond_t* cond) {
+#ifdef _WIN32
+    WakeAllConditionVariable(&cond->cond);
+#else
+    pthread_cond_broadcast(&cond->cond);
+#endif
+}
+
+/**
+ * @brief Thread entry point
+ */
+typedef void* (*retldb_thread_fn)(void* arg);
+
+/**
+ * @brief Thread handle
+ */
+typedef struct {
+#ifdef _WIN32
+    HANDLE handle;               // Win32 thread handle
+#else
+    pthread_t thread;            // POSIX thread
+#endif
+} retldb_thread_t;
+
+#ifdef _WIN32
+/**
+ * @brief Start routine and argument handed to a new Win32 thread
+ */
+typedef struct {
+    retldb_thread_fn fn;         // Entry point
+    void* arg;                   // Argument for the entry point
+} retldb_thread_start_t;
+
+/**
+ * @brief Run a retldb_thread_fn on a Win32 thread
+ */
+static inline DWORD WINAPI retldb_thread_trampoline(LPVOID param) {
+    retldb_thread_start_t start = *(retldb_thread_start_t*)param;
+    HeapFree(GetProcessHeap(), 0, param);
+    start.fn(start.arg);
+    return 0;
+}
+#endif
+
+/**
+ * @brief Start a thread
+ *
+ * @param thread The handle to fill
+ * @param fn The entry point
+ * @param arg Argument passed to the entry point
+ * @return 0 on success, non-zero on failure
+ */
+static inline int retldb_thread_create(retldb_thread_t* thread, retldb_thread_fn fn, void* arg) {
+#ifdef _WIN32
+    retldb_thread_start_t* start = (retldb_thread_start_t*)HeapAlloc(GetProcessHeap(), 0,
+                                                                     sizeof(*start));
+    if (!start) {
+        return -1;
+    }
+    start->fn = fn;
+    start->arg = arg;
+    thread->handle = CreateThread(NULL, 0, retldb_thread_trampoline, start, 0, NULL);
+    if (!thread->handle) {
+        HeapFree(GetProcessHeap(), 0, start);
+        return -1;
+    }
+    return 0;
+#else
+    return pthread_create(&thread->thread, NULL, fn, arg);
+#endif
+}
+
+/**
+ * @brief Wait for a thread to exit
+ *
+ * @param thread The thread to join
+ */
+static inline void retldb_thread_join(retldb_thread_t* thread) {
+#ifdef _WIN32
+    WaitForSingleObject(thread->handle, INFINITE);
+    CloseHandle(thread->handle);
+#else
+    pthread_join(thread->thread, NULL);
+#endif
+}
+
+/**
+ * @brief One-time initialization flag, set up with RETLDB_ONCE_INIT
+ */
+typedef struct {
+#ifdef _WIN32
+    INIT_ONCE once;              // Win32 one-time initialization state
+#else
+    pthread_once_t once;         // POSIX once control
+#endif
+} retldb_once_t;
+
+#ifdef _WIN32
+#define RETLDB_ONCE_INIT { INIT_ONCE_STATIC_INIT }
+#else
+#define RETLDB_ONCE_INIT { PTHREAD_ONCE_INIT }
+#endif
+
+/**
+ * @brief One-time initialization routine
+ */
+typedef void (*retldb_once_fn)(void);
+
+#ifdef _WIN32
+/**
+ * @brief Initialization routine handed to InitOnceExecuteOnce
+ */
+typedef struct {
+    retldb_once_fn fn;           // Routine to run
+} retldb_once_call_t;
+
+/**
+ * @brief Run a retldb_once_fn from InitOnceExecuteOnce
+ */
+static inline BOOL CALLBACK retldb_once_trampoline(PINIT_ONCE once, PVOID param, PVOID* context) {
+    (void)once;
+    (void)context;
+    ((retldb_once_call_t*)param)->fn();
+    return TRUE;
+}
+#endif
+
+/**
+ * @brief Run a routine exactly once, however many threads get here
+ *
+ * Callers return only after the routine has finished.
+ *
+ * @param once The flag, initialized with RETLDB_ONCE_INIT
+ * @param fn The routine
+ */
+static inline void retldb_once(retldb_once_t* once, retldb_once_fn fn) {
+#ifdef _WIN32
+    retldb_once_call_t call = { fn };
+    InitOnceExecuteOnce(&once->once, retldb_once_trampoline, &call, NULL);
+#else
+    pthread_once(&once->once, fn);
+#endif
+}
+
+/**
+ * @brief Load a pointer with acquire semantics
+ *
+ * @param ptr Address of the pointer to load
+ * @return The loaded pointer
+ */
+static inline void* retldb_atomic_load_ptr(void* const* ptr) {
+#ifdef _MSC_VER
+    void* value = *(void* const volatile*)ptr;
+    MemoryBarrier();
+    return value;
+#else
+    return __atomic_load_n(ptr, __ATOMIC_ACQUIRE);
+#endif
+}
+
+/**
+ * @brief Store a pointer with release semantics
+ *
+ * @param ptr Address of the pointer to store to
+ * @param value The value to publish
+ */
+static inline void retldb_atomic_store_ptr(void** ptr, void* value) {
+#ifdef _MSC_VER
+    MemoryBarrier();
+    *(void* volatile*)ptr = value;
+#else
+    __atomic_store_n(ptr, value, __ATOMIC_RELEASE);
+#endif
+}
+
+/**
+ * @brief Load an int with acquire semantics
+ *
+ * @param ptr Address of the int to load
+ * @return The loaded value
+ */
+static inline int retldb_atomic_load_int(const int* ptr) {
+#ifdef _MSC_VER
+    int value = *(const volatile int*)ptr;
+    MemoryBarrier();
+    return value;
+#else
+    return __atomic_load_n(ptr, __ATOMIC_ACQUIRE);
+#endif
+}
+
+/**
+ * @brief Store an int with release semantics
+ *
+ * @param ptr Address of the int to store to
+ * @param value The value to publish
+ */
+static inline void retldb_atomic_store_int(int* ptr, int value) {
+#ifdef _MSC_VER
+    MemoryBarrier();
+    *(volatile int*)ptr = value;
+#else
+    __atomic_store_n(ptr, value, __ATOMIC_RELEASE);
+#endif
+}
+
+/**
+ * @brief Atomically add to an int
+ *
+ * @param ptr Address of the int
+ * @param delta Value to add
+ * @return The value before the addition
+ */
+static inline int retldb_atomic_fetch_add_int(int* ptr, int delta) {
+#ifdef _MSC_VER
+    return (int)InterlockedExchangeAdd((volatile LONG*)ptr, (LONG)delta);
+#else
+    return __atomic_fetch_add(ptr, delta, __ATOMIC_SEQ_CST);
+#endif
+}
+
+/**
+ * @brief Load a 64-bit value with acquire semantics
+ *
+ * @param ptr Address of the value to load
+ * @return The loaded value
+ */
+static inline uint64_t retldb_atomic_load_u64(const uint64_t* ptr) {
+#ifdef _MSC_VER
+    return (uint64_t)InterlockedCompareExchange64((volatile LONG64*)ptr, 0, 0);
+#else
+    return __atomic_load_n(ptr, __ATOMIC_ACQUIRE);
+#endif
+}
+
+/**
+ * @brief Store a 64-bit value with release semantics
+ *
+ * @param ptr Address of the value to store to
+ * @param value The value to publish
+ */
+static inline void retldb_atomic_store_u64(uint64_t* ptr, uint64_t value) {
+#ifdef _MSC_VER
+    InterlockedExchange64((volatile LONG64*)ptr, (LONG64)value);
+#else
+    __atomic_store_n(ptr, value, __ATOMIC_RELEASE);
+#endif
+}
+
+/**
+ * @brief Atomically add to a 64-bit value
+ *
+ * @param ptr Address of the value
+ * @param delta Value to add
+ * @return The value before the addition
+ */
+static inline uint64_t retldb_atomic_fetch_add_u64(uint64_t* ptr, uint64_t delta) {
+#ifdef _MSC_VER
+    return (uint64_t)InterlockedExchangeAdd64((volatile LONG64*)ptr, (LONG64)delta);
+#else
+    return __atomic_fetch_add(ptr, delta, __ATOMIC_SEQ_CST);
+#endif
+}
+
+/**
+ * @brief Atomically replace a 64-bit value if it matches an expected value
+ *
+ * @param ptr Address of the value
+ * @param expected The value the caller believes is current
+ * @param desired The replacement value
+ * @return Non-zero if the value was replaced
+ */
+static inline int retldb_atomic_cas_u64(uint64_t* ptr, uint64_t expected, uint64_t desired) {
+#ifdef _MSC_VER
+    return (uint64_t)InterlockedCompareExchange64((volatile LONG64*)ptr, (LONG64)desired,
+                                                  (LONG64)expected) == expected;
+#else
+    return __atomic_compare_exchange_n(ptr, &expected, desired, 0,
+                                       __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+#endif
+}
+
+/**
+ * @brief Full memory fence
+ */
+static inline void retldb_atomic_fence(void) {
+#ifdef _MSC_VER
+    MemoryBarrier();
+#else
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+#endif
+}
+
+/**
+ * @brief Yield the processor to another thread
+ */
+static inline void retldb_thread_yield(void) {
+#ifdef _WIN32
+    SwitchToThread();
+#else
+    sched_yield();
+#endif
+}
+
+#endif /* RETLDB_SYNC_H */
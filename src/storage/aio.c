@@ -0,0 +1,494 @@
+/**
+ * @file aio.c
+ * @brief Implementation of the asynchronous read engine for rETL DB
+ */
+
+/* Define _DEFAULT_SOURCE to make syscall available on glibc */
+#define _DEFAULT_SOURCE
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+#ifdef RETLDB_HAVE_IO_URING
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#if !defined(__NR_io_uring_setup) || !defined(__NR_io_uring_enter)
+#undef RETLDB_HAVE_IO_URING      // Headers present but no system call numbers
+#endif
+#endif
+
+#include "retldb/storage.h"
+#include "storage/aio.h"
+#include "common/sync.h"
+
+#define AIO_WORKERS 4                   // Threads issuing reads without io_uring
+#define AIO_SUBMIT_RETRIES 16           // Submission attempts while the kernel is out of resources
+
+/**
+ * @brief Queued read
+ */
+typedef struct aio_request {
+    void* file;                  // File handle to read from
+    void* buf;                   // Destination buffer
+    size_t len;                  // Number of bytes to read
+    uint64_t offset;             // Offset in the file
+    aio_callback_t callback;     // Completion callback
+    void* arg;                   // Argument for the callback
+#ifdef RETLDB_HAVE_IO_URING
+    struct iovec iov;            // Single-segment vector for IORING_OP_READV
+#endif
+    struct aio_request* next;    // Next queued read (thread pool only)
+} aio_request_t;
+
+/**
+ * @brief Read engine structure
+ */
+struct aio_engine {
+    retldb_mutex_t lock;         // Protects everything below except the rings
+    retldb_cond_t space;         // Signalled when a read completes
+    retldb_cond_t work;          // Signalled when a read is queued (thread pool)
+    unsigned depth;              // Maximum reads in flight
+    unsigned inflight;           // Reads queued or submitted, not yet completed
+    int closing;                 // Set once destruction has begun
+    aio_request_t* head;         // Oldest queued read (thread pool)
+    aio_request_t* tail;         // Newest queued read (thread pool)
+    retldb_thread_t threads[AIO_WORKERS]; // Workers, or the io_uring reaper
+    unsigned thread_count;       // Number of threads started
+#ifdef RETLDB_HAVE_IO_URING
+    int ring_fd;                 // io_uring instance, -1 when using threads
+    void* sq_ring;               // Submission ring mapping
+    size_t sq_ring_size;         // Size of the submission ring mapping
+    void* cq_ring;               // Completion ring mapping (may alias sq_ring)
+    size_t cq_ring_size;         // Size of the completion ring mapping
+    struct io_uring_sqe* sqes;   // Submission queue entries
+    size_t sqes_size;            // Size of the entry mapping
+    unsigned* sq_head;           // Kernel-owned submission head
+    unsigned* sq_tail;           // Submission tail, advanced under lock
+    unsigned* sq_mask;           // Submission ring mask
+    unsigned* sq_array;          // Submission index array
+    unsigned* cq_head;           // Completion head, advanced by the reaper
+    unsigned* cq_tail;           // Kernel-owned completion tail
+    unsigned* cq_mask;           // Completion ring mask
+    struct io_uring_cqe* cqes;   // Completion queue entries
+#endif
+};
+
+/**
+ * @brief Deliver a completion and retire the request
+ *
+ * @param engine The engine
+ * @param req The completed request
+ * @param result Bytes read, -1 on failure
+ */
+static void complete(aio_engine_t* engine, aio_request_t* req, long long result) {
+    req->callback(req->arg, result);
+    free(req);
+    
+    retldb_mutex_lock(&engine->lock);
+    engine->inflight--;
+    retldb_cond_broadcast(&engine->space);
+    retldb_mutex_unlock(&engine->lock);
+}
+
+/**
+ * @brief Thread pool worker: issue queued reads until the engine closes
+ *
+ * @param arg The engine
+ * @return NULL
+ */
+static void* worker_main(void* arg) {
+    aio_engine_t* engine = (aio_engine_t*)arg;
+    
+    retldb_mutex_lock(&engine->lock);
+    for (;;) {
+        while (!engine->head && !engine->closing) {
+            retldb_cond_wait(&engine->work, &engine->lock);
+        }
+        
+        aio_request_t* req = engine->head;
+        if (!req) {
+            break; // Closing with nothing left to do
+        }
+        engine->head = req->next;
+        if (!engine->head) {
+            engine->tail = NULL;
+        }
+        retldb_mutex_unlock(&engine->lock);
+        
+        complete(engine, req, file_pread(req->file, req->buf, req->len, req->offset));
+        
+        retldb_mutex_lock(&engine->lock);
+    }
+    retldb_mutex_unlock(&engine->lock);
+    
+    return NULL;
+}
+
+#ifdef RETLDB_HAVE_IO_URING
+/**
+ * @brief Invoke io_uring_enter, retrying when interrupted
+ *
+ * @param fd The io_uring instance
+ * @param to_submit Number of entries to submit
+ * @param min_complete Number of completions to wait for
+ * @param flags IORING_ENTER_* flags
+ * @return Number of entries submitted, -1 on failure
+ */
+static int ring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+    long result;
+    do {
+        result = syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+    } while (result == -1 && errno == EINTR);
+    return (int)result;
+}
+
+/**
+ * @brief Set up an io_uring instance and map its rings
+ *
+ * @param engine The engine to attach the ring to
+ * @param entries Requested submission queue size
+ * @return 0 on success, non-zero if io_uring is unavailable
+ */
+static int ring_setup(aio_engine_t* engine, unsigned entries) {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    
+    int fd = (int)syscall(__NR_io_uring_setup, entries, &params);
+    if (fd < 0) {
+        return -1; // Old kernel, or io_uring disabled by policy
+    }
+    
+    engine->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    engine->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    int single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single_mmap) {
+        if (engine->cq_ring_size > engine->sq_ring_size) {
+            engine->sq_ring_size = engine->cq_ring_size;
+        }
+        engine->cq_ring_size = engine->sq_ring_size;
+    }
+    engine->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    
+    engine->sq_ring = mmap(NULL, engine->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                           fd, IORING_OFF_SQ_RING);
+    engine->cq_ring = single_mmap ? engine->sq_ring :
+                      mmap(NULL, engine->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                           fd, IORING_OFF_CQ_RING);
+    engine->sqes = (struct io_uring_sqe*)mmap(NULL, engine->sqes_size, PROT_READ | PROT_WRITE,
+                                              MAP_SHARED, fd, IORING_OFF_SQES);
+    if (engine->sq_ring == MAP_FAILED || engine->cq_ring == MAP_FAILED ||
+        engine->sqes == (struct io_uring_sqe*)MAP_FAILED) {
+        if (engine->sqes != (struct io_uring_sqe*)MAP_FAILED) {
+            munmap(engine->sqes, engine->sqes_size);
+        }
+        if (!single_mmap && engine->cq_ring != MAP_FAILED) {
+            munmap(engine->cq_ring, engine->cq_ring_size);
+        }
+        if (engine->sq_ring != MAP_FAILED) {
+            munmap(engine->sq_ring, engine->sq_ring_size);
+        }
+        close(fd);
+        return -1;
+    }
+    
+    char* sq = (char*)engine->sq_ring;
+    char* cq = (char*)engine->cq_ring;
+    engine->sq_head = (unsigned*)(sq + params.sq_off.head);
+    engine->sq_tail = (unsigned*)(sq + params.sq_off.tail);
+    engine->sq_mask = (unsigned*)(sq + params.sq_off.ring_mask);
+    engine->sq_array = (unsigned*)(sq + params.sq_off.array);
+    engine->cq_head = (unsigned*)(cq + params.cq_off.head);
+    engine->cq_tail = (unsigned*)(cq + params.cq_off.tail);
+    engine->cq_mask = (unsigned*)(cq + params.cq_off.ring_mask);
+    engine->cqes = (struct io_uring_cqe*)(cq + params.cq_off.cqes);
+    engine->ring_fd = fd;
+    
+    // Never queue more reads than the rings can hold
+    if (engine->depth > params.sq_entries) {
+        engine->depth = params.sq_entries;
+    }
+    
+    return 0;
+}
+
+/**
+ * @brief Unmap and close an io_uring instance
+ *
+ * @param engine The engine owning the ring
+ */
+static void ring_teardown(aio_engine_t* engine) {
+    munmap(engine->sqes, engine->sqes_size);
+    if (engine->cq_ring != engine->sq_ring) {
+        munmap(engine->cq_ring, engine->cq_ring_size);
+    }
+    munmap(engine->sq_ring, engine->sq_ring_size);
+    close(engine->ring_fd);
+}
+
+/**
+ * @brief Place one entry on the submission ring and submit it
+ *
+ * The caller must hold the engine lock, which serializes producers. While
+ * the kernel is out of resources the submission is retried up to
+ * AIO_SUBMIT_RETRIES times; after that the entry is withdrawn and the
+ * caller reads some other way.
+ *
+ * @param engine The engine
+ * @param opcode IORING_OP_READV or IORING_OP_NOP
+ * @param req The request, NULL for the shutdown marker
+ * @return 0 on success, non-zero on failure
+ */
+static int ring_submit(aio_engine_t* engine, int opcode, aio_request_t* req) {
+    unsigned tail = *engine->sq_tail;
+    unsigned index = tail & *engine->sq_mask;
+    struct io_uring_sqe* sqe = &engine->sqes[index];
+    
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = (uint8_t)opcode;
+    sqe->fd = -1;
+    if (req) {
+        req->iov.iov_base = req->buf;
+        req->iov.iov_len = req->len;
+        sqe->fd = file_descriptor(req->file);
+        sqe->addr = (uint64_t)(uintptr_t)&req->iov;
+        sqe->len = 1;
+        sqe->off = req->offset;
+    }
+    sqe->user_data = (uint64_t)(uintptr_t)req;
+    
+    engine->sq_array[index] = index;
+    __atomic_store_n(engine->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    
+    for (unsigned attempt = 0; attempt < AIO_SUBMIT_RETRIES; attempt++) {
+        int submitted = ring_enter(engine->ring_fd, 1, 0, 0);
+        if (submitted == 1) {
+            return 0;
+        }
+        if (submitted == -1 && errno != EAGAIN && errno != EBUSY) {
+            break;
+        }
+        retldb_thread_yield(); // Out of kernel resources; let completions drain
+    }
+    
+    // The kernel took nothing, so the entry can be withdrawn
+    __atomic_store_n(engine->sq_tail, tail, __ATOMIC_RELEASE);
+    return -1;
+}
+
+/**
+ * @brief io_uring reaper: deliver completions until the shutdown marker
+ *
+ * @param arg The engine
+ * @return NULL
+ */
+static void* reaper_main(void* arg) {
+    aio_engine_t* engine = (aio_engine_t*)arg;
+    
+    for (;;) {
+        unsigned head = *engine->cq_head;
+        if (head == __atomic_load_n(engine->cq_tail, __ATOMIC_ACQUIRE)) {
+            ring_enter(engine->ring_fd, 0, 1, IORING_ENTER_GETEVENTS);
+            continue;
+        }
+        
+        // The kernel orders the submitter's writes to the request (and the
+        // buffer it describes) before the completion becomes visible here
+        struct io_uring_cqe* cqe = &engine->cqes[head & *engine->cq_mask];
+        aio_request_t* req = (aio_request_t*)(uintptr_t)cqe->user_data;
+        int res = cqe->res;
+        __atomic_store_n(engine->cq_head, head + 1, __ATOMIC_RELEASE);
+        
+        if (!req) {
+            break; // Shutdown marker
+        }
+        complete(engine, req, res < 0 ? -1 : (long long)res);
+    }
+    
+    return NULL;
+}
+#endif
+
+/**
+ * @brief Create a read engine
+ *
+ * @param depth Maximum number of reads in flight
+ * @param backend The backend to use
+ * @return New engine, NULL on failure
+ */
+aio_engine_t* aio_create(unsigned depth, aio_backend_t backend) {
+    if (depth == 0) {
+        return NULL;
+    }
+    
+    aio_engine_t* engine = (aio_engine_t*)calloc(1, sizeof(aio_engine_t));
+    if (!engine) {
+        return NULL;
+    }
+    engine->depth = depth;
+    
+    if (retldb_mutex_init(&engine->lock) != 0) {
+        free(engine);
+        return NULL;
+    }
+    if (retldb_cond_init(&engine->space) != 0) {
+        retldb_mutex_destroy(&engine->lock);
+        free(engine);
+        return NULL;
+    }
+    if (retldb_cond_init(&engine->work) != 0) {
+        retldb_cond_destroy(&engine->space);
+        retldb_mutex_destroy(&engine->lock);
+        free(engine);
+        return NULL;
+    }
+    
+#ifdef RETLDB_HAVE_IO_URING
+    engine->ring_fd = -1;
+    if (backend == AIO_BACKEND_AUTO && ring_setup(engine, depth) == 0) {
+        if (retldb_thread_create(&engine->threads[0], reaper_main, engine) == 0) {
+            engine->thread_count = 1;
+            return engine;
+        }
+        ring_teardown(engine);
+        engine->ring_fd = -1;
+        engine->depth = depth;
+    }
+#else
+    (void)backend;
+#endif
+    
+    for (unsigned i = 0; i < AIO_WORKERS; i++) {
+        if (retldb_thread_create(&engine->threads[i], worker_main, engine) != 0) {
+            break;
+        }
+        engine->thread_count++;
+    }
+    
+    if (engine->thread_count == 0) {
+        retldb_cond_destroy(&engine->work);
+        retldb_cond_destroy(&engine->space);
+        retldb_mutex_destroy(&engine->lock);
+        free(engine);
+        return NULL;
+    }
+    
+    return engine;
+}
+
+/**
+ * @brief Wait for all reads in flight, then destroy the engine
+ *
+ * @param engine The engine to destroy
+ */
+void aio_destroy(aio_engine_t* engine) {
+    if (!engine) {
+        return;
+    }
+    
+    retldb_mutex_lock(&engine->lock);
+    while (engine->inflight > 0) {
+        retldb_cond_wait(&engine->space, &engine->lock);
+    }
+    engine->closing = 1;
+    
+#ifdef RETLDB_HAVE_IO_URING
+    if (engine->ring_fd != -1) {
+        // The reaper sleeps in the kernel; a no-op completion wakes it
+        while (ring_submit(engine, IORING_OP_NOP, NULL) != 0) {
+            retldb_thread_yield();
+        }
+    }
+#endif
+    retldb_cond_broadcast(&engine->work);
+    retldb_mutex_unlock(&engine->lock);
+    
+    for (unsigned i = 0; i < engine->thread_count; i++) {
+        retldb_thread_join(&engine->threads[i]);
+    }
+    
+#ifdef RETLDB_HAVE_IO_URING
+    if (engine->ring_fd != -1) {
+        ring_teardown(engine);
+    }
+#endif
+    
+    retldb_cond_destroy(&engine->work);
+    retldb_cond_destroy(&engine->space);
+    retldb_mutex_destroy(&engine->lock);
+    free(engine);
+}
+
+/**
+ * @brief Queue a positioned read
+ *
+ * @param engine The engine
+ * @param file The file handle to read from
+ * @param buf Destination buffer
+ * @param len Number of bytes to read
+ * @param offset Offset in the file
+ * @param callback Completion callback
+ * @param arg Argument for the callback
+ * @return 0 if the read was queued, non-zero on failure
+ */
+int aio_read(aio_engine_t* engine, void* file, void* buf, size_t len, uint64_t offset,
+             aio_callback_t callback, void* arg) {
+    if (!engine || !file || !buf || !callback) {
+        return -1;
+    }
+    
+    aio_request_t* req = (aio_request_t*)calloc(1, sizeof(aio_request_t));
+    if (!req) {
+        return -1;
+    }
+    req->file = file;
+    req->buf = buf;
+    req->len = len;
+    req->offset = offset;
+    req->callback = callback;
+    req->arg = arg;
+    
+    retldb_mutex_lock(&engine->lock);
+    
+    while (engine->inflight >= engine->depth && !engine->closing) {
+        retldb_cond_wait(&engine->space, &engine->lock);
+    }
+    if (engine->closing) {
+        retldb_mutex_unlock(&engine->lock);
+        free(req);
+        return -1;
+    }
+    
+#ifdef RETLDB_HAVE_IO_URING
+    if (engine->ring_fd != -1) {
+        if (ring_submit(engine, IORING_OP_READV, req) != 0) {
+            retldb_mutex_unlock(&engine->lock);
+            free(req);
+            return -1;
+        }
+        engine->inflight++;
+        retldb_mutex_unlock(&engine->lock);
+        return 0;
+    }
+#endif
+    
+    if (engine->tail) {
+        engine->tail->next = req;
+    } else {
+        engine->head = req;
+    }
+    engine->tail = req;
+    engine->inflight++;
+    retldb_cond_signal(&engine->work);
+    
+    retldb_mutex_unlock(&engine->lock);
+    return 0;
+}
+
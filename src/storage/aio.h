@@ -0,0 +1,73 @@
+/**
+ * @file aio.h
+ * @brief Internal asynchronous read engine for rETL DB
+ *
+ * Keeps many positioned reads in flight at once. On Linux the reads go
+ * through an io_uring instance driven by raw system calls; elsewhere, or
+ * where the kernel refuses io_uring, a small pool of threads issues
+ * blocking reads instead. Completions are delivered on an engine thread.
+ */
+
+#ifndef RETLDB_AIO_H
+#define RETLDB_AIO_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Read engine backends
+ */
+typedef enum {
+    AIO_BACKEND_AUTO = 0,        // io_uring where available, threads otherwise
+    AIO_BACKEND_THREADS          // Always use the thread pool
+} aio_backend_t;
+
+/**
+ * @brief Completion callback
+ *
+ * @param arg The argument passed to aio_read()
+ * @param result Bytes read (0 at end of file), -1 on failure
+ */
+typedef void (*aio_callback_t)(void* arg, long long result);
+
+/**
+ * @brief Asynchronous read engine (opaque)
+ */
+typedef struct aio_engine aio_engine_t;
+
+/**
+ * @brief Create a read engine
+ *
+ * @param depth Maximum number of reads in flight
+ * @param backend The backend to use
+ * @return New engine, NULL on failure
+ */
+aio_engine_t* aio_create(unsigned depth, aio_backend_t backend);
+
+/**
+ * @brief Wait for all reads in flight, then destroy the engine
+ *
+ * @param engine The engine to destroy
+ */
+void aio_destroy(aio_engine_t* engine);
+
+/**
+ * @brief Queue a positioned read
+ *
+ * Waits while the engine already has its maximum number of reads in flight.
+ * The callback runs exactly once, on an engine thread, unless queueing
+ * fails.
+ *
+ * @param engine The engine
+ * @param file The file handle (file_open_flags()) to read from
+ * @param buf Destination buffer (must stay valid until the callback runs)
+ * @param len Number of bytes to read
+ * @param offset Offset in the file
+ * @param callback Completion callback
+ * @param arg Argument for the callback
+ * @return 0 if the read was queued, non-zero on failure
+ */
+int aio_read(aio_engine_t* engine, void* file, void* buf, size_t len, uint64_t offset,
+             aio_callback_t callback, void* arg);
+
+#endif /* RETLDB_AIO_H */
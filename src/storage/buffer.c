@@ -5,291 +5,2712 @@
 
 /* Define _POSIX_C_SOURCE to make strdup available */
 #define _POSIX_C_SOURCE 200809L
+/* Define _DEFAULT_SOURCE to make MAP_ANONYMOUS and madvise available on glibc */
+#define _DEFAULT_SOURCE
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <time.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+
+#include "retldb/storage.h"
+#include "common/sync.h"
+#include "storage/aio.h"
+
+// Page table geometry
+#define BUFFER_MAX_SHARDS 16            // Upper bound on independently locked shards
+#define BUFFER_MIN_SHARD_CAPACITY 64    // Smallest pool share worth its own shard
+#define BUFFER_MIN_CLASS_FRAMES 8       // Largest-class pages an automatically sized shard holds
+#define BUFFER_FILE_BUCKETS 1024        // Buckets in the interned filename table
+#define BUFFER_CACHE_LINE 64            // Padding between shards to avoid false sharing
+
+// 2Q replacement
+#define BUFFER_2Q_A1IN_PERCENT 25       // Share of a shard kept for first-time pages
+#define BUFFER_2Q_A1OUT_PERCENT 50      // Ghost history size relative to the shard
+
+// Write-back
+#define BUFFER_MAX_IOV 256              // Most pages coalesced into one vectored write
+
+// Prefetch
+#define BUFFER_READAHEAD_TRIGGER 4      // Sequential accesses before read-ahead starts
+
+// Background cleaner
+#define BUFFER_CLEAN_BATCH 64           // Most pages the cleaner writes per pass
+#define BUFFER_CLEAN_SCAN_DEPTH 16      // Pages at the eviction end kept clean ahead of eviction
+#define BUFFER_CLEANER_INTERVAL_MS 100  // Idle cleaner polling interval
+
+// Frame arena
+#define BUFFER_FRAME_ALIGN 4096         // Alignment of page-sized frames (O_DIRECT safe)
+
+/**
+ * @brief Interned file entry
+ *
+ * Files are interned once and never removed until the pool is cleaned up, so
+ * lookups can walk the chains without taking the registry lock.
+ */
+typedef struct buffer_file {
+    char* name;                  // Filename
+    uint64_t hash;               // Hash of the filename
+    uint32_t id;                 // Interned file id
+    void* handle;                // File handle, NULL while the file does not exist
+    uint64_t ra_next;            // Page that would continue the current sequential run
+    uint64_t ra_end;             // First page past the read-ahead window
+    int ra_run;                  // Length of the current sequential run
+    int page_class;              // Size class of the file's pages
+    int accessed;                // Set once a page was requested; fixes page_class
+    struct buffer_file* next;    // Next file in the hash chain
+} buffer_file_t;
+
+struct buffer_shard;
+struct buffer_pool;
+
+/**
+ * @brief Replacement queues
+ *
+ * LRU uses only the hot queue. 2Q admits new pages to the probation FIFO
+ * (A1in) and only promotes pages to the hot LRU (Am) when they are
+ * referenced again after falling out of probation into the ghost history.
+ */
+enum {
+    BUFFER_QUEUE_HOT = 0,        // LRU list, or 2Q Am
+    BUFFER_QUEUE_PROBATION,      // 2Q A1in
+    BUFFER_QUEUE_COUNT
+};
+
+/**
+ * @brief Frame load states
+ */
+enum {
+    BUFFER_FRAME_READY = 0,      // Contents valid
+    BUFFER_FRAME_LOADING         // Being read in by the thread that pinned it
+};
+
+/**
+ * @brief Which pages may be evicted to free a frame
+ */
+typedef enum {
+    BUFFER_VICTIM_ANY = 0,       // Least recently used, writing it back if dirty
+    BUFFER_VICTIM_PREFER_CLEAN,  // A clean page near the eviction end if there is one
+    BUFFER_VICTIM_CLEAN          // Clean pages only
+} buffer_victim_t;
 
 /**
  * @brief Buffer pool entry structure
+ *
+ * Identity, queue links and the dirty flag are protected by the shard lock.
+ * The pin count, load state and latch words are atomics so that pinned
+ * holders can release and latch without touching the shard lock.
  */
 typedef struct buffer_entry {
     void* data;                  // Buffer data
     size_t size;                 // Buffer size
+    int pins;                    // Outstanding pins; pinned frames are never evicted
+    int state;                   // BUFFER_FRAME_* load state
+    int readers;                 // Holders of the shared latch
+    uint64_t version;            // Odd while exclusively latched; bumped on every change
     int dirty;                   // Whether the buffer is dirty
-    char* filename;              // Associated filename
+    unsigned dirty_seq;          // Bumped by every buffer_mark_dirty()
+    unsigned clean_seq;          // dirty_seq seen by the cleaner when it took the page
+    int queue;                   // Replacement queue holding the entry
+    int once;                    // Fetched for a single use; evict first
+    int page_class;              // Size class the frame belongs to
+    buffer_file_t* file;         // Associated file
     size_t offset;               // Offset in the file
-    struct buffer_entry* next;   // Next entry in LRU list
-    struct buffer_entry* prev;   // Previous entry in LRU list
+    uint64_t page_no;            // Page number (offset / buffer size)
+    struct buffer_shard* shard;  // Shard owning this entry
+    struct buffer_entry* hash_next; // Next entry in the page table bucket
+    struct buffer_entry* next;   // Next entry in the queue (towards the tail)
+    struct buffer_entry* prev;   // Previous entry in the queue (towards the head)
 } buffer_entry_t;
 
 /**
- * @brief Buffer pool structure
+ * @brief Dirty page picked for write-back outside the shard lock
+ */
+typedef struct {
+    buffer_entry_t* entry;       // The page, pinned while it is written
+    unsigned seq;                // Its dirty_seq when it was picked
+} buffer_writeback_t;
+
+/**
+ * @brief Replacement queue
+ */
+typedef struct {
+    buffer_entry_t* head;        // Most recently inserted or used
+    buffer_entry_t* tail;        // Next eviction candidate
+    size_t count;                // Number of entries in the queue
+} buffer_queue_t;
+
+/**
+ * @brief Ghost entry remembering a page recently evicted from probation
+ */
+typedef struct {
+    buffer_file_t* file;         // File of the page, NULL when retired
+    uint64_t page_no;            // Page number
+    size_t hash_next;            // Next ghost in the bucket, or the ghost capacity
+} buffer_ghost_t;
+
+/**
+ * @brief Page size class
+ *
+ * Each class has its own arena, with address space for the whole memory
+ * budget to be spent on it. The arenas reserve no memory: frames are backed
+ * as they are first used, and frames given up to another class are returned
+ * to the operating system, so the pool never holds more than the budget.
+ */
+typedef struct {
+    size_t size;                 // Page size of the class
+    size_t stride;               // Distance between consecutive frames
+    void* arena;                 // Frame memory
+    size_t arena_size;           // Size of the arena mapping
+    buffer_entry_t* frames;      // Descriptor for every frame
+    size_t frame_count;          // Number of frames
+} buffer_class_t;
+
+/**
+ * @brief Statistics counters kept by each shard
+ *
+ * Every update is an atomic add, so paths that run without the shard lock
+ * (reads, write-back, latency) count without taking it.
  */
 typedef struct {
-    buffer_entry_t* head;        // Head of LRU list (most recently used)
-    buffer_entry_t* tail;        // Tail of LRU list (least recently used)
-    size_t count;                // Number of buffers in the pool
-    size_t capacity;             // Maximum number of buffers
-    size_t buffer_size;          // Size of each buffer
+    uint64_t hits;               // Lookups served from the pool
+    uint64_t misses;             // Lookups that read the page
+    uint64_t errors;             // Misses that failed
+    uint64_t evictions;          // Pages evicted to free a frame
+    uint64_t dirty_writes;       // Dirty pages written back
+    uint64_t read_bytes;         // Bytes read from files
+    uint64_t write_bytes;        // Bytes written to files
+    uint64_t pin_waits;          // Lookups that waited on a frame held elsewhere
+    uint64_t miss_latency[BUFFER_LATENCY_BUCKETS]; // Miss service time, log2 microseconds
+} buffer_counters_t;
+
+/**
+ * @brief Buffer pool shard
+ *
+ * Each shard owns a slice of the pool capacity together with its own page
+ * table, LRU list and lock, so threads touching different pages rarely
+ * contend.
+ */
+typedef struct buffer_shard {
+    retldb_mutex_t lock;         // Protects everything below
+    struct buffer_pool* pool;    // Pool owning this shard
+    buffer_entry_t** buckets;    // Page table buckets
+    size_t bucket_mask;          // Number of buckets minus one
+    buffer_queue_t queues[BUFFER_QUEUE_COUNT]; // Replacement queues
+    buffer_entry_t* free_frames[BUFFER_MAX_CLASSES]; // Unused frames of each class (linked by next)
+    size_t count;                // Number of buffers in the shard
+    size_t capacity;             // Most buffers the shard can hold (in its smallest class)
+    size_t budget;               // Bytes of page memory the shard may use
+    size_t used;                 // Bytes of page memory holding pages
+    size_t probation_capacity;   // 2Q A1in target size
+    buffer_ghost_t* ghosts;      // 2Q A1out ring, oldest at ghost_head
+    size_t* ghost_buckets;       // Ghost hash buckets (indices into ghosts)
+    size_t ghost_mask;           // Number of ghost buckets minus one
+    size_t ghost_capacity;       // Size of the ghost ring
+    size_t ghost_head;           // Index of the oldest ghost
+    size_t ghost_count;          // Number of ghost slots in use
+    buffer_counters_t stats;     // Statistics for pages owned by the shard
+    char pad[BUFFER_CACHE_LINE]; // Keeps neighbouring shard locks apart
+} buffer_shard_t;
+
+/**
+ * @brief Buffer pool structure
+ */
+typedef struct buffer_pool {
+    buffer_shard_t* shards;      // Page table shards
+    size_t shard_count;          // Number of shards (power of two)
+    size_t capacity;             // Maximum number of default-size buffers
+    size_t buffer_size;          // Default page size (class 0)
+    size_t memory_budget;        // Bytes of page memory shared by all classes
+    buffer_class_t classes[BUFFER_MAX_CLASSES]; // Page size classes
+    int class_count;             // Number of classes in use
+    buffer_policy_t policy;      // Replacement policy
+    int direct_io;               // Open files with O_DIRECT where supported
+    size_t readahead;            // Pages read ahead of a sequential scan, 0 if disabled
+    unsigned io_depth;           // Maximum prefetch reads in flight
+    buffer_io_t io_backend;      // Requested prefetch backend
+    aio_engine_t* aio;           // Prefetch engine, started on first use
+    uint64_t dirty_bytes;        // Bytes of dirty pages
+    size_t dirty_high;           // Dirty bytes that wake the cleaner, 0 without a cleaner
+    size_t dirty_low;            // Dirty bytes the cleaner writes down to
+    size_t clean_rate;           // Most pages cleaned per second, 0 for unlimited
+    size_t clean_cursor;         // Shard the next cleaner pass starts at
+    int users;                   // Databases attached to the pool
+    int cleaner_running;         // Whether the cleaner thread was started
+    int cleaner_stop;            // Asks the cleaner to exit
+    int cleaner_draining;        // Set while cleaning down from the high watermark
+    int cleaner_holding;         // Set while the cleaner holds latches on a batch
+    retldb_mutex_t cleaner_lock; // Protects the cleaner wake-up state
+    retldb_cond_t cleaner_wake;  // Signalled to wake or stop the cleaner
+    retldb_thread_t cleaner;     // Background cleaner thread
+    retldb_mutex_t file_lock;    // Serializes file interning and engine start-up
+    buffer_file_t* files[BUFFER_FILE_BUCKETS]; // Interned filenames
+    uint32_t file_count;         // Number of interned files
 } buffer_pool_t;
 
 // Global buffer pool
 static buffer_pool_t* g_buffer_pool = NULL;
 
 /**
- * @brief Initialize the buffer pool
- * 
- * @param capacity Maximum number of buffers in the pool
- * @param buffer_size Size of each buffer
- * @return 0 on success, non-zero on failure
+ * @brief Hash a filename (FNV-1a)
+ *
+ * @param name The filename
+ * @return 64-bit hash of the name
  */
-int buffer_init(size_t capacity, size_t buffer_size) {
-    if (g_buffer_pool) {
-        return -1; // Already initialized
+static uint64_t hash_name(const char* name) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    while (*name) {
+        hash ^= (unsigned char)*name++;
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+/**
+ * @brief Hash a page key
+ *
+ * @param file_id Interned file id
+ * @param page_no Page number within the file
+ * @return 64-bit hash of the key
+ */
+static uint64_t hash_page(uint32_t file_id, uint64_t page_no) {
+    uint64_t x = (page_no * 0x9e3779b97f4a7c15ULL) ^ file_id;
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x;
+}
+
+/**
+ * @brief Round up to the next power of two
+ *
+ * @param value The value to round
+ * @return Smallest power of two >= value
+ */
+static size_t next_pow2(size_t value) {
+    size_t result = 1;
+    while (result < value) {
+        result <<= 1;
+    }
+    return result;
+}
+
+/**
+ * @brief Read a monotonic clock
+ *
+ * @return Microseconds since an arbitrary fixed point
+ */
+static uint64_t now_us(void) {
+#ifdef _WIN32
+    LARGE_INTEGER frequency, counter;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+    return (uint64_t)(counter.QuadPart / frequency.QuadPart) * 1000000 +
+           (uint64_t)(counter.QuadPart % frequency.QuadPart) * 1000000 /
+           (uint64_t)frequency.QuadPart;
+#else
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000 + (uint64_t)now.tv_nsec / 1000;
+#endif
+}
+
+/**
+ * @brief Acquire a frame's exclusive latch
+ *
+ * Makes the version odd, which fails every optimistic read in progress,
+ * then waits for shared holders to drain.
+ *
+ * @param entry The buffer entry
+ */
+static void latch_exclusive(buffer_entry_t* entry) {
+    for (;;) {
+        uint64_t version = retldb_atomic_load_u64(&entry->version);
+        if ((version & 1) == 0 && retldb_atomic_cas_u64(&entry->version, version, version + 1)) {
+            break;
+        }
+        retldb_thread_yield();
     }
     
-    g_buffer_pool = (buffer_pool_t*)malloc(sizeof(buffer_pool_t));
-    if (!g_buffer_pool) {
-        return -1;
+    while (retldb_atomic_load_int(&entry->readers) != 0) {
+        retldb_thread_yield();
+    }
+}
+
+/**
+ * @brief Release a frame's exclusive latch
+ *
+ * @param entry The buffer entry
+ */
+static void unlatch_exclusive(buffer_entry_t* entry) {
+    retldb_atomic_fetch_add_u64(&entry->version, 1);
+}
+
+/**
+ * @brief Try to acquire a frame's shared latch without waiting
+ *
+ * @param entry The buffer entry
+ * @return 1 if the latch was acquired, 0 if a writer holds the frame
+ */
+static int try_latch_shared(buffer_entry_t* entry) {
+    uint64_t version = retldb_atomic_load_u64(&entry->version);
+    if (version & 1) {
+        return 0;
     }
     
-    g_buffer_pool->head = NULL;
-    g_buffer_pool->tail = NULL;
-    g_buffer_pool->count = 0;
-    g_buffer_pool->capacity = capacity;
-    g_buffer_pool->buffer_size = buffer_size;
+    retldb_atomic_fetch_add_int(&entry->readers, 1);
+    if (retldb_atomic_load_u64(&entry->version) != version) {
+        // A writer slipped in; back off
+        retldb_atomic_fetch_add_int(&entry->readers, -1);
+        return 0;
+    }
     
-    return 0;
+    return 1;
 }
 
 /**
- * @brief Clean up the buffer pool
- * 
- * @return 0 on success, non-zero on failure
+ * @brief Acquire a frame's shared latch
+ *
+ * @param entry The buffer entry
  */
-int buffer_cleanup(void) {
-    if (!g_buffer_pool) {
-        return -1; // Not initialized
+static void latch_shared(buffer_entry_t* entry) {
+    while (!try_latch_shared(entry)) {
+        retldb_thread_yield();
+    }
+}
+
+/**
+ * @brief Release a frame's shared latch
+ *
+ * @param entry The buffer entry
+ */
+static void unlatch_shared(buffer_entry_t* entry) {
+    retldb_atomic_fetch_add_int(&entry->readers, -1);
+}
+
+/**
+ * @brief Open a file for page I/O
+ *
+ * With direct I/O enabled the file bypasses the page cache, falling back to
+ * buffered I/O on file systems that reject it.
+ *
+ * @param pool The buffer pool
+ * @param filename The file to open
+ * @param flags FILE_* access mode and creation flags
+ * @return File handle on success, NULL on failure
+ */
+static void* open_file(const buffer_pool_t* pool, const char* filename, int flags) {
+    return file_open_flags(filename, flags | (pool->direct_io ? FILE_DIRECT : 0));
+}
+
+/**
+ * @brief Look up or intern a filename
+ *
+ * @param pool The buffer pool
+ * @param filename The filename to intern
+ * @return Interned file entry, NULL on allocation failure
+ */
+static buffer_file_t* intern_file(buffer_pool_t* pool, const char* filename) {
+    uint64_t hash = hash_name(filename);
+    buffer_file_t** bucket = &pool->files[hash & (BUFFER_FILE_BUCKETS - 1)];
+    
+    // Fast path: lock-free walk of the published chain
+    buffer_file_t* file = (buffer_file_t*)retldb_atomic_load_ptr((void* const*)bucket);
+    for (; file; file = file->next) {
+        if (file->hash == hash && strcmp(file->name, filename) == 0) {
+            return file;
+        }
     }
     
-    // Free all buffer entries
-    buffer_entry_t* entry = g_buffer_pool->head;
-    while (entry) {
-        buffer_entry_t* next = entry->next;
-        
-        if (entry->data) {
-            free(entry->data);
+    retldb_mutex_lock(&pool->file_lock);
+    
+    // Re-check in case another thread interned the name meanwhile
+    for (file = *bucket; file; file = file->next) {
+        if (file->hash == hash && strcmp(file->name, filename) == 0) {
+            retldb_mutex_unlock(&pool->file_lock);
+            return file;
         }
-        
-        if (entry->filename) {
-            free(entry->filename);
+    }
+    
+    file = (buffer_file_t*)malloc(sizeof(buffer_file_t));
+    if (file) {
+        file->name = strdup(filename);
+        if (!file->name) {
+            free(file);
+            file = NULL;
         }
-        
-        free(entry);
-        entry = next;
     }
     
-    free(g_buffer_pool);
-    g_buffer_pool = NULL;
+    if (file) {
+        // A missing file reads as zeros; it is created on first write-back
+        file->handle = open_file(pool, filename, FILE_READ | FILE_WRITE);
+        if (!file->handle && (errno == EACCES || errno == EROFS)) {
+            file->handle = open_file(pool, filename, FILE_READ);
+        }
+        
+        file->hash = hash;
+        file->id = pool->file_count++;
+        file->page_class = 0;
+        file->accessed = 0;
+        file->ra_next = 0;
+        file->ra_end = 0;
+        file->ra_run = 0;
+        file->next = *bucket;
+        retldb_atomic_store_ptr((void**)bucket, file);
+    }
     
-    return 0;
+    retldb_mutex_unlock(&pool->file_lock);
+    return file;
 }
 
 /**
- * @brief Move a buffer entry to the head of the LRU list
- * 
- * @param entry The buffer entry to move
+ * @brief Get the page size of a file, fixing its size class on first use
+ *
+ * @param pool The buffer pool
+ * @param file The interned file
+ * @return Page size in bytes
  */
-static void move_to_head(buffer_entry_t* entry) {
-    if (!entry || entry == g_buffer_pool->head) {
-        return; // Already at head or invalid
+static size_t file_page_size(const buffer_pool_t* pool, buffer_file_t* file) {
+    if (!retldb_atomic_load_int(&file->accessed)) {
+        retldb_atomic_store_int(&file->accessed, 1);
     }
-    
-    // Remove from current position
-    if (entry->prev) {
-        entry->prev->next = entry->next;
+    return pool->classes[retldb_atomic_load_int(&file->page_class)].size;
+}
+
+/**
+ * @brief Get a handle for writing to a file, creating it if needed
+ *
+ * @param pool The buffer pool
+ * @param file The interned file
+ * @return File handle on success, NULL on failure
+ */
+static void* writable_file(buffer_pool_t* pool, buffer_file_t* file) {
+    void* handle = retldb_atomic_load_ptr(&file->handle);
+    if (handle) {
+        return handle;
     }
     
-    if (entry->next) {
-        entry->next->prev = entry->prev;
-    } else {
-        // This was the tail
-        g_buffer_pool->tail = entry->prev;
+    retldb_mutex_lock(&pool->file_lock);
+    handle = file->handle;
+    if (!handle) {
+        handle = open_file(pool, file->name, FILE_READ | FILE_WRITE | FILE_CREATE);
+        if (handle) {
+            retldb_atomic_store_ptr(&file->handle, handle);
+        }
     }
+    retldb_mutex_unlock(&pool->file_lock);
     
-    // Add to head
-    entry->next = g_buffer_pool->head;
-    entry->prev = NULL;
+    return handle;
+}
+
+/**
+ * @brief Fill a buffer entry from its backing file
+ *
+ * Bytes beyond the end of the file (or of a missing file) read as zeros.
+ *
+ * @param entry The buffer entry
+ * @param done Number of leading bytes already read (after a short read)
+ * @return 0 on success, non-zero on failure
+ */
+static int read_page(buffer_entry_t* entry, size_t done) {
+    void* handle = retldb_atomic_load_ptr(&entry->file->handle);
+    char* dst = (char*)entry->data;
     
-    if (g_buffer_pool->head) {
-        g_buffer_pool->head->prev = entry;
-    } else {
-        // Empty list
-        g_buffer_pool->tail = entry;
+    // Reads stop short only at the end of the file
+    if (handle && done < entry->size) {
+        long long n = file_pread(handle, dst + done, entry->size - done,
+                                 (uint64_t)entry->offset + done);
+        if (n < 0) {
+            return -1;
+        }
+        done += (size_t)n;
     }
     
-    g_buffer_pool->head = entry;
+    retldb_atomic_fetch_add_u64(&entry->shard->stats.read_bytes, (uint64_t)done);
+    memset(dst + done, 0, entry->size - done);
+    return 0;
 }
 
 /**
- * @brief Get a buffer from the pool
- * 
- * @param filename The filename associated with the buffer
- * @param offset The offset in the file
- * @return Buffer entry on success, NULL on failure
+ * @brief Write a run of file-adjacent pages with one vectored write
+ *
+ * The entries must belong to the same file, be sorted by page number and
+ * have no gaps. The caller must keep the contents stable with a shared
+ * latch. Dirty flags are not touched.
+ *
+ * @param pool The buffer pool
+ * @param run The entries to write
+ * @param count Number of entries (at most BUFFER_MAX_IOV)
+ * @return 0 on success, non-zero on failure
  */
-buffer_entry_t* buffer_get(const char* filename, size_t offset) {
-    if (!g_buffer_pool || !filename) {
-        return NULL;
+static int write_pages(buffer_pool_t* pool, buffer_entry_t** run, size_t count) {
+    file_iovec_t iov[BUFFER_MAX_IOV];
+    void* handle = writable_file(pool, run[0]->file);
+    if (!handle) {
+        return -1;
     }
     
-    // Align offset to buffer size
-    offset = (offset / g_buffer_pool->buffer_size) * g_buffer_pool->buffer_size;
+    size_t total = 0;
+    for (size_t i = 0; i < count; i++) {
+        iov[i].base = run[i]->data;
+        iov[i].len = run[i]->size;
+        total += run[i]->size;
+    }
     
-    // Check if buffer is already in the pool
-    buffer_entry_t* entry = g_buffer_pool->head;
-    while (entry) {
-        if (entry->offset == offset && strcmp(entry->filename, filename) == 0) {
-            // Move to head of LRU list (most recently used)
-            move_to_head(entry);
-            return entry;
+    // Resume after short writes until the whole run is on disk
+    file_iovec_t* cur = iov;
+    int remaining = (int)count;
+    uint64_t offset = run[0]->offset;
+    size_t written = 0;
+    while (written < total) {
+        long long n = file_pwritev(handle, cur, remaining, offset);
+        if (n <= 0) {
+            return -1;
         }
+        written += (size_t)n;
+        offset += (uint64_t)n;
         
-        entry = entry->next;
+        while (remaining > 0 && (size_t)n >= cur->len) {
+            n -= (long long)cur->len;
+            cur++;
+            remaining--;
+        }
+        if (remaining > 0) {
+            cur->base = (char*)cur->base + n;
+            cur->len -= (size_t)n;
+        }
     }
     
-    // Buffer not found, create a new one
-    entry = (buffer_entry_t*)malloc(sizeof(buffer_entry_t));
-    if (!entry) {
-        return NULL;
+    for (size_t i = 0; i < count; i++) {
+        retldb_atomic_fetch_add_u64(&run[i]->shard->stats.dirty_writes, 1);
+        retldb_atomic_fetch_add_u64(&run[i]->shard->stats.write_bytes, (uint64_t)run[i]->size);
     }
     
-    entry->data = malloc(g_buffer_pool->buffer_size);
-    if (!entry->data) {
-        free(entry);
-        return NULL;
+    return 0;
+}
+
+/**
+ * @brief Clear an entry's dirty flag
+ *
+ * The caller must hold the owning shard lock.
+ *
+ * @param entry The buffer entry
+ */
+static void set_clean(buffer_entry_t* entry) {
+    if (entry->dirty) {
+        entry->dirty = 0;
+        retldb_atomic_fetch_add_u64(&entry->shard->pool->dirty_bytes, (uint64_t)0 - entry->size);
     }
+}
+
+/**
+ * @brief Order entries by file and page number
+ */
+static int compare_entries(const void* a, const void* b) {
+    const buffer_entry_t* x = *(const buffer_entry_t* const*)a;
+    const buffer_entry_t* y = *(const buffer_entry_t* const*)b;
     
-    entry->filename = strdup(filename);
-    if (!entry->filename) {
-        free(entry->data);
-        free(entry);
-        return NULL;
+    if (x->file->id != y->file->id) {
+        return x->file->id < y->file->id ? -1 : 1;
     }
+    if (x->page_no != y->page_no) {
+        return x->page_no < y->page_no ? -1 : 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Order picked pages by file and page number
+ */
+static int compare_writebacks(const void* a, const void* b) {
+    return compare_entries(&((const buffer_writeback_t*)a)->entry,
+                           &((const buffer_writeback_t*)b)->entry);
+}
+
+/**
+ * @brief Write back picked pages without holding any shard lock
+ *
+ * Each page is written under a shared latch, adjacent pages of a file going
+ * out as one vectored write, and is marked clean unless it was dirtied again
+ * after it was picked. Pages exclusively latched right now are skipped
+ * rather than waited for, since the holder may be the caller itself; they
+ * stay dirty. Every pin is released and the array is reordered.
+ *
+ * @param pool The buffer pool
+ * @param pages The pages, each pinned under its shard lock when picked
+ * @param count Number of pages
+ * @return 0 on success, RETLDB_ERROR_BUSY if a latched page was skipped,
+ *         -1 if a write failed
+ */
+static int write_back(buffer_pool_t* pool, buffer_writeback_t* pages, size_t count) {
+    buffer_entry_t* run[BUFFER_MAX_IOV];
+    int result = 0;
     
-    entry->size = g_buffer_pool->buffer_size;
-    entry->offset = offset;
-    entry->dirty = 0;
-    
-    // Add to head of LRU list (most recently used)
-    entry->next = g_buffer_pool->head;
-    entry->prev = NULL;
-    
-    if (g_buffer_pool->head) {
-        g_buffer_pool->head->prev = entry;
-    } else {
-        g_buffer_pool->tail = entry;
+    // Latched pages move to the front, skipped ones to the back
+    size_t latched = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (try_latch_shared(pages[i].entry)) {
+            buffer_writeback_t page = pages[i];
+            pages[i] = pages[latched];
+            pages[latched++] = page;
+        } else {
+            result = RETLDB_ERROR_BUSY;
+        }
     }
     
-    g_buffer_pool->head = entry;
-    g_buffer_pool->count++;
+    qsort(pages, latched, sizeof(buffer_writeback_t), compare_writebacks);
     
-    // If pool is full, evict the least recently used buffer
-    if (g_buffer_pool->count > g_buffer_pool->capacity) {
-        buffer_entry_t* victim = g_buffer_pool->tail;
+    size_t start = 0;
+    while (start < latched) {
+        size_t n = 0;
+        do {
+            run[n] = pages[start + n].entry;
+            n++;
+        } while (start + n < latched && n < BUFFER_MAX_IOV &&
+                 pages[start + n].entry->file == run[0]->file &&
+                 pages[start + n].entry->page_no == run[n - 1]->page_no + 1);
         
-        if (!victim) {
-            // This shouldn't happen, but just in case
-            return entry;
+        int ok = write_pages(pool, run, n) == 0;
+        if (!ok) {
+            result = -1;
         }
         
-        // Remove from tail
-        g_buffer_pool->tail = victim->prev;
-        
-        if (g_buffer_pool->tail) {
-            g_buffer_pool->tail->next = NULL;
-        } else {
-            g_buffer_pool->head = NULL;
+        for (size_t i = start; i < start + n; i++) {
+            buffer_entry_t* entry = pages[i].entry;
+            unlatch_shared(entry);
+            
+            retldb_mutex_lock(&entry->shard->lock);
+            if (ok && entry->dirty && entry->dirty_seq == pages[i].seq) {
+                set_clean(entry);
+            }
+            retldb_mutex_unlock(&entry->shard->lock);
         }
+        start += n;
+    }
+    
+    for (size_t i = 0; i < count; i++) {
+        retldb_atomic_fetch_add_int(&pages[i].entry->pins, -1);
+    }
+    
+    return result;
+}
+
+/**
+ * @brief Write back every dirty page in a pool
+ *
+ * Dirty pages are pinned one shard at a time and then written by
+ * write_back() with no shard lock held, so lookups keep going while the
+ * flush runs. Pages dirtied after their shard was visited are left for the
+ * next flush.
+ *
+ * @param pool The buffer pool
+ * @return 0 on success, RETLDB_ERROR_BUSY if an exclusively latched page
+ *         was left dirty, -1 on failure
+ */
+static int flush_pool(buffer_pool_t* pool) {
+    buffer_writeback_t* pages = NULL;
+    size_t count = 0;
+    int result = 0;
+    
+    for (size_t i = 0; i < pool->shard_count && result == 0; i++) {
+        buffer_shard_t* shard = &pool->shards[i];
         
-        // If the victim is dirty, flush it (in a real implementation)
-        if (victim->dirty) {
-            // In a real implementation, this would write to the file
+        retldb_mutex_lock(&shard->lock);
+        size_t dirty = 0;
+        for (int q = 0; q < BUFFER_QUEUE_COUNT; q++) {
+            for (buffer_entry_t* entry = shard->queues[q].head; entry; entry = entry->next) {
+                dirty += entry->dirty ? 1 : 0;
+            }
         }
         
-        // Free resources
-        free(victim->data);
-        free(victim->filename);
-        free(victim);
-        
-        g_buffer_pool->count--;
+        if (dirty > 0) {
+            buffer_writeback_t* grown = (buffer_writeback_t*)realloc(
+                pages, (count + dirty) * sizeof(buffer_writeback_t));
+            if (grown) {
+                pages = grown;
+                for (int q = 0; q < BUFFER_QUEUE_COUNT; q++) {
+                    for (buffer_entry_t* entry = shard->queues[q].head; entry;
+                         entry = entry->next) {
+                        if (entry->dirty) {
+                            // The pin keeps the page resident once the lock is dropped
+                            retldb_atomic_fetch_add_int(&entry->pins, 1);
+                            pages[count].entry = entry;
+                            pages[count].seq = entry->dirty_seq;
+                            count++;
+                        }
+                    }
+                }
+            } else {
+                result = -1;
+            }
+        }
+        retldb_mutex_unlock(&shard->lock);
     }
     
-    // Load data from file (placeholder)
-    // In a real implementation, this would read from the file
-    memset(entry->data, 0, entry->size);
+    // Pages already picked are written (and unpinned) even after a failure
+    if (count > 0) {
+        int written = write_back(pool, pages, count);
+        if (result == 0) {
+            result = written;
+        }
+    }
+    free(pages);
     
-    return entry;
+    return result;
 }
 
 /**
- * @brief Mark a buffer as dirty
+ * @brief Write out one batch of dirty pages in the background
  * 
- * @param entry The buffer entry
- * @return 0 on success, non-zero on failure
+ * Pages are taken from the eviction end of each shard, oldest first, and
+ * written under a shared latch without holding any shard lock. A page
+ * dirtied again while it was being written stays dirty.
+ * 
+ * @param pool The buffer pool
+ * @param tail_only Only look at the pages closest to eviction
+ * @param limit Most pages to write (at most BUFFER_CLEAN_BATCH)
+ * @return Number of pages written
  */
-int buffer_mark_dirty(buffer_entry_t* entry) {
-    if (!entry) {
-        return -1;
+static size_t clean_pass(buffer_pool_t* pool, int tail_only, size_t limit) {
+    buffer_entry_t* batch[BUFFER_CLEAN_BATCH];
+    int written[BUFFER_CLEAN_BATCH];
+    size_t n = 0;
+    
+    // Misses that find every frame latched wait for this to clear
+    retldb_atomic_store_int(&pool->cleaner_holding, 1);
+    
+    // Rotate the starting shard so every shard gets its turn
+    for (size_t k = 0; k < pool->shard_count && n < limit; k++) {
+        buffer_shard_t* shard = &pool->shards[(pool->clean_cursor + k) % pool->shard_count];
+        
+        retldb_mutex_lock(&shard->lock);
+        for (int q = BUFFER_QUEUE_PROBATION; q >= BUFFER_QUEUE_HOT && n < limit; q--) {
+            size_t depth = 0;
+            for (buffer_entry_t* entry = shard->queues[q].tail; entry && n < limit;
+                 entry = entry->prev) {
+                if (tail_only && depth++ >= BUFFER_CLEAN_SCAN_DEPTH) {
+                    break;
+                }
+                if (entry->dirty && try_latch_shared(entry)) {
+                    entry->clean_seq = entry->dirty_seq;
+                    batch[n++] = entry;
+                }
+            }
+        }
+        retldb_mutex_unlock(&shard->lock);
     }
+    pool->clean_cursor = (pool->clean_cursor + 1) % pool->shard_count;
     
-    entry->dirty = 1;
+    if (n == 0) {
+        retldb_atomic_store_int(&pool->cleaner_holding, 0);
+        return 0;
+    }
     
-    // Move to head of LRU list (most recently used)
-    move_to_head(entry);
+    qsort(batch, n, sizeof(buffer_entry_t*), compare_entries);
     
-    return 0;
+    size_t start = 0;
+    while (start < n) {
+        size_t end = start + 1;
+        while (end < n && batch[end]->file == batch[start]->file &&
+               batch[end]->page_no == batch[end - 1]->page_no + 1) {
+            end++;
+        }
+        
+        int ok = write_pages(pool, &batch[start], end - start) == 0;
+        for (size_t i = start; i < end; i++) {
+            written[i] = ok;
+        }
+        start = end;
+    }
+    
+    size_t cleaned = 0;
+    for (size_t i = 0; i < n; i++) {
+        buffer_entry_t* entry = batch[i];
+        unlatch_shared(entry);
+        
+        retldb_mutex_lock(&entry->shard->lock);
+        if (written[i] && entry->dirty && entry->dirty_seq == entry->clean_seq) {
+            set_clean(entry);
+            cleaned++;
+        }
+        retldb_mutex_unlock(&entry->shard->lock);
+    }
+    retldb_atomic_store_int(&pool->cleaner_holding, 0);
+    
+    return cleaned;
 }
 
 /**
- * @brief Flush a dirty buffer to disk
+ * @brief Background cleaner: keep dirty pages between the watermarks
  * 
- * @param entry The buffer entry
- * @return 0 on success, non-zero on failure
+ * Once the dirty count reaches the high watermark the cleaner writes
+ * batches until it is back down to the low watermark. In between it wakes
+ * periodically to keep the pages closest to eviction clean, so that misses
+ * rarely have to write a victim back themselves.
+ * 
+ * @param arg The buffer pool
+ * @return NULL
  */
-int buffer_flush(buffer_entry_t* entry) {
-    if (!entry) {
-        return -1; // Error: NULL pointer
+static void* cleaner_main(void* arg) {
+    buffer_pool_t* pool = (buffer_pool_t*)arg;
+    
+    size_t limit = BUFFER_CLEAN_BATCH;
+    if (pool->clean_rate > 0) {
+        // Write in small steps so the rate holds over short intervals
+        limit = pool->clean_rate / 10 > 0 ? pool->clean_rate / 10 : 1;
+        if (limit > BUFFER_CLEAN_BATCH) {
+            limit = BUFFER_CLEAN_BATCH;
+        }
     }
     
-    if (!entry->dirty) {
-        return 0; // Nothing to do
+    retldb_mutex_lock(&pool->cleaner_lock);
+    while (!pool->cleaner_stop) {
+        size_t dirty = (size_t)retldb_atomic_load_u64(&pool->dirty_bytes);
+        int draining = dirty >= pool->dirty_high ||
+                       (retldb_atomic_load_int(&pool->cleaner_draining) && dirty > pool->dirty_low);
+        retldb_atomic_store_int(&pool->cleaner_draining, draining);
+        retldb_mutex_unlock(&pool->cleaner_lock);
+        
+        size_t cleaned = clean_pass(pool, !draining, limit);
+        
+        retldb_mutex_lock(&pool->cleaner_lock);
+        if (pool->cleaner_stop) {
+            break;
+        }
+        
+        if (cleaned > 0 && pool->clean_rate > 0) {
+            unsigned pause_ms = (unsigned)(cleaned * 1000 / pool->clean_rate);
+            retldb_cond_timedwait(&pool->cleaner_wake, &pool->cleaner_lock,
+                                  pause_ms > 0 ? pause_ms : 1);
+        } else if (!draining || cleaned == 0) {
+            // Nothing urgent, or nothing writable right now
+            retldb_cond_timedwait(&pool->cleaner_wake, &pool->cleaner_lock,
+                                  BUFFER_CLEANER_INTERVAL_MS);
+        }
     }
+    retldb_mutex_unlock(&pool->cleaner_lock);
     
-    // In a real implementation, this would write to the file
-    entry->dirty = 0;
-    return 0;
+    return NULL;
 }
 
 /**
- * @brief Flush all dirty buffers
+ * @brief Wake the background cleaner early, if the pool runs one
+ * 
+ * @param pool The buffer pool
+ */
+static void wake_cleaner(buffer_pool_t* pool) {
+    if (pool->dirty_high) {
+        retldb_mutex_lock(&pool->cleaner_lock);
+        retldb_cond_signal(&pool->cleaner_wake);
+        retldb_mutex_unlock(&pool->cleaner_lock);
+    }
+}
+
+/**
+ * @brief Start the background cleaner if the pool is configured for one
  * 
+ * @param pool The buffer pool (watermarks already set)
  * @return 0 on success, non-zero on failure
  */
-int buffer_flush_all(void) {
-    if (!g_buffer_pool) {
-        return -1;
+static int cleaner_start(buffer_pool_t* pool) {
+    if (pool->dirty_high == 0) {
+        return 0;
     }
     
-    buffer_entry_t* entry = g_buffer_pool->head;
-    while (entry) {
-        if (entry->dirty) {
-            buffer_flush(entry);
-        }
-        
-        entry = entry->next;
+    if (retldb_mutex_init(&pool->cleaner_lock) != 0) {
+        return -1;
+    }
+    if (retldb_cond_init(&pool->cleaner_wake) != 0) {
+        retldb_mutex_destroy(&pool->cleaner_lock);
+        return -1;
+    }
+    if (retldb_thread_create(&pool->cleaner, cleaner_main, pool) != 0) {
+        retldb_cond_destroy(&pool->cleaner_wake);
+        retldb_mutex_destroy(&pool->cleaner_lock);
+        return -1;
     }
     
+    pool->cleaner_running = 1;
     return 0;
 }
+
+/**
+ * @brief Stop the background cleaner and wait for it to exit
+ * 
+ * @param pool The buffer pool
+ */
+static void cleaner_stop(buffer_pool_t* pool) {
+    if (!pool->cleaner_running) {
+        return;
+    }
+    
+    retldb_mutex_lock(&pool->cleaner_lock);
+    pool->cleaner_stop = 1;
+    retldb_cond_signal(&pool->cleaner_wake);
+    retldb_mutex_unlock(&pool->cleaner_lock);
+    
+    retldb_thread_join(&pool->cleaner);
+    retldb_cond_destroy(&pool->cleaner_wake);
+    retldb_mutex_destroy(&pool->cleaner_lock);
+    pool->cleaner_running = 0;
+}
+
+/**
+ * @brief Reserve the frame arena of a size class
+ *
+ * The arena is one anonymous, page-aligned mapping that only reserves
+ * address space: every class has room for the whole budget, so committing
+ * the arenas up front would cost the budget once per class. Memory is
+ * backed as frames are first used. With huge pages requested the arena is
+ * backed by transparent huge pages where the kernel allows; explicit
+ * (MAP_HUGETLB) pages are not used, since they are committed at map time.
+ *
+ * @param cls The size class (arena_size already set)
+ * @param huge_pages Whether to ask for transparent huge pages
+ * @return 0 on success, non-zero on failure
+ */
+static int arena_reserve(buffer_class_t* cls, int huge_pages) {
+#ifdef _WIN32
+    (void)huge_pages;
+    cls->arena = VirtualAlloc(NULL, cls->arena_size, MEM_RESERVE, PAGE_READWRITE);
+    return cls->arena ? 0 : -1;
+#else
+    int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+#ifdef MAP_NORESERVE
+    flags |= MAP_NORESERVE;
+#endif
+    void* arena = mmap(NULL, cls->arena_size, PROT_READ | PROT_WRITE, flags, -1, 0);
+    if (arena == MAP_FAILED) {
+        return -1;
+    }
+    
+#ifdef MADV_HUGEPAGE
+    if (huge_pages) {
+        madvise(arena, cls->arena_size, MADV_HUGEPAGE); // Best effort
+    }
+#else
+    (void)huge_pages;
+#endif
+    
+    cls->arena = arena;
+    return 0;
+#endif
+}
+
+/**
+ * @brief Release the frame arena of a size class
+ *
+ * @param cls The size class
+ */
+static void arena_release(buffer_class_t* cls) {
+    if (!cls->arena) {
+        return;
+    }
+    
+#ifdef _WIN32
+    VirtualFree(cls->arena, 0, MEM_RELEASE);
+#else
+    munmap(cls->arena, cls->arena_size);
+#endif
+    cls->arena = NULL;
+}
+
+/**
+ * @brief Back a frame with memory before it is used
+ *
+ * Only Windows needs this: its arenas are reserved without being
+ * committed. Elsewhere the first touch backs the frame.
+ *
+ * @param entry The frame
+ * @return 0 on success, non-zero on failure
+ */
+static int frame_commit(buffer_entry_t* entry) {
+#ifdef _WIN32
+    return VirtualAlloc(entry->data, entry->size, MEM_COMMIT, PAGE_READWRITE) ? 0 : -1;
+#else
+    (void)entry;
+    return 0;
+#endif
+}
+
+/**
+ * @brief Hand the memory behind a free frame back to the operating system
+ *
+ * Used when a frame's share of the budget moves to another size class. The
+ * mapping stays in place and reads as zeros when the frame is reused.
+ * Frames smaller than a memory page are left alone.
+ *
+ * @param entry The free frame
+ */
+static void frame_release(buffer_entry_t* entry) {
+    if (entry->size < BUFFER_FRAME_ALIGN) {
+        return;
+    }
+    
+#ifdef _WIN32
+    VirtualFree(entry->data, entry->size, MEM_DECOMMIT);
+#elif defined(MADV_DONTNEED)
+    madvise(entry->data, entry->size, MADV_DONTNEED);
+#endif
+}
+
+/**
+ * @brief Release the per-shard resources
+ *
+ * Frames and descriptors belong to the size classes and are released with them.
+ *
+ * @param shard The shard to tear down
+ */
+static void shard_destroy(buffer_shard_t* shard) {
+    free(shard->ghosts);
+    free(shard->ghost_buckets);
+    free(shard->buckets);
+    retldb_mutex_destroy(&shard->lock);
+}
+
+/**
+ * @brief Free a pool and everything it owns
+ *
+ * Works on partially initialized pools: only the first ready_shards shards
+ * are torn down, and unreserved arenas are skipped.
+ *
+ * @param pool The buffer pool (file_lock initialized)
+ * @param ready_shards Number of shards that were initialized
+ */
+static void pool_release(buffer_pool_t* pool, size_t ready_shards) {
+    for (size_t i = 0; i < ready_shards; i++) {
+        shard_destroy(&pool->shards[i]);
+    }
+    for (int c = 0; c < pool->class_count; c++) {
+        arena_release(&pool->classes[c]);
+        free(pool->classes[c].frames);
+    }
+    retldb_mutex_destroy(&pool->file_lock);
+    free(pool->shards);
+    free(pool);
+}
+
+/**
+ * @brief Fill a buffer pool configuration with default values
+ * 
+ * @param config The configuration to fill
+ */
+void buffer_config_default(buffer_config_t* config) {
+    if (!config) {
+        return;
+    }
+    
+    config->capacity = 1024;
+    config->buffer_size = 4096;
+    memset(config->page_classes, 0, sizeof(config->page_classes));
+    config->policy = BUFFER_POLICY_LRU;
+    config->num_shards = 0;
+    config->huge_pages = 0;
+    config->direct_io = 0;
+    config->readahead = 0;
+    config->io_depth = 64;
+    config->io_backend = BUFFER_IO_AUTO;
+    config->dirty_high = 0;
+    config->dirty_low = 0;
+    config->clean_rate = 0;
+}
+
+/**
+ * @brief Allocate the page table and replacement state of a shard
+ * 
+ * @param shard The shard to set up (capacity and policy already set)
+ * @param policy The replacement policy
+ * @return 0 on success, non-zero on failure
+ */
+static int shard_init(buffer_shard_t* shard, buffer_policy_t policy) {
+    // Keep the load factor at or below one half
+    size_t bucket_count = next_pow2(shard->capacity * 2);
+    shard->buckets = (buffer_entry_t**)calloc(bucket_count, sizeof(buffer_entry_t*));
+    if (!shard->buckets) {
+        return -1;
+    }
+    shard->bucket_mask = bucket_count - 1;
+    
+    if (policy == BUFFER_POLICY_2Q) {
+        shard->probation_capacity = shard->capacity * BUFFER_2Q_A1IN_PERCENT / 100;
+        if (shard->probation_capacity == 0) {
+            shard->probation_capacity = 1;
+        }
+        
+        shard->ghost_capacity = shard->capacity * BUFFER_2Q_A1OUT_PERCENT / 100;
+        if (shard->ghost_capacity == 0) {
+            shard->ghost_capacity = 1;
+        }
+        
+        size_t ghost_bucket_count = next_pow2(shard->ghost_capacity * 2);
+        shard->ghosts = (buffer_ghost_t*)calloc(shard->ghost_capacity, sizeof(buffer_ghost_t));
+        shard->ghost_buckets = (size_t*)malloc(ghost_bucket_count * sizeof(size_t));
+        if (!shard->ghosts || !shard->ghost_buckets) {
+            free(shard->ghosts);
+            free(shard->ghost_buckets);
+            free(shard->buckets);
+            return -1;
+        }
+        
+        for (size_t i = 0; i < ghost_bucket_count; i++) {
+            shard->ghost_buckets[i] = shard->ghost_capacity;
+        }
+        shard->ghost_mask = ghost_bucket_count - 1;
+    }
+    
+    if (retldb_mutex_init(&shard->lock) != 0) {
+        free(shard->ghosts);
+        free(shard->ghost_buckets);
+        free(shard->buckets);
+        return -1;
+    }
+    
+    return 0;
+}
+
+/**
+ * @brief Create a buffer pool from a configuration
+ * 
+ * @param config The pool configuration
+ * @return Pool handle on success, NULL on failure
+ */
+void* buffer_pool_create(const buffer_config_t* config) {
+    if (!config || config->capacity == 0 || config->buffer_size == 0 ||
+        config->capacity > SIZE_MAX / config->buffer_size) {
+        return NULL;
+    }
+    
+    // Collect the size classes, the default size first
+    size_t sizes[BUFFER_MAX_CLASSES];
+    int class_count = 0;
+    sizes[class_count++] = config->buffer_size;
+    for (int i = 0; i < BUFFER_MAX_CLASSES - 1 && config->page_classes[i] != 0; i++) {
+        for (int c = 0; c < class_count; c++) {
+            if (sizes[c] == config->page_classes[i]) {
+                return NULL; // Listed twice
+            }
+        }
+        sizes[class_count++] = config->page_classes[i];
+    }
+    
+    size_t smallest = sizes[0];
+    size_t largest = sizes[0];
+    for (int c = 0; c < class_count; c++) {
+        // Direct I/O transfers whole, aligned blocks
+        if (config->direct_io && sizes[c] % BUFFER_FRAME_ALIGN != 0) {
+            return NULL;
+        }
+        smallest = sizes[c] < smallest ? sizes[c] : smallest;
+        largest = sizes[c] > largest ? sizes[c] : largest;
+    }
+    
+    if (config->policy != BUFFER_POLICY_LRU && config->policy != BUFFER_POLICY_2Q) {
+        return NULL;
+    }
+    
+    if (config->io_backend != BUFFER_IO_AUTO && config->io_backend != BUFFER_IO_THREADS) {
+        return NULL;
+    }
+    
+    // The cleaner needs room between its watermarks; an unset low watermark
+    // is derived from the high one below
+    if (config->dirty_high > 100 ||
+        (config->dirty_high > 0 && config->dirty_low > 0 && config->dirty_low >= config->dirty_high)) {
+        return NULL;
+    }
+    
+    size_t capacity = config->capacity;
+    size_t budget = capacity * config->buffer_size;
+    
+    // Every class must be able to hold at least one page
+    if (largest > budget) {
+        return NULL;
+    }
+    
+    buffer_pool_t* pool = (buffer_pool_t*)calloc(1, sizeof(buffer_pool_t));
+    if (!pool) {
+        return NULL;
+    }
+    if (retldb_mutex_init(&pool->file_lock) != 0) {
+        free(pool);
+        return NULL;
+    }
+    
+    pool->capacity = capacity;
+    pool->buffer_size = config->buffer_size;
+    pool->memory_budget = budget;
+    pool->policy = config->policy;
+    pool->direct_io = config->direct_io;
+    pool->io_depth = config->io_depth;
+    pool->io_backend = config->io_backend;
+    
+    // Leave most of the pool to pages that are actually in use
+    pool->readahead = config->readahead;
+    if (pool->readahead > capacity / 4) {
+        pool->readahead = capacity / 4;
+    }
+    
+    // Watermarks are given as percentages of the memory budget
+    if (config->dirty_high > 0) {
+        pool->dirty_high = budget / 100 * config->dirty_high +
+                           budget % 100 * config->dirty_high / 100;
+        pool->dirty_low = budget / 100 * config->dirty_low +
+                          budget % 100 * config->dirty_low / 100;
+        if (pool->dirty_high == 0) {
+            pool->dirty_high = 1;
+        }
+        if (config->dirty_low == 0) {
+            pool->dirty_low = pool->dirty_high / 2;
+        }
+        pool->clean_rate = config->clean_rate;
+    }
+    
+    if (config->num_shards > 0) {
+        // Honour the request, rounded down to a power of two, as long as
+        // every shard can still hold a page of the largest class
+        pool->shard_count = 1;
+        while (pool->shard_count * 2 <= config->num_shards &&
+               pool->shard_count * 2 <= capacity &&
+               capacity / (pool->shard_count * 2) * config->buffer_size >= largest) {
+            pool->shard_count *= 2;
+        }
+    } else {
+        // Only split the pool when every shard still gets a meaningful share
+        pool->shard_count = 1;
+        while (pool->shard_count < BUFFER_MAX_SHARDS &&
+               capacity / (pool->shard_count * 2) >= BUFFER_MIN_SHARD_CAPACITY &&
+               capacity / (pool->shard_count * 2) * config->buffer_size /
+               BUFFER_MIN_CLASS_FRAMES >= largest) {
+            pool->shard_count *= 2;
+        }
+    }
+    
+    pool->shards = (buffer_shard_t*)calloc(pool->shard_count, sizeof(buffer_shard_t));
+    if (!pool->shards) {
+        pool_release(pool, 0);
+        return NULL;
+    }
+    
+    // Split the budget between the shards
+    for (size_t i = 0; i < pool->shard_count; i++) {
+        buffer_shard_t* shard = &pool->shards[i];
+        shard->pool = pool;
+        shard->budget = (capacity / pool->shard_count +
+                         (i < capacity % pool->shard_count ? 1 : 0)) * config->buffer_size;
+        shard->capacity = shard->budget / smallest;
+    }
+    
+    // Give every class enough frames to spend each shard's whole budget
+    for (int c = 0; c < class_count; c++) {
+        buffer_class_t* cls = &pool->classes[c];
+        pool->class_count++;
+        cls->size = sizes[c];
+        
+        // Frames are aligned to their size (up to the page size) so that
+        // page-sized frames are suitable for O_DIRECT transfers
+        size_t frame_align = next_pow2(cls->size);
+        if (frame_align > BUFFER_FRAME_ALIGN) {
+            frame_align = BUFFER_FRAME_ALIGN;
+        }
+        cls->stride = (cls->size + frame_align - 1) / frame_align * frame_align;
+        
+        for (size_t i = 0; i < pool->shard_count; i++) {
+            cls->frame_count += pool->shards[i].budget / cls->size;
+        }
+        if (cls->frame_count > SIZE_MAX / cls->stride) {
+            pool_release(pool, 0);
+            return NULL;
+        }
+        cls->arena_size = cls->frame_count * cls->stride;
+        
+        cls->frames = (buffer_entry_t*)calloc(cls->frame_count, sizeof(buffer_entry_t));
+        if (!cls->frames || arena_reserve(cls, config->huge_pages) != 0) {
+            pool_release(pool, 0);
+            return NULL;
+        }
+    }
+    
+    size_t next_frame[BUFFER_MAX_CLASSES] = {0};
+    for (size_t i = 0; i < pool->shard_count; i++) {
+        buffer_shard_t* shard = &pool->shards[i];
+        
+        if (shard_init(shard, pool->policy) != 0) {
+            pool_release(pool, i);
+            return NULL;
+        }
+        
+        // Hand the shard its own contiguous run of frames in every class
+        for (int c = 0; c < pool->class_count; c++) {
+            buffer_class_t* cls = &pool->classes[c];
+            for (size_t f = 0; f < shard->budget / cls->size; f++, next_frame[c]++) {
+                buffer_entry_t* entry = &cls->frames[next_frame[c]];
+                entry->data = (char*)cls->arena + next_frame[c] * cls->stride;
+                entry->size = cls->size;
+                entry->page_class = c;
+                entry->shard = shard;
+                entry->next = shard->free_frames[c];
+                shard->free_frames[c] = entry;
+            }
+        }
+    }
+    
+    if (cleaner_start(pool) != 0) {
+        pool_release(pool, pool->shard_count);
+        return NULL;
+    }
+    
+    return pool;
+}
+
+/**
+ * @brief Initialize the default buffer pool from a configuration
+ * 
+ * @param config The pool configuration
+ * @return 0 on success, non-zero on failure
+ */
+int buffer_init_config(const buffer_config_t* config) {
+    if (g_buffer_pool) {
+        return -1; // Already initialized
+    }
+    
+    g_buffer_pool = (buffer_pool_t*)buffer_pool_create(config);
+    return g_buffer_pool ? 0 : -1;
+}
+
+/**
+ * @brief Initialize the buffer pool
+ * 
+ * @param capacity Maximum number of buffers in the pool
+ * @param buffer_size Size of each buffer
+ * @return 0 on success, non-zero on failure
+ */
+int buffer_init(size_t capacity, size_t buffer_size) {
+    buffer_config_t config;
+    buffer_config_default(&config);
+    config.capacity = capacity;
+    config.buffer_size = buffer_size;
+    
+    return buffer_init_config(&config);
+}
+
+/**
+ * @brief Destroy a buffer pool
+ * 
+ * @param handle The pool handle
+ * @return 0 on success, non-zero on failure
+ */
+int buffer_pool_destroy(void* handle) {
+    if (!handle) {
+        return -1;
+    }
+    
+    buffer_pool_t* pool = (buffer_pool_t*)handle;
+    if (retldb_atomic_load_int(&pool->users) != 0) {
+        return -1; // Still attached to a database
+    }
+    
+    // Quiesce background work before tearing the frames down
+    cleaner_stop(pool);
+    aio_destroy(pool->aio);
+    
+    // Write back whatever is still dirty before dropping it
+    int result = flush_pool(pool);
+    
+    // Free interned filenames
+    for (size_t i = 0; i < BUFFER_FILE_BUCKETS; i++) {
+        buffer_file_t* file = pool->files[i];
+        while (file) {
+            buffer_file_t* next = file->next;
+            if (file->handle) {
+                file_close(file->handle);
+            }
+            free(file->name);
+            free(file);
+            file = next;
+        }
+    }
+    
+    // Release shards, frame arenas and the pool itself
+    pool_release(pool, pool->shard_count);
+    
+    return result;
+}
+
+/**
+ * @brief Clean up the default buffer pool
+ * 
+ * @return 0 on success, non-zero on failure
+ */
+int buffer_cleanup(void) {
+    if (!g_buffer_pool) {
+        return -1; // Not initialized
+    }
+    
+    if (retldb_atomic_load_int(&g_buffer_pool->users) != 0) {
+        return -1; // Still attached to a database; keep it
+    }
+    
+    int result = buffer_pool_destroy(g_buffer_pool);
+    g_buffer_pool = NULL;
+    
+    return result;
+}
+
+/**
+ * @brief Register a user of a pool
+ * 
+ * @param handle The pool handle
+ * @return 0 on success, non-zero on failure
+ */
+int buffer_pool_attach(void* handle) {
+    if (!handle) {
+        return -1;
+    }
+    
+    retldb_atomic_fetch_add_int(&((buffer_pool_t*)handle)->users, 1);
+    return 0;
+}
+
+/**
+ * @brief Drop a user registered with buffer_pool_attach()
+ * 
+ * @param handle The pool handle
+ * @return 0 on success, non-zero on failure
+ */
+int buffer_pool_detach(void* handle) {
+    if (!handle) {
+        return -1;
+    }
+    
+    buffer_pool_t* pool = (buffer_pool_t*)handle;
+    if (retldb_atomic_fetch_add_int(&pool->users, -1) <= 0) {
+        retldb_atomic_fetch_add_int(&pool->users, 1);
+        return -1; // Not attached
+    }
+    return 0;
+}
+
+/**
+ * @brief Unlink an entry from its replacement queue
+ * 
+ * The caller must hold the shard lock.
+ * 
+ * @param shard The shard owning the entry
+ * @param entry The buffer entry to unlink
+ */
+static void queue_remove(buffer_shard_t* shard, buffer_entry_t* entry) {
+    buffer_queue_t* queue = &shard->queues[entry->queue];
+    
+    if (entry->prev) {
+        entry->prev->next = entry->next;
+    } else {
+        queue->head = entry->next;
+    }
+    
+    if (entry->next) {
+        entry->next->prev = entry->prev;
+    } else {
+        queue->tail = entry->prev;
+    }
+    
+    entry->next = NULL;
+    entry->prev = NULL;
+    queue->count--;
+}
+
+/**
+ * @brief Insert an entry into a replacement queue
+ * 
+ * The caller must hold the shard lock.
+ * 
+ * @param shard The shard owning the entry
+ * @param entry The buffer entry to insert
+ * @param queue_id The queue to insert into
+ * @param at_tail Insert at the eviction end instead of the head
+ */
+static void queue_insert(buffer_shard_t* shard, buffer_entry_t* entry, int queue_id, int at_tail) {
+    buffer_queue_t* queue = &shard->queues[queue_id];
+    entry->queue = queue_id;
+    
+    if (at_tail) {
+        entry->next = NULL;
+        entry->prev = queue->tail;
+        if (queue->tail) {
+            queue->tail->next = entry;
+        } else {
+            queue->head = entry;
+        }
+        queue->tail = entry;
+    } else {
+        entry->prev = NULL;
+        entry->next = queue->head;
+        if (queue->head) {
+            queue->head->prev = entry;
+        } else {
+            queue->tail = entry;
+        }
+        queue->head = entry;
+    }
+    
+    queue->count++;
+}
+
+/**
+ * @brief Find and retire a ghost entry for a page
+ * 
+ * The caller must hold the shard lock.
+ * 
+ * @param shard The shard to search
+ * @param file The file of the page
+ * @param page_no The page number
+ * @return 1 if the page was in the ghost history, 0 otherwise
+ */
+static int ghost_take(buffer_shard_t* shard, buffer_file_t* file, uint64_t page_no) {
+    if (!shard->ghosts) {
+        return 0;
+    }
+    
+    size_t* link = &shard->ghost_buckets[hash_page(file->id, page_no) & shard->ghost_mask];
+    while (*link != shard->ghost_capacity) {
+        buffer_ghost_t* ghost = &shard->ghosts[*link];
+        if (ghost->file == file && ghost->page_no == page_no) {
+            *link = ghost->hash_next;
+            ghost->file = NULL; // Leave the ring slot to age out
+            return 1;
+        }
+        link = &ghost->hash_next;
+    }
+    
+    return 0;
+}
+
+/**
+ * @brief Remember a page evicted from probation
+ * 
+ * The caller must hold the shard lock.
+ * 
+ * @param shard The shard owning the page
+ * @param file The file of the page
+ * @param page_no The page number
+ */
+static void ghost_add(buffer_shard_t* shard, buffer_file_t* file, uint64_t page_no) {
+    // Drop the oldest ghost when the ring is full
+    if (shard->ghost_count == shard->ghost_capacity) {
+        buffer_ghost_t* oldest = &shard->ghosts[shard->ghost_head];
+        if (oldest->file) {
+            ghost_take(shard, oldest->file, oldest->page_no);
+        }
+        shard->ghost_head = (shard->ghost_head + 1) % shard->ghost_capacity;
+        shard->ghost_count--;
+    }
+    
+    size_t index = (shard->ghost_head + shard->ghost_count) % shard->ghost_capacity;
+    size_t* bucket = &shard->ghost_buckets[hash_page(file->id, page_no) & shard->ghost_mask];
+    buffer_ghost_t* ghost = &shard->ghosts[index];
+    
+    ghost->file = file;
+    ghost->page_no = page_no;
+    ghost->hash_next = *bucket;
+    *bucket = index;
+    shard->ghost_count++;
+}
+
+/**
+ * @brief Find the evictable entry closest to the eviction end of a queue
+ * 
+ * Pins are only ever taken under the shard lock, which the caller holds, so
+ * an entry seen unpinned here stays unpinned. Entries the cleaner is
+ * writing (shared latch held) are passed over rather than waited for.
+ * 
+ * @param queue The queue to search
+ * @param mode Which dirty entries qualify
+ * @return The entry, NULL if no entry qualifies
+ */
+static buffer_entry_t* unpinned_tail(buffer_queue_t* queue, buffer_victim_t mode) {
+    buffer_entry_t* fallback = NULL;
+    int scanned = 0;
+    
+    for (buffer_entry_t* entry = queue->tail; entry; entry = entry->prev) {
+        if (retldb_atomic_load_int(&entry->pins) != 0 ||
+            retldb_atomic_load_int(&entry->readers) != 0) {
+            continue;
+        }
+        
+        if (!entry->dirty || mode == BUFFER_VICTIM_ANY) {
+            return entry;
+        }
+        
+        // A dirty page only goes if nothing clean is close behind it
+        if (mode == BUFFER_VICTIM_PREFER_CLEAN) {
+            if (!fallback) {
+                fallback = entry;
+            }
+            if (++scanned >= BUFFER_CLEAN_SCAN_DEPTH) {
+                break;
+            }
+        }
+    }
+    
+    return fallback;
+}
+
+/**
+ * @brief Pick the entry to evict from a full shard
+ * 
+ * Single-use pages always go first. Under 2Q the probation queue is drained
+ * while it exceeds its share, so scans cycle through it without touching the
+ * hot queue.
+ * 
+ * The caller must hold the shard lock.
+ * 
+ * @param shard The shard to evict from
+ * @param mode Which dirty pages may be chosen
+ * @return The victim entry, NULL if no frame qualifies
+ */
+static buffer_entry_t* choose_victim(buffer_shard_t* shard, buffer_victim_t mode) {
+    buffer_entry_t* hot = unpinned_tail(&shard->queues[BUFFER_QUEUE_HOT], mode);
+    buffer_entry_t* probation = unpinned_tail(&shard->queues[BUFFER_QUEUE_PROBATION], mode);
+    
+    if (probation && (probation->once || !hot ||
+                      shard->queues[BUFFER_QUEUE_PROBATION].count > shard->probation_capacity)) {
+        return probation;
+    }
+    
+    return hot;
+}
+
+/**
+ * @brief Update replacement state for a hit
+ * 
+ * The caller must hold the shard lock.
+ * 
+ * @param shard The shard owning the entry
+ * @param entry The buffer entry that was accessed
+ * @param hint The caller's access hint
+ */
+static void record_hit(buffer_shard_t* shard, buffer_entry_t* entry, buffer_access_t hint) {
+    if (hint == BUFFER_ACCESS_ONCE) {
+        return; // Never promote on a single-use access
+    }
+    
+    if (entry->once) {
+        // Reused after all; treat it as a regular hot page
+        entry->once = 0;
+        queue_remove(shard, entry);
+        queue_insert(shard, entry, BUFFER_QUEUE_HOT, 0);
+        return;
+    }
+    
+    if (entry->queue == BUFFER_QUEUE_HOT) {
+        // Move to head of LRU list (most recently used)
+        queue_remove(shard, entry);
+        queue_insert(shard, entry, BUFFER_QUEUE_HOT, 0);
+    }
+    
+    // 2Q leaves probation hits in place: correlated references within a
+    // short window say nothing about long-term reuse
+}
+
+/**
+ * @brief Insert a newly loaded entry into the replacement queues
+ * 
+ * The caller must hold the shard lock.
+ * 
+ * @param shard The shard owning the entry
+ * @param entry The new buffer entry
+ * @param hint The caller's access hint
+ */
+static void record_miss(buffer_shard_t* shard, buffer_entry_t* entry, buffer_access_t hint) {
+    entry->once = hint == BUFFER_ACCESS_ONCE;
+    
+    if (shard->pool->policy == BUFFER_POLICY_LRU) {
+        queue_insert(shard, entry, BUFFER_QUEUE_HOT, entry->once);
+    } else if (entry->once) {
+        queue_insert(shard, entry, BUFFER_QUEUE_PROBATION, 1);
+    } else if (ghost_take(shard, entry->file, entry->page_no)) {
+        // Referenced again soon after leaving probation: promote
+        queue_insert(shard, entry, BUFFER_QUEUE_HOT, 0);
+    } else {
+        queue_insert(shard, entry, BUFFER_QUEUE_PROBATION, 0);
+    }
+}
+
+/**
+ * @brief Count a finished miss's service time
+ * 
+ * The miss itself was counted when it started, so failed misses also show
+ * up in the hit ratio.
+ * 
+ * @param shard The shard that served the miss
+ * @param elapsed Service time in microseconds
+ */
+static void record_latency(buffer_shard_t* shard, uint64_t elapsed) {
+    size_t bucket = 0;
+    while (elapsed > 1 && bucket < BUFFER_LATENCY_BUCKETS - 1) {
+        elapsed >>= 1;
+        bucket++;
+    }
+    
+    retldb_atomic_fetch_add_u64(&shard->stats.miss_latency[bucket], 1);
+}
+
+/**
+ * @brief Count a miss that failed, along with its service time
+ * 
+ * @param shard The shard that served the miss
+ * @param start When the miss started, in microseconds
+ */
+static void record_failure(buffer_shard_t* shard, uint64_t start) {
+    retldb_atomic_fetch_add_u64(&shard->stats.errors, 1);
+    record_latency(shard, now_us() - start);
+}
+
+/**
+ * @brief Remove an entry from its page table bucket
+ * 
+ * The caller must hold the shard lock.
+ * 
+ * @param shard The shard owning the entry
+ * @param entry The buffer entry to unlink
+ */
+static void unlink_from_table(buffer_shard_t* shard, buffer_entry_t* entry) {
+    uint64_t hash = hash_page(entry->file->id, entry->page_no);
+    buffer_entry_t** link = &shard->buckets[hash & shard->bucket_mask];
+    
+    while (*link && *link != entry) {
+        link = &(*link)->hash_next;
+    }
+    
+    if (*link) {
+        *link = entry->hash_next;
+    }
+}
+
+/**
+ * @brief Find the shard and bucket for a page
+ * 
+ * @param pool The buffer pool
+ * @param file The interned file
+ * @param page_no The page number
+ * @param bucket Pointer to store the page table bucket
+ * @return The shard owning the page
+ */
+static buffer_shard_t* locate(buffer_pool_t* pool, const buffer_file_t* file, uint64_t page_no,
+                              buffer_entry_t*** bucket) {
+    // High bits pick the shard, low bits pick the bucket within it
+    uint64_t hash = hash_page(file->id, page_no);
+    buffer_shard_t* shard = &pool->shards[(hash >> 32) & (pool->shard_count - 1)];
+    *bucket = &shard->buckets[hash & shard->bucket_mask];
+    return shard;
+}
+
+/**
+ * @brief Search a page table bucket
+ * 
+ * The caller must hold the shard lock.
+ * 
+ * @param bucket The bucket to search
+ * @param file The interned file
+ * @param page_no The page number
+ * @return The resident entry, NULL if the page is not in the pool
+ */
+static buffer_entry_t* lookup(buffer_entry_t* const* bucket, const buffer_file_t* file,
+                              uint64_t page_no) {
+    for (buffer_entry_t* entry = *bucket; entry; entry = entry->hash_next) {
+        if (entry->page_no == page_no && entry->file == file) {
+            return entry;
+        }
+    }
+    
+    return NULL;
+}
+
+/**
+ * @brief Claim a frame for a page that is not resident
+ * 
+ * Takes a free frame or evicts a victim, then publishes the frame in the
+ * page table in the loading state, exclusively latched and pinned once for
+ * the loader. Concurrent requests for the page wait for the load instead of
+ * starting their own. The caller must hold the shard lock.
+ * 
+ * A dirty victim is never written here: it is pinned and handed back
+ * through writeback, for the caller to write once the shard lock is
+ * dropped before trying again.
+ * 
+ * @param shard The shard owning the page
+ * @param bucket The page table bucket of the page
+ * @param file The interned file
+ * @param page_no The page number
+ * @param hint The caller's access hint
+ * @param mode Which pages may be evicted
+ * @param writeback Set to a dirty victim that must be written back first
+ *                  (may be NULL with BUFFER_VICTIM_CLEAN)
+ * @return The claimed frame, NULL if no frame could be freed
+ */
+static buffer_entry_t* claim_frame(buffer_shard_t* shard, buffer_entry_t** bucket,
+                                   buffer_file_t* file, uint64_t page_no,
+                                   buffer_access_t hint, buffer_victim_t mode,
+                                   buffer_writeback_t* writeback) {
+    buffer_pool_t* pool = shard->pool;
+    int page_class = retldb_atomic_load_int(&file->page_class);
+    size_t size = pool->classes[page_class].size;
+    buffer_entry_t* entry;
+    
+    // Evict until the page fits in the shard's budget. Victims may be of any
+    // class; evicting before taking a frame means a failed write-back leaves
+    // the pool consistent.
+    while (shard->used + size > shard->budget) {
+        entry = choose_victim(shard, mode);
+        if (!entry) {
+            return NULL;
+        }
+        
+        if (entry->dirty) {
+            if (writeback) {
+                retldb_atomic_fetch_add_int(&entry->pins, 1);
+                writeback->entry = entry;
+                writeback->seq = entry->dirty_seq;
+            }
+            return NULL;
+        }
+        
+        // Pages leaving probation are remembered so a quick re-reference
+        // promotes them; single-use pages leave no trace
+        if (entry->queue == BUFFER_QUEUE_PROBATION && !entry->once) {
+            ghost_add(shard, entry->file, entry->page_no);
+        }
+        
+        queue_remove(shard, entry);
+        unlink_from_table(shard, entry);
+        shard->count--;
+        shard->used -= entry->size;
+        retldb_atomic_fetch_add_u64(&shard->stats.evictions, 1);
+        
+        // Memory moving to another class goes back to the system. The
+        // latch fails optimistic readers of the evicted page before its
+        // memory changes; the victim has no pins or readers, so it never waits.
+        latch_exclusive(entry);
+        if (entry->page_class != page_class) {
+            frame_release(entry);
+        }
+        unlatch_exclusive(entry);
+        entry->next = shard->free_frames[entry->page_class];
+        shard->free_frames[entry->page_class] = entry;
+    }
+    
+    // Each class has frames for the whole budget, so one is always free here
+    entry = shard->free_frames[page_class];
+    if (frame_commit(entry) != 0) {
+        return NULL;
+    }
+    shard->free_frames[page_class] = entry->next;
+    shard->used += size;
+    
+    // Unpinned frames have no latch holders, so this never waits; the odd
+    // version fails optimistic readers of the previous page
+    latch_exclusive(entry);
+    
+    entry->file = file;
+    entry->offset = (size_t)page_no * size;
+    entry->page_no = page_no;
+    entry->dirty = 0;
+    retldb_atomic_store_int(&entry->state, BUFFER_FRAME_LOADING);
+    retldb_atomic_store_int(&entry->pins, 1);
+    
+    entry->hash_next = *bucket;
+    *bucket = entry;
+    
+    record_miss(shard, entry, hint);
+    shard->count++;
+    
+    return entry;
+}
+
+/**
+ * @brief Make a loaded frame visible to readers
+ * 
+ * The loader's pin is left in place.
+ * 
+ * @param entry The claimed frame
+ */
+static void publish_frame(buffer_entry_t* entry) {
+    retldb_atomic_store_int(&entry->state, BUFFER_FRAME_READY);
+    unlatch_exclusive(entry);
+}
+
+/**
+ * @brief Return a frame whose load failed to the free list
+ * 
+ * @param entry The claimed frame
+ */
+static void abandon_frame(buffer_entry_t* entry) {
+    buffer_shard_t* shard = entry->shard;
+    
+    retldb_mutex_lock(&shard->lock);
+    queue_remove(shard, entry);
+    unlink_from_table(shard, entry);
+    shard->count--;
+    shard->used -= entry->size;
+    retldb_atomic_store_int(&entry->pins, 0);
+    retldb_atomic_store_int(&entry->state, BUFFER_FRAME_READY);
+    unlatch_exclusive(entry);
+    entry->next = shard->free_frames[entry->page_class];
+    shard->free_frames[entry->page_class] = entry;
+    retldb_mutex_unlock(&shard->lock);
+}
+
+/**
+ * @brief Get the pool's prefetch engine, starting it on first use
+ * 
+ * @param pool The buffer pool
+ * @return The engine, NULL if it could not be started
+ */
+static aio_engine_t* pool_aio(buffer_pool_t* pool) {
+    aio_engine_t* aio = (aio_engine_t*)retldb_atomic_load_ptr((void* const*)&pool->aio);
+    if (aio) {
+        return aio;
+    }
+    
+    retldb_mutex_lock(&pool->file_lock);
+    aio = pool->aio;
+    if (!aio) {
+        aio = aio_create(pool->io_depth, pool->io_backend == BUFFER_IO_THREADS ?
+                                         AIO_BACKEND_THREADS : AIO_BACKEND_AUTO);
+        retldb_atomic_store_ptr((void**)&pool->aio, aio);
+    }
+    retldb_mutex_unlock(&pool->file_lock);
+    
+    return aio;
+}
+
+/**
+ * @brief Finish an asynchronous page load
+ * 
+ * Runs on a prefetch engine thread. Short reads are completed in place.
+ * 
+ * @param arg The claimed frame
+ * @param result Bytes read, -1 on failure
+ */
+static void prefetch_done(void* arg, long long result) {
+    buffer_entry_t* entry = (buffer_entry_t*)arg;
+    
+    if (result < 0 || read_page(entry, (size_t)result) != 0) {
+        abandon_frame(entry);
+        return;
+    }
+    
+    publish_frame(entry);
+    retldb_atomic_fetch_add_int(&entry->pins, -1);
+}
+
+/**
+ * @brief Start loading a range of pages without waiting for them
+ * 
+ * Resident and loading pages are skipped. Prefetching never writes back a
+ * dirty page to make room; pages whose shard has no clean, unpinned frame
+ * are skipped too.
+ * 
+ * @param pool The buffer pool
+ * @param file The interned file
+ * @param first First page to load
+ * @param count Number of pages
+ * @param hint Access hint for the loaded pages
+ * @return 0 on success
+ */
+static int prefetch_pages(buffer_pool_t* pool, buffer_file_t* file, uint64_t first,
+                          uint64_t count, buffer_access_t hint) {
+    aio_engine_t* aio = pool_aio(pool);
+    
+    for (uint64_t page_no = first; page_no < first + count; page_no++) {
+        buffer_entry_t** bucket;
+        buffer_shard_t* shard = locate(pool, file, page_no, &bucket);
+        
+        retldb_mutex_lock(&shard->lock);
+        buffer_entry_t* entry = NULL;
+        if (!lookup(bucket, file, page_no)) {
+            entry = claim_frame(shard, bucket, file, page_no, hint, BUFFER_VICTIM_CLEAN,
+                                NULL);
+        }
+        retldb_mutex_unlock(&shard->lock);
+        
+        if (!entry) {
+            continue;
+        }
+        
+        void* handle = retldb_atomic_load_ptr(&file->handle);
+        if (handle && aio && aio_read(aio, handle, entry->data, entry->size, entry->offset,
+                                      prefetch_done, entry) == 0) {
+            continue;
+        }
+        
+        // Missing files read as zeros without I/O; if the engine is
+        // unavailable the page is read synchronously instead
+        prefetch_done(entry, 0);
+    }
+    
+    return 0;
+}
+
+/**
+ * @brief Detect sequential access and keep a read-ahead window ahead of it
+ * 
+ * After BUFFER_READAHEAD_TRIGGER consecutive pages of a file, the next
+ * window of pages is prefetched, and refilled whenever the reader gets
+ * within half a window of its end. Concurrent readers race benignly: at
+ * worst a window is detected late or skipped.
+ * 
+ * @param pool The buffer pool
+ * @param file The interned file
+ * @param page_no The page just requested
+ * @param hint The caller's access hint, inherited by prefetched pages
+ */
+static void readahead(buffer_pool_t* pool, buffer_file_t* file, uint64_t page_no,
+                      buffer_access_t hint) {
+    // A window never takes more than a quarter of the memory budget
+    uint64_t window = pool->readahead;
+    uint64_t most = pool->memory_budget / 4 / file_page_size(pool, file);
+    if (window > most) {
+        window = most;
+    }
+    if (window == 0) {
+        return;
+    }
+    
+    uint64_t expected = retldb_atomic_load_u64(&file->ra_next);
+    retldb_atomic_store_u64(&file->ra_next, page_no + 1);
+    if (page_no != expected) {
+        // Random access; start over
+        retldb_atomic_store_int(&file->ra_run, 0);
+        retldb_atomic_store_u64(&file->ra_end, 0);
+        return;
+    }
+    
+    if (retldb_atomic_fetch_add_int(&file->ra_run, 1) + 1 < BUFFER_READAHEAD_TRIGGER) {
+        return;
+    }
+    
+    uint64_t end = retldb_atomic_load_u64(&file->ra_end);
+    if (end > page_no + window / 2) {
+        return; // Enough pages are already on their way
+    }
+    
+    uint64_t start = end > page_no + 1 ? end : page_no + 1;
+    uint64_t new_end = page_no + 1 + window;
+    if (retldb_atomic_cas_u64(&file->ra_end, end, new_end)) {
+        prefetch_pages(pool, file, start, new_end - start, hint);
+    }
+}
+
+/**
+ * @brief Choose the page size for a file
+ * 
+ * @param handle The pool handle
+ * @param filename The file
+ * @param page_size The page size for the file
+ * @return 0 on success, non-zero on failure
+ */
+int buffer_pool_set_page_size(void* handle, const char* filename, size_t page_size) {
+    if (!handle || !filename) {
+        return -1;
+    }
+    
+    buffer_pool_t* pool = (buffer_pool_t*)handle;
+    
+    int page_class = -1;
+    for (int c = 0; c < pool->class_count; c++) {
+        if (pool->classes[c].size == page_size) {
+            page_class = c;
+        }
+    }
+    if (page_class < 0) {
+        return -1;
+    }
+    
+    buffer_file_t* file = intern_file(pool, filename);
+    if (!file) {
+        return -1;
+    }
+    
+    // Pages already cached were cut at the old size
+    int result = 0;
+    retldb_mutex_lock(&pool->file_lock);
+    if (retldb_atomic_load_int(&file->page_class) != page_class) {
+        if (retldb_atomic_load_int(&file->accessed)) {
+            result = -1;
+        } else {
+            retldb_atomic_store_int(&file->page_class, page_class);
+        }
+    }
+    retldb_mutex_unlock(&pool->file_lock);
+    
+    return result;
+}
+
+/**
+ * @brief Choose the page size for a file
+ * 
+ * @param filename The file
+ * @param page_size The page size for the file
+ * @return 0 on success, non-zero on failure
+ */
+int buffer_set_page_size(const char* filename, size_t page_size) {
+    return buffer_pool_set_page_size(g_buffer_pool, filename, page_size);
+}
+
+/**
+ * @brief Get a buffer from the pool with an access hint
+ * 
+ * @param handle The pool handle
+ * @param filename The filename associated with the buffer
+ * @param offset The offset in the file
+ * @param hint How the caller expects to use the page
+ * @return Pinned buffer handle on success, NULL on failure
+ */
+void* buffer_pool_get(void* handle, const char* filename, size_t offset, buffer_access_t hint) {
+    if (!handle || !filename) {
+        return NULL;
+    }
+    
+    buffer_pool_t* pool = (buffer_pool_t*)handle;
+    
+    buffer_file_t* file = intern_file(pool, filename);
+    if (!file) {
+        return NULL;
+    }
+    
+    uint64_t page_no = offset / file_page_size(pool, file);
+    buffer_entry_t** bucket;
+    buffer_shard_t* shard = locate(pool, file, page_no, &bucket);
+    buffer_entry_t* entry;
+    uint64_t start = 0;
+    int waited = 0;
+    
+    for (;;) {
+        retldb_mutex_lock(&shard->lock);
+        
+        // Check if buffer is already in the pool
+        entry = lookup(bucket, file, page_no);
+        if (!entry) {
+            if (!start) {
+                start = now_us();
+                retldb_atomic_fetch_add_u64(&shard->stats.misses, 1);
+            }
+            
+            // With a cleaner running, foreground misses leave dirty pages to it
+            buffer_writeback_t victim = { NULL, 0 };
+            entry = claim_frame(shard, bucket, file, page_no, hint,
+                                pool->dirty_high ? BUFFER_VICTIM_PREFER_CLEAN : BUFFER_VICTIM_ANY,
+                                &victim);
+            retldb_mutex_unlock(&shard->lock);
+            if (entry) {
+                break;
+            }
+            
+            // Only a dirty page can be evicted: get the cleaner going on the
+            // rest and write this one back without holding the shard. If a
+            // writer latched it meanwhile, it is pinned and the retry moves on.
+            if (victim.entry) {
+                wake_cleaner(pool);
+                if (write_back(pool, &victim, 1) < 0) {
+                    record_failure(shard, start);
+                    return NULL;
+                }
+                continue;
+            }
+            
+            // Frames latched by the cleaner come free once its batch is
+            // written; anything else is a real failure
+            if (!retldb_atomic_load_int(&pool->cleaner_holding)) {
+                record_failure(shard, start);
+                return NULL;
+            }
+        } else if (retldb_atomic_load_int(&entry->state) == BUFFER_FRAME_READY) {
+            retldb_atomic_fetch_add_int(&entry->pins, 1);
+            record_hit(shard, entry, hint);
+            retldb_mutex_unlock(&shard->lock);
+            retldb_atomic_fetch_add_u64(&shard->stats.hits, 1);
+            readahead(pool, file, page_no, hint);
+            return entry;
+        } else {
+            // Another thread is reading the page in; wait without holding
+            // the shard, then look again (the load may also have failed)
+            retldb_mutex_unlock(&shard->lock);
+        }
+        
+        if (!waited) {
+            retldb_atomic_fetch_add_u64(&shard->stats.pin_waits, 1);
+            waited = 1;
+        }
+        retldb_thread_yield();
+    }
+    
+    // Start any read-ahead before blocking on this page so the reads overlap
+    readahead(pool, file, page_no, hint);
+    
+    // Load data from file without holding the shard
+    if (read_page(entry, 0) != 0) {
+        abandon_frame(entry);
+        record_failure(shard, start);
+        return NULL;
+    }
+    
+    publish_frame(entry);
+    record_latency(shard, now_us() - start);
+    return entry;
+}
+
+/**
+ * @brief Get a buffer from the pool with an access hint
+ * 
+ * @param filename The filename associated with the buffer
+ * @param offset The offset in the file
+ * @param hint How the caller expects to use the page
+ * @return Pinned buffer handle on success, NULL on failure
+ */
+void* buffer_get_hint(const char* filename, size_t offset, buffer_access_t hint) {
+    return buffer_pool_get(g_buffer_pool, filename, offset, hint);
+}
+
+/**
+ * @brief Get a buffer from the pool
+ * 
+ * @param filename The filename associated with the buffer
+ * @param offset The offset in the file
+ * @return Pinned buffer handle on success, NULL on failure
+ */
+void* buffer_get(const char* filename, size_t offset) {
+    return buffer_get_hint(filename, offset, BUFFER_ACCESS_NORMAL);
+}
+
+/**
+ * @brief Start reading a byte range of a file into the pool
+ * 
+ * @param handle The pool handle
+ * @param filename The file to read
+ * @param offset Offset of the first byte
+ * @param len Number of bytes
+ * @return 0 on success, non-zero on failure
+ */
+int buffer_pool_prefetch(void* handle, const char* filename, size_t offset, size_t len) {
+    if (!handle || !filename) {
+        return -1;
+    }
+    
+    buffer_pool_t* pool = (buffer_pool_t*)handle;
+    
+    buffer_file_t* file = intern_file(pool, filename);
+    if (!file) {
+        return -1;
+    }
+    
+    if (len == 0) {
+        return 0;
+    }
+    
+    size_t page_size = file_page_size(pool, file);
+    uint64_t first = offset / page_size;
+    uint64_t last = ((uint64_t)offset + len - 1) / page_size;
+    return prefetch_pages(pool, file, first, last - first + 1, BUFFER_ACCESS_NORMAL);
+}
+
+/**
+ * @brief Start reading a byte range of a file into the pool
+ * 
+ * @param filename The file to read
+ * @param offset Offset of the first byte
+ * @param len Number of bytes
+ * @return 0 on success, non-zero on failure
+ */
+int buffer_prefetch(const char* filename, size_t offset, size_t len) {
+    return buffer_pool_prefetch(g_buffer_pool, filename, offset, len);
+}
+
+/**
+ * @brief Add a pin to a buffer the caller already holds pinned
+ * 
+ * @param buffer The buffer handle
+ * @return 0 on success, non-zero on failure
+ */
+int buffer_pin(void* buffer) {
+    if (!buffer) {
+        return -1;
+    }
+    
+    buffer_entry_t* entry = (buffer_entry_t*)buffer;
+    if (retldb_atomic_load_int(&entry->pins) <= 0) {
+        return -1; // Only a pinned frame is guaranteed to still hold the page
+    }
+    
+    retldb_atomic_fetch_add_int(&entry->pins, 1);
+    return 0;
+}
+
+/**
+ * @brief Release a pin on a buffer
+ * 
+ * @param buffer The buffer handle
+ * @return 0 on success, non-zero on failure
+ */
+int buffer_unpin(void* buffer) {
+    if (!buffer) {
+        return -1;
+    }
+    
+    buffer_entry_t* entry = (buffer_entry_t*)buffer;
+    if (retldb_atomic_fetch_add_int(&entry->pins, -1) <= 0) {
+        retldb_atomic_fetch_add_int(&entry->pins, 1);
+        return -1; // Not pinned
+    }
+    
+    return 0;
+}
+
+/**
+ * @brief Acquire a buffer's shared latch
+ * 
+ * @param buffer The pinned buffer handle
+ * @return 0 on success, non-zero on failure
+ */
+int buffer_latch_shared(void* buffer) {
+    if (!buffer) {
+        return -1;
+    }
+    
+    latch_shared((buffer_entry_t*)buffer);
+    return 0;
+}
+
+/**
+ * @brief Release a buffer's shared latch
+ * 
+ * @param buffer The buffer handle
+ * @return 0 on success, non-zero on failure
+ */
+int buffer_unlatch_shared(void* buffer) {
+    if (!buffer) {
+        return -1;
+    }
+    
+    unlatch_shared((buffer_entry_t*)buffer);
+    return 0;
+}
+
+/**
+ * @brief Acquire a buffer's exclusive latch
+ * 
+ * @param buffer The pinned buffer handle
+ * @return 0 on success, non-zero on failure
+ */
+int buffer_latch_exclusive(void* buffer) {
+    if (!buffer) {
+        return -1;
+    }
+    
+    latch_exclusive((buffer_entry_t*)buffer);
+    return 0;
+}
+
+/**
+ * @brief Release a buffer's exclusive latch
+ * 
+ * @param buffer The buffer handle
+ * @return 0 on success, non-zero on failure
+ */
+int buffer_unlatch_exclusive(void* buffer) {
+    if (!buffer) {
+        return -1;
+    }
+    
+    unlatch_exclusive((buffer_entry_t*)buffer);
+    return 0;
+}
+
+/**
+ * @brief Look up a resident page for an optimistic read without pinning it
+ * 
+ * @param handle The pool handle
+ * @param filename The filename associated with the buffer
+ * @param offset The offset in the file
+ * @param version Pointer to store the version to validate against
+ * @return Buffer handle, NULL if the page is not resident or is being written
+ */
+void* buffer_pool_peek(void* handle, const char* filename, size_t offset, uint64_t* version) {
+    if (!handle || !filename || !version) {
+        return NULL;
+    }
+    
+    buffer_pool_t* pool = (buffer_pool_t*)handle;
+    
+    buffer_file_t* file = intern_file(pool, filename);
+    if (!file) {
+        return NULL;
+    }
+    
+    uint64_t page_no = offset / file_page_size(pool, file);
+    buffer_entry_t** bucket;
+    buffer_shard_t* shard = locate(pool, file, page_no, &bucket);
+    
+    retldb_mutex_lock(&shard->lock);
+    buffer_entry_t* entry = lookup(bucket, file, page_no);
+    if (entry) {
+        *version = retldb_atomic_load_u64(&entry->version);
+        if (*version & 1) {
+            entry = NULL; // Loading or exclusively latched
+        }
+    }
+    retldb_mutex_unlock(&shard->lock);
+    
+    return entry;
+}
+
+/**
+ * @brief Look up a resident page for an optimistic read without pinning it
+ * 
+ * @param filename The filename associated with the buffer
+ * @param offset The offset in the file
+ * @param version Pointer to store the version to validate against
+ * @return Buffer handle, NULL if the page is not resident or is being written
+ */
+void* buffer_peek(const char* filename, size_t offset, uint64_t* version) {
+    return buffer_pool_peek(g_buffer_pool, filename, offset, version);
+}
+
+/**
+ * @brief Check that an optimistic read saw a consistent page
+ * 
+ * @param buffer The buffer handle returned by buffer_peek()
+ * @param version The version returned by buffer_peek()
+ * @return 1 if the page was not modified or replaced since, 0 otherwise
+ */
+int buffer_validate(void* buffer, uint64_t version) {
+    if (!buffer) {
+        return 0;
+    }
+    
+    // Order the caller's data reads before the version check
+    retldb_atomic_fence();
+    return retldb_atomic_load_u64(&((buffer_entry_t*)buffer)->version) == version;
+}
+
+/**
+ * @brief Get the data of a buffer
+ * 
+ * @param buffer The buffer handle
+ * @return Pointer to the page data, NULL on failure
+ */
+void* buffer_get_data(void* buffer) {
+    if (!buffer) {
+        return NULL;
+    }
+    
+    return ((buffer_entry_t*)buffer)->data;
+}
+
+/**
+ * @brief Get the size of a buffer
+ * 
+ * @param buffer The buffer handle
+ * @return Size of the page data, 0 on failure
+ */
+size_t buffer_get_size(void* buffer) {
+    if (!buffer) {
+        return 0;
+    }
+    
+    return ((buffer_entry_t*)buffer)->size;
+}
+
+/**
+ * @brief Mark a buffer as dirty
+ * 
+ * @param buffer The buffer handle
+ * @return 0 on success, non-zero on failure
+ */
+int buffer_mark_dirty(void* buffer) {
+    if (!buffer) {
+        return -1;
+    }
+    
+    buffer_entry_t* entry = (buffer_entry_t*)buffer;
+    buffer_shard_t* shard = entry->shard;
+    buffer_pool_t* pool = shard->pool;
+    retldb_mutex_lock(&shard->lock);
+    
+    if (!entry->dirty) {
+        entry->dirty = 1;
+        retldb_atomic_fetch_add_u64(&pool->dirty_bytes, entry->size);
+    }
+    entry->dirty_seq++;
+    
+    // A modified page is no longer a throwaway
+    record_hit(shard, entry, BUFFER_ACCESS_NORMAL);
+    
+    retldb_mutex_unlock(&shard->lock);
+    
+    if (pool->dirty_high && retldb_atomic_load_u64(&pool->dirty_bytes) >= pool->dirty_high &&
+        !retldb_atomic_load_int(&pool->cleaner_draining)) {
+        wake_cleaner(pool);
+    }
+    
+    return 0;
+}
+
+/**
+ * @brief Flush a dirty buffer to disk
+ * 
+ * @param buffer The buffer handle
+ * @return 0 on success, RETLDB_ERROR_BUSY if the buffer is exclusively
+ *         latched, other non-zero on failure
+ */
+int buffer_flush(void* buffer) {
+    if (!buffer) {
+        return -1; // Error: NULL pointer
+    }
+    
+    buffer_entry_t* entry = (buffer_entry_t*)buffer;
+    buffer_shard_t* shard = entry->shard;
+    buffer_writeback_t page = { entry, 0 };
+    
+    retldb_mutex_lock(&shard->lock);
+    if (!entry->dirty) {
+        retldb_mutex_unlock(&shard->lock);
+        return 0;
+    }
+    retldb_atomic_fetch_add_int(&entry->pins, 1);
+    page.seq = entry->dirty_seq;
+    retldb_mutex_unlock(&shard->lock);
+    
+    // An exclusive latch is reported rather than waited for: the latch
+    // word does not record its holder, which may be the caller
+    return write_back(shard->pool, &page, 1);
+}
+
+/**
+ * @brief Flush all dirty buffers of a pool
+ * 
+ * @param handle The pool handle
+ * @return 0 on success, RETLDB_ERROR_BUSY if a latched page was left dirty,
+ *         other non-zero on failure
+ */
+int buffer_pool_flush_all(void* handle) {
+    if (!handle) {
+        return -1;
+    }
+    
+    return flush_pool((buffer_pool_t*)handle);
+}
+
+/**
+ * @brief Flush all dirty buffers
+ * 
+ * @return 0 on success, RETLDB_ERROR_BUSY if a latched page was left dirty,
+ *         other non-zero on failure
+ */
+int buffer_flush_all(void) {
+    return buffer_pool_flush_all(g_buffer_pool);
+}
+
+/**
+ * @brief Take a snapshot of the pool statistics
+ * 
+ * @param handle The pool handle
+ * @param stats The statistics to fill
+ * @return 0 on success, non-zero on failure
+ */
+int buffer_pool_stats_snapshot(void* handle, buffer_stats_t* stats) {
+    if (!handle || !stats) {
+        return -1;
+    }
+    
+    buffer_pool_t* pool = (buffer_pool_t*)handle;
+    memset(stats, 0, sizeof(*stats));
+    
+    for (size_t i = 0; i < pool->shard_count; i++) {
+        buffer_shard_t* shard = &pool->shards[i];
+        buffer_counters_t* counters = &shard->stats;
+        
+        stats->hits += retldb_atomic_load_u64(&counters->hits);
+        stats->misses += retldb_atomic_load_u64(&counters->misses);
+        stats->errors += retldb_atomic_load_u64(&counters->errors);
+        stats->evictions += retldb_atomic_load_u64(&counters->evictions);
+        stats->dirty_writes += retldb_atomic_load_u64(&counters->dirty_writes);
+        stats->read_bytes += retldb_atomic_load_u64(&counters->read_bytes);
+        stats->write_bytes += retldb_atomic_load_u64(&counters->write_bytes);
+        stats->pin_waits += retldb_atomic_load_u64(&counters->pin_waits);
+        for (size_t b = 0; b < BUFFER_LATENCY_BUCKETS; b++) {
+            stats->miss_latency[b] += retldb_atomic_load_u64(&counters->miss_latency[b]);
+        }
+        
+        retldb_mutex_lock(&shard->lock);
+        stats->resident += shard->count;
+        stats->memory_used += shard->used;
+        retldb_mutex_unlock(&shard->lock);
+    }
+    
+    stats->capacity = pool->capacity;
+    stats->memory_budget = pool->memory_budget;
+    stats->dirty_bytes = (size_t)retldb_atomic_load_u64(&pool->dirty_bytes);
+    
+    return 0;
+}
+
+/**
+ * @brief Take a snapshot of the pool statistics
+ * 
+ * @param stats The statistics to fill
+ * @return 0 on success, non-zero on failure
+ */
+int buffer_stats_snapshot(buffer_stats_t* stats) {
+    return buffer_pool_stats_snapshot(g_buffer_pool, stats);
+}
+
+/**
+ * @brief Reset the pool statistics counters to zero
+ * 
+ * @param handle The pool handle
+ * @return 0 on success, non-zero on failure
+ */
+int buffer_pool_stats_reset(void* handle) {
+    if (!handle) {
+        return -1;
+    }
+    
+    buffer_pool_t* pool = (buffer_pool_t*)handle;
+    for (size_t i = 0; i < pool->shard_count; i++) {
+        buffer_counters_t* counters = &pool->shards[i].stats;
+        
+        retldb_atomic_store_u64(&counters->hits, 0);
+        retldb_atomic_store_u64(&counters->misses, 0);
+        retldb_atomic_store_u64(&counters->errors, 0);
+        retldb_atomic_store_u64(&counters->evictions, 0);
+        retldb_atomic_store_u64(&counters->dirty_writes, 0);
+        retldb_atomic_store_u64(&counters->read_bytes, 0);
+        retldb_atomic_store_u64(&counters->write_bytes, 0);
+        retldb_atomic_store_u64(&counters->pin_waits, 0);
+        for (size_t b = 0; b < BUFFER_LATENCY_BUCKETS; b++) {
+            retldb_atomic_store_u64(&counters->miss_latency[b], 0);
+        }
+    }
+    
+    return 0;
+}
+
+/**
+ * @brief Reset the pool statistics counters to zero
+ * 
+ * @return 0 on success, non-zero on failure
+ */
+int buffer_stats_reset(void) {
+    return buffer_pool_stats_reset(g_buffer_pool);
+}
@@ -0,0 +1,467 @@
+/**
+ * @file chunk_cache.c
+ * @brief Implementation of the decoded chunk cache for rETL DB
+ *
+ * Holds column chunks after they have been read, verified, decompressed
+ * and decoded, keyed by segment fingerprint, row group and column. Chunks
+ * handed out by chunk_cache_acquire() are pinned until released; released
+ * chunks wait on an idle list in least-recently-used order and are freed
+ * from its tail whenever the cache holds more bytes than its capacity.
+ */
+
+/* Define _POSIX_C_SOURCE for the clock_gettime inlined from common/sync.h */
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "retldb/storage.h"
+#include "common/sync.h"
+
+#define CHUNK_CACHE_DEFAULT ((size_t)256 << 20)  // Capacity when none is given
+#define CHUNK_CACHE_BUCKETS 4096                 // Hash buckets for chunk keys
+
+/**
+ * @brief Cached decoded chunk
+ */
+typedef struct chunk_cache_entry {
+    uint64_t fingerprint;                 // Fingerprint of the segment
+    size_t row_group;                     // Row group index
+    size_t column;                        // Column index
+    segment_vector_t vector;              // Decoded values, pointing into stored or scratch
+    void* stored;                         // Chunk as read, NULL unless the vector uses it
+    void* scratch;                        // Decompressed and decoded chunk
+    size_t bytes;                         // Bytes charged to the cache
+    int pins;                             // Outstanding acquisitions
+    struct chunk_cache_entry* next;       // Next entry in the bucket, or next victim
+    struct chunk_cache_entry* lru_prev;   // Previous idle entry (more recently used), or pinned entry
+    struct chunk_cache_entry* lru_next;   // Next idle entry (less recently used), or pinned entry
+} chunk_cache_entry_t;
+
+/**
+ * @brief Chunk cache structure
+ */
+typedef struct {
+    retldb_mutex_t lock;                  // Protects everything below
+    size_t capacity;                      // Bytes kept before idle chunks are dropped
+    size_t bytes;                         // Bytes held by cached chunks
+    size_t entries;                       // Chunks cached
+    size_t pinned;                        // Chunks with at least one pin
+    uint64_t hits;                        // Acquisitions served from the cache
+    uint64_t misses;                      // Acquisitions that loaded the chunk
+    uint64_t evictions;                   // Idle chunks dropped to stay within capacity
+    chunk_cache_entry_t* buckets[CHUNK_CACHE_BUCKETS];  // Entries by key
+    chunk_cache_entry_t* lru_head;        // Most recently released idle entry
+    chunk_cache_entry_t* lru_tail;        // Least recently released idle entry
+    chunk_cache_entry_t* pinned_head;     // Pinned entries, in no particular order
+} chunk_cache_t;
+
+/**
+ * @brief Hash a chunk key
+ *
+ * @param fingerprint Fingerprint of the segment
+ * @param row_group Row group index
+ * @param column Column index
+ * @return Bucket index for the key
+ */
+static size_t key_bucket(uint64_t fingerprint, size_t row_group, size_t column) {
+    uint64_t hash = fingerprint ^ ((uint64_t)row_group * 0x9e3779b97f4a7c15ULL) ^
+                    ((uint64_t)column * 0xc2b2ae3d27d4eb4fULL);
+    hash ^= hash >> 29;
+    hash *= 0xbf58476d1ce4e5b9ULL;
+    return (size_t)(hash >> 32) % CHUNK_CACHE_BUCKETS;
+}
+
+/**
+ * @brief Find an entry by key
+ *
+ * Must be called with the cache lock held.
+ *
+ * @param cache The cache
+ * @param fingerprint Fingerprint of the segment
+ * @param row_group Row group index
+ * @param column Column index
+ * @return The entry, or NULL if the chunk is not cached
+ */
+static chunk_cache_entry_t* find(chunk_cache_t* cache, uint64_t fingerprint, size_t row_group,
+                                 size_t column) {
+    chunk_cache_entry_t* entry = cache->buckets[key_bucket(fingerprint, row_group, column)];
+    while (entry && (entry->fingerprint != fingerprint || entry->row_group != row_group ||
+                     entry->column != column)) {
+        entry = entry->next;
+    }
+    return entry;
+}
+
+/**
+ * @brief Take an entry off the idle list
+ *
+ * Must be called with the cache lock held.
+ *
+ * @param cache The cache
+ * @param entry The entry, which must be idle
+ */
+static void lru_remove(chunk_cache_t* cache, chunk_cache_entry_t* entry) {
+    if (entry->lru_prev) {
+        entry->lru_prev->lru_next = entry->lru_next;
+    } else {
+        cache->lru_head = entry->lru_next;
+    }
+    if (entry->lru_next) {
+        entry->lru_next->lru_prev = entry->lru_prev;
+    } else {
+        cache->lru_tail = entry->lru_prev;
+    }
+    entry->lru_prev = entry->lru_next = NULL;
+}
+
+/**
+ * @brief Put an entry that just gained its first pin on the pinned list
+ *
+ * Must be called with the cache lock held.
+ *
+ * @param cache The cache
+ * @param entry The entry, on neither list
+ */
+static void pinned_add(chunk_cache_t* cache, chunk_cache_entry_t* entry) {
+    entry->lru_prev = NULL;
+    entry->lru_next = cache->pinned_head;
+    if (cache->pinned_head) {
+        cache->pinned_head->lru_prev = entry;
+    }
+    cache->pinned_head = entry;
+    cache->pinned++;
+}
+
+/**
+ * @brief Take an entry that lost its last pin off the pinned list
+ *
+ * Must be called with the cache lock held.
+ *
+ * @param cache The cache
+ * @param entry The entry, which must be on the pinned list
+ */
+static void pinned_remove(chunk_cache_t* cache, chunk_cache_entry_t* entry) {
+    if (entry->lru_prev) {
+        entry->lru_prev->lru_next = entry->lru_next;
+    } else {
+        cache->pinned_head = entry->lru_next;
+    }
+    if (entry->lru_next) {
+        entry->lru_next->lru_prev = entry->lru_prev;
+    }
+    entry->lru_prev = entry->lru_next = NULL;
+    cache->pinned--;
+}
+
+/**
+ * @brief Add a pin to an entry, taking it off the idle list if needed
+ *
+ * Must be called with the cache lock held.
+ *
+ * @param cache The cache
+ * @param entry The entry
+ */
+static void pin(chunk_cache_t* cache, chunk_cache_entry_t* entry) {
+    if (entry->pins++ == 0) {
+        lru_remove(cache, entry);
+        pinned_add(cache, entry);
+    }
+}
+
+/**
+ * @brief Unlink idle entries until the cache is within capacity
+ *
+ * Must be called with the cache lock held.
+ *
+ * @param cache The cache
+ * @param victims Unlinked entries are pushed here, chained through next
+ * @param limit Bytes that may stay cached
+ */
+static void trim(chunk_cache_t* cache, chunk_cache_entry_t** victims, size_t limit) {
+    while (cache->bytes > limit && cache->lru_tail) {
+        chunk_cache_entry_t* entry = cache->lru_tail;
+        lru_remove(cache, entry);
+        
+        chunk_cache_entry_t** link =
+            &cache->buckets[key_bucket(entry->fingerprint, entry->row_group, entry->column)];
+        while (*link != entry) {
+            link = &(*link)->next;
+        }
+        *link = entry->next;
+        
+        cache->bytes -= entry->bytes;
+        cache->entries--;
+        cache->evictions++;
+        entry->next = *victims;
+        *victims = entry;
+    }
+}
+
+/**
+ * @brief Free an entry and its data
+ *
+ * @param entry The entry
+ */
+static void free_entry(chunk_cache_entry_t* entry) {
+    free(entry->stored);
+    free(entry->scratch);
+    free(entry);
+}
+
+/**
+ * @brief Free a chain of unlinked entries
+ *
+ * @param victims Entries chained through next
+ */
+static void free_entries(chunk_cache_entry_t* victims) {
+    while (victims) {
+        chunk_cache_entry_t* next = victims->next;
+        free_entry(victims);
+        victims = next;
+    }
+}
+
+/**
+ * @brief Read, verify, decompress and decode a chunk into a new entry
+ *
+ * @param segment The segment handle
+ * @param row_group Row group index
+ * @param column Column index
+ * @return The entry, NULL on failure
+ */
+static chunk_cache_entry_t* load(void* segment, size_t row_group, size_t column) {
+    segment_chunk_t chunk;
+    if (segment_chunk(segment, row_group, column, &chunk) != 0) {
+        return NULL;
+    }
+    
+    chunk_cache_entry_t* entry = (chunk_cache_entry_t*)calloc(1, sizeof(chunk_cache_entry_t));
+    if (!entry) {
+        return NULL;
+    }
+    size_t scratch_size = segment_scratch_size(&chunk);
+    entry->stored = malloc(chunk.size ? (size_t)chunk.size : 1);
+    entry->scratch = scratch_size ? malloc(scratch_size) : NULL;
+    if (!entry->stored || (scratch_size && !entry->scratch) ||
+        segment_read_chunk(segment, row_group, column, entry->stored) != 0 ||
+        segment_decode_chunk(segment, row_group, column, entry->stored, entry->scratch,
+                             &entry->vector) != 0) {
+        free_entry(entry);
+        return NULL;
+    }
+    
+    // A compressed chunk is fully unpacked into scratch; the stored bytes can go
+    if (chunk.compression != SEGMENT_COMPRESSION_NONE) {
+        free(entry->stored);
+        entry->stored = NULL;
+    }
+    entry->fingerprint = segment_fingerprint(segment);
+    entry->row_group = row_group;
+    entry->column = column;
+    entry->bytes = sizeof(*entry) + scratch_size + (entry->stored ? (size_t)chunk.size : 0);
+    return entry;
+}
+
+/**
+ * @brief Create a cache of decoded column chunks
+ *
+ * @param capacity Bytes to keep, 0 for a default of 256 MiB
+ * @return Cache handle on success, NULL on failure
+ */
+void* chunk_cache_create(size_t capacity) {
+    chunk_cache_t* cache = (chunk_cache_t*)calloc(1, sizeof(chunk_cache_t));
+    if (!cache) {
+        return NULL;
+    }
+    
+    if (retldb_mutex_init(&cache->lock) != 0) {
+        free(cache);
+        return NULL;
+    }
+    
+    cache->capacity = capacity ? capacity : CHUNK_CACHE_DEFAULT;
+    return cache;
+}
+
+/**
+ * @brief Destroy a decoded chunk cache
+ *
+ * @param handle The cache handle
+ * @return 0 on success, non-zero if chunks are still acquired (the cache is kept)
+ */
+int chunk_cache_destroy(void* handle) {
+    chunk_cache_t* cache = (chunk_cache_t*)handle;
+    if (!cache) {
+        return -1;
+    }
+    
+    chunk_cache_entry_t* victims = NULL;
+    retldb_mutex_lock(&cache->lock);
+    if (cache->pinned > 0) {
+        retldb_mutex_unlock(&cache->lock);
+        return -1;
+    }
+    trim(cache, &victims, 0);
+    retldb_mutex_unlock(&cache->lock);
+    
+    free_entries(victims);
+    retldb_mutex_destroy(&cache->lock);
+    free(cache);
+    return 0;
+}
+
+/**
+ * @brief Get the decoded values of a chunk, loading them on a miss
+ *
+ * @param handle The cache handle
+ * @param segment The segment handle
+ * @param row_group Row group index
+ * @param column Column index
+ * @param vector Filled with the values, valid until chunk_cache_release()
+ * @return Handle pinning the chunk, NULL on failure
+ */
+const void* chunk_cache_acquire(void* handle, void* segment, size_t row_group, size_t column,
+                                segment_vector_t* vector) {
+    chunk_cache_t* cache = (chunk_cache_t*)handle;
+    uint64_t fingerprint = segment_fingerprint(segment);
+    if (!cache || !vector || fingerprint == 0) {
+        return NULL;
+    }
+    
+    retldb_mutex_lock(&cache->lock);
+    chunk_cache_entry_t* entry = find(cache, fingerprint, row_group, column);
+    if (entry) {
+        pin(cache, entry);
+        cache->hits++;
+        *vector = entry->vector;
+        retldb_mutex_unlock(&cache->lock);
+        return entry;
+    }
+    cache->misses++;
+    retldb_mutex_unlock(&cache->lock);
+    
+    // Read and decode without the lock so hits on other chunks are not held up
+    entry = load(segment, row_group, column);
+    if (!entry) {
+        return NULL;
+    }
+    entry->pins = 1;
+    
+    chunk_cache_entry_t* victims = NULL;
+    retldb_mutex_lock(&cache->lock);
+    chunk_cache_entry_t* existing = find(cache, fingerprint, row_group, column);
+    if (existing) {
+        // Another thread loaded it meanwhile; use theirs
+        pin(cache, existing);
+        *vector = existing->vector;
+        retldb_mutex_unlock(&cache->lock);
+        free_entry(entry);
+        return existing;
+    }
+    
+    size_t bucket = key_bucket(fingerprint, row_group, column);
+    entry->next = cache->buckets[bucket];
+    cache->buckets[bucket] = entry;
+    cache->entries++;
+    pinned_add(cache, entry);
+    cache->bytes += entry->bytes;
+    *vector = entry->vector;
+    trim(cache, &victims, cache->capacity);
+    retldb_mutex_unlock(&cache->lock);
+    
+    free_entries(victims);
+    return entry;
+}
+
+/**
+ * @brief Release a chunk obtained from chunk_cache_acquire()
+ *
+ * @param handle The cache handle
+ * @param chunk The handle returned by chunk_cache_acquire()
+ * @return 0 on success, non-zero on failure
+ */
+int chunk_cache_release(void* handle, const void* chunk) {
+    chunk_cache_t* cache = (chunk_cache_t*)handle;
+    if (!cache || !chunk) {
+        return -1;
+    }
+    
+    // Only pinned entries can be released, so the handle is looked up among
+    // them by address: a stale handle may point at freed memory
+    chunk_cache_entry_t* victims = NULL;
+    retldb_mutex_lock(&cache->lock);
+    chunk_cache_entry_t* entry = cache->pinned_head;
+    while (entry && entry != chunk) {
+        entry = entry->lru_next;
+    }
+    if (!entry) {
+        retldb_mutex_unlock(&cache->lock);
+        return -1;
+    }
+    
+    if (--entry->pins == 0) {
+        pinned_remove(cache, entry);
+        entry->lru_next = cache->lru_head;
+        if (cache->lru_head) {
+            cache->lru_head->lru_prev = entry;
+        } else {
+            cache->lru_tail = entry;
+        }
+        cache->lru_head = entry;
+        trim(cache, &victims, cache->capacity);
+    }
+    retldb_mutex_unlock(&cache->lock);
+    
+    free_entries(victims);
+    return 0;
+}
+
+/**
+ * @brief Change the capacity of a decoded chunk cache
+ *
+ * @param handle The cache handle
+ * @param capacity Bytes to keep (idle chunks over it are dropped at once)
+ * @return 0 on success, non-zero on failure
+ */
+int chunk_cache_set_capacity(void* handle, size_t capacity) {
+    chunk_cache_t* cache = (chunk_cache_t*)handle;
+    if (!cache) {
+        return -1;
+    }
+    
+    chunk_cache_entry_t* victims = NULL;
+    retldb_mutex_lock(&cache->lock);
+    cache->capacity = capacity;
+    trim(cache, &victims, capacity);
+    retldb_mutex_unlock(&cache->lock);
+    
+    free_entries(victims);
+    return 0;
+}
+
+/**
+ * @brief Get decoded chunk cache statistics
+ *
+ * @param handle The cache handle
+ * @param stats Filled with the current counters
+ * @return 0 on success, non-zero on failure
+ */
+int chunk_cache_stats(void* handle, chunk_cache_stats_t* stats) {
+    chunk_cache_t* cache = (chunk_cache_t*)handle;
+    if (!cache || !stats) {
+        return -1;
+    }
+    
+    retldb_mutex_lock(&cache->lock);
+    stats->hits = cache->hits;
+    stats->misses = cache->misses;
+    stats->evictions = cache->evictions;
+    stats->entries = cache->entries;
+    stats->pinned = cache->pinned;
+    stats->bytes = cache->bytes;
+    stats->capacity = cache->capacity;
+    retldb_mutex_unlock(&cache->lock);
+    return 0;
+}
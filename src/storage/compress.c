@@ -0,0 +1,134 @@
+/**
+ * @file compress.c
+ * @brief Implementation of block compression for rETL DB
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <limits.h>
+
+#include <lz4.h>
+#include <snappy-c.h>
+
+#include "retldb/storage.h"
+#include "storage/compress.h"
+
+/**
+ * @brief Check whether a codec is known
+ *
+ * @param compression SEGMENT_COMPRESSION_*
+ * @return Non-zero if supported
+ */
+int compress_supported(uint32_t compression) {
+    return compression == SEGMENT_COMPRESSION_NONE || compression == SEGMENT_COMPRESSION_LZ4 ||
+           compression == SEGMENT_COMPRESSION_SNAPPY;
+}
+
+/**
+ * @brief Get the largest compressed size of a block
+ *
+ * @param compression SEGMENT_COMPRESSION_*
+ * @param size Bytes to compress
+ * @return Bytes a destination must hold, 0 if the block is too large for the codec
+ */
+size_t compress_bound(uint32_t compression, size_t size) {
+    switch (compression) {
+        case SEGMENT_COMPRESSION_NONE:
+            return size;
+        case SEGMENT_COMPRESSION_LZ4:
+            // LZ4 blocks are limited to LZ4_MAX_INPUT_SIZE and sized in int
+            return size <= LZ4_MAX_INPUT_SIZE ? (size_t)LZ4_compressBound((int)size) : 0;
+        case SEGMENT_COMPRESSION_SNAPPY:
+            return size <= UINT32_MAX ? snappy_max_compressed_length(size) : 0;
+        default:
+            return 0;
+    }
+}
+
+/**
+ * @brief Compress a block
+ *
+ * @param compression SEGMENT_COMPRESSION_*
+ * @param in The bytes
+ * @param size Bytes to compress
+ * @param out Receives the block
+ * @param capacity Bytes out can hold (at least compress_bound())
+ * @param out_size Receives the compressed size
+ * @return 0 on success, non-zero on failure
+ */
+int compress_block(uint32_t compression, const void* in, size_t size, void* out,
+                   size_t capacity, size_t* out_size) {
+    size_t bound = compress_bound(compression, size);
+    if (!in || !out || !out_size || bound == 0 || capacity < bound) {
+        return -1;
+    }
+    
+    switch (compression) {
+        case SEGMENT_COMPRESSION_NONE:
+            memcpy(out, in, size);
+            *out_size = size;
+            return 0;
+        case SEGMENT_COMPRESSION_LZ4: {
+            int written = LZ4_compress_default((const char*)in, (char*)out, (int)size,
+                                               capacity > INT_MAX ? INT_MAX : (int)capacity);
+            if (written <= 0) {
+                return -1;
+            }
+            *out_size = (size_t)written;
+            return 0;
+        }
+        default: {
+            size_t written = capacity;
+            if (snappy_compress((const char*)in, size, (char*)out, &written) != SNAPPY_OK) {
+                return -1;
+            }
+            *out_size = written;
+            return 0;
+        }
+    }
+}
+
+/**
+ * @brief Decompress a block
+ *
+ * @param compression SEGMENT_COMPRESSION_*
+ * @param in The block
+ * @param size Bytes of the block
+ * @param out Receives the bytes
+ * @param out_size Exact decompressed size
+ * @return 0 on success, non-zero if the block is malformed or has another size
+ */
+int decompress_block(uint32_t compression, const void* in, size_t size, void* out,
+                     size_t out_size) {
+    if (!in || !out) {
+        return -1;
+    }
+    
+    switch (compression) {
+        case SEGMENT_COMPRESSION_NONE:
+            if (size != out_size) {
+                return -1;
+            }
+            memcpy(out, in, size);
+            return 0;
+        case SEGMENT_COMPRESSION_LZ4: {
+            if (size > INT_MAX || out_size > INT_MAX) {
+                return -1;
+            }
+            int read = LZ4_decompress_safe((const char*)in, (char*)out, (int)size, (int)out_size);
+            return read >= 0 && (size_t)read == out_size ? 0 : -1;
+        }
+        case SEGMENT_COMPRESSION_SNAPPY: {
+            size_t length = 0;
+            if (snappy_uncompressed_length((const char*)in, size, &length) != SNAPPY_OK ||
+                length != out_size) {
+                return -1;
+            }
+            return snappy_uncompress((const char*)in, size, (char*)out, &length) == SNAPPY_OK &&
+                   length == out_size ? 0 : -1;
+        }
+        default:
+            return -1;
+    }
+}
@@ -0,0 +1,60 @@
+/**
+ * @file compress.h
+ * @brief Internal block compression for rETL DB
+ *
+ * Thin wrappers over the LZ4 and Snappy block formats, so the segment
+ * format can treat every SEGMENT_COMPRESSION_* codec the same way. A
+ * block carries no framing: callers record both sizes themselves.
+ */
+
+#ifndef RETLDB_COMPRESS_H
+#define RETLDB_COMPRESS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Check whether a codec is known
+ *
+ * @param compression SEGMENT_COMPRESSION_*
+ * @return Non-zero if supported
+ */
+int compress_supported(uint32_t compression);
+
+/**
+ * @brief Get the largest compressed size of a block
+ *
+ * @param compression SEGMENT_COMPRESSION_*
+ * @param size Bytes to compress
+ * @return Bytes a destination must hold, 0 if the block is too large for the codec
+ */
+size_t compress_bound(uint32_t compression, size_t size);
+
+/**
+ * @brief Compress a block
+ *
+ * @param compression SEGMENT_COMPRESSION_*
+ * @param in The bytes
+ * @param size Bytes to compress
+ * @param out Receives the block
+ * @param capacity Bytes out can hold (at least compress_bound())
+ * @param out_size Receives the compressed size
+ * @return 0 on success, non-zero on failure
+ */
+int compress_block(uint32_t compression, const void* in, size_t size, void* out,
+                   size_t capacity, size_t* out_size);
+
+/**
+ * @brief Decompress a block
+ *
+ * @param compression SEGMENT_COMPRESSION_*
+ * @param in The block
+ * @param size Bytes of the block
+ * @param out Receives the bytes
+ * @param out_size Exact decompressed size
+ * @return 0 on success, non-zero if the block is malformed or has another size
+ */
+int decompress_block(uint32_t compression, const void* in, size_t size, void* out,
+                     size_t out_size);
+
+#endif /* RETLDB_COMPRESS_H */
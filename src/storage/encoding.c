@@ -0,0 +1,1184 @@
+/**
+ * @file encoding.c
+ * @brief Implementation of column chunk encodings for rETL DB
+ *
+ * Encoded layouts (native byte order; every section padded to 8 bytes):
+ *
+ *   PLAIN        values as in the PLAIN layout
+ *   DICTIONARY   uint32_t count, uint32_t bits; the count distinct values
+ *                in the PLAIN layout; one bit-packed index per row
+ *   RLE          uint32_t runs, uint32_t zero; uint32_t length[runs];
+ *                one value per run
+ *   BITPACK      uint64_t base, uint32_t bits, uint32_t zero; one
+ *                bit-packed (value - base) per row
+ *   DELTA        uint64_t first, uint64_t base, uint32_t bits, uint32_t
+ *                zero; one bit-packed (delta - base) per row after the first
+ *   DELTA_DELTA  uint64_t first, uint64_t first_delta, uint64_t base,
+ *                uint32_t bits, uint32_t zero; one bit-packed
+ *                (delta - previous delta - base) per row after the second
+ *
+ * Bit-packed fields are stored least significant bit first and followed by
+ * 8 spare bytes, so a decoder can always load a whole 64-bit word. Integer
+ * arithmetic is done on 64 bits modulo 2^64 with signed types sign-extended,
+ * which makes every encoding exact for every integer width.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "storage/encoding.h"
+#include "storage/unpack.h"
+#include "common/checksum.h"
+
+#define SAMPLE_BLOCKS 16                // Blocks of consecutive rows sampled by encoding_choose()
+#define SAMPLE_BLOCK_ROWS 64            // Rows per sampled block
+#define SAMPLE_SLOTS 2048               // Hash slots for counting distinct sampled values
+#define DICTIONARY_MAX 65536            // Most entries a dictionary may have
+
+/**
+ * @brief Round up to a multiple of 8
+ *
+ * @param n The value
+ * @return The rounded value
+ */
+static size_t pad8(size_t n) {
+    return (n + 7) & ~(size_t)7;
+}
+
+/**
+ * @brief Make room for more bytes in a buffer
+ *
+ * @param buffer The buffer
+ * @param extra Bytes needed past the current size
+ * @return 0 on success, non-zero on failure
+ */
+int encoding_buffer_reserve(encoding_buffer_t* buffer, size_t extra) {
+    if (buffer->size + extra <= buffer->capacity) {
+        return 0;
+    }
+    
+    size_t capacity = buffer->capacity ? buffer->capacity : 4096;
+    while (capacity < buffer->size + extra) {
+        capacity *= 2;
+    }
+    uint8_t* data = (uint8_t*)realloc(buffer->data, capacity);
+    if (!data) {
+        return -1;
+    }
+    buffer->data = data;
+    buffer->capacity = capacity;
+    return 0;
+}
+
+/**
+ * @brief Append bytes to a buffer
+ *
+ * @param buffer The buffer
+ * @param data The bytes (NULL appends zeros)
+ * @param len Number of bytes
+ * @return 0 on success, non-zero on failure
+ */
+int encoding_buffer_append(encoding_buffer_t* buffer, const void* data, size_t len) {
+    if (encoding_buffer_reserve(buffer, len) != 0) {
+        return -1;
+    }
+    
+    if (data) {
+        memcpy(buffer->data + buffer->size, data, len);
+    } else {
+        memset(buffer->data + buffer->size, 0, len);
+    }
+    buffer->size += len;
+    return 0;
+}
+
+/**
+ * @brief Free a buffer's memory and empty it
+ *
+ * @param buffer The buffer
+ */
+void encoding_buffer_free(encoding_buffer_t* buffer) {
+    free(buffer->data);
+    buffer->data = NULL;
+    buffer->size = 0;
+    buffer->capacity = 0;
+}
+
+/**
+ * @brief Pad a buffer with zeros to a multiple of 8 bytes
+ *
+ * @param buffer The buffer
+ * @return 0 on success, non-zero on failure
+ */
+static int append_padding(encoding_buffer_t* buffer) {
+    return encoding_buffer_append(buffer, NULL, pad8(buffer->size) - buffer->size);
+}
+
+/**
+ * @brief Check whether a type is stored as an integer
+ *
+ * @param type The type
+ * @return Non-zero for booleans, integers and timestamps
+ */
+static int is_integer(retldb_type_t type) {
+    switch (type) {
+        case RETLDB_TYPE_BOOLEAN:
+        case RETLDB_TYPE_INT8:
+        case RETLDB_TYPE_INT16:
+        case RETLDB_TYPE_INT32:
+        case RETLDB_TYPE_INT64:
+        case RETLDB_TYPE_UINT8:
+        case RETLDB_TYPE_UINT16:
+        case RETLDB_TYPE_UINT32:
+        case RETLDB_TYPE_UINT64:
+        case RETLDB_TYPE_TIMESTAMP:
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+/**
+ * @brief Check whether an integer type is signed
+ *
+ * @param type The type
+ * @return Non-zero for signed integers and timestamps
+ */
+static int is_signed(retldb_type_t type) {
+    return type == RETLDB_TYPE_INT8 || type == RETLDB_TYPE_INT16 ||
+           type == RETLDB_TYPE_INT32 || type == RETLDB_TYPE_INT64 ||
+           type == RETLDB_TYPE_TIMESTAMP;
+}
+
+/**
+ * @brief Load an integer as 64 bits
+ *
+ * @param values The packed values
+ * @param i Value index
+ * @param width Bytes per value
+ * @param sign Whether to sign-extend
+ * @return The value
+ */
+static uint64_t load_int(const uint8_t* values, size_t i, size_t width, int sign) {
+    const uint8_t* p = values + i * width;
+    switch (width) {
+        case 1: {
+            uint8_t v = *p;
+            return sign ? (uint64_t)(int64_t)(int8_t)v : v;
+        }
+        case 2: {
+            uint16_t v;
+            memcpy(&v, p, sizeof(v));
+            return sign ? (uint64_t)(int64_t)(int16_t)v : v;
+        }
+        case 4: {
+            uint32_t v;
+            memcpy(&v, p, sizeof(v));
+            return sign ? (uint64_t)(int64_t)(int32_t)v : v;
+        }
+        default: {
+            uint64_t v;
+            memcpy(&v, p, sizeof(v));
+            return v;
+        }
+    }
+}
+
+/**
+ * @brief Store the low bytes of a 64-bit integer
+ *
+ * @param values The packed values
+ * @param i Value index
+ * @param width Bytes per value
+ * @param v The value
+ */
+static void store_int(uint8_t* values, size_t i, size_t width, uint64_t v) {
+    uint8_t* p = values + i * width;
+    switch (width) {
+        case 1:
+            *p = (uint8_t)v;
+            break;
+        case 2: {
+            uint16_t narrow = (uint16_t)v;
+            memcpy(p, &narrow, sizeof(narrow));
+            break;
+        }
+        case 4: {
+            uint32_t narrow = (uint32_t)v;
+            memcpy(p, &narrow, sizeof(narrow));
+            break;
+        }
+        default:
+            memcpy(p, &v, sizeof(v));
+            break;
+    }
+}
+
+/**
+ * @brief Store a block of unpacked offsets from a base
+ *
+ * @param values The packed values
+ * @param i Index of the first value to store
+ * @param width Bytes per value
+ * @param base Added to every offset (modulo 2^64)
+ * @param offsets The offsets
+ * @param count Number of offsets
+ */
+static void store_offsets(uint8_t* values, size_t i, size_t width, uint64_t base,
+                          const uint32_t* offsets, size_t count) {
+    uint8_t* p = values + i * width;
+    switch (width) {
+        case 1:
+            for (size_t j = 0; j < count; j++) {
+                p[j] = (uint8_t)(base + offsets[j]);
+            }
+            break;
+        case 2:
+            for (size_t j = 0; j < count; j++) {
+                uint16_t v = (uint16_t)(base + offsets[j]);
+                memcpy(p + j * 2, &v, sizeof(v));
+            }
+            break;
+        case 4:
+            for (size_t j = 0; j < count; j++) {
+                uint32_t v = (uint32_t)(base + offsets[j]);
+                memcpy(p + j * 4, &v, sizeof(v));
+            }
+            break;
+        default:
+            for (size_t j = 0; j < count; j++) {
+                uint64_t v = base + offsets[j];
+                memcpy(p + j * 8, &v, sizeof(v));
+            }
+            break;
+    }
+}
+
+/**
+ * @brief Copy one fixed-width value
+ *
+ * @param dst Destination
+ * @param src Source
+ * @param width Bytes per value
+ */
+static void copy_value(uint8_t* dst, const uint8_t* src, size_t width) {
+    switch (width) {
+        case 1:
+            *dst = *src;
+            break;
+        case 2:
+            memcpy(dst, src, 2);
+            break;
+        case 4:
+            memcpy(dst, src, 4);
+            break;
+        default:
+            memcpy(dst, src, 8);
+            break;
+    }
+}
+
+/**
+ * @brief Get the bits needed to hold a value
+ *
+ * @param range The value
+ * @return Bits up to the highest set bit, 0 for zero
+ */
+static unsigned bits_for(uint64_t range) {
+    unsigned bits = 0;
+    while (range) {
+        bits++;
+        range >>= 1;
+    }
+    return bits;
+}
+
+/**
+ * @brief Get the bytes of a bit-packed field
+ *
+ * @param count Number of values
+ * @param bits Bits per value
+ * @return Bytes including the spare word
+ */
+static size_t packed_size(size_t count, unsigned bits) {
+    return pad8((size_t)(((uint64_t)count * bits + 7) / 8)) + 8;
+}
+
+/**
+ * @brief Write one value into a zeroed bit-packed field
+ *
+ * @param out The field
+ * @param index Value index
+ * @param bits Bits per value
+ * @param v The value, less than 2^bits
+ */
+static void pack(uint8_t* out, size_t index, unsigned bits, uint64_t v) {
+    uint64_t bit = (uint64_t)index * bits;
+    unsigned left = bits;
+    while (left > 0) {
+        unsigned shift = (unsigned)(bit & 7);
+        unsigned take = 8 - shift < left ? 8 - shift : left;
+        out[bit >> 3] |= (uint8_t)((v & ((1u << take) - 1)) << shift);
+        v >>= take;
+        bit += take;
+        left -= take;
+    }
+}
+
+/**
+ * @brief Read one value from a bit-packed field
+ *
+ * @param in The field, including its spare word
+ * @param index Value index
+ * @param bits Bits per value
+ * @return The value
+ */
+static uint64_t unpack(const uint8_t* in, size_t index, unsigned bits) {
+    if (bits == 0) {
+        return 0;
+    }
+    
+    uint64_t bit = (uint64_t)index * bits;
+    const uint8_t* p = in + (bit >> 3);
+    unsigned shift = (unsigned)(bit & 7);
+    uint64_t word;
+    memcpy(&word, p, sizeof(word));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    word = __builtin_bswap64(word);
+#endif
+    uint64_t v = word >> shift;
+    if (shift + bits > 64) {
+        v |= (uint64_t)p[8] << (64 - shift);
+    }
+    return bits == 64 ? v : v & ((UINT64_C(1) << bits) - 1);
+}
+
+/**
+ * @brief Append a zeroed bit-packed field
+ *
+ * @param out The buffer
+ * @param count Number of values
+ * @param bits Bits per value
+ * @return The field, NULL on failure
+ */
+static uint8_t* append_packed(encoding_buffer_t* out, size_t count, unsigned bits) {
+    size_t size = packed_size(count, bits);
+    if (encoding_buffer_append(out, NULL, size) != 0) {
+        return NULL;
+    }
+    return out->data + out->size - size;
+}
+
+/**
+ * @brief Get the bytes of a value
+ *
+ * @param values The values
+ * @param width Bytes per fixed-width value, 0 for variable-length values
+ * @param i Value index
+ * @param len Receives the length
+ * @return The value's bytes
+ */
+static const uint8_t* value_at(const segment_vector_t* values, size_t width, size_t i,
+                               size_t* len) {
+    if (width > 0) {
+        *len = width;
+        return (const uint8_t*)values->values + i * width;
+    }
+    *len = values->offsets[i + 1] - values->offsets[i];
+    return (const uint8_t*)values->values + values->offsets[i];
+}
+
+/**
+ * @brief Check whether two values are equal
+ *
+ * @param values The values
+ * @param width Bytes per fixed-width value, 0 for variable-length values
+ * @param a First value index
+ * @param b Second value index
+ * @return Non-zero if equal
+ */
+static int values_equal(const segment_vector_t* values, size_t width, size_t a, size_t b) {
+    size_t len_a, len_b;
+    const uint8_t* pa = value_at(values, width, a, &len_a);
+    const uint8_t* pb = value_at(values, width, b, &len_b);
+    return len_a == len_b && (len_a == 0 || memcmp(pa, pb, len_a) == 0);
+}
+
+/**
+ * @brief Hash a value
+ *
+ * @param values The values
+ * @param width Bytes per fixed-width value, 0 for variable-length values
+ * @param i Value index
+ * @return The hash
+ */
+static uint64_t hash_value(const segment_vector_t* values, size_t width, size_t i) {
+    size_t len;
+    const uint8_t* p = value_at(values, width, i, &len);
+    return checksum64(p, len);
+}
+
+/**
+ * @brief Check whether an encoding can store a type
+ *
+ * @param encoding SEGMENT_ENCODING_*
+ * @param type The column type
+ * @return Non-zero if supported
+ */
+int encoding_supports(uint32_t encoding, retldb_type_t type) {
+    size_t width = segment_type_width(type);
+    int any = width > 0 || type == RETLDB_TYPE_STRING || type == RETLDB_TYPE_BINARY;
+    switch (encoding) {
+        case SEGMENT_ENCODING_PLAIN:
+        case SEGMENT_ENCODING_DICTIONARY:
+            return any;
+        case SEGMENT_ENCODING_RLE:
+            return width > 0;
+        case SEGMENT_ENCODING_BITPACK:
+        case SEGMENT_ENCODING_DELTA:
+        case SEGMENT_ENCODING_DELTA_DELTA:
+            return is_integer(type);
+        default:
+            return 0;
+    }
+}
+
+/**
+ * @brief Encode values as they are
+ */
+static int encode_plain(retldb_type_t type, const segment_vector_t* values, size_t rows,
+                        encoding_buffer_t* out) {
+    size_t width = segment_type_width(type);
+    if (width > 0) {
+        return encoding_buffer_append(out, values->values, rows * width);
+    }
+    
+    // Rebase the offsets so a vector can be a window of a larger buffer
+    uint32_t base = values->offsets[0];
+    size_t bytes = values->offsets[rows] - base;
+    if (encoding_buffer_reserve(out, (rows + 1) * sizeof(uint32_t) + bytes) != 0) {
+        return -1;
+    }
+    uint32_t* offsets = (uint32_t*)(out->data + out->size);
+    for (size_t i = 0; i <= rows; i++) {
+        offsets[i] = values->offsets[i] - base;
+    }
+    out->size += (rows + 1) * sizeof(uint32_t);
+    return bytes > 0 ? encoding_buffer_append(out, (const uint8_t*)values->values + base, bytes)
+                     : 0;
+}
+
+/**
+ * @brief Encode values as a dictionary and one index per row
+ */
+static int encode_dictionary(retldb_type_t type, const segment_vector_t* values, size_t rows,
+                             encoding_buffer_t* out) {
+    size_t width = segment_type_width(type);
+    size_t limit = rows / 2 > DICTIONARY_MAX ? DICTIONARY_MAX : (rows / 2 ? rows / 2 : 1);
+    size_t slot_count = 64;
+    while (slot_count < limit * 2) {
+        slot_count *= 2;
+    }
+    
+    // Slots hold entry + 1 (0 for empty); entries remember the row they came from
+    uint32_t* slots = (uint32_t*)calloc(slot_count, sizeof(uint32_t));
+    uint32_t* entries = (uint32_t*)malloc(limit * sizeof(uint32_t));
+    uint32_t* indexes = (uint32_t*)malloc(rows * sizeof(uint32_t));
+    if (!slots || !entries || !indexes) {
+        free(slots);
+        free(entries);
+        free(indexes);
+        return -1;
+    }
+    
+    size_t count = 0;
+    size_t bytes = 0;
+    int result = 0;
+    for (size_t i = 0; i < rows && result == 0; i++) {
+        size_t slot = (size_t)hash_value(values, width, i) & (slot_count - 1);
+        while (slots[slot] && !values_equal(values, width, entries[slots[slot] - 1], i)) {
+            slot = (slot + 1) & (slot_count - 1);
+        }
+        if (!slots[slot]) {
+            if (count == limit) {
+                result = 1;
+                break;
+            }
+            size_t len;
+            value_at(values, width, i, &len);
+            bytes += len;
+            entries[count] = (uint32_t)i;
+            slots[slot] = (uint32_t)++count;
+        }
+        indexes[i] = slots[slot] - 1;
+    }
+    free(slots);
+    
+    size_t start = out->size;
+    unsigned bits = bits_for(count - 1);
+    if (result == 0) {
+        uint32_t header[2] = {(uint32_t)count, bits};
+        result = encoding_buffer_append(out, header, sizeof(header));
+    }
+    if (result == 0 && width == 0) {
+        result = encoding_buffer_reserve(out, (count + 1) * sizeof(uint32_t));
+        if (result == 0) {
+            uint32_t* offsets = (uint32_t*)(out->data + out->size);
+            uint32_t offset = 0;
+            for (size_t e = 0; e < count; e++) {
+                size_t len;
+                value_at(values, width, entries[e], &len);
+                offsets[e] = offset;
+                offset += (uint32_t)len;
+            }
+            offsets[count] = offset;
+            out->size += (count + 1) * sizeof(uint32_t);
+        }
+    }
+    if (result == 0) {
+        result = encoding_buffer_reserve(out, width ? count * width : bytes);
+        for (size_t e = 0; e < count && result == 0; e++) {
+            size_t len;
+            const uint8_t* p = value_at(values, width, entries[e], &len);
+            memcpy(out->data + out->size, p, len);
+            out->size += len;
+        }
+    }
+    if (result == 0) {
+        result = append_padding(out);
+    }
+    uint8_t* packed = result == 0 ? append_packed(out, rows, bits) : NULL;
+    if (packed) {
+        for (size_t i = 0; i < rows; i++) {
+            pack(packed, i, bits, indexes[i]);
+        }
+    } else if (result == 0) {
+        result = -1;
+    }
+    
+    free(entries);
+    free(indexes);
+    if (result != 0) {
+        out->size = start;
+    }
+    return result;
+}
+
+/**
+ * @brief Encode runs of equal values as a length and one value each
+ */
+static int encode_rle(retldb_type_t type, const segment_vector_t* values, size_t rows,
+                      encoding_buffer_t* out) {
+    size_t width = segment_type_width(type);
+    size_t limit = rows / 2 ? rows / 2 : 1;
+    uint32_t* starts = (uint32_t*)malloc(limit * sizeof(uint32_t));
+    if (!starts) {
+        return -1;
+    }
+    
+    size_t runs = 0;
+    for (size_t i = 0; i < rows; i++) {
+        if (i == 0 || !values_equal(values, width, i - 1, i)) {
+            if (runs == limit) {
+                free(starts);
+                return 1;
+            }
+            starts[runs++] = (uint32_t)i;
+        }
+    }
+    
+    size_t start = out->size;
+    uint32_t header[2] = {(uint32_t)runs, 0};
+    int result = encoding_buffer_append(out, header, sizeof(header));
+    if (result == 0) {
+        result = encoding_buffer_reserve(out, pad8(runs * sizeof(uint32_t)) + runs * width);
+    }
+    if (result == 0) {
+        uint32_t* lengths = (uint32_t*)(out->data + out->size);
+        for (size_t r = 0; r < runs; r++) {
+            uint32_t end = r + 1 < runs ? starts[r + 1] : (uint32_t)rows;
+            lengths[r] = end - starts[r];
+        }
+        out->size += runs * sizeof(uint32_t);
+        result = append_padding(out);
+    }
+    for (size_t r = 0; r < runs && result == 0; r++) {
+        result = encoding_buffer_append(out, (const uint8_t*)values->values + starts[r] * width,
+                                        width);
+    }
+    if (result == 0) {
+        result = append_padding(out);
+    }
+    
+    free(starts);
+    if (result != 0) {
+        out->size = start;
+    }
+    return result;
+}
+
+/**
+ * @brief Encode integers as bit-packed offsets from their minimum
+ */
+static int encode_bitpack(retldb_type_t type, const segment_vector_t* values, size_t rows,
+                          encoding_buffer_t* out) {
+    size_t width = segment_type_width(type);
+    int sign = is_signed(type);
+    const uint8_t* in = (const uint8_t*)values->values;
+    uint64_t min = load_int(in, 0, width, sign);
+    uint64_t max = min;
+    for (size_t i = 1; i < rows; i++) {
+        uint64_t v = load_int(in, i, width, sign);
+        if (sign ? (int64_t)v < (int64_t)min : v < min) {
+            min = v;
+        }
+        if (sign ? (int64_t)v > (int64_t)max : v > max) {
+            max = v;
+        }
+    }
+    
+    size_t start = out->size;
+    unsigned bits = bits_for(max - min);
+    uint64_t base = min;
+    uint32_t header[2] = {bits, 0};
+    uint8_t* packed = NULL;
+    if (encoding_buffer_append(out, &base, sizeof(base)) == 0 &&
+        encoding_buffer_append(out, header, sizeof(header)) == 0) {
+        packed = append_packed(out, rows, bits);
+    }
+    if (!packed) {
+        out->size = start;
+        return -1;
+    }
+    for (size_t i = 0; i < rows; i++) {
+        pack(packed, i, bits, load_int(in, i, width, sign) - base);
+    }
+    return 0;
+}
+
+/**
+ * @brief Encode integers as the first value and bit-packed deltas
+ *
+ * @param order 1 for deltas, 2 for deltas of deltas
+ */
+static int encode_delta(retldb_type_t type, const segment_vector_t* values, size_t rows,
+                        int order, encoding_buffer_t* out) {
+    size_t width = segment_type_width(type);
+    int sign = is_signed(type);
+    const uint8_t* in = (const uint8_t*)values->values;
+    size_t skip = (size_t)order < rows ? (size_t)order : rows;
+    
+    // The minimum over what gets packed (signed, so small negative steps stay small)
+    uint64_t first = load_int(in, 0, width, sign);
+    uint64_t first_delta = rows > 1 ? load_int(in, 1, width, sign) - first : 0;
+    int64_t min = 0, max = 0;
+    uint64_t prev = first, delta = 0;
+    for (size_t i = 1; i < rows; i++) {
+        uint64_t v = load_int(in, i, width, sign);
+        uint64_t step = v - prev;
+        int64_t packed = (int64_t)(order == 1 ? step : step - delta);
+        if (i >= skip && (i == skip || packed < min)) {
+            min = packed;
+        }
+        if (i >= skip && (i == skip || packed > max)) {
+            max = packed;
+        }
+        prev = v;
+        delta = step;
+    }
+    
+    size_t start = out->size;
+    unsigned bits = bits_for((uint64_t)max - (uint64_t)min);
+    uint64_t header[3] = {first, first_delta, (uint64_t)min};
+    uint32_t tail[2] = {bits, 0};
+    uint8_t* packed = NULL;
+    if (encoding_buffer_append(out, &header[0], sizeof(uint64_t)) == 0 &&
+        (order == 1 || encoding_buffer_append(out, &header[1], sizeof(uint64_t)) == 0) &&
+        encoding_buffer_append(out, &header[2], sizeof(uint64_t)) == 0 &&
+        encoding_buffer_append(out, tail, sizeof(tail)) == 0) {
+        packed = append_packed(out, rows - skip, bits);
+    }
+    if (!packed) {
+        out->size = start;
+        return -1;
+    }
+    
+    prev = first;
+    delta = 0;
+    for (size_t i = 1; i < rows; i++) {
+        uint64_t v = load_int(in, i, width, sign);
+        uint64_t step = v - prev;
+        if (i >= skip) {
+            pack(packed, i - skip, bits, (order == 1 ? step : step - delta) - (uint64_t)min);
+        }
+        prev = v;
+        delta = step;
+    }
+    return 0;
+}
+
+/**
+ * @brief Encode values, appending them to a buffer
+ *
+ * @param encoding SEGMENT_ENCODING_*
+ * @param type The column type
+ * @param values The values (validity is ignored)
+ * @param rows Number of values
+ * @param out The buffer to append to
+ * @return 0 on success, 1 if the encoding does not suit these values (out
+ *         is then unchanged in size), -1 on failure
+ */
+int encoding_encode(uint32_t encoding, retldb_type_t type, const segment_vector_t* values,
+                    size_t rows, encoding_buffer_t* out) {
+    if (!values || !out || rows == 0 || !encoding_supports(encoding, type)) {
+        return -1;
+    }
+    
+    switch (encoding) {
+        case SEGMENT_ENCODING_PLAIN:
+            return encode_plain(type, values, rows, out);
+        case SEGMENT_ENCODING_DICTIONARY:
+            return encode_dictionary(type, values, rows, out);
+        case SEGMENT_ENCODING_RLE:
+            return encode_rle(type, values, rows, out);
+        case SEGMENT_ENCODING_BITPACK:
+            return encode_bitpack(type, values, rows, out);
+        case SEGMENT_ENCODING_DELTA:
+            return encode_delta(type, values, rows, 1, out);
+        default:
+            return encode_delta(type, values, rows, 2, out);
+    }
+}
+
+/**
+ * @brief Decode a dictionary-encoded chunk
+ */
+static int decode_dictionary(size_t width, const uint8_t* in, size_t size, size_t rows,
+                             uint8_t* out, size_t out_size) {
+    uint32_t header[2];
+    if (size < sizeof(header)) {
+        return -1;
+    }
+    memcpy(header, in, sizeof(header));
+    size_t count = header[0];
+    unsigned bits = header[1];
+    if (count == 0 || bits > 32) {
+        return -1;
+    }
+    in += sizeof(header);
+    size -= sizeof(header);
+    
+    const uint32_t* offsets = NULL;
+    size_t dict_size;
+    if (width > 0) {
+        dict_size = pad8(count * width);
+    } else {
+        if ((count + 1) * sizeof(uint32_t) > size) {
+            return -1;
+        }
+        offsets = (const uint32_t*)in;
+        for (size_t e = 0; e < count; e++) {
+            if (offsets[e + 1] < offsets[e]) {
+                return -1;
+            }
+        }
+        if (offsets[0] != 0) {
+            return -1;
+        }
+        dict_size = pad8((count + 1) * sizeof(uint32_t) + offsets[count]);
+    }
+    if (dict_size > size || packed_size(rows, bits) > size - dict_size) {
+        return -1;
+    }
+    const uint8_t* dict = in;
+    const uint8_t* packed = in + dict_size;
+    
+    if (width > 0) {
+        if (out_size != rows * width) {
+            return -1;
+        }
+        uint32_t block[UNPACK_BLOCK];
+        size_t packed_bytes = size - dict_size;
+        for (size_t i = 0; i < rows; i += UNPACK_BLOCK) {
+            size_t n = rows - i < UNPACK_BLOCK ? rows - i : UNPACK_BLOCK;
+            unpack_bits(packed, packed_bytes, i, n, bits, block);
+            if (unpack_gather(dict, count, width, block, n, out + i * width) != 0) {
+                return -1;
+            }
+        }
+        return 0;
+    }
+    
+    // First the offsets, so the bytes can be bounded before they are copied
+    const uint8_t* bytes = dict + (count + 1) * sizeof(uint32_t);
+    if ((rows + 1) * sizeof(uint32_t) > out_size) {
+        return -1;
+    }
+    uint32_t* out_offsets = (uint32_t*)out;
+    uint64_t total = 0;
+    out_offsets[0] = 0;
+    for (size_t i = 0; i < rows; i++) {
+        uint64_t index = unpack(packed, i, bits);
+        if (index >= count) {
+            return -1;
+        }
+        total += offsets[index + 1] - offsets[index];
+        if (total > UINT32_MAX) {
+            return -1;
+        }
+        out_offsets[i + 1] = (uint32_t)total;
+    }
+    if (total != out_size - (rows + 1) * sizeof(uint32_t)) {
+        return -1;
+    }
+    uint8_t* out_bytes = out + (rows + 1) * sizeof(uint32_t);
+    for (size_t i = 0; i < rows; i++) {
+        uint64_t index = unpack(packed, i, bits);
+        memcpy(out_bytes + out_offsets[i], bytes + offsets[index],
+               out_offsets[i + 1] - out_offsets[i]);
+    }
+    return 0;
+}
+
+/**
+ * @brief Decode a run-length-encoded chunk
+ */
+static int decode_rle(size_t width, const uint8_t* in, size_t size, size_t rows, uint8_t* out,
+                      size_t out_size) {
+    uint32_t header[2];
+    if (size < sizeof(header) || out_size != rows * width) {
+        return -1;
+    }
+    memcpy(header, in, sizeof(header));
+    size_t runs = header[0];
+    size_t lengths_size = pad8(runs * sizeof(uint32_t));
+    if (runs == 0 || runs > rows || lengths_size + runs * width > size - sizeof(header)) {
+        return -1;
+    }
+    const uint32_t* lengths = (const uint32_t*)(in + sizeof(header));
+    const uint8_t* run_values = in + sizeof(header) + lengths_size;
+    
+    size_t row = 0;
+    for (size_t r = 0; r < runs; r++) {
+        if (lengths[r] == 0 || lengths[r] > rows - row) {
+            return -1;
+        }
+        const uint8_t* value = run_values + r * width;
+        for (size_t end = row + lengths[r]; row < end; row++) {
+            copy_value(out + row * width, value, width);
+        }
+    }
+    return row == rows ? 0 : -1;
+}
+
+/**
+ * @brief Decode a bit-packed chunk
+ */
+static int decode_bitpack(size_t width, const uint8_t* in, size_t size, size_t rows,
+                          uint8_t* out, size_t out_size) {
+    uint64_t base;
+    uint32_t header[2];
+    if (size < sizeof(base) + sizeof(header) || out_size != rows * width) {
+        return -1;
+    }
+    memcpy(&base, in, sizeof(base));
+    memcpy(header, in + sizeof(base), sizeof(header));
+    unsigned bits = header[0];
+    const uint8_t* packed = in + sizeof(base) + sizeof(header);
+    if (bits > 64 || packed_size(rows, bits) > size - sizeof(base) - sizeof(header)) {
+        return -1;
+    }
+    
+    if (bits > 32) {
+        for (size_t i = 0; i < rows; i++) {
+            store_int(out, i, width, base + unpack(packed, i, bits));
+        }
+        return 0;
+    }
+    
+    uint32_t block[UNPACK_BLOCK];
+    size_t packed_bytes = size - sizeof(base) - sizeof(header);
+    for (size_t i = 0; i < rows; i += UNPACK_BLOCK) {
+        size_t n = rows - i < UNPACK_BLOCK ? rows - i : UNPACK_BLOCK;
+        unpack_bits(packed, packed_bytes, i, n, bits, block);
+        store_offsets(out, i, width, base, block, n);
+    }
+    return 0;
+}
+
+/**
+ * @brief Decode a delta-encoded chunk
+ *
+ * @param order 1 for deltas, 2 for deltas of deltas
+ */
+static int decode_delta(size_t width, const uint8_t* in, size_t size, size_t rows, int order,
+                        uint8_t* out, size_t out_size) {
+    uint64_t header[3] = {0, 0, 0};
+    uint32_t tail[2];
+    size_t header_size = (order == 1 ? 2 : 3) * sizeof(uint64_t);
+    if (size < header_size + sizeof(tail) || out_size != rows * width) {
+        return -1;
+    }
+    memcpy(&header[0], in, sizeof(uint64_t));
+    if (order == 1) {
+        memcpy(&header[2], in + sizeof(uint64_t), sizeof(uint64_t));
+    } else {
+        memcpy(&header[1], in + sizeof(uint64_t), 2 * sizeof(uint64_t));
+    }
+    memcpy(tail, in + header_size, sizeof(tail));
+    unsigned bits = tail[0];
+    size_t skip = (size_t)order < rows ? (size_t)order : rows;
+    const uint8_t* packed = in + header_size + sizeof(tail);
+    if (bits > 64 || packed_size(rows - skip, bits) > size - header_size - sizeof(tail)) {
+        return -1;
+    }
+    
+    uint64_t value = header[0];
+    uint64_t delta = header[1];
+    uint64_t base = header[2];
+    store_int(out, 0, width, value);
+    if (order == 2 && rows > 1) {
+        value += delta;
+        store_int(out, 1, width, value);
+    }
+    
+    // Row skip + f takes field f; narrow fields are unpacked a block at a time
+    uint32_t block[UNPACK_BLOCK];
+    size_t fields = rows - skip;
+    size_t packed_bytes = size - header_size - sizeof(tail);
+    for (size_t f = 0; f < fields; f += UNPACK_BLOCK) {
+        size_t n = fields - f < UNPACK_BLOCK ? fields - f : UNPACK_BLOCK;
+        if (bits <= 32) {
+            unpack_bits(packed, packed_bytes, f, n, bits, block);
+        }
+        for (size_t j = 0; j < n; j++) {
+            uint64_t field = bits <= 32 ? block[j] : unpack(packed, f + j, bits);
+            if (order == 1) {
+                value += base + field;
+            } else {
+                delta += base + field;
+                value += delta;
+            }
+            store_int(out, skip + f + j, width, value);
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Decode values into the PLAIN layout
+ *
+ * @param encoding SEGMENT_ENCODING_*
+ * @param type The column type
+ * @param in The encoded values
+ * @param size Bytes of encoded values
+ * @param rows Number of values
+ * @param out Receives the PLAIN values, 8-byte aligned
+ * @param out_size Bytes of the PLAIN values
+ * @return 0 on success, non-zero if the input is malformed
+ */
+int encoding_decode(uint32_t encoding, retldb_type_t type, const void* in, size_t size,
+                    size_t rows, void* out, size_t out_size) {
+    if (!in || !out || rows == 0 || !encoding_supports(encoding, type)) {
+        return -1;
+    }
+    
+    size_t width = segment_type_width(type);
+    const uint8_t* bytes = (const uint8_t*)in;
+    uint8_t* dest = (uint8_t*)out;
+    switch (encoding) {
+        case SEGMENT_ENCODING_PLAIN:
+            if (size != out_size) {
+                return -1;
+            }
+            memcpy(dest, bytes, size);
+            return 0;
+        case SEGMENT_ENCODING_DICTIONARY:
+            return decode_dictionary(width, bytes, size, rows, dest, out_size);
+        case SEGMENT_ENCODING_RLE:
+            return decode_rle(width, bytes, size, rows, dest, out_size);
+        case SEGMENT_ENCODING_BITPACK:
+            return decode_bitpack(width, bytes, size, rows, dest, out_size);
+        case SEGMENT_ENCODING_DELTA:
+            return decode_delta(width, bytes, size, rows, 1, dest, out_size);
+        default:
+            return decode_delta(width, bytes, size, rows, 2, dest, out_size);
+    }
+}
+
+/**
+ * @brief Statistics of a sample of a chunk
+ */
+typedef struct {
+    size_t sampled;              // Values sampled
+    size_t runs;                 // Runs of equal values among them
+    size_t distinct;             // Distinct values among them
+    size_t bytes;                // Bytes of the sampled values
+    uint64_t min;                // Smallest value (integers)
+    uint64_t max;                // Largest value (integers)
+    int64_t delta_min;           // Smallest delta (integers)
+    int64_t delta_max;           // Largest delta (integers)
+    int64_t delta2_min;          // Smallest delta of deltas (integers)
+    int64_t delta2_max;          // Largest delta of deltas (integers)
+} encoding_sample_t;
+
+/**
+ * @brief Gather statistics from blocks of consecutive rows spread over a chunk
+ */
+static int take_sample(retldb_type_t type, const segment_vector_t* values, size_t rows,
+                       encoding_sample_t* sample) {
+    size_t width = segment_type_width(type);
+    int integer = is_integer(type);
+    int sign = is_signed(type);
+    const uint8_t* in = (const uint8_t*)values->values;
+    uint64_t* slots = (uint64_t*)calloc(SAMPLE_SLOTS, sizeof(uint64_t));
+    if (!slots) {
+        return -1;
+    }
+    
+    size_t blocks = SAMPLE_BLOCKS;
+    size_t block_rows = SAMPLE_BLOCK_ROWS;
+    if (rows <= blocks * block_rows) {
+        blocks = 1;
+        block_rows = rows;
+    }
+    
+    memset(sample, 0, sizeof(*sample));
+    int have_delta = 0, have_delta2 = 0;
+    for (size_t b = 0; b < blocks; b++) {
+        size_t first = blocks == 1 ? 0 : b * (rows - block_rows) / (blocks - 1);
+        uint64_t prev = 0, delta = 0;
+        for (size_t i = first; i < first + block_rows; i++) {
+            sample->sampled++;
+            if (i == first || !values_equal(values, width, i - 1, i)) {
+                sample->runs++;
+            }
+            size_t len;
+            value_at(values, width, i, &len);
+            sample->bytes += len;
+            
+            // Hashes stand in for values; 0 marks an empty slot
+            uint64_t hash = hash_value(values, width, i) | 1;
+            size_t slot = (size_t)(hash >> 1) & (SAMPLE_SLOTS - 1);
+            while (slots[slot] && slots[slot] != hash) {
+                slot = (slot + 1) & (SAMPLE_SLOTS - 1);
+            }
+            if (!slots[slot]) {
+                slots[slot] = hash;
+                sample->distinct++;
+            }
+            
+            if (!integer) {
+                continue;
+            }
+            uint64_t v = load_int(in, i, width, sign);
+            int first_value = sample->sampled == 1;
+            if (first_value || (sign ? (int64_t)v < (int64_t)sample->min : v < sample->min)) {
+                sample->min = v;
+            }
+            if (first_value || (sign ? (int64_t)v > (int64_t)sample->max : v > sample->max)) {
+                sample->max = v;
+            }
+            if (i > first) {
+                uint64_t step = v - prev;
+                if (!have_delta || (int64_t)step < sample->delta_min) {
+                    sample->delta_min = (int64_t)step;
+                }
+                if (!have_delta || (int64_t)step > sample->delta_max) {
+                    sample->delta_max = (int64_t)step;
+                }
+                have_delta = 1;
+                if (i > first + 1) {
+                    int64_t step2 = (int64_t)(step - delta);
+                    if (!have_delta2 || step2 < sample->delta2_min) {
+                        sample->delta2_min = step2;
+                    }
+                    if (!have_delta2 || step2 > sample->delta2_max) {
+                        sample->delta2_max = step2;
+                    }
+                    have_delta2 = 1;
+                }
+                delta = step;
+            }
+            prev = v;
+        }
+    }
+    
+    free(slots);
+    return 0;
+}
+
+/**
+ * @brief Pick the encoding likely to store a chunk smallest
+ *
+ * Looks at a sample of the values (blocks of consecutive rows spread over
+ * the chunk) to estimate cardinality, run lengths and value and delta
+ * ranges, and returns SEGMENT_ENCODING_PLAIN unless another encoding is
+ * expected to save a worthwhile share.
+ *
+ * @param type The column type
+ * @param values The values
+ * @param rows Number of values
+ * @return SEGMENT_ENCODING_*
+ */
+uint32_t encoding_choose(retldb_type_t type, const segment_vector_t* values, size_t rows) {
+    encoding_sample_t sample;
+    if (!values || rows == 0 || take_sample(type, values, rows, &sample) != 0) {
+        return SEGMENT_ENCODING_PLAIN;
+    }
+    
+    size_t width = segment_type_width(type);
+    double scale = (double)rows / (double)sample.sampled;
+    // A partial sample can miss the extremes; allow one bit of headroom
+    unsigned slack = sample.sampled < rows ? 1 : 0;
+    double plain = width > 0 ? (double)(rows * width)
+                             : (double)((rows + 1) * sizeof(uint32_t) +
+                                        (values->offsets[rows] - values->offsets[0]));
+    uint32_t best = SEGMENT_ENCODING_PLAIN;
+    double best_size = plain;
+    
+    if (width > 0) {
+        double size = sample.runs * scale * (double)(width + sizeof(uint32_t));
+        if (size < best_size) {
+            best = SEGMENT_ENCODING_RLE;
+            best_size = size;
+        }
+    }
+    
+    // Few distinct values in the sample: likely the whole domain; otherwise scale up
+    double distinct = sample.distinct * 4 <= sample.sampled ? (double)sample.distinct
+                                                            : sample.distinct * scale;
+    if (distinct <= DICTIONARY_MAX && distinct * 2 <= (double)rows) {
+        double entry = width > 0 ? (double)width
+                                 : sizeof(uint32_t) + (double)sample.bytes / sample.sampled;
+        unsigned bits = bits_for((uint64_t)distinct) + slack;
+        double size = distinct * entry + rows * bits / 8.0;
+        if (size < best_size) {
+            best = SEGMENT_ENCODING_DICTIONARY;
+            best_size = size;
+        }
+    }
+    
+    if (is_integer(type)) {
+        uint64_t ranges[3] = {
+            sample.max - sample.min,
+            (uint64_t)sample.delta_max - (uint64_t)sample.delta_min,
+            (uint64_t)sample.delta2_max - (uint64_t)sample.delta2_min,
+        };
+        uint32_t encodings[3] = {
+            SEGMENT_ENCODING_BITPACK, SEGMENT_ENCODING_DELTA, SEGMENT_ENCODING_DELTA_DELTA,
+        };
+        for (int e = 0; e < 3; e++) {
+            unsigned bits = bits_for(ranges[e]) + slack;
+            double size = 32 + rows * (bits > 64 ? 64 : bits) / 8.0;
+            if (size < best_size) {
+                best = encodings[e];
+                best_size = size;
+            }
+        }
+    }
+    
+    // Not worth decoding for less than a tenth saved
+    return best_size * 10 < plain * 9 ? best : SEGMENT_ENCODING_PLAIN;
+}
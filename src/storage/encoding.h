@@ -0,0 +1,108 @@
+/**
+ * @file encoding.h
+ * @brief Internal column chunk encodings for rETL DB
+ *
+ * Encoders turn the values of one column chunk into one of the
+ * SEGMENT_ENCODING_* layouts; decoders turn them back into the PLAIN
+ * layout (packed fixed-width values, or uint32_t offsets[rows + 1]
+ * followed by the bytes for STRING and BINARY). Validity bitmaps are
+ * handled by the segment format and never pass through here.
+ */
+
+#ifndef RETLDB_ENCODING_H
+#define RETLDB_ENCODING_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "retldb/storage.h"
+
+/**
+ * @brief Growable byte buffer encoders append to
+ */
+typedef struct {
+    uint8_t* data;               // Bytes
+    size_t size;                 // Bytes in use
+    size_t capacity;             // Bytes allocated
+} encoding_buffer_t;
+
+/**
+ * @brief Make room for more bytes in a buffer
+ *
+ * @param buffer The buffer
+ * @param extra Bytes needed past the current size
+ * @return 0 on success, non-zero on failure
+ */
+int encoding_buffer_reserve(encoding_buffer_t* buffer, size_t extra);
+
+/**
+ * @brief Append bytes to a buffer
+ *
+ * @param buffer The buffer
+ * @param data The bytes (NULL appends zeros)
+ * @param len Number of bytes
+ * @return 0 on success, non-zero on failure
+ */
+int encoding_buffer_append(encoding_buffer_t* buffer, const void* data, size_t len);
+
+/**
+ * @brief Free a buffer's memory and empty it
+ *
+ * @param buffer The buffer
+ */
+void encoding_buffer_free(encoding_buffer_t* buffer);
+
+/**
+ * @brief Check whether an encoding can store a type
+ *
+ * @param encoding SEGMENT_ENCODING_*
+ * @param type The column type
+ * @return Non-zero if supported
+ */
+int encoding_supports(uint32_t encoding, retldb_type_t type);
+
+/**
+ * @brief Pick the encoding likely to store a chunk smallest
+ *
+ * Looks at a sample of the values (blocks of consecutive rows spread over
+ * the chunk) to estimate cardinality, run lengths and value and delta
+ * ranges, and returns SEGMENT_ENCODING_PLAIN unless another encoding is
+ * expected to save a worthwhile share.
+ *
+ * @param type The column type
+ * @param values The values
+ * @param rows Number of values
+ * @return SEGMENT_ENCODING_*
+ */
+uint32_t encoding_choose(retldb_type_t type, const segment_vector_t* values, size_t rows);
+
+/**
+ * @brief Encode values, appending them to a buffer
+ *
+ * @param encoding SEGMENT_ENCODING_*
+ * @param type The column type
+ * @param values The values (validity is ignored)
+ * @param rows Number of values
+ * @param out The buffer to append to
+ * @return 0 on success, 1 if the encoding does not suit these values (out
+ *         is then unchanged in size), -1 on failure
+ */
+int encoding_encode(uint32_t encoding, retldb_type_t type, const segment_vector_t* values,
+                    size_t rows, encoding_buffer_t* out);
+
+/**
+ * @brief Decode values into the PLAIN layout
+ *
+ * @param encoding SEGMENT_ENCODING_*
+ * @param type The column type
+ * @param in The encoded values
+ * @param size Bytes of encoded values
+ * @param rows Number of values
+ * @param out Receives the PLAIN values, 8-byte aligned
+ * @param out_size Bytes of the PLAIN values
+ * @return 0 on success, non-zero if the input is malformed
+ */
+int encoding_decode(uint32_t encoding, retldb_type_t type, const void* in, size_t size,
+                    size_t rows, void* out, size_t out_size);
+
+#endif /* RETLDB_ENCODING_H */
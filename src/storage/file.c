@@ -3,9 +3,56 @@
  * @brief Implementation of file operations for rETL DB
  */
 
+/* Define _GNU_SOURCE to make O_DIRECT, preadv and fallocate available on Linux */
+#define _GNU_SOURCE
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#include <malloc.h>
+#include <windows.h>
+#else
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/uio.h>
+#endif
+
+#include "retldb/storage.h"
+#include "common/sync.h"
+
+#define FILE_DIRECT_ALIGN 4096          // Alignment that satisfies direct I/O on common devices
+#define FILE_MAX_CHUNK 0x40000000u      // Largest single read or write issued at once
+#define FILE_END_OFFSET UINT64_MAX      // Overlapped offset that writes at the end of the file
+#define FILE_STAGE_BUFFER (1u << 20)    // Write buffer of a staged file
+
+#ifndef _WIN32
+// file_iovec_t is passed straight to preadv/pwritev, so it must match struct iovec
+typedef char file_iovec_size_check[sizeof(file_iovec_t) == sizeof(struct iovec) ? 1 : -1];
+typedef char file_iovec_base_check[offsetof(file_iovec_t, base) ==
+                                   offsetof(struct iovec, iov_base) ? 1 : -1];
+typedef char file_iovec_len_check[offsetof(file_iovec_t, len) ==
+                                  offsetof(struct iovec, iov_len) ? 1 : -1];
+#endif
+
+/**
+ * @brief Native file handle structure
+ */
+typedef struct {
+#ifdef _WIN32
+    HANDLE handle;   // Win32 file handle
+#else
+    int fd;          // File descriptor
+#endif
+    int flags;       // FILE_* flags in effect (FILE_DIRECT cleared on fallback)
+} file_handle_t;
 
 /**
  * @brief Initialize file operations
@@ -13,7 +60,7 @@
  * @return 0 on success, non-zero on failure
  */
 int file_init(void) {
-    // Placeholder implementation
+    // Nothing to set up
     return 0;
 }
 
@@ -24,34 +71,167 @@ int file_init(void) {
  * @return 0 on success, non-zero on failure
  */
 int file_create(const char* filename) {
-    // Placeholder implementation
-    if (!filename) {
+    void* file = file_open_flags(filename, FILE_WRITE | FILE_CREATE | FILE_TRUNCATE);
+    if (!file) {
         return -1;
     }
     
-    FILE* fp = fopen(filename, "wb");
-    if (!fp) {
-        return -1;
+    return file_close(file);
+}
+
+#ifndef _WIN32
+/**
+ * @brief Open a descriptor, retrying when interrupted
+ * 
+ * @param filename The file to open
+ * @param flags Flags for open()
+ * @return Descriptor on success, -1 on failure
+ */
+static int open_descriptor(const char* filename, int flags) {
+    int fd;
+    do {
+        fd = open(filename, flags, 0644);
+    } while (fd == -1 && errno == EINTR);
+    return fd;
+}
+#endif
+
+/**
+ * @brief Open a file with FILE_* flags
+ * 
+ * @param filename The name of the file to open
+ * @param flags FILE_READ, FILE_WRITE, FILE_CREATE, FILE_TRUNCATE, FILE_DIRECT,
+ *              FILE_APPEND
+ * @return File handle on success, NULL on failure
+ */
+void* file_open_flags(const char* filename, int flags) {
+    if (!filename || !(flags & (FILE_READ | FILE_WRITE))) {
+        return NULL;
     }
     
-    fclose(fp);
-    return 0;
+    file_handle_t* file = (file_handle_t*)malloc(sizeof(file_handle_t));
+    if (!file) {
+        return NULL;
+    }
+    file->flags = flags;
+    
+#ifdef _WIN32
+    DWORD access = 0;
+    if (flags & FILE_READ) {
+        access |= GENERIC_READ;
+    }
+    if (flags & FILE_WRITE) {
+        access |= GENERIC_WRITE;
+    }
+    
+    DWORD disposition = OPEN_EXISTING;
+    if ((flags & FILE_CREATE) && (flags & FILE_TRUNCATE)) {
+        disposition = CREATE_ALWAYS;
+    } else if (flags & FILE_CREATE) {
+        disposition = OPEN_ALWAYS;
+    } else if (flags & FILE_TRUNCATE) {
+        disposition = TRUNCATE_EXISTING;
+    }
+    
+    // Win32 handles are not inherited unless asked for, like O_CLOEXEC
+    DWORD share = FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE;
+    DWORD attributes = FILE_ATTRIBUTE_NORMAL;
+    if (flags & FILE_DIRECT) {
+        attributes |= FILE_FLAG_NO_BUFFERING | FILE_FLAG_WRITE_THROUGH;
+    }
+    file->handle = CreateFileA(filename, access, share, NULL, disposition, attributes, NULL);
+    if (file->handle == INVALID_HANDLE_VALUE && (flags & FILE_DIRECT)) {
+        file->flags &= ~FILE_DIRECT;
+        file->handle = CreateFileA(filename, access, share, NULL, disposition,
+                                   FILE_ATTRIBUTE_NORMAL, NULL);
+    }
+    if (file->handle == INVALID_HANDLE_VALUE) {
+        // Callers tell a read-only file from a missing one through errno
+        errno = GetLastError() == ERROR_ACCESS_DENIED ? EACCES : ENOENT;
+        free(file);
+        return NULL;
+    }
+#else
+    int open_flags = O_CLOEXEC;
+    if ((flags & FILE_READ) && (flags & FILE_WRITE)) {
+        open_flags |= O_RDWR;
+    } else if (flags & FILE_WRITE) {
+        open_flags |= O_WRONLY;
+    } else {
+        open_flags |= O_RDONLY;
+    }
+    if (flags & FILE_CREATE) {
+        open_flags |= O_CREAT;
+    }
+    if (flags & FILE_TRUNCATE) {
+        open_flags |= O_TRUNC;
+    }
+    if (flags & FILE_APPEND) {
+        open_flags |= O_APPEND;
+    }
+    
+    file->fd = -1;
+#ifdef O_DIRECT
+    if (flags & FILE_DIRECT) {
+        // Some file systems (tmpfs, for one) reject O_DIRECT; fall back below
+        file->fd = open_descriptor(filename, open_flags | O_DIRECT);
+        if (file->fd == -1 && errno != EINVAL) {
+            free(file);
+            return NULL;
+        }
+    }
+#endif
+    if (file->fd == -1) {
+        file->fd = open_descriptor(filename, open_flags);
+        if (file->fd == -1) {
+            free(file);
+            return NULL;
+        }
+#if defined(F_NOCACHE)
+        // macOS has no O_DIRECT, only a per-descriptor cache bypass
+        if (!(flags & FILE_DIRECT) || fcntl(file->fd, F_NOCACHE, 1) == -1) {
+            file->flags &= ~FILE_DIRECT;
+        }
+#else
+        file->flags &= ~FILE_DIRECT;
+#endif
+    }
+#endif
+    
+    return file;
 }
 
 /**
- * @brief Open an existing file
+ * @brief Open an existing file with an fopen()-style mode
  * 
  * @param filename The name of the file to open
  * @param mode The mode to open the file in
  * @return File handle on success, NULL on failure
  */
 void* file_open(const char* filename, const char* mode) {
-    // Placeholder implementation
     if (!filename || !mode) {
         return NULL;
     }
     
-    return fopen(filename, mode);
+    int flags;
+    switch (mode[0]) {
+        case 'r':
+            flags = FILE_READ;
+            break;
+        case 'w':
+            flags = FILE_WRITE | FILE_CREATE | FILE_TRUNCATE;
+            break;
+        case 'a':
+            flags = FILE_WRITE | FILE_CREATE | FILE_APPEND;
+            break;
+        default:
+            return NULL;
+    }
+    if (strchr(mode, '+')) {
+        flags |= FILE_READ | FILE_WRITE;
+    }
+    
+    return file_open_flags(filename, flags);
 }
 
 /**
@@ -61,10 +241,787 @@ void* file_open(const char* filename, const char* mode) {
  * @return 0 on success, non-zero on failure
  */
 int file_close(void* file) {
-    // Placeholder implementation
     if (!file) {
         return -1;
     }
     
-    return fclose((FILE*)file);
+    file_handle_t* handle = (file_handle_t*)file;
+#ifdef _WIN32
+    int result = CloseHandle(handle->handle) ? 0 : -1;
+#else
+    // The descriptor is released even when close() reports an error
+    int result = close(handle->fd) == 0 ? 0 : -1;
+#endif
+    
+    free(handle);
+    return result;
+}
+
+#ifdef _WIN32
+/**
+ * @brief Issue one positioned read or write
+ * 
+ * @param handle The Win32 file handle
+ * @param buf The buffer
+ * @param len Number of bytes (at most FILE_MAX_CHUNK)
+ * @param offset Offset in the file
+ * @param write Non-zero to write, zero to read
+ * @return Bytes transferred (0 at end of file), -1 on failure
+ */
+static long long transfer_at(HANDLE handle, void* buf, size_t len, uint64_t offset, int write) {
+    OVERLAPPED ov;
+    DWORD done = 0;
+    memset(&ov, 0, sizeof(ov));
+    ov.Offset = (DWORD)offset;
+    ov.OffsetHigh = (DWORD)(offset >> 32);
+    BOOL ok = write ? WriteFile(handle, buf, (DWORD)len, &done, &ov)
+                    : ReadFile(handle, buf, (DWORD)len, &done, &ov);
+    if (!ok) {
+        return !write && GetLastError() == ERROR_HANDLE_EOF ? 0 : -1;
+    }
+    return (long long)done;
+}
+#endif
+
+/**
+ * @brief Read from a file at an offset until the range is filled or EOF
+ * 
+ * @param file The file handle
+ * @param buf Destination buffer
+ * @param len Number of bytes to read
+ * @param offset Offset in the file
+ * @return Number of bytes read, -1 on failure
+ */
+long long file_pread(void* file, void* buf, size_t len, uint64_t offset) {
+    if (!file || (!buf && len > 0)) {
+        return -1;
+    }
+    
+    const file_handle_t* handle = (const file_handle_t*)file;
+    size_t done = 0;
+    
+    while (done < len) {
+        size_t chunk = len - done > FILE_MAX_CHUNK ? FILE_MAX_CHUNK : len - done;
+#ifdef _WIN32
+        long long n = transfer_at(handle->handle, (char*)buf + done, chunk, offset + done, 0);
+#else
+        ssize_t n = pread(handle->fd, (char*)buf + done, chunk, (off_t)(offset + done));
+        if (n == -1 && errno == EINTR) {
+            continue;
+        }
+#endif
+        if (n < 0) {
+            return -1;
+        }
+        if (n == 0) {
+            break; // End of file
+        }
+        done += (size_t)n;
+    }
+    
+    return (long long)done;
+}
+
+/**
+ * @brief Write a buffer to a file at an offset
+ * 
+ * @param file The file handle
+ * @param buf Source buffer
+ * @param len Number of bytes to write
+ * @param offset Offset in the file
+ * @return Number of bytes written (always len), -1 on failure
+ */
+long long file_pwrite(void* file, const void* buf, size_t len, uint64_t offset) {
+    if (!file || (!buf && len > 0)) {
+        return -1;
+    }
+    
+    const file_handle_t* handle = (const file_handle_t*)file;
+    size_t done = 0;
+    
+    while (done < len) {
+        size_t chunk = len - done > FILE_MAX_CHUNK ? FILE_MAX_CHUNK : len - done;
+#ifdef _WIN32
+        long long n = transfer_at(handle->handle, (char*)buf + done, chunk,
+                                  (handle->flags & FILE_APPEND) ? FILE_END_OFFSET : offset + done, 1);
+#else
+        // pwrite() only honours O_APPEND on some systems; write() always does
+        ssize_t n = (handle->flags & FILE_APPEND)
+                        ? write(handle->fd, (const char*)buf + done, chunk)
+                        : pwrite(handle->fd, (const char*)buf + done, chunk, (off_t)(offset + done));
+        if (n == -1 && errno == EINTR) {
+            continue;
+        }
+#endif
+        if (n <= 0) {
+            return -1;
+        }
+        done += (size_t)n;
+    }
+    
+    return (long long)done;
+}
+
+/**
+ * @brief Read into a scatter list at an offset with one request
+ * 
+ * @param file The file handle
+ * @param iov The segments to fill
+ * @param iovcnt Number of segments
+ * @param offset Offset in the file
+ * @return Number of bytes read, -1 on failure
+ */
+long long file_preadv(void* file, const file_iovec_t* iov, int iovcnt, uint64_t offset) {
+    if (!file || !iov || iovcnt <= 0) {
+        return -1;
+    }
+    
+    const file_handle_t* handle = (const file_handle_t*)file;
+#ifdef _WIN32
+    long long total = 0;
+    for (int i = 0; i < iovcnt; i++) {
+        size_t len = iov[i].len > FILE_MAX_CHUNK ? FILE_MAX_CHUNK : iov[i].len;
+        long long n = transfer_at(handle->handle, iov[i].base, len, offset + total, 0);
+        if (n < 0) {
+            return total > 0 ? total : -1;
+        }
+        total += n;
+        if ((size_t)n < iov[i].len) {
+            break;
+        }
+    }
+    return total;
+#else
+    ssize_t result;
+    do {
+        result = preadv(handle->fd, (const struct iovec*)iov, iovcnt, (off_t)offset);
+    } while (result == -1 && errno == EINTR);
+    return (long long)result;
+#endif
+}
+
+/**
+ * @brief Write a gather list at an offset with one request
+ * 
+ * @param file The file handle
+ * @param iov The segments to write
+ * @param iovcnt Number of segments
+ * @param offset Offset in the file
+ * @return Number of bytes written, -1 on failure
+ */
+long long file_pwritev(void* file, const file_iovec_t* iov, int iovcnt, uint64_t offset) {
+    if (!file || !iov || iovcnt <= 0) {
+        return -1;
+    }
+    
+    const file_handle_t* handle = (const file_handle_t*)file;
+#ifdef _WIN32
+    long long total = 0;
+    for (int i = 0; i < iovcnt; i++) {
+        size_t len = iov[i].len > FILE_MAX_CHUNK ? FILE_MAX_CHUNK : iov[i].len;
+        long long n = transfer_at(handle->handle, iov[i].base, len,
+                                  (handle->flags & FILE_APPEND) ? FILE_END_OFFSET : offset + total, 1);
+        if (n < 0) {
+            return total > 0 ? total : -1;
+        }
+        total += n;
+        if ((size_t)n < iov[i].len) {
+            break;
+        }
+    }
+    return total;
+#else
+    ssize_t result;
+    do {
+        result = (handle->flags & FILE_APPEND)
+                     ? writev(handle->fd, (const struct iovec*)iov, iovcnt)
+                     : pwritev(handle->fd, (const struct iovec*)iov, iovcnt, (off_t)offset);
+    } while (result == -1 && errno == EINTR);
+    return (long long)result;
+#endif
+}
+
+/**
+ * @brief Reserve disk space for a range without changing the file size
+ * 
+ * @param file The file handle
+ * @param offset Start of the range
+ * @param length Length of the range
+ * @return 0 on success, non-zero on failure
+ */
+int file_allocate(void* file, uint64_t offset, uint64_t length) {
+    if (!file) {
+        return -1;
+    }
+    
+    const file_handle_t* handle = (const file_handle_t*)file;
+#ifdef _WIN32
+    FILE_ALLOCATION_INFO info;
+    info.AllocationSize.QuadPart = (LONGLONG)(offset + length);
+    return SetFileInformationByHandle(handle->handle, FileAllocationInfo, &info, sizeof(info))
+           ? 0 : -1;
+#elif defined(__linux__)
+    int result;
+    do {
+        result = fallocate(handle->fd, FALLOC_FL_KEEP_SIZE, (off_t)offset, (off_t)length);
+    } while (result == -1 && errno == EINTR);
+    
+    // Preallocation is an optimization; file systems without it are fine
+    if (result == -1 && (errno == EOPNOTSUPP || errno == ENOSYS)) {
+        return 0;
+    }
+    return result == 0 ? 0 : -1;
+#else
+    (void)handle;
+    (void)offset;
+    (void)length;
+    return 0;
+#endif
+}
+
+/**
+ * @brief Flush a file's data, and the metadata needed to read it, to disk
+ * 
+ * @param file The file handle
+ * @return 0 on success, non-zero on failure
+ */
+int file_sync(void* file) {
+    if (!file) {
+        return -1;
+    }
+    
+    const file_handle_t* handle = (const file_handle_t*)file;
+#ifdef _WIN32
+    return FlushFileBuffers(handle->handle) ? 0 : -1;
+#elif defined(__APPLE__)
+    return fsync(handle->fd) == 0 ? 0 : -1;
+#else
+    return fdatasync(handle->fd) == 0 ? 0 : -1;
+#endif
+}
+
+/**
+ * @brief Set the size of a file
+ * 
+ * @param file The file handle
+ * @param size The new size
+ * @return 0 on success, non-zero on failure
+ */
+int file_truncate(void* file, uint64_t size) {
+    if (!file) {
+        return -1;
+    }
+    
+    const file_handle_t* handle = (const file_handle_t*)file;
+#ifdef _WIN32
+    FILE_END_OF_FILE_INFO info;
+    info.EndOfFile.QuadPart = (LONGLONG)size;
+    return SetFileInformationByHandle(handle->handle, FileEndOfFileInfo, &info, sizeof(info))
+           ? 0 : -1;
+#else
+    return ftruncate(handle->fd, (off_t)size) == 0 ? 0 : -1;
+#endif
+}
+
+/**
+ * @brief Get the size of a file
+ * 
+ * @param file The file handle
+ * @param size Set to the size in bytes
+ * @return 0 on success, non-zero on failure
+ */
+int file_size(void* file, uint64_t* size) {
+    if (!file || !size) {
+        return -1;
+    }
+    
+    const file_handle_t* handle = (const file_handle_t*)file;
+#ifdef _WIN32
+    LARGE_INTEGER file_size;
+    if (!GetFileSizeEx(handle->handle, &file_size)) {
+        return -1;
+    }
+    *size = (uint64_t)file_size.QuadPart;
+#else
+    struct stat sb;
+    if (fstat(handle->fd, &sb) == -1) {
+        return -1;
+    }
+    *size = (uint64_t)sb.st_size;
+#endif
+    return 0;
+}
+
+/**
+ * @brief Get the alignment I/O on a file must respect
+ * 
+ * @param file The file handle
+ * @return FILE_DIRECT_ALIGN for direct I/O, 1 otherwise, 0 on error
+ */
+size_t file_alignment(const void* file) {
+    if (!file) {
+        return 0;
+    }
+    
+    const file_handle_t* handle = (const file_handle_t*)file;
+    return (handle->flags & FILE_DIRECT) ? FILE_DIRECT_ALIGN : 1;
+}
+
+/**
+ * @brief Get the POSIX descriptor behind a file handle
+ * 
+ * @param file The file handle
+ * @return The descriptor, -1 on error or on Windows
+ */
+int file_descriptor(const void* file) {
+    if (!file) {
+        return -1;
+    }
+    
+#ifdef _WIN32
+    return -1;
+#else
+    const file_handle_t* handle = (const file_handle_t*)file;
+    return handle->fd;
+#endif
+}
+
+#ifndef _WIN32
+/**
+ * @brief Lock a whole open file
+ * 
+ * Uses open file description locks where the kernel has them and flock()
+ * otherwise. Both belong to the open file, not the process, so two opens
+ * within one process conflict just as two processes do, and closing some
+ * other descriptor of the file does not drop the lock.
+ * 
+ * @param fd The descriptor
+ * @param exclusive Non-zero for an exclusive lock, zero for a shared one
+ * @param wait Non-zero to block until the lock is granted
+ * @return 0 on success, -1 with errno set on failure
+ */
+static int lock_descriptor(int fd, int exclusive, int wait) {
+    int result;
+#ifdef F_OFD_SETLK
+    struct flock lock;
+    memset(&lock, 0, sizeof(lock));
+    lock.l_type = exclusive ? F_WRLCK : F_RDLCK;
+    lock.l_whence = SEEK_SET;
+    do {
+        result = fcntl(fd, wait ? F_OFD_SETLKW : F_OFD_SETLK, &lock);
+    } while (result == -1 && errno == EINTR);
+    if (result == 0 || errno != EINVAL) {
+        return result;
+    }
+    // Kernel without OFD locks
+#endif
+    do {
+        result = flock(fd, (exclusive ? LOCK_EX : LOCK_SH) | (wait ? 0 : LOCK_NB));
+    } while (result == -1 && errno == EINTR);
+    return result;
+}
+#endif
+
+/**
+ * @brief Take an advisory lock on a file, creating the file if needed
+ * 
+ * @param filename The lock file
+ * @param flags FILE_LOCK_SHARED or FILE_LOCK_EXCLUSIVE, optionally with FILE_LOCK_WAIT
+ * @param lock Receives the lock handle on success
+ * @return RETLDB_OK, RETLDB_ERROR_BUSY if another holder conflicts and
+ *         FILE_LOCK_WAIT is not set, or another error code
+ */
+retldb_error_t file_lock(const char* filename, int flags, void** lock) {
+    int exclusive = (flags & FILE_LOCK_EXCLUSIVE) != 0;
+    if (!filename || !lock || exclusive == ((flags & FILE_LOCK_SHARED) != 0)) {
+        return RETLDB_ERROR_INVALID_ARGUMENT;
+    }
+    
+    // A shared lock can be taken on a file this process may only read
+    void* file = file_open_flags(filename, FILE_READ | FILE_WRITE | FILE_CREATE);
+    if (!file && !exclusive) {
+        file = file_open_flags(filename, FILE_READ);
+    }
+    if (!file) {
+        return RETLDB_ERROR_IO;
+    }
+    
+    file_handle_t* handle = (file_handle_t*)file;
+#ifdef _WIN32
+    OVERLAPPED overlapped;
+    memset(&overlapped, 0, sizeof(overlapped));
+    DWORD lock_flags = (exclusive ? LOCKFILE_EXCLUSIVE_LOCK : 0) |
+                       ((flags & FILE_LOCK_WAIT) ? 0 : LOCKFILE_FAIL_IMMEDIATELY);
+    if (!LockFileEx(handle->handle, lock_flags, 0, MAXDWORD, MAXDWORD, &overlapped)) {
+        int busy = GetLastError() == ERROR_LOCK_VIOLATION;
+        file_close(file);
+        return busy ? RETLDB_ERROR_BUSY : RETLDB_ERROR_IO;
+    }
+#else
+    if (lock_descriptor(handle->fd, exclusive, (flags & FILE_LOCK_WAIT) != 0) != 0) {
+        int busy = errno == EAGAIN || errno == EWOULDBLOCK || errno == EACCES;
+        file_close(file);
+        return busy ? RETLDB_ERROR_BUSY : RETLDB_ERROR_IO;
+    }
+#endif
+    
+    *lock = file;
+    return RETLDB_OK;
+}
+
+/**
+ * @brief Release a lock taken with file_lock()
+ * 
+ * @param lock The lock handle
+ * @return 0 on success, non-zero on failure
+ */
+int file_unlock(void* lock) {
+    // Closing the only descriptor of the lock releases it
+    return file_close(lock);
+}
+
+/**
+ * @brief Staged replacement of a file
+ */
+typedef struct {
+    void* file;                  // Handle of the temporary file
+    char* target;                // Name the file gets on commit
+    char* temp;                  // Name of the temporary file
+    char* buffer;                // Write buffer (aligned for direct I/O)
+    size_t buffered;             // Bytes waiting in the buffer
+    uint64_t offset;             // File offset of the buffer's first byte
+    int failed;                  // Set once a write failed; commit then aborts
+    file_stage_stats_t stats;    // Bytes and time per step
+} file_stage_t;
+
+static int stage_counter;        // Distinguishes temporary names within a process
+
+/**
+ * @brief Get a monotonic timestamp
+ * 
+ * @return Microseconds since an arbitrary point
+ */
+static uint64_t now_us(void) {
+#ifdef _WIN32
+    LARGE_INTEGER frequency, counter;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+    return (uint64_t)(counter.QuadPart / frequency.QuadPart) * 1000000 +
+           (uint64_t)(counter.QuadPart % frequency.QuadPart) * 1000000 /
+           (uint64_t)frequency.QuadPart;
+#else
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000 + (uint64_t)now.tv_nsec / 1000;
+#endif
+}
+
+/**
+ * @brief Flush a file's directory entry changes to disk
+ * 
+ * @param dirname The directory
+ * @return 0 on success, non-zero on failure
+ */
+int file_sync_directory(const char* dirname) {
+    if (!dirname) {
+        return -1;
+    }
+    
+#ifdef _WIN32
+    // Directory entries cannot be flushed on their own; renames done with
+    // MOVEFILE_WRITE_THROUGH are durable when they return
+    return 0;
+#else
+    int fd = open_descriptor(dirname, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        return -1;
+    }
+    int result = fsync(fd) == 0 ? 0 : -1;
+    close(fd);
+    return result;
+#endif
+}
+
+/**
+ * @brief Get the directory part of a path
+ * 
+ * @param path The path
+ * @return Newly allocated directory name ("." for a bare name), NULL on failure
+ */
+static char* directory_of(const char* path) {
+    const char* slash = strrchr(path, '/');
+#ifdef _WIN32
+    const char* backslash = strrchr(path, '\\');
+    if (backslash && (!slash || backslash > slash)) {
+        slash = backslash;
+    }
+#endif
+    if (!slash) {
+        char* dot = (char*)malloc(2);
+        if (dot) {
+            memcpy(dot, ".", 2);
+        }
+        return dot;
+    }
+    
+    size_t len = slash == path ? 1 : (size_t)(slash - path);
+    char* dir = (char*)malloc(len + 1);
+    if (dir) {
+        memcpy(dir, path, len);
+        dir[len] = '\0';
+    }
+    return dir;
+}
+
+/**
+ * @brief Free a stage and everything it owns
+ * 
+ * @param stage The stage
+ */
+static void stage_free(file_stage_t* stage) {
+#ifdef _WIN32
+    _aligned_free(stage->buffer);
+#else
+    free(stage->buffer);
+#endif
+    free(stage->temp);
+    free(stage->target);
+    free(stage);
+}
+
+/**
+ * @brief Start writing a replacement for a file
+ * 
+ * @param filename The file to replace (or create)
+ * @param flags 0 or FILE_DIRECT
+ * @return Stage handle on success, NULL on failure
+ */
+void* file_stage_open(const char* filename, int flags) {
+    if (!filename || (flags & ~FILE_DIRECT)) {
+        return NULL;
+    }
+    
+    file_stage_t* stage = (file_stage_t*)calloc(1, sizeof(file_stage_t));
+    if (!stage) {
+        return NULL;
+    }
+    
+    // The temporary file sits next to the target so the rename stays on
+    // one file system; pid and counter keep concurrent writers apart
+    size_t len = strlen(filename) + 48;
+    stage->target = (char*)malloc(strlen(filename) + 1);
+    stage->temp = (char*)malloc(len);
+#ifdef _WIN32
+    stage->buffer = (char*)_aligned_malloc(FILE_STAGE_BUFFER, FILE_DIRECT_ALIGN);
+    unsigned long pid = (unsigned long)GetCurrentProcessId();
+#else
+    void* buffer = NULL;
+    if (posix_memalign(&buffer, FILE_DIRECT_ALIGN, FILE_STAGE_BUFFER) == 0) {
+        stage->buffer = (char*)buffer;
+    }
+    unsigned long pid = (unsigned long)getpid();
+#endif
+    if (!stage->target || !stage->temp || !stage->buffer) {
+        stage_free(stage);
+        return NULL;
+    }
+    memcpy(stage->target, filename, strlen(filename) + 1);
+    snprintf(stage->temp, len, "%s.tmp-%lu-%d", filename, pid,
+             retldb_atomic_fetch_add_int(&stage_counter, 1));
+    
+    stage->file = file_open_flags(stage->temp, FILE_READ | FILE_WRITE | FILE_CREATE |
+                                               FILE_TRUNCATE | flags);
+    if (!stage->file) {
+        stage_free(stage);
+        return NULL;
+    }
+    
+    return stage;
+}
+
+/**
+ * @brief Write out the stage's buffer
+ * 
+ * With direct I/O a partial final block is padded to the alignment; commit
+ * trims the padding off again.
+ * 
+ * @param stage The stage
+ * @return 0 on success, non-zero on failure
+ */
+static int stage_flush(file_stage_t* stage) {
+    if (stage->buffered == 0) {
+        return 0;
+    }
+    
+    size_t align = file_alignment(stage->file);
+    size_t len = (stage->buffered + align - 1) / align * align;
+    memset(stage->buffer + stage->buffered, 0, len - stage->buffered);
+    
+    uint64_t start = now_us();
+    long long n = file_pwrite(stage->file, stage->buffer, len, stage->offset);
+    stage->stats.write_us += now_us() - start;
+    if (n < 0) {
+        stage->failed = 1;
+        return -1;
+    }
+    
+    stage->offset += stage->buffered;
+    stage->buffered = 0;
+    return 0;
+}
+
+/**
+ * @brief Append data to a staged file
+ * 
+ * @param stage The stage handle
+ * @param buf The data
+ * @param len Number of bytes
+ * @return 0 on success, non-zero on failure
+ */
+int file_stage_write(void* stage, const void* buf, size_t len) {
+    if (!stage || (!buf && len > 0)) {
+        return -1;
+    }
+    
+    file_stage_t* staged = (file_stage_t*)stage;
+    if (staged->failed) {
+        return -1;
+    }
+    
+    // Large buffered writes skip the copy
+    if (staged->buffered == 0 && len >= FILE_STAGE_BUFFER && file_alignment(staged->file) == 1) {
+        uint64_t start = now_us();
+        long long n = file_pwrite(staged->file, buf, len, staged->offset);
+        staged->stats.write_us += now_us() - start;
+        if (n < 0) {
+            staged->failed = 1;
+            return -1;
+        }
+        staged->offset += len;
+        staged->stats.bytes += len;
+        return 0;
+    }
+    
+    const char* src = (const char*)buf;
+    size_t left = len;
+    while (left > 0) {
+        size_t chunk = FILE_STAGE_BUFFER - staged->buffered;
+        if (chunk > left) {
+            chunk = left;
+        }
+        memcpy(staged->buffer + staged->buffered, src, chunk);
+        staged->buffered += chunk;
+        src += chunk;
+        left -= chunk;
+        if (staged->buffered == FILE_STAGE_BUFFER && stage_flush(staged) != 0) {
+            return -1;
+        }
+    }
+    
+    staged->stats.bytes += len;
+    return 0;
+}
+
+/**
+ * @brief Abandon a staged file, leaving the target untouched
+ * 
+ * @param stage The stage handle
+ * @return 0 on success, non-zero on failure
+ */
+int file_stage_abort(void* stage) {
+    if (!stage) {
+        return -1;
+    }
+    
+    file_stage_t* staged = (file_stage_t*)stage;
+    int result = file_close(staged->file);
+    if (remove(staged->temp) != 0) {
+        result = -1;
+    }
+    stage_free(staged);
+    return result;
+}
+
+/**
+ * @brief Make a staged file durable and atomically put it in place
+ * 
+ * @param stage The stage handle (freed, whatever the outcome)
+ * @param stats Filled with bytes written and time per step, may be NULL
+ * @return 0 on success, non-zero on failure
+ */
+int file_stage_commit(void* stage, file_stage_stats_t* stats) {
+    if (!stage) {
+        return -1;
+    }
+    
+    file_stage_t* staged = (file_stage_t*)stage;
+    if (staged->failed || stage_flush(staged) != 0) {
+        file_stage_abort(staged);
+        return -1;
+    }
+    
+    // Drop direct I/O padding past the real end of the data
+    uint64_t size = 0;
+    if (file_size(staged->file, &size) != 0 ||
+        (size != staged->offset && file_truncate(staged->file, staged->offset) != 0)) {
+        file_stage_abort(staged);
+        return -1;
+    }
+    
+    // The data must be on disk before the name points at it
+    uint64_t start = now_us();
+    if (file_sync(staged->file) != 0) {
+        file_stage_abort(staged);
+        return -1;
+    }
+    staged->stats.sync_us = now_us() - start;
+    if (file_close(staged->file) != 0) {
+        staged->file = NULL;
+        remove(staged->temp);
+        stage_free(staged);
+        return -1;
+    }
+    staged->file = NULL;
+    
+    start = now_us();
+#ifdef _WIN32
+    int renamed = MoveFileExA(staged->temp, staged->target,
+                              MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) ? 0 : -1;
+#else
+    int renamed = rename(staged->temp, staged->target) == 0 ? 0 : -1;
+#endif
+    staged->stats.rename_us = now_us() - start;
+    if (renamed != 0) {
+        remove(staged->temp);
+        stage_free(staged);
+        return -1;
+    }
+    
+    // Then the rename itself must survive a crash
+    start = now_us();
+    char* dir = directory_of(staged->target);
+    int result = dir ? file_sync_directory(dir) : -1;
+    free(dir);
+    staged->stats.dir_sync_us = now_us() - start;
+    
+    if (stats) {
+        *stats = staged->stats;
+    }
+    stage_free(staged);
+    return result;
+}
+
+/**
+ * @brief Get the name of a stage's temporary file
+ * 
+ * @param stage The stage handle
+ * @return The temporary file name, NULL on error
+ */
+const char* file_stage_path(const void* stage) {
+    if (!stage) {
+        return NULL;
+    }
+    
+    const file_stage_t* staged = (const file_stage_t*)stage;
+    return staged->temp;
 }
@@ -0,0 +1,502 @@
+/**
+ * @file file_cache.c
+ * @brief Implementation of the open file cache for rETL DB
+ *
+ * Keeps descriptors of recently used files open so repeated reads of the
+ * same (immutable) segment files skip open() and close(). Files handed out
+ * by file_cache_acquire() are pinned until released; released files wait on
+ * an idle list in least-recently-used order and are closed from its tail
+ * whenever more files are open than the cache's capacity.
+ */
+
+/* Define _POSIX_C_SOURCE to make strdup and clock_gettime available */
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+#include "retldb/storage.h"
+#include "common/sync.h"
+
+#define FILE_CACHE_DEFAULT 1024         // Capacity when the descriptor limit is unknown or unlimited
+#define FILE_CACHE_BUCKETS 256          // Hash buckets for names and for handles
+
+/**
+ * @brief Cached open file
+ */
+typedef struct file_cache_entry {
+    char* name;                          // File name, NULL once evicted
+    void* file;                          // Open file handle
+    int pins;                            // Outstanding acquisitions
+    struct file_cache_entry* name_next;  // Next entry in the name bucket
+    struct file_cache_entry* file_next;  // Next entry in the handle bucket
+    struct file_cache_entry* lru_prev;   // Previous idle entry (more recently used)
+    struct file_cache_entry* lru_next;   // Next idle entry (less recently used)
+} file_cache_entry_t;
+
+/**
+ * @brief File cache structure
+ */
+typedef struct {
+    retldb_mutex_t lock;                 // Protects everything below
+    int flags;                           // FILE_* flags files are opened with
+    size_t capacity;                     // Files kept open before idle ones are closed
+    size_t open;                         // Files currently open
+    size_t pinned;                       // Files with at least one pin
+    uint64_t hits;                       // Acquisitions served by an open file
+    uint64_t misses;                     // Acquisitions that opened the file
+    uint64_t evictions;                  // Idle files closed to stay within capacity
+    file_cache_entry_t* names[FILE_CACHE_BUCKETS];  // Entries by name
+    file_cache_entry_t* files[FILE_CACHE_BUCKETS];  // Entries by handle
+    file_cache_entry_t* lru_head;        // Most recently released idle entry
+    file_cache_entry_t* lru_tail;        // Least recently released idle entry
+} file_cache_t;
+
+/**
+ * @brief Hash a filename (FNV-1a)
+ *
+ * @param name The filename
+ * @return Bucket index for the name
+ */
+static size_t name_bucket(const char* name) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    while (*name) {
+        hash ^= (unsigned char)*name++;
+        hash *= 0x100000001b3ULL;
+    }
+    return (size_t)(hash % FILE_CACHE_BUCKETS);
+}
+
+/**
+ * @brief Hash a file handle
+ *
+ * @param file The file handle
+ * @return Bucket index for the handle
+ */
+static size_t file_bucket(const void* file) {
+    uint64_t hash = (uint64_t)(uintptr_t)file * 0x9e3779b97f4a7c15ULL;
+    return (size_t)(hash >> 56) % FILE_CACHE_BUCKETS;
+}
+
+/**
+ * @brief Pick a capacity that leaves room under the process descriptor limit
+ *
+ * @return Half the soft RLIMIT_NOFILE, or FILE_CACHE_DEFAULT without one
+ */
+static size_t default_capacity(void) {
+#ifndef _WIN32
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur != RLIM_INFINITY &&
+        limit.rlim_cur / 2 < FILE_CACHE_DEFAULT) {
+        return limit.rlim_cur / 2 > 0 ? (size_t)(limit.rlim_cur / 2) : 1;
+    }
+#endif
+    return FILE_CACHE_DEFAULT;
+}
+
+/**
+ * @brief Find an entry by name
+ *
+ * Must be called with the cache lock held.
+ *
+ * @param cache The cache
+ * @param name The filename
+ * @return The entry, or NULL if the file is not cached
+ */
+static file_cache_entry_t* find_name(file_cache_t* cache, const char* name) {
+    file_cache_entry_t* entry = cache->names[name_bucket(name)];
+    while (entry && strcmp(entry->name, name) != 0) {
+        entry = entry->name_next;
+    }
+    return entry;
+}
+
+/**
+ * @brief Find an entry by file handle
+ *
+ * Must be called with the cache lock held.
+ *
+ * @param cache The cache
+ * @param file The file handle
+ * @return The entry, or NULL if the handle did not come from this cache
+ */
+static file_cache_entry_t* find_file(file_cache_t* cache, const void* file) {
+    file_cache_entry_t* entry = cache->files[file_bucket(file)];
+    while (entry && entry->file != file) {
+        entry = entry->file_next;
+    }
+    return entry;
+}
+
+/**
+ * @brief Take an entry off the idle list
+ *
+ * Must be called with the cache lock held.
+ *
+ * @param cache The cache
+ * @param entry The entry, which must be idle
+ */
+static void lru_remove(file_cache_t* cache, file_cache_entry_t* entry) {
+    if (entry->lru_prev) {
+        entry->lru_prev->lru_next = entry->lru_next;
+    } else {
+        cache->lru_head = entry->lru_next;
+    }
+    if (entry->lru_next) {
+        entry->lru_next->lru_prev = entry->lru_prev;
+    } else {
+        cache->lru_tail = entry->lru_prev;
+    }
+    entry->lru_prev = entry->lru_next = NULL;
+}
+
+/**
+ * @brief Add a pin to an entry, taking it off the idle list if needed
+ *
+ * Must be called with the cache lock held.
+ *
+ * @param cache The cache
+ * @param entry The entry
+ */
+static void pin(file_cache_t* cache, file_cache_entry_t* entry) {
+    if (entry->pins++ == 0) {
+        lru_remove(cache, entry);
+        cache->pinned++;
+    }
+}
+
+/**
+ * @brief Remove an entry from the name table
+ *
+ * Must be called with the cache lock held. The entry stays reachable by
+ * its handle until it is closed.
+ *
+ * @param cache The cache
+ * @param entry The entry
+ */
+static void unlink_name(file_cache_t* cache, file_cache_entry_t* entry) {
+    file_cache_entry_t** link = &cache->names[name_bucket(entry->name)];
+    while (*link != entry) {
+        link = &(*link)->name_next;
+    }
+    *link = entry->name_next;
+    free(entry->name);
+    entry->name = NULL;
+}
+
+/**
+ * @brief Remove an entry from the handle table and, if listed, the idle list
+ *
+ * Must be called with the cache lock held. The caller closes the file and
+ * frees the entry, ideally after dropping the lock.
+ *
+ * @param cache The cache
+ * @param entry The entry
+ */
+static void unlink_entry(file_cache_t* cache, file_cache_entry_t* entry) {
+    // Only named entries without pins sit on the idle list
+    int idle = entry->pins == 0 && entry->name;
+    if (entry->name) {
+        unlink_name(cache, entry);
+    }
+    
+    file_cache_entry_t** link = &cache->files[file_bucket(entry->file)];
+    while (*link != entry) {
+        link = &(*link)->file_next;
+    }
+    *link = entry->file_next;
+    
+    if (idle) {
+        lru_remove(cache, entry);
+    }
+    cache->open--;
+}
+
+/**
+ * @brief Unlink idle entries until the cache is within capacity
+ *
+ * Must be called with the cache lock held.
+ *
+ * @param cache The cache
+ * @param victims Unlinked entries are pushed here, chained through file_next
+ * @param limit Files that may stay open
+ */
+static void trim(file_cache_t* cache, file_cache_entry_t** victims, size_t limit) {
+    while (cache->open > limit && cache->lru_tail) {
+        file_cache_entry_t* entry = cache->lru_tail;
+        unlink_entry(cache, entry);
+        entry->file_next = *victims;
+        *victims = entry;
+        cache->evictions++;
+    }
+}
+
+/**
+ * @brief Close and free a chain of unlinked entries
+ *
+ * @param victims Entries chained through file_next
+ * @return 0 if every file closed cleanly, non-zero otherwise
+ */
+static int close_entries(file_cache_entry_t* victims) {
+    int result = 0;
+    while (victims) {
+        file_cache_entry_t* next = victims->file_next;
+        if (file_close(victims->file) != 0) {
+            result = -1;
+        }
+        free(victims);
+        victims = next;
+    }
+    return result;
+}
+
+/**
+ * @brief Create an open file cache
+ *
+ * @param capacity Files to keep open, 0 for half the process descriptor limit
+ * @param flags FILE_* flags to open files with (FILE_READ if 0)
+ * @return Cache handle on success, NULL on failure
+ */
+void* file_cache_create(size_t capacity, int flags) {
+    file_cache_t* cache = (file_cache_t*)calloc(1, sizeof(file_cache_t));
+    if (!cache) {
+        return NULL;
+    }
+    
+    if (retldb_mutex_init(&cache->lock) != 0) {
+        free(cache);
+        return NULL;
+    }
+    
+    cache->flags = flags ? flags : FILE_READ;
+    cache->capacity = capacity ? capacity : default_capacity();
+    return cache;
+}
+
+/**
+ * @brief Destroy an open file cache, closing its files
+ *
+ * @param handle The cache handle
+ * @return 0 on success, non-zero if files are still acquired (the cache is kept)
+ */
+int file_cache_destroy(void* handle) {
+    file_cache_t* cache = (file_cache_t*)handle;
+    if (!cache) {
+        return -1;
+    }
+    
+    file_cache_entry_t* victims = NULL;
+    retldb_mutex_lock(&cache->lock);
+    if (cache->pinned > 0) {
+        retldb_mutex_unlock(&cache->lock);
+        return -1;
+    }
+    trim(cache, &victims, 0);
+    retldb_mutex_unlock(&cache->lock);
+    
+    int result = close_entries(victims);
+    retldb_mutex_destroy(&cache->lock);
+    free(cache);
+    return result;
+}
+
+/**
+ * @brief Get an open handle for a file, opening it on a miss
+ *
+ * @param handle The cache handle
+ * @param filename The file
+ * @return File handle, pinned until file_cache_release(); NULL on failure
+ */
+void* file_cache_acquire(void* handle, const char* filename) {
+    file_cache_t* cache = (file_cache_t*)handle;
+    if (!cache || !filename) {
+        return NULL;
+    }
+    
+    retldb_mutex_lock(&cache->lock);
+    file_cache_entry_t* entry = find_name(cache, filename);
+    if (entry) {
+        pin(cache, entry);
+        cache->hits++;
+        void* file = entry->file;
+        retldb_mutex_unlock(&cache->lock);
+        return file;
+    }
+    cache->misses++;
+    retldb_mutex_unlock(&cache->lock);
+    
+    // Open without the lock so hits on other files are not held up
+    void* file = file_open_flags(filename, cache->flags);
+    if (!file) {
+        return NULL;
+    }
+    
+    entry = (file_cache_entry_t*)calloc(1, sizeof(file_cache_entry_t));
+    char* name = strdup(filename);
+    if (!entry || !name) {
+        free(entry);
+        free(name);
+        file_close(file);
+        return NULL;
+    }
+    entry->name = name;
+    entry->file = file;
+    entry->pins = 1;
+    
+    file_cache_entry_t* victims = NULL;
+    retldb_mutex_lock(&cache->lock);
+    file_cache_entry_t* existing = find_name(cache, filename);
+    if (existing) {
+        // Another thread opened it meanwhile; use theirs
+        pin(cache, existing);
+        void* winner = existing->file;
+        retldb_mutex_unlock(&cache->lock);
+        file_close(file);
+        free(name);
+        free(entry);
+        return winner;
+    }
+    
+    size_t bucket = name_bucket(filename);
+    entry->name_next = cache->names[bucket];
+    cache->names[bucket] = entry;
+    bucket = file_bucket(file);
+    entry->file_next = cache->files[bucket];
+    cache->files[bucket] = entry;
+    cache->open++;
+    cache->pinned++;
+    trim(cache, &victims, cache->capacity);
+    retldb_mutex_unlock(&cache->lock);
+    
+    close_entries(victims);
+    return file;
+}
+
+/**
+ * @brief Release a file handle obtained from file_cache_acquire()
+ *
+ * @param handle The cache handle
+ * @param file The file handle
+ * @return 0 on success, non-zero if the handle is not acquired from this cache
+ */
+int file_cache_release(void* handle, void* file) {
+    file_cache_t* cache = (file_cache_t*)handle;
+    if (!cache || !file) {
+        return -1;
+    }
+    
+    file_cache_entry_t* victims = NULL;
+    retldb_mutex_lock(&cache->lock);
+    file_cache_entry_t* entry = find_file(cache, file);
+    if (!entry || entry->pins == 0) {
+        retldb_mutex_unlock(&cache->lock);
+        return -1;
+    }
+    
+    if (--entry->pins == 0) {
+        cache->pinned--;
+        if (!entry->name) {
+            // Evicted while in use; close it now that the last user is done
+            unlink_entry(cache, entry);
+            entry->file_next = victims;
+            victims = entry;
+        } else {
+            entry->lru_prev = NULL;
+            entry->lru_next = cache->lru_head;
+            if (cache->lru_head) {
+                cache->lru_head->lru_prev = entry;
+            } else {
+                cache->lru_tail = entry;
+            }
+            cache->lru_head = entry;
+            trim(cache, &victims, cache->capacity);
+        }
+    }
+    retldb_mutex_unlock(&cache->lock);
+    
+    return close_entries(victims);
+}
+
+/**
+ * @brief Drop a file from the cache, e.g. before deleting or replacing it
+ *
+ * An idle file is closed at once; one still acquired is closed when its
+ * last user releases it. Later acquisitions open the file afresh.
+ *
+ * @param handle The cache handle
+ * @param filename The file
+ * @return 0 on success (including when the file is not cached), non-zero on failure
+ */
+int file_cache_evict(void* handle, const char* filename) {
+    file_cache_t* cache = (file_cache_t*)handle;
+    if (!cache || !filename) {
+        return -1;
+    }
+    
+    file_cache_entry_t* victims = NULL;
+    retldb_mutex_lock(&cache->lock);
+    file_cache_entry_t* entry = find_name(cache, filename);
+    if (entry) {
+        if (entry->pins == 0) {
+            unlink_entry(cache, entry);
+            entry->file_next = victims;
+            victims = entry;
+        } else {
+            unlink_name(cache, entry);
+        }
+    }
+    retldb_mutex_unlock(&cache->lock);
+    
+    return close_entries(victims);
+}
+
+/**
+ * @brief Change how many files a cache keeps open
+ *
+ * @param handle The cache handle
+ * @param capacity Files to keep open, 0 for half the process descriptor limit
+ * @return 0 on success, non-zero on failure
+ */
+int file_cache_set_capacity(void* handle, size_t capacity) {
+    file_cache_t* cache = (file_cache_t*)handle;
+    if (!cache) {
+        return -1;
+    }
+    
+    file_cache_entry_t* victims = NULL;
+    retldb_mutex_lock(&cache->lock);
+    cache->capacity = capacity ? capacity : default_capacity();
+    trim(cache, &victims, cache->capacity);
+    retldb_mutex_unlock(&cache->lock);
+    
+    return close_entries(victims);
+}
+
+/**
+ * @brief Get open file cache statistics
+ *
+ * @param handle The cache handle
+ * @param stats Filled with the current counters
+ * @return 0 on success, non-zero on failure
+ */
+int file_cache_stats(void* handle, file_cache_stats_t* stats) {
+    file_cache_t* cache = (file_cache_t*)handle;
+    if (!cache || !stats) {
+        return -1;
+    }
+    
+    retldb_mutex_lock(&cache->lock);
+    stats->hits = cache->hits;
+    stats->misses = cache->misses;
+    stats->evictions = cache->evictions;
+    stats->open = cache->open;
+    stats->pinned = cache->pinned;
+    stats->capacity = cache->capacity;
+    retldb_mutex_unlock(&cache->lock);
+    return 0;
+}
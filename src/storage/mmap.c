@@ -3,25 +3,51 @@
  * @brief Implementation of memory-mapped file operations for rETL DB
  */
 
+/* Define _GNU_SOURCE to make mremap available on Linux */
+#define _GNU_SOURCE
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
 #include <fcntl.h>
 #include <sys/stat.h>
 
+#include "retldb/storage.h"
+#include "common/sync.h"
+
 #ifdef _WIN32
 #include <windows.h>
 #else
 #include <unistd.h>
+#include <signal.h>
+#include <setjmp.h>
 #include <sys/mman.h>
 #endif
 
+#define MMAP_REGISTRY_BUCKETS 64 // Hash buckets of the shared mapping registry
+
 /**
  * @brief Memory-mapped file handle structure
+ * 
+ * Handles are shared: mapping the same window of the same file with the
+ * same hints again returns the live handle with one more reference.
  */
-typedef struct {
+typedef struct mmap_handle {
     void* addr;      // Mapped memory address
     size_t size;     // Size of the mapped region
+    uint64_t offset; // File offset of the first mapped byte
+    int read_only;   // Whether the mapping is read-only
+    int advice;      // Access pattern hint for the whole window (mmap_advice_t)
+    int flags;       // MMAP_POPULATE / MMAP_LOCK flags given at open
+    int locks;       // Outstanding lock requests; the window is locked while non-zero
+    int huge;        // Whether a preloaded copy sits on explicit huge pages
+    size_t map_size; // Bytes allocated for a preloaded copy (whole huge pages)
+    uint64_t dev;    // Device (volume) of the file
+    uint64_t ino;    // Inode (file index) of the file
+    int refs;        // References held by callers, under the registry lock
+    int fault_error; // Error that retired the window after a fault (retldb_error_t)
+    struct mmap_handle* next; // Next handle in the registry bucket
 #ifdef _WIN32
     HANDLE file;     // File handle
     HANDLE mapping;  // File mapping handle
@@ -30,40 +56,555 @@ typedef struct {
 #endif
 } mmap_handle_t;
 
+/**
+ * @brief Registry of live mappings keyed by file identity
+ */
+static struct {
+    retldb_mutex_t lock;                            // Protects buckets, refs and next
+    mmap_handle_t* buckets[MMAP_REGISTRY_BUCKETS];  // Hash chains of live handles
+} registry;
+
+static retldb_once_t registry_once = RETLDB_ONCE_INIT;
+
+#ifndef _WIN32
+/**
+ * @brief A guarded read in progress on this thread
+ */
+typedef struct mmap_guard {
+    sigjmp_buf env;              // Where a fault in the window jumps back to
+    const char* start;           // First guarded byte
+    const char* end;             // Byte past the guarded range
+    const char* volatile fault;  // Faulting address, set by the handler
+    struct mmap_guard* prev;     // Enclosing guard on this thread
+} mmap_guard_t;
+
+static RETLDB_THREAD_LOCAL mmap_guard_t* current_guard;
+static struct sigaction previous_sigbus;
+static retldb_once_t sigbus_once = RETLDB_ONCE_INIT;
+
+/**
+ * @brief Turn a SIGBUS inside a guarded window into a jump out of the read
+ * 
+ * Faults outside every guard on this thread go to whatever handler was
+ * installed before ours, or get the default action.
+ */
+static void sigbus_handler(int sig, siginfo_t* info, void* context) {
+    const char* addr = (const char*)info->si_addr;
+    for (mmap_guard_t* guard = current_guard; guard; guard = guard->prev) {
+        if (addr >= guard->start && addr < guard->end) {
+            guard->fault = addr;
+            siglongjmp(guard->env, 1);
+        }
+    }
+    
+    if (previous_sigbus.sa_flags & SA_SIGINFO) {
+        previous_sigbus.sa_sigaction(sig, info, context);
+    } else if (previous_sigbus.sa_handler != SIG_DFL && previous_sigbus.sa_handler != SIG_IGN) {
+        previous_sigbus.sa_handler(sig);
+    } else {
+        // Returning re-runs the faulting access, which now takes the default action
+        signal(sig, SIG_DFL);
+    }
+}
+
+/**
+ * @brief Install the SIGBUS handler, run once
+ */
+static void install_sigbus_handler(void) {
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_sigaction = sigbus_handler;
+    // SA_NODEFER leaves SIGBUS unblocked in the handler, so jumping out of it
+    // needs no saved signal mask (and guarded reads no sigprocmask call)
+    action.sa_flags = SA_SIGINFO | SA_ONSTACK | SA_NODEFER;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGBUS, &action, &previous_sigbus);
+}
+#endif
+
+/**
+ * @brief Set up the registry, run once
+ */
+static void registry_init(void) {
+    retldb_mutex_init(&registry.lock);
+}
+
 /**
  * @brief Initialize memory mapping subsystem
  * 
+ * Safe to call any number of times; mapping a file calls it too.
+ * 
  * @return 0 on success, non-zero on failure
  */
 int mmap_init(void) {
-    // Placeholder implementation
+    retldb_once(&registry_once, registry_init);
     return 0;
 }
 
 /**
- * @brief Map a file into memory
+ * @brief Get the registry bucket of a file window
+ * 
+ * @param dev Device of the file
+ * @param ino Inode of the file
+ * @param offset File offset of the window
+ * @return The bucket index
+ */
+static size_t registry_bucket(uint64_t dev, uint64_t ino, uint64_t offset) {
+    uint64_t hash = (dev * 0x9e3779b97f4a7c15ULL) ^ ino ^ (offset >> 12);
+    hash ^= hash >> 29;
+    return (size_t)(hash % MMAP_REGISTRY_BUCKETS);
+}
+
+/**
+ * @brief Find a live handle for a window and take a reference to it
+ * 
+ * Called with the registry lock held.
+ * 
+ * @param key A handle whose identity, window and hints are to be matched
+ * @return The shared handle, NULL if there is none
+ */
+static mmap_handle_t* registry_find(const mmap_handle_t* key) {
+    mmap_handle_t* handle = registry.buckets[registry_bucket(key->dev, key->ino, key->offset)];
+    for (; handle; handle = handle->next) {
+        if (handle->dev == key->dev && handle->ino == key->ino &&
+            handle->offset == key->offset && handle->size == key->size &&
+            handle->read_only == key->read_only && handle->advice == key->advice &&
+            handle->flags == key->flags) {
+            handle->refs++;
+            return handle;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Remove a handle from its registry bucket
+ * 
+ * Called with the registry lock held.
+ * 
+ * @param handle The handle
+ */
+static void registry_remove(mmap_handle_t* handle) {
+    mmap_handle_t** link = &registry.buckets[registry_bucket(handle->dev, handle->ino,
+                                                             handle->offset)];
+    while (*link && *link != handle) {
+        link = &(*link)->next;
+    }
+    if (*link) {
+        *link = handle->next;
+    }
+}
+
+/**
+ * @brief Look up the identity and size of a file without opening a mapping
+ * 
+ * @param filename The name of the file
+ * @param key Handle whose dev and ino are set
+ * @param file_size Set to the size of the file
+ * @return 0 on success, non-zero on failure
+ */
+static int file_identity(const char* filename, mmap_handle_t* key, uint64_t* file_size) {
+#ifdef _WIN32
+    HANDLE file = CreateFileA(filename, 0, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                              NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) {
+        return -1;
+    }
+    BY_HANDLE_FILE_INFORMATION info;
+    BOOL ok = GetFileInformationByHandle(file, &info);
+    CloseHandle(file);
+    if (!ok) {
+        return -1;
+    }
+    key->dev = info.dwVolumeSerialNumber;
+    key->ino = ((uint64_t)info.nFileIndexHigh << 32) | info.nFileIndexLow;
+    *file_size = ((uint64_t)info.nFileSizeHigh << 32) | info.nFileSizeLow;
+#else
+    struct stat sb;
+    if (stat(filename, &sb) == -1) {
+        return -1;
+    }
+    key->dev = (uint64_t)sb.st_dev;
+    key->ino = (uint64_t)sb.st_ino;
+    *file_size = (uint64_t)sb.st_size;
+#endif
+    return 0;
+}
+
+/**
+ * @brief Get the virtual memory page size
+ * 
+ * @return The page size in bytes
+ */
+static size_t page_size(void) {
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return (size_t)info.dwPageSize;
+#else
+    long size = sysconf(_SC_PAGESIZE);
+    return size > 0 ? (size_t)size : 4096;
+#endif
+}
+
+/**
+ * @brief Get the size of explicit huge pages
+ * 
+ * @return The huge page size in bytes, 0 if the system has none
+ */
+static size_t huge_page_size(void) {
+#ifdef _WIN32
+    return (size_t)GetLargePageMinimum();
+#elif defined(MAP_HUGETLB)
+    static size_t cached;
+    if (cached == 0) {
+        size_t size = 2 * 1024 * 1024;
+        FILE* fp = fopen("/proc/meminfo", "r");
+        if (fp) {
+            char line[128];
+            unsigned long kb;
+            while (fgets(line, sizeof(line), fp)) {
+                if (sscanf(line, "Hugepagesize: %lu kB", &kb) == 1 && kb > 0) {
+                    size = (size_t)kb * 1024;
+                    break;
+                }
+            }
+            fclose(fp);
+        }
+        cached = size;
+    }
+    return cached;
+#else
+    return 0;
+#endif
+}
+
+/**
+ * @brief Get the alignment required of mapping offsets
+ * 
+ * @return The mapping granularity in bytes
+ */
+size_t mmap_granularity(void) {
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return (size_t)info.dwAllocationGranularity;
+#else
+    return page_size();
+#endif
+}
+
+#ifdef _WIN32
+/**
+ * @brief Create a mapping object and a view of a window of the file
+ * 
+ * @param handle The handle (file, offset and read_only set)
+ * @param size Size of the window
+ * @param mapping Set to the new mapping object
+ * @return The view, NULL on failure
+ */
+static void* map_view(const mmap_handle_t* handle, size_t size, HANDLE* mapping) {
+    DWORD protect = handle->read_only ? PAGE_READONLY : PAGE_READWRITE;
+    *mapping = CreateFileMappingA(handle->file, NULL, protect, 0, 0, NULL);
+    if (!*mapping) {
+        return NULL;
+    }
+    
+    DWORD map_access = handle->read_only ? FILE_MAP_READ : FILE_MAP_ALL_ACCESS;
+    void* addr = MapViewOfFile(*mapping, map_access, (DWORD)(handle->offset >> 32),
+                               (DWORD)(handle->offset & 0xffffffffu), size);
+    if (!addr) {
+        CloseHandle(*mapping);
+    }
+    return addr;
+}
+#endif
+
+#ifndef _WIN32
+/**
+ * @brief Translate an access pattern hint to its madvise() value
+ * 
+ * @param advice The hint
+ * @return The madvise() advice, -1 if the hint is unknown
+ */
+static int advice_to_madvise(mmap_advice_t advice) {
+    switch (advice) {
+        case MMAP_ADVICE_NORMAL:
+            return MADV_NORMAL;
+        case MMAP_ADVICE_SEQUENTIAL:
+            return MADV_SEQUENTIAL;
+        case MMAP_ADVICE_RANDOM:
+            return MADV_RANDOM;
+        case MMAP_ADVICE_WILLNEED:
+            return MADV_WILLNEED;
+        case MMAP_ADVICE_DONTNEED:
+            return MADV_DONTNEED;
+    }
+    return -1;
+}
+#endif
+
+/**
+ * @brief Apply a hint to a page-aligned range of a window
+ * 
+ * @param addr Start of the range (page aligned)
+ * @param length Length of the range
+ * @param advice The hint
+ * @return 0 on success, non-zero on failure
+ */
+static int advise_range(void* addr, size_t length, mmap_advice_t advice) {
+#ifdef _WIN32
+    // Windows has no per-range read-ahead policy; only WILLNEED has an
+    // equivalent, and the rest are accepted as no-ops since they are hints
+#if defined(_WIN32_WINNT) && _WIN32_WINNT >= 0x0602
+    if (advice == MMAP_ADVICE_WILLNEED) {
+        WIN32_MEMORY_RANGE_ENTRY range = { addr, length };
+        return PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0) ? 0 : -1;
+    }
+#else
+    (void)addr;
+    (void)length;
+#endif
+    return advice >= MMAP_ADVICE_NORMAL && advice <= MMAP_ADVICE_DONTNEED ? 0 : -1;
+#else
+    int value = advice_to_madvise(advice);
+    if (value < 0) {
+        return -1;
+    }
+    return madvise(addr, length, value) == 0 ? 0 : -1;
+#endif
+}
+
+/**
+ * @brief Lock or unlock a window in memory
+ * 
+ * @param addr Start of the window
+ * @param length Length of the window
+ * @param lock Non-zero to lock, zero to unlock
+ * @return 0 on success, non-zero on failure
+ */
+static int lock_range(void* addr, size_t length, int lock) {
+#ifdef _WIN32
+    BOOL ok = lock ? VirtualLock(addr, length) : VirtualUnlock(addr, length);
+    return ok ? 0 : -1;
+#else
+    int result = lock ? mlock(addr, length) : munlock(addr, length);
+    return result == 0 ? 0 : -1;
+#endif
+}
+
+/**
+ * @brief Reapply the open-time hints after a window was (re)mapped
+ * 
+ * A freshly mapped window has default read-ahead and is not locked, so the
+ * window-wide hint and the lock are applied again.
+ * 
+ * @param handle The handle
+ * @return 0 on success, non-zero on failure
+ */
+static int apply_hints(mmap_handle_t* handle) {
+    if (handle->advice != MMAP_ADVICE_NORMAL &&
+        advise_range(handle->addr, handle->size, (mmap_advice_t)handle->advice) != 0) {
+        return -1;
+    }
+#ifdef MADV_HUGEPAGE
+    // Only a hint: kernels without transparent huge pages reject it
+    if ((handle->flags & MMAP_HUGE_PAGES) && !handle->huge) {
+        madvise(handle->addr, handle->size, MADV_HUGEPAGE);
+    }
+#endif
+    if (handle->locks > 0 && lock_range(handle->addr, handle->size, 1) != 0) {
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Map a window of a file into memory
  * 
  * @param filename The name of the file to map
- * @param size The size of the mapping (0 for whole file)
+ * @param offset File offset of the window (a multiple of mmap_granularity())
+ * @param size The size of the window (0 for the rest of the file)
  * @param read_only Whether the mapping should be read-only
- * @return Handle to the mapped file, NULL on failure
+ * @return Handle to the mapped window, NULL on failure
  */
-void* mmap_file(const char* filename, size_t size, int read_only) {
-    if (!filename) {
-        return NULL;
+void* mmap_file_range(const char* filename, uint64_t offset, size_t size, int read_only) {
+    return mmap_file_hinted(filename, offset, size, read_only, MMAP_ADVICE_NORMAL, 0);
+}
+
+/**
+ * @brief Copy a window of the file into anonymous memory
+ * 
+ * With MMAP_HUGE_PAGES, explicit huge pages are tried first, and without
+ * reserved ones regular pages are used with the transparent huge page
+ * hint. Without it the copy uses regular pages. Bytes past the end of the
+ * file read as zero.
+ * 
+ * @param handle The handle (file, offset set)
+ * @param size Size of the window
+ * @param map_size Set to the bytes allocated
+ * @param huge Set to whether explicit huge pages were used
+ * @return The copy, NULL on failure
+ */
+static void* preload_window(const mmap_handle_t* handle, size_t size, size_t* map_size, int* huge) {
+    int want_huge = (handle->flags & MMAP_HUGE_PAGES) != 0;
+    size_t huge_size = want_huge ? huge_page_size() : 0;
+    size_t done = 0;
+    *huge = 0;
+    
+#ifdef _WIN32
+    void* addr = NULL;
+    (void)want_huge;
+    if (huge_size > 0) {
+        // Needs SeLockMemoryPrivilege; without it this fails and we fall back
+        *map_size = (size + huge_size - 1) / huge_size * huge_size;
+        addr = VirtualAlloc(NULL, *map_size, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES,
+                            PAGE_READWRITE);
+        *huge = addr != NULL;
+    }
+    if (!addr) {
+        *map_size = size;
+        addr = VirtualAlloc(NULL, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+        if (!addr) {
+            return NULL;
+        }
+    }
+    
+    while (done < size) {
+        OVERLAPPED overlapped;
+        memset(&overlapped, 0, sizeof(overlapped));
+        uint64_t position = handle->offset + done;
+        overlapped.Offset = (DWORD)(position & 0xffffffffu);
+        overlapped.OffsetHigh = (DWORD)(position >> 32);
+        DWORD chunk = size - done > 0x40000000 ? 0x40000000 : (DWORD)(size - done);
+        DWORD got = 0;
+        if (!ReadFile(handle->file, (char*)addr + done, chunk, &got, &overlapped)) {
+            if (GetLastError() == ERROR_HANDLE_EOF) {
+                break;
+            }
+            VirtualFree(addr, 0, MEM_RELEASE);
+            return NULL;
+        }
+        if (got == 0) {
+            break;
+        }
+        done += got;
+    }
+    
+    DWORD old_protect;
+    VirtualProtect(addr, *map_size, PAGE_READONLY, &old_protect);
+#else
+    void* addr = MAP_FAILED;
+#ifdef MAP_HUGETLB
+    if (huge_size > 0) {
+        *map_size = (size + huge_size - 1) / huge_size * huge_size;
+        addr = mmap(NULL, *map_size, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        *huge = addr != MAP_FAILED;
     }
+#else
+    (void)huge_size;
+#endif
+    if (addr == MAP_FAILED) {
+        *map_size = size;
+        addr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (addr == MAP_FAILED) {
+            return NULL;
+        }
+#ifdef MADV_HUGEPAGE
+        if (want_huge) {
+            madvise(addr, size, MADV_HUGEPAGE);
+        }
+#endif
+    }
+    
+    while (done < size) {
+        ssize_t got = pread(handle->fd, (char*)addr + done, size - done,
+                            (off_t)(handle->offset + done));
+        if (got < 0) {
+            munmap(addr, *map_size);
+            return NULL;
+        }
+        if (got == 0) {
+            break;
+        }
+        done += (size_t)got;
+    }
+    
+    // The copy is read-only like the mapping it stands in for
+    mprotect(addr, *map_size, PROT_READ);
+#endif
+    
+    return addr;
+}
+
+/**
+ * @brief Release the memory of a window, mapped or preloaded
+ * 
+ * @param mmap_handle The memory-mapped file handle
+ * @return 0 on success, non-zero on failure
+ */
+static int release_window(mmap_handle_t* mmap_handle) {
+#ifdef _WIN32
+    if (mmap_handle->flags & MMAP_PRELOAD) {
+        return VirtualFree(mmap_handle->addr, 0, MEM_RELEASE) ? 0 : -1;
+    }
+    int result = UnmapViewOfFile(mmap_handle->addr) ? 0 : -1;
+    CloseHandle(mmap_handle->mapping);
+    return result;
+#else
+    size_t length = (mmap_handle->flags & MMAP_PRELOAD) ? mmap_handle->map_size : mmap_handle->size;
+    return munmap(mmap_handle->addr, length) == -1 ? -1 : 0;
+#endif
+}
+
+/**
+ * @brief Unmap a window and free its handle
+ * 
+ * @param mmap_handle The memory-mapped file handle
+ * @return 0 on success, non-zero on failure
+ */
+static int unmap_window(mmap_handle_t* mmap_handle) {
+    int result = release_window(mmap_handle);
+    
+#ifdef _WIN32
+    CloseHandle(mmap_handle->file);
+#else
+    close(mmap_handle->fd);
+#endif
     
+    free(mmap_handle);
+    return result;
+}
+
+/**
+ * @brief Map a new, unshared window of a file
+ * 
+ * @param filename The name of the file to map
+ * @param offset File offset of the window
+ * @param size The size of the window (0 for the rest of the file)
+ * @param read_only Whether the mapping should be read-only
+ * @param advice Access pattern hint for the whole window
+ * @param flags MMAP_* flags
+ * @return The new handle, NULL on failure
+ */
+static mmap_handle_t* map_window(const char* filename, uint64_t offset, size_t size, int read_only,
+                                 mmap_advice_t advice, int flags) {
     mmap_handle_t* handle = (mmap_handle_t*)malloc(sizeof(mmap_handle_t));
     if (!handle) {
         return NULL;
     }
     
     memset(handle, 0, sizeof(mmap_handle_t));
+    handle->offset = offset;
+    handle->read_only = read_only;
+    handle->advice = advice;
+    handle->flags = flags;
+    handle->locks = (flags & MMAP_LOCK) != 0;
     
 #ifdef _WIN32
     // Windows implementation
     DWORD access = read_only ? GENERIC_READ : (GENERIC_READ | GENERIC_WRITE);
-    DWORD protect = read_only ? PAGE_READONLY : PAGE_READWRITE;
     DWORD share = FILE_SHARE_READ;
     
     handle->file = CreateFileA(filename, access, share, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
@@ -72,60 +613,507 @@ void* mmap_file(const char* filename, size_t size, int read_only) {
         return NULL;
     }
     
-    LARGE_INTEGER file_size;
-    if (!GetFileSizeEx(handle->file, &file_size)) {
+    BY_HANDLE_FILE_INFORMATION info;
+    if (!GetFileInformationByHandle(handle->file, &info)) {
         CloseHandle(handle->file);
         free(handle);
         return NULL;
     }
     
-    handle->size = size > 0 ? size : (size_t)file_size.QuadPart;
-    
-    handle->mapping = CreateFileMappingA(handle->file, NULL, protect, 0, 0, NULL);
-    if (!handle->mapping) {
+    uint64_t file_size = ((uint64_t)info.nFileSizeHigh << 32) | info.nFileSizeLow;
+    if (size == 0 && file_size <= offset) {
         CloseHandle(handle->file);
         free(handle);
         return NULL;
     }
     
-    DWORD map_access = read_only ? FILE_MAP_READ : FILE_MAP_ALL_ACCESS;
-    handle->addr = MapViewOfFile(handle->mapping, map_access, 0, 0, handle->size);
+    handle->dev = info.dwVolumeSerialNumber;
+    handle->ino = ((uint64_t)info.nFileIndexHigh << 32) | info.nFileIndexLow;
+    handle->size = size > 0 ? size : (size_t)(file_size - offset);
+    
+    if (flags & MMAP_PRELOAD) {
+        handle->addr = preload_window(handle, handle->size, &handle->map_size, &handle->huge);
+    } else {
+        handle->addr = map_view(handle, handle->size, &handle->mapping);
+    }
     if (!handle->addr) {
-        CloseHandle(handle->mapping);
         CloseHandle(handle->file);
         free(handle);
         return NULL;
     }
+    
+    // Windows has no MAP_POPULATE; prefetching the view is the closest match
+    if ((flags & MMAP_POPULATE) && !(flags & MMAP_PRELOAD) && advice != MMAP_ADVICE_WILLNEED) {
+        advise_range(handle->addr, handle->size, MMAP_ADVICE_WILLNEED);
+    }
 #else
     // Unix implementation
-    int flags = read_only ? O_RDONLY : O_RDWR;
-    handle->fd = open(filename, flags);
+    int open_flags = read_only ? O_RDONLY : O_RDWR;
+    handle->fd = open(filename, open_flags);
     if (handle->fd == -1) {
         free(handle);
         return NULL;
     }
     
     struct stat sb;
-    if (fstat(handle->fd, &sb) == -1) {
+    if (fstat(handle->fd, &sb) == -1 || (size == 0 && (uint64_t)sb.st_size <= offset)) {
         close(handle->fd);
         free(handle);
         return NULL;
     }
     
-    handle->size = size > 0 ? size : (size_t)sb.st_size;
+    handle->dev = (uint64_t)sb.st_dev;
+    handle->ino = (uint64_t)sb.st_ino;
+    handle->size = size > 0 ? size : (size_t)((uint64_t)sb.st_size - offset);
     
-    int prot = read_only ? PROT_READ : (PROT_READ | PROT_WRITE);
-    handle->addr = mmap(NULL, handle->size, prot, MAP_SHARED, handle->fd, 0);
-    if (handle->addr == MAP_FAILED) {
-        close(handle->fd);
-        free(handle);
-        return NULL;
+    if (flags & MMAP_PRELOAD) {
+        handle->addr = preload_window(handle, handle->size, &handle->map_size, &handle->huge);
+        if (!handle->addr) {
+            close(handle->fd);
+            free(handle);
+            return NULL;
+        }
+    } else {
+        int prot = read_only ? PROT_READ : (PROT_READ | PROT_WRITE);
+        int map_flags = MAP_SHARED;
+#ifdef MAP_POPULATE
+        if (flags & MMAP_POPULATE) {
+            map_flags |= MAP_POPULATE;
+        }
+#endif
+        handle->addr = mmap(NULL, handle->size, prot, map_flags, handle->fd, (off_t)offset);
+        if (handle->addr == MAP_FAILED) {
+            close(handle->fd);
+            free(handle);
+            return NULL;
+        }
+#ifndef MAP_POPULATE
+        // Without MAP_POPULATE, at least start reading the window in
+        if ((flags & MMAP_POPULATE) && advice != MMAP_ADVICE_WILLNEED) {
+            advise_range(handle->addr, handle->size, MMAP_ADVICE_WILLNEED);
+        }
+#endif
     }
 #endif
     
+    if (apply_hints(handle) != 0) {
+        unmap_window(handle);
+        return NULL;
+    }
+    
     return handle;
 }
 
+/**
+ * @brief Map a window of a file with an access pattern hint
+ * 
+ * @param filename The name of the file to map
+ * @param offset File offset of the window (a multiple of mmap_granularity())
+ * @param size The size of the window (0 for the rest of the file)
+ * @param read_only Whether the mapping should be read-only
+ * @param advice Access pattern hint for the whole window
+ * @param flags MMAP_* flags
+ * @return Handle to the mapped window, NULL on failure
+ */
+void* mmap_file_hinted(const char* filename, uint64_t offset, size_t size, int read_only,
+                       mmap_advice_t advice, int flags) {
+    if (!filename || offset % mmap_granularity() != 0 ||
+        advice < MMAP_ADVICE_NORMAL || advice > MMAP_ADVICE_DONTNEED ||
+        ((flags & MMAP_PRELOAD) && !read_only)) {
+        return NULL;
+    }
+    
+    mmap_init();
+    
+    // A stat is enough to find a live mapping of the same window
+    mmap_handle_t key;
+    uint64_t file_size;
+    memset(&key, 0, sizeof(key));
+    if (file_identity(filename, &key, &file_size) != 0 ||
+        (size == 0 && file_size <= offset)) {
+        return NULL;
+    }
+    key.offset = offset;
+    key.size = size > 0 ? size : (size_t)(file_size - offset);
+    key.read_only = read_only;
+    key.advice = advice;
+    key.flags = flags;
+    
+    retldb_mutex_lock(&registry.lock);
+    mmap_handle_t* shared = registry_find(&key);
+    retldb_mutex_unlock(&registry.lock);
+    if (shared) {
+        return shared;
+    }
+    
+    mmap_handle_t* handle = map_window(filename, offset, size, read_only, advice, flags);
+    if (!handle) {
+        return NULL;
+    }
+    
+    // Another thread may have mapped the same window meanwhile; keep theirs
+    retldb_mutex_lock(&registry.lock);
+    shared = registry_find(handle);
+    if (!shared) {
+        size_t bucket = registry_bucket(handle->dev, handle->ino, handle->offset);
+        handle->refs = 1;
+        handle->next = registry.buckets[bucket];
+        registry.buckets[bucket] = handle;
+    }
+    retldb_mutex_unlock(&registry.lock);
+    
+    if (shared) {
+        unmap_window(handle);
+        return shared;
+    }
+    return handle;
+}
+
+/**
+ * @brief Map a file into memory
+ * 
+ * @param filename The name of the file to map
+ * @param size The size of the mapping (0 for whole file)
+ * @param read_only Whether the mapping should be read-only
+ * @return Handle to the mapped file, NULL on failure
+ */
+void* mmap_file(const char* filename, size_t size, int read_only) {
+    return mmap_file_range(filename, 0, size, read_only);
+}
+
+/**
+ * @brief Resize a mapped window in place or by moving it
+ * 
+ * On Linux the window is grown or shrunk with mremap(), which may move it;
+ * elsewhere a new window is mapped before the old one is released. Either
+ * way, pointers into the old window are invalid afterwards. Called with the
+ * registry lock held, so nobody can start sharing the window meanwhile.
+ * 
+ * @param mmap_handle The memory-mapped file handle
+ * @param size The new window size (0 for the rest of the file)
+ * @return 0 on success, non-zero on failure
+ */
+static int remap_window(mmap_handle_t* mmap_handle, size_t size) {
+#ifdef _WIN32
+    if (size == 0) {
+        LARGE_INTEGER file_size;
+        if (!GetFileSizeEx(mmap_handle->file, &file_size) ||
+            (uint64_t)file_size.QuadPart <= mmap_handle->offset) {
+            return -1;
+        }
+        size = (size_t)((uint64_t)file_size.QuadPart - mmap_handle->offset);
+    }
+    if (size == mmap_handle->size) {
+        return 0;
+    }
+#else
+    if (size == 0) {
+        struct stat sb;
+        if (fstat(mmap_handle->fd, &sb) == -1 || (uint64_t)sb.st_size <= mmap_handle->offset) {
+            return -1;
+        }
+        size = (size_t)((uint64_t)sb.st_size - mmap_handle->offset);
+    }
+    if (size == mmap_handle->size) {
+        return 0;
+    }
+#endif
+    
+    void* addr;
+    if (mmap_handle->flags & MMAP_PRELOAD) {
+        // A preloaded copy is simply made again at the new size
+        size_t map_size;
+        int huge;
+        addr = preload_window(mmap_handle, size, &map_size, &huge);
+        if (!addr) {
+            return -1;
+        }
+        release_window(mmap_handle);
+        mmap_handle->map_size = map_size;
+        mmap_handle->huge = huge;
+    } else {
+#ifdef _WIN32
+        // A mapping object covers the file size at creation, so make a new one
+        HANDLE mapping;
+        addr = map_view(mmap_handle, size, &mapping);
+        if (!addr) {
+            return -1;
+        }
+        release_window(mmap_handle);
+        mmap_handle->mapping = mapping;
+#elif defined(MREMAP_MAYMOVE)
+        addr = mremap(mmap_handle->addr, mmap_handle->size, size, MREMAP_MAYMOVE);
+        if (addr == MAP_FAILED) {
+            return -1;
+        }
+#else
+        int prot = mmap_handle->read_only ? PROT_READ : (PROT_READ | PROT_WRITE);
+        addr = mmap(NULL, size, prot, MAP_SHARED, mmap_handle->fd, (off_t)mmap_handle->offset);
+        if (addr == MAP_FAILED) {
+            return -1;
+        }
+        release_window(mmap_handle);
+#endif
+    }
+    
+    mmap_handle->addr = addr;
+    mmap_handle->size = size;
+    return apply_hints(mmap_handle);
+}
+
+/**
+ * @brief Grow or shrink a mapped window
+ * 
+ * @param handle The memory-mapped file handle
+ * @param size The new window size (0 for the rest of the file)
+ * @return 0 on success, non-zero on failure (including a shared window)
+ */
+int mmap_remap(void* handle, size_t size) {
+    if (!handle) {
+        return -1;
+    }
+    
+    mmap_handle_t* mmap_handle = (mmap_handle_t*)handle;
+    
+    // Moving a window under other holders would leave them dangling, and a
+    // retired window stays retired
+    retldb_mutex_lock(&registry.lock);
+    int result = mmap_handle->refs > 1 || mmap_handle->fault_error != RETLDB_OK ?
+                 -1 : remap_window(mmap_handle, size);
+    retldb_mutex_unlock(&registry.lock);
+    return result;
+}
+
+/**
+ * @brief Give the kernel an access pattern hint for part of a window
+ * 
+ * @param handle The memory-mapped file handle
+ * @param offset Offset of the range within the window (rounded down to a page)
+ * @param length Length of the range (0 for the rest of the window)
+ * @param advice The hint
+ * @return 0 on success, non-zero on failure
+ */
+int mmap_advise(void* handle, size_t offset, size_t length, mmap_advice_t advice) {
+    if (!handle) {
+        return -1;
+    }
+    
+    mmap_handle_t* mmap_handle = (mmap_handle_t*)handle;
+    if (offset >= mmap_handle->size) {
+        return -1;
+    }
+    if (length == 0) {
+        length = mmap_handle->size - offset;
+    }
+    if (length > mmap_handle->size - offset) {
+        return -1;
+    }
+    
+    // The window starts on a page boundary, so rounding the offset down
+    // keeps the range inside it
+    size_t start = offset - offset % page_size();
+    return advise_range((char*)mmap_handle->addr + start, length + (offset - start), advice);
+}
+
+/**
+ * @brief Lock a window in memory or release the lock
+ * 
+ * Lock requests are counted on the shared window: only the first one locks
+ * it and only the release of the last one unlocks it, so one holder cannot
+ * unlock the window under another.
+ * 
+ * @param handle The memory-mapped file handle
+ * @param lock Non-zero to lock, zero to unlock
+ * @return 0 on success, non-zero on failure (including an unlock without a lock)
+ */
+int mmap_lock(void* handle, int lock) {
+    if (!handle) {
+        return -1;
+    }
+    
+    mmap_handle_t* mmap_handle = (mmap_handle_t*)handle;
+    int result = 0;
+    retldb_mutex_lock(&registry.lock);
+    if (lock) {
+        if (mmap_handle->locks == 0) {
+            result = lock_range(mmap_handle->addr, mmap_handle->size, 1);
+        }
+        if (result == 0) {
+            mmap_handle->locks++;
+        }
+    } else if (mmap_handle->locks == 0) {
+        result = -1;
+    } else {
+        if (mmap_handle->locks == 1) {
+            result = lock_range(mmap_handle->addr, mmap_handle->size, 0);
+        }
+        if (result == 0) {
+            mmap_handle->locks--;
+        }
+    }
+    retldb_mutex_unlock(&registry.lock);
+    return result;
+}
+
+/**
+ * @brief Retire a window after a fault while reading it
+ * 
+ * The window leaves the registry, so mapping the file again starts afresh.
+ * On POSIX its pages are replaced with zero pages so that stray raw
+ * pointers into it stop faulting.
+ * 
+ * @param mmap_handle The memory-mapped file handle
+ * @param fault The faulting address, NULL if unknown
+ * @return The error that retired the window
+ */
+static retldb_error_t retire_window(mmap_handle_t* mmap_handle, const char* fault) {
+    // A fault past the current end of file means the file was truncated
+    // under the mapping; anything else is a failed read from the device
+    retldb_error_t error = RETLDB_ERROR_IO;
+    uint64_t position = mmap_handle->offset +
+        (fault ? (uint64_t)(fault - (const char*)mmap_handle->addr) : mmap_handle->size - 1);
+#ifdef _WIN32
+    LARGE_INTEGER file_size;
+    if (GetFileSizeEx(mmap_handle->file, &file_size) && position >= (uint64_t)file_size.QuadPart) {
+        error = RETLDB_ERROR_CORRUPT_DATA;
+    }
+#else
+    struct stat sb;
+    if (fstat(mmap_handle->fd, &sb) == 0 && position >= (uint64_t)sb.st_size) {
+        error = RETLDB_ERROR_CORRUPT_DATA;
+    }
+#endif
+    
+    retldb_mutex_lock(&registry.lock);
+    if (mmap_handle->fault_error == RETLDB_OK) {
+        registry_remove(mmap_handle);
+#ifndef _WIN32
+        mmap(mmap_handle->addr, mmap_handle->size, PROT_READ,
+             MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0);
+#endif
+        retldb_atomic_store_int(&mmap_handle->fault_error, (int)error);
+    } else {
+        error = (retldb_error_t)mmap_handle->fault_error;
+    }
+    retldb_mutex_unlock(&registry.lock);
+    return error;
+}
+
+/**
+ * @brief Read a window in place with faults turned into errors
+ * 
+ * @param handle The memory-mapped file handle
+ * @param fn Called with the window's address and size
+ * @param arg Passed through to fn
+ * @return RETLDB_OK, or the error that retired the window
+ */
+retldb_error_t mmap_guarded(void* handle, mmap_reader_fn fn, void* arg) {
+    if (!handle || !fn) {
+        return RETLDB_ERROR_INVALID_ARGUMENT;
+    }
+    
+    mmap_handle_t* mmap_handle = (mmap_handle_t*)handle;
+    int fault_error = retldb_atomic_load_int(&mmap_handle->fault_error);
+    if (fault_error != RETLDB_OK) {
+        return (retldb_error_t)fault_error;
+    }
+    
+    // A preloaded copy is anonymous memory, which cannot fault this way
+    if (mmap_handle->flags & MMAP_PRELOAD) {
+        fn(mmap_handle->addr, mmap_handle->size, arg);
+        return RETLDB_OK;
+    }
+    
+#ifdef _WIN32
+#ifdef _MSC_VER
+    __try {
+        fn(mmap_handle->addr, mmap_handle->size, arg);
+    } __except (GetExceptionCode() == EXCEPTION_IN_PAGE_ERROR ?
+                EXCEPTION_EXECUTE_HANDLER : EXCEPTION_CONTINUE_SEARCH) {
+        return retire_window(mmap_handle, NULL);
+    }
+#else
+    // Without structured exception handling the read is unguarded
+    fn(mmap_handle->addr, mmap_handle->size, arg);
+#endif
+#else
+    retldb_once(&sigbus_once, install_sigbus_handler);
+    
+    mmap_guard_t guard;
+    guard.start = (const char*)mmap_handle->addr;
+    guard.end = guard.start + mmap_handle->size;
+    guard.fault = NULL;
+    guard.prev = current_guard;
+    if (sigsetjmp(guard.env, 0) != 0) {
+        current_guard = guard.prev;
+        return retire_window(mmap_handle, guard.fault);
+    }
+    current_guard = &guard;
+    fn(mmap_handle->addr, mmap_handle->size, arg);
+    current_guard = guard.prev;
+#endif
+    
+    // Another reader may have retired the window while this one ran, in
+    // which case this one may have seen zero pages
+    return (retldb_error_t)retldb_atomic_load_int(&mmap_handle->fault_error);
+}
+
+/**
+ * @brief Range and destination of a guarded copy
+ */
+typedef struct {
+    size_t offset;               // Offset of the range within the window
+    void* dest;                  // Destination buffer
+    size_t length;               // Bytes to copy
+} mmap_copy_t;
+
+/**
+ * @brief Copy a range out of a window, called under the fault guard
+ */
+static void copy_range(const void* data, size_t size, void* arg) {
+    const mmap_copy_t* copy = (const mmap_copy_t*)arg;
+    (void)size;
+    memcpy(copy->dest, (const char*)data + copy->offset, copy->length);
+}
+
+/**
+ * @brief Copy bytes out of a window with faults turned into errors
+ * 
+ * @param handle The memory-mapped file handle
+ * @param offset Offset of the range within the window
+ * @param dest Destination buffer
+ * @param length Bytes to copy
+ * @return RETLDB_OK, or an error
+ */
+retldb_error_t mmap_read(void* handle, size_t offset, void* dest, size_t length) {
+    if (!handle || (!dest && length > 0)) {
+        return RETLDB_ERROR_INVALID_ARGUMENT;
+    }
+    
+    const mmap_handle_t* mmap_handle = (const mmap_handle_t*)handle;
+    if (offset > mmap_handle->size || length > mmap_handle->size - offset) {
+        return RETLDB_ERROR_INVALID_ARGUMENT;
+    }
+    
+    mmap_copy_t copy = { offset, dest, length };
+    return mmap_guarded(handle, copy_range, &copy);
+}
+
+/**
+ * @brief Check whether a window was retired by a fault
+ * 
+ * @param handle The memory-mapped file handle
+ * @return The error that retired it, RETLDB_OK if it is healthy
+ */
+retldb_error_t mmap_fault_error(const void* handle) {
+    if (!handle) {
+        return RETLDB_ERROR_INVALID_ARGUMENT;
+    }
+    
+    const mmap_handle_t* mmap_handle = (const mmap_handle_t*)handle;
+    return (retldb_error_t)retldb_atomic_load_int(&mmap_handle->fault_error);
+}
+
 /**
  * @brief Get the memory address of a memory-mapped file
  * 
@@ -156,9 +1144,90 @@ size_t mmap_get_size(const void* handle) {
     return mmap_handle->size;
 }
 
+/**
+ * @brief Check whether transparent huge pages back part of a range
+ * 
+ * Reads the kernel's per-mapping counters, so the answer reflects what the
+ * kernel did with MADV_HUGEPAGE rather than what was asked for.
+ * 
+ * @param addr Start of the range
+ * @param size Size of the range
+ * @return Non-zero if at least one huge page is mapped in the range
+ */
+static int transparent_huge(const void* addr, size_t size) {
+#ifdef __linux__
+    FILE* fp = fopen("/proc/self/smaps", "r");
+    if (!fp) {
+        return 0;
+    }
+    
+    uintptr_t start = (uintptr_t)addr;
+    uintptr_t end = start + size;
+    int inside = 0;
+    int found = 0;
+    char line[256];
+    while (!found && fgets(line, sizeof(line), fp)) {
+        unsigned long low, high, kb;
+        if (sscanf(line, "%lx-%lx ", &low, &high) == 2) {
+            inside = low < end && high > start;
+        } else if (inside && (sscanf(line, "AnonHugePages: %lu kB", &kb) == 1 ||
+                              sscanf(line, "ShmemPmdMapped: %lu kB", &kb) == 1 ||
+                              sscanf(line, "FilePmdMapped: %lu kB", &kb) == 1)) {
+            found = kb > 0;
+        }
+    }
+    fclose(fp);
+    return found;
+#else
+    (void)addr;
+    (void)size;
+    return 0;
+#endif
+}
+
+/**
+ * @brief Get the size of the pages backing a window
+ * 
+ * @param handle The memory-mapped file handle
+ * @return The page size in bytes, or 0 on error
+ */
+size_t mmap_page_size(const void* handle) {
+    if (!handle) {
+        return 0;
+    }
+    
+    const mmap_handle_t* mmap_handle = (const mmap_handle_t*)handle;
+    if (mmap_handle->huge) {
+        return huge_page_size();
+    }
+    if ((mmap_handle->flags & MMAP_HUGE_PAGES) &&
+        transparent_huge(mmap_handle->addr, mmap_handle->size)) {
+        // Transparent huge pages are PMD-sized, like the default explicit ones
+        return 2 * 1024 * 1024;
+    }
+    return page_size();
+}
+
+/**
+ * @brief Get the file offset of a mapped window
+ * 
+ * @param handle The memory-mapped file handle
+ * @return The offset of the first mapped byte, or 0 on error
+ */
+uint64_t mmap_get_offset(const void* handle) {
+    if (!handle) {
+        return 0;
+    }
+    
+    const mmap_handle_t* mmap_handle = (const mmap_handle_t*)handle;
+    return mmap_handle->offset;
+}
+
 /**
  * @brief Unmap a memory-mapped file
  * 
+ * Drops one reference; the window is unmapped when the last one goes.
+ * 
  * @param handle The memory-mapped file handle
  * @return 0 on success, non-zero on failure
  */
@@ -168,23 +1237,14 @@ int mmap_unmap(void* handle) {
     }
     
     mmap_handle_t* mmap_handle = (mmap_handle_t*)handle;
-    int result = 0;
     
-#ifdef _WIN32
-    // Windows implementation
-    if (!UnmapViewOfFile(mmap_handle->addr)) {
-        result = -1;
+    // Only the last reference unmaps the window
+    retldb_mutex_lock(&registry.lock);
+    int last = --mmap_handle->refs == 0;
+    if (last) {
+        registry_remove(mmap_handle);
     }
-    CloseHandle(mmap_handle->mapping);
-    CloseHandle(mmap_handle->file);
-#else
-    // Unix implementation
-    if (munmap(mmap_handle->addr, mmap_handle->size) == -1) {
-        result = -1;
-    }
-    close(mmap_handle->fd);
-#endif
+    retldb_mutex_unlock(&registry.lock);
     
-    free(mmap_handle);
-    return result;
+    return last ? unmap_window(mmap_handle) : 0;
 }
@@ -0,0 +1,1377 @@
+/**
+ * @file segment.c
+ * @brief Implementation of the columnar segment file format for rETL DB
+ *
+ * File layout (native byte order, like the manifest):
+ *
+ *   segment_header_t, zero-padded to the alignment
+ *   column chunks, row group by row group, each starting at an aligned
+ *   offset and zero-padded up to the next one
+ *   footer:
+ *     segment_footer_t
+ *     segment_column_rec_t[column_count]
+ *     segment_row_group_rec_t[row_group_count]
+ *     segment_chunk_rec_t[row_group_count][column_count]
+ *     segment_zone_rec_t[row_group_count][column_count] (chunk zone maps)
+ *     segment_zone_rec_t[column_count] (column zone maps)
+ *     strings_size bytes of NUL-terminated column names
+ *   segment_trailer_t
+ *
+ * A reader fetches the fixed-size trailer from the end of the file, then
+ * the footer it points at, and from then on reads or maps only the chunks
+ * of the columns it needs.
+ *
+ * A chunk holds a validity bitmap padded to 8 bytes when the chunk has
+ * nulls, followed by the values in the chunk's encoding (see encoding.c).
+ * PLAIN values are packed for fixed-width types, or uint32_t
+ * offsets[rows + 1] and then the bytes for STRING and BINARY; every other
+ * encoding decodes back to that layout.
+ *
+ * Zone maps (see zone.c) are gathered from the vectors as they are
+ * appended and stored in the footer, so scans can skip chunks without
+ * reading them.
+ */
+
+/* Define _POSIX_C_SOURCE for strdup and the clock_gettime inlined from common/sync.h */
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "retldb/storage.h"
+#include "common/checksum.h"
+#include "common/sync.h"
+#include "storage/compress.h"
+#include "storage/encoding.h"
+#include "storage/zone.h"
+
+#define SEGMENT_MAGIC "RETLDBSG"        // First and last 8 bytes of every segment
+#define SEGMENT_VERSION 4               // Bumped on incompatible layout changes
+
+/*
+ * Layout versions (only the current one is read):
+ *   1  PLAIN chunks only
+ *   2  encoding and decoded_size in the chunk records
+ *   3  compression and encoded_size in the chunk records
+ *   4  zone map records after the chunk records
+ */
+
+/**
+ * @brief Segment file header
+ */
+typedef struct {
+    char magic[8];               // SEGMENT_MAGIC
+    uint32_t version;            // SEGMENT_VERSION
+    uint32_t header_size;        // sizeof(segment_header_t)
+    uint32_t alignment;          // Alignment of chunk offsets
+    uint32_t flags;              // Zero
+    uint64_t created;            // Creation time in seconds since the epoch
+} segment_header_t;
+
+/**
+ * @brief Footer header
+ */
+typedef struct {
+    uint32_t column_count;       // Column records
+    uint32_t row_group_count;    // Row group records
+    uint64_t row_count;          // Rows in all row groups
+    uint64_t strings_size;       // Bytes of names after the records
+} segment_footer_t;
+
+/**
+ * @brief Column record
+ */
+typedef struct {
+    uint64_t name;               // Offset of the name in the string area
+    uint32_t type;               // retldb_type_t
+    uint32_t nullable;           // Whether values can be null
+} segment_column_rec_t;
+
+/**
+ * @brief Row group record
+ */
+typedef struct {
+    uint64_t first_row;          // Index of the first row in the segment
+    uint64_t rows;               // Number of rows
+} segment_row_group_rec_t;
+
+/**
+ * @brief Chunk record
+ */
+typedef struct {
+    uint64_t offset;             // File offset
+    uint64_t size;               // Stored bytes
+    uint64_t null_count;         // Null values
+    uint64_t encoded_size;       // Bytes once decompressed
+    uint64_t decoded_size;       // Bytes once decoded to PLAIN
+    uint32_t encoding;           // SEGMENT_ENCODING_*
+    uint32_t compression;        // SEGMENT_COMPRESSION_*
+    uint64_t checksum;           // Checksum of the stored bytes
+} segment_chunk_rec_t;
+
+/**
+ * @brief Zone map record (null counts come from the chunk records)
+ */
+typedef struct {
+    uint64_t distinct;           // Estimated distinct present values
+    uint32_t flags;              // SEGMENT_ZONE_*
+    uint32_t min_size;           // Bytes of min
+    uint32_t max_size;           // Bytes of max
+    uint32_t reserved;           // Zero
+    uint8_t min[SEGMENT_ZONE_BYTES];  // Smallest present value
+    uint8_t max[SEGMENT_ZONE_BYTES];  // Largest present value, or its prefix
+} segment_zone_rec_t;
+
+/**
+ * @brief Segment file trailer
+ */
+typedef struct {
+    uint64_t footer_offset;      // File offset of the footer
+    uint64_t footer_size;        // Bytes of the footer
+    uint64_t footer_checksum;    // Checksum of the footer
+    char magic[8];               // SEGMENT_MAGIC
+} segment_trailer_t;
+
+/**
+ * @brief Segment writer
+ */
+typedef struct {
+    void* stage;                      // Staged output file
+    segment_column_t* columns;        // Columns, names owned
+    size_t column_count;              // Number of columns
+    size_t alignment;                 // Chunk alignment
+    uint64_t offset;                  // Bytes written so far
+    uint64_t row_count;               // Rows written so far
+    segment_row_group_rec_t* groups;  // Row groups written
+    size_t group_count;               // Number of row groups
+    size_t group_capacity;            // Capacity of groups
+    segment_chunk_rec_t* chunks;      // Chunks written, row group by row group
+    segment_zone_t* zones;            // Zone maps of the chunks written
+    segment_zone_t* column_zones;     // Zone maps of the columns so far
+    zone_sketch_t* sketches;          // Distinct-count sketches of the columns so far
+    uint32_t* encodings;              // SEGMENT_ENCODING_* per column
+    uint32_t* compressions;           // SEGMENT_COMPRESSION_* per column
+    encoding_buffer_t scratch;        // Chunk being assembled
+    encoding_buffer_t compressed;     // Chunk being compressed
+    int failed;                       // Set once a write has failed
+} segment_writer_t;
+
+/**
+ * @brief Open segment
+ */
+typedef struct {
+    void* file;                       // Open file handle
+    segment_column_t* columns;        // Columns, names in strings
+    size_t column_count;              // Number of columns
+    segment_row_group_rec_t* groups;  // Row groups
+    size_t group_count;               // Number of row groups
+    segment_chunk_t* chunks;          // Chunks, row group by row group
+    segment_zone_t* zones;            // Zone maps of the chunks
+    segment_zone_t* column_zones;     // Zone maps of the columns
+    uint64_t row_count;               // Rows in all row groups
+    uint64_t fingerprint;             // Checksum of the footer
+    char* strings;                    // Column names
+    uint64_t footer_bytes;            // Bytes read at open
+    uint64_t chunk_bytes;             // Chunk bytes read since open
+    uint64_t chunks_read;             // Chunks read since open
+} segment_t;
+
+/**
+ * @brief Round up to a multiple of a power of two
+ *
+ * @param value The value
+ * @param alignment The power of two
+ * @return The rounded value
+ */
+static uint64_t align_up(uint64_t value, uint64_t alignment) {
+    return (value + alignment - 1) & ~(alignment - 1);
+}
+
+/**
+ * @brief Get the bytes of a validity bitmap as stored in a chunk
+ *
+ * @param rows Number of rows
+ * @return Bitmap bytes, padded to 8
+ */
+static size_t bitmap_size(uint64_t rows) {
+    return (size_t)align_up((rows + 7) / 8, 8);
+}
+
+/**
+ * @brief Check whether a type can be stored in a segment
+ *
+ * @param type The type
+ * @return Non-zero if supported
+ */
+static int type_supported(retldb_type_t type) {
+    return type == RETLDB_TYPE_STRING || type == RETLDB_TYPE_BINARY ||
+           segment_type_width(type) > 0;
+}
+
+/**
+ * @brief Get the width of a fixed-width type in a segment
+ *
+ * @param type The type
+ * @return Bytes per value, 0 for STRING and BINARY or unsupported types
+ */
+size_t segment_type_width(retldb_type_t type) {
+    switch (type) {
+        case RETLDB_TYPE_BOOLEAN:
+        case RETLDB_TYPE_INT8:
+        case RETLDB_TYPE_UINT8:
+            return 1;
+        case RETLDB_TYPE_INT16:
+        case RETLDB_TYPE_UINT16:
+            return 2;
+        case RETLDB_TYPE_INT32:
+        case RETLDB_TYPE_UINT32:
+        case RETLDB_TYPE_FLOAT:
+            return 4;
+        case RETLDB_TYPE_INT64:
+        case RETLDB_TYPE_UINT64:
+        case RETLDB_TYPE_DOUBLE:
+        case RETLDB_TYPE_TIMESTAMP:
+            return 8;
+        default:
+            return 0;
+    }
+}
+
+/**
+ * @brief Count the nulls in a validity bitmap
+ *
+ * @param validity The bitmap, NULL for none
+ * @param rows Number of rows
+ * @return Number of clear bits among the first rows
+ */
+static uint64_t count_nulls(const uint8_t* validity, size_t rows) {
+    if (!validity) {
+        return 0;
+    }
+    
+    uint64_t present = 0;
+    size_t full = rows / 8;
+    for (size_t i = 0; i < full; i++) {
+        uint8_t byte = validity[i];
+        while (byte) {
+            byte &= (uint8_t)(byte - 1);
+            present++;
+        }
+    }
+    for (size_t i = full * 8; i < rows; i++) {
+        present += (validity[i / 8] >> (i % 8)) & 1;
+    }
+    return rows - present;
+}
+
+/**
+ * @brief Write bytes to the segment being written
+ *
+ * @param writer The writer
+ * @param buf The bytes
+ * @param len Number of bytes
+ * @return 0 on success, non-zero on failure
+ */
+static int writer_write(segment_writer_t* writer, const void* buf, size_t len) {
+    if (len > 0 && file_stage_write(writer->stage, buf, len) != 0) {
+        writer->failed = 1;
+        return -1;
+    }
+    writer->offset += len;
+    return 0;
+}
+
+/**
+ * @brief Free a writer
+ *
+ * @param writer The writer
+ */
+static void free_writer(segment_writer_t* writer) {
+    for (size_t i = 0; i < writer->column_count; i++) {
+        free((char*)writer->columns[i].name);
+    }
+    free(writer->columns);
+    free(writer->groups);
+    free(writer->chunks);
+    free(writer->zones);
+    free(writer->column_zones);
+    free(writer->sketches);
+    free(writer->encodings);
+    free(writer->compressions);
+    encoding_buffer_free(&writer->scratch);
+    encoding_buffer_free(&writer->compressed);
+    free(writer);
+}
+
+/**
+ * @brief Start writing a segment file
+ *
+ * Segment files are immutable columnar files. Rows are written in row
+ * groups; each column of a row group is a separate chunk starting at an
+ * aligned offset, so a reader can fetch or map exactly the columns it
+ * needs. A footer indexes every chunk. The file is staged and appears
+ * under its name only when segment_writer_finish() succeeds.
+ *
+ * @param filename The segment file
+ * @param columns The columns
+ * @param num_columns Number of columns
+ * @param alignment Chunk alignment, a power of two of at least 8 (0 for
+ *        SEGMENT_DEFAULT_ALIGNMENT); use mmap_granularity() or more to map chunks
+ * @return Writer handle on success, NULL on failure
+ */
+void* segment_writer_create(const char* filename, const segment_column_t* columns,
+                            size_t num_columns, size_t alignment) {
+    if (!filename || !columns || num_columns == 0 || num_columns > UINT32_MAX) {
+        return NULL;
+    }
+    if (alignment == 0) {
+        alignment = SEGMENT_DEFAULT_ALIGNMENT;
+    }
+    if (alignment < 8 || alignment > UINT32_MAX || (alignment & (alignment - 1)) != 0) {
+        return NULL;
+    }
+    for (size_t i = 0; i < num_columns; i++) {
+        if (!columns[i].name || !type_supported(columns[i].type)) {
+            return NULL;
+        }
+    }
+    
+    segment_writer_t* writer = (segment_writer_t*)calloc(1, sizeof(segment_writer_t));
+    if (!writer) {
+        return NULL;
+    }
+    writer->alignment = alignment;
+    writer->columns = (segment_column_t*)calloc(num_columns, sizeof(segment_column_t));
+    writer->encodings = (uint32_t*)malloc(num_columns * sizeof(uint32_t));
+    writer->compressions = (uint32_t*)calloc(num_columns, sizeof(uint32_t));
+    writer->column_zones = (segment_zone_t*)malloc(num_columns * sizeof(segment_zone_t));
+    writer->sketches = (zone_sketch_t*)calloc(num_columns, sizeof(zone_sketch_t));
+    if (!writer->columns || !writer->encodings || !writer->compressions ||
+        !writer->column_zones || !writer->sketches) {
+        free_writer(writer);
+        return NULL;
+    }
+    for (size_t i = 0; i < num_columns; i++) {
+        writer->columns[i] = columns[i];
+        writer->columns[i].name = strdup(columns[i].name);
+        writer->encodings[i] = SEGMENT_ENCODING_AUTO;
+        zone_init(&writer->column_zones[i]);
+        writer->column_count = i + 1;
+        if (!writer->columns[i].name) {
+            free_writer(writer);
+            return NULL;
+        }
+    }
+    
+    // The header takes the first aligned block, so the first chunk is aligned too
+    if (encoding_buffer_append(&writer->scratch, NULL, alignment) != 0) {
+        free_writer(writer);
+        return NULL;
+    }
+    segment_header_t header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SEGMENT_MAGIC, sizeof(header.magic));
+    header.version = SEGMENT_VERSION;
+    header.header_size = sizeof(segment_header_t);
+    header.alignment = (uint32_t)alignment;
+    header.created = (uint64_t)time(NULL);
+    memcpy(writer->scratch.data, &header, sizeof(header));
+    
+    writer->stage = file_stage_open(filename, 0);
+    if (!writer->stage) {
+        free_writer(writer);
+        return NULL;
+    }
+    if (writer_write(writer, writer->scratch.data, alignment) != 0) {
+        file_stage_abort(writer->stage);
+        free_writer(writer);
+        return NULL;
+    }
+    return writer;
+}
+
+/**
+ * @brief Choose how a column's chunks are encoded
+ *
+ * Every column starts out as SEGMENT_ENCODING_AUTO, which samples each
+ * chunk to pick the encoding likely to store it smallest. A forced
+ * encoding that does not suit a chunk (a dictionary with too many
+ * distinct values) falls back to PLAIN for that chunk.
+ *
+ * @param writer The writer handle
+ * @param column Column index
+ * @param encoding SEGMENT_ENCODING_*, including SEGMENT_ENCODING_AUTO
+ * @return 0 on success, non-zero if the encoding cannot store the column's type
+ */
+int segment_writer_set_encoding(void* handle, size_t column, uint32_t encoding) {
+    segment_writer_t* writer = (segment_writer_t*)handle;
+    if (!writer || column >= writer->column_count) {
+        return -1;
+    }
+    if (encoding != SEGMENT_ENCODING_AUTO &&
+        !encoding_supports(encoding, writer->columns[column].type)) {
+        return -1;
+    }
+    
+    writer->encodings[column] = encoding;
+    return 0;
+}
+
+/**
+ * @brief Choose how a column's chunks are compressed
+ *
+ * Compression applies to the encoded chunk as a single block. Columns
+ * start out uncompressed; a chunk that does not get smaller is stored
+ * uncompressed whatever the choice.
+ *
+ * @param writer The writer handle
+ * @param column Column index
+ * @param compression SEGMENT_COMPRESSION_*
+ * @return 0 on success, non-zero for an unknown codec
+ */
+int segment_writer_set_compression(void* handle, size_t column, uint32_t compression) {
+    segment_writer_t* writer = (segment_writer_t*)handle;
+    if (!writer || column >= writer->column_count || !compress_supported(compression)) {
+        return -1;
+    }
+    
+    writer->compressions[column] = compression;
+    return 0;
+}
+
+/**
+ * @brief Encode one column of a row group into the scratch buffer
+ *
+ * The chunk is the validity bitmap (if any value is null) followed by the
+ * values in the column's encoding, or PLAIN when that does not pay off,
+ * then compressed as a whole if the column asks for it and it helps.
+ *
+ * @param writer The writer
+ * @param column Column index
+ * @param vector The values
+ * @param rows Number of rows
+ * @param chunk Filled with the chunk's size, null count, encoding and checksum
+ * @return 0 on success, non-zero on failure
+ */
+static int encode_chunk(segment_writer_t* writer, size_t column, const segment_vector_t* vector,
+                        size_t rows, segment_chunk_rec_t* chunk) {
+    const segment_column_t* def = &writer->columns[column];
+    uint64_t nulls = count_nulls(vector->validity, rows);
+    if (nulls > 0 && !def->nullable) {
+        return -1;
+    }
+    
+    size_t width = segment_type_width(def->type);
+    size_t plain;
+    if (width > 0) {
+        if (!vector->values) {
+            return -1;
+        }
+        plain = rows * width;
+    } else {
+        if (!vector->offsets || (!vector->values && vector->offsets[rows] != vector->offsets[0])) {
+            return -1;
+        }
+        for (size_t i = 0; i < rows; i++) {
+            if (vector->offsets[i + 1] < vector->offsets[i]) {
+                return -1;
+            }
+        }
+        plain = (rows + 1) * sizeof(uint32_t) + (vector->offsets[rows] - vector->offsets[0]);
+    }
+    
+    encoding_buffer_t* out = &writer->scratch;
+    out->size = 0;
+    if (nulls > 0) {
+        if (encoding_buffer_append(out, NULL, bitmap_size(rows)) != 0) {
+            return -1;
+        }
+        memcpy(out->data, vector->validity, (rows + 7) / 8);
+        if (rows % 8 != 0) {
+            out->data[rows / 8] &= (uint8_t)((1u << (rows % 8)) - 1);
+        }
+    }
+    size_t header = out->size;
+    
+    uint32_t encoding = writer->encodings[column];
+    if (encoding == SEGMENT_ENCODING_AUTO) {
+        encoding = encoding_choose(def->type, vector, rows);
+    }
+    if (encoding != SEGMENT_ENCODING_PLAIN) {
+        int result = encoding_encode(encoding, def->type, vector, rows, out);
+        if (result < 0) {
+            return -1;
+        }
+        if (result > 0 || out->size - header >= plain) {
+            out->size = header;
+            encoding = SEGMENT_ENCODING_PLAIN;
+        }
+    }
+    if (encoding == SEGMENT_ENCODING_PLAIN &&
+        encoding_encode(encoding, def->type, vector, rows, out) != 0) {
+        return -1;
+    }
+    
+    size_t encoded = out->size;
+    uint32_t compression = writer->compressions[column];
+    if (compression != SEGMENT_COMPRESSION_NONE) {
+        encoding_buffer_t* packed = &writer->compressed;
+        size_t bound = compress_bound(compression, encoded);
+        packed->size = 0;
+        if (bound > 0 && encoding_buffer_reserve(packed, bound) == 0 &&
+            compress_block(compression, out->data, encoded, packed->data, bound,
+                           &packed->size) == 0 && packed->size < encoded) {
+            // Keep the compressed block; the old scratch buffer is reused next time
+            encoding_buffer_t swap = *out;
+            *out = *packed;
+            *packed = swap;
+        } else {
+            compression = SEGMENT_COMPRESSION_NONE;
+        }
+    }
+    
+    size_t size = out->size;
+    if (encoding_buffer_append(out, NULL, (size_t)align_up(size, writer->alignment) - size) != 0) {
+        return -1;
+    }
+    chunk->size = size;
+    chunk->null_count = nulls;
+    chunk->encoded_size = encoded;
+    chunk->decoded_size = header + plain;
+    chunk->encoding = encoding;
+    chunk->compression = compression;
+    chunk->checksum = checksum64(out->data, size);
+    return 0;
+}
+
+/**
+ * @brief Write one row group
+ *
+ * @param writer The writer handle
+ * @param columns One vector per column, in column order
+ * @param rows Number of rows in the group (at least one)
+ * @return 0 on success, non-zero on failure (the writer must then be aborted)
+ */
+int segment_writer_append(void* handle, const segment_vector_t* columns, size_t rows) {
+    segment_writer_t* writer = (segment_writer_t*)handle;
+    if (!writer || !columns || rows == 0 || rows > UINT32_MAX || writer->failed) {
+        return -1;
+    }
+    if (writer->group_count == UINT32_MAX) {
+        return -1;
+    }
+    
+    if (writer->group_count == writer->group_capacity) {
+        size_t capacity = writer->group_capacity ? writer->group_capacity * 2 : 16;
+        segment_row_group_rec_t* groups = (segment_row_group_rec_t*)realloc(
+            writer->groups, capacity * sizeof(segment_row_group_rec_t));
+        if (!groups) {
+            return -1;
+        }
+        writer->groups = groups;
+        segment_chunk_rec_t* chunks = (segment_chunk_rec_t*)realloc(
+            writer->chunks, capacity * writer->column_count * sizeof(segment_chunk_rec_t));
+        if (!chunks) {
+            return -1;
+        }
+        writer->chunks = chunks;
+        segment_zone_t* zones = (segment_zone_t*)realloc(
+            writer->zones, capacity * writer->column_count * sizeof(segment_zone_t));
+        if (!zones) {
+            return -1;
+        }
+        writer->zones = zones;
+        writer->group_capacity = capacity;
+    }
+    
+    segment_chunk_rec_t* chunks = writer->chunks + writer->group_count * writer->column_count;
+    segment_zone_t* zones = writer->zones + writer->group_count * writer->column_count;
+    for (size_t i = 0; i < writer->column_count; i++) {
+        segment_chunk_rec_t* chunk = &chunks[i];
+        memset(chunk, 0, sizeof(*chunk));
+        if (encode_chunk(writer, i, &columns[i], rows, chunk) != 0) {
+            writer->failed = 1;
+            return -1;
+        }
+        chunk->offset = writer->offset;
+        if (writer_write(writer, writer->scratch.data, writer->scratch.size) != 0) {
+            return -1;
+        }
+        
+        // Vectors are valid once encoded, so the zone map can read them freely
+        zone_sketch_t sketch;
+        retldb_type_t type = writer->columns[i].type;
+        zone_collect(type, &columns[i], rows, &zones[i], &sketch);
+        zone_merge(type, &writer->column_zones[i], &zones[i]);
+        zone_sketch_merge(&writer->sketches[i], &sketch);
+    }
+    
+    writer->groups[writer->group_count].first_row = writer->row_count;
+    writer->groups[writer->group_count].rows = rows;
+    writer->group_count++;
+    writer->row_count += rows;
+    return 0;
+}
+
+/**
+ * @brief Store a zone map in the footer
+ *
+ * @param out Where the record goes
+ * @param zone The zone map
+ * @return The byte after the record
+ */
+static uint8_t* put_zone(uint8_t* out, const segment_zone_t* zone) {
+    segment_zone_rec_t rec;
+    memset(&rec, 0, sizeof(rec));
+    rec.distinct = zone->distinct;
+    rec.flags = zone->flags;
+    rec.min_size = zone->min_size;
+    rec.max_size = zone->max_size;
+    memcpy(rec.min, zone->min, sizeof(rec.min));
+    memcpy(rec.max, zone->max, sizeof(rec.max));
+    memcpy(out, &rec, sizeof(rec));
+    return out + sizeof(rec);
+}
+
+/**
+ * @brief Write the footer and publish the segment file
+ *
+ * @param writer The writer handle, freed whatever the outcome
+ * @param file_size Receives the size of the file (may be NULL)
+ * @return 0 on success, non-zero on failure
+ */
+int segment_writer_finish(void* handle, uint64_t* file_size) {
+    segment_writer_t* writer = (segment_writer_t*)handle;
+    if (!writer) {
+        return -1;
+    }
+    if (writer->failed) {
+        segment_writer_abort(writer);
+        return -1;
+    }
+    
+    size_t strings_size = 0;
+    for (size_t i = 0; i < writer->column_count; i++) {
+        strings_size += strlen(writer->columns[i].name) + 1;
+    }
+    size_t chunk_count = writer->group_count * writer->column_count;
+    size_t footer_size = sizeof(segment_footer_t) +
+                         writer->column_count * sizeof(segment_column_rec_t) +
+                         writer->group_count * sizeof(segment_row_group_rec_t) +
+                         chunk_count * sizeof(segment_chunk_rec_t) +
+                         (chunk_count + writer->column_count) * sizeof(segment_zone_rec_t) +
+                         strings_size;
+    
+    uint8_t* footer = (uint8_t*)malloc(footer_size);
+    if (!footer) {
+        segment_writer_abort(writer);
+        return -1;
+    }
+    segment_footer_t head;
+    memset(&head, 0, sizeof(head));
+    head.column_count = (uint32_t)writer->column_count;
+    head.row_group_count = (uint32_t)writer->group_count;
+    head.row_count = writer->row_count;
+    head.strings_size = strings_size;
+    memcpy(footer, &head, sizeof(head));
+    
+    uint8_t* out = footer + sizeof(head);
+    char* strings = (char*)footer + footer_size - strings_size;
+    uint64_t name = 0;
+    for (size_t i = 0; i < writer->column_count; i++) {
+        segment_column_rec_t rec;
+        memset(&rec, 0, sizeof(rec));
+        rec.name = name;
+        rec.type = (uint32_t)writer->columns[i].type;
+        rec.nullable = writer->columns[i].nullable ? 1 : 0;
+        memcpy(out, &rec, sizeof(rec));
+        out += sizeof(rec);
+        
+        size_t len = strlen(writer->columns[i].name) + 1;
+        memcpy(strings + name, writer->columns[i].name, len);
+        name += len;
+    }
+    if (writer->group_count > 0) {
+        memcpy(out, writer->groups, writer->group_count * sizeof(segment_row_group_rec_t));
+        out += writer->group_count * sizeof(segment_row_group_rec_t);
+        memcpy(out, writer->chunks, chunk_count * sizeof(segment_chunk_rec_t));
+        out += chunk_count * sizeof(segment_chunk_rec_t);
+    }
+    for (size_t i = 0; i < chunk_count; i++) {
+        out = put_zone(out, &writer->zones[i]);
+    }
+    for (size_t i = 0; i < writer->column_count; i++) {
+        // An estimate can overshoot the values there are
+        segment_zone_t* zone = &writer->column_zones[i];
+        uint64_t present = writer->row_count - zone->null_count;
+        zone->distinct = zone_sketch_estimate(&writer->sketches[i]);
+        if (zone->distinct > present) {
+            zone->distinct = present;
+        }
+        out = put_zone(out, zone);
+    }
+    
+    segment_trailer_t trailer;
+    memset(&trailer, 0, sizeof(trailer));
+    trailer.footer_offset = writer->offset;
+    trailer.footer_size = footer_size;
+    trailer.footer_checksum = checksum64(footer, footer_size);
+    memcpy(trailer.magic, SEGMENT_MAGIC, sizeof(trailer.magic));
+    
+    int result = writer_write(writer, footer, footer_size);
+    free(footer);
+    if (result == 0) {
+        result = writer_write(writer, &trailer, sizeof(trailer));
+    }
+    if (result != 0) {
+        segment_writer_abort(writer);
+        return -1;
+    }
+    
+    uint64_t size = writer->offset;
+    result = file_stage_commit(writer->stage, NULL);
+    writer->stage = NULL;
+    free_writer(writer);
+    if (result == 0 && file_size) {
+        *file_size = size;
+    }
+    return result;
+}
+
+/**
+ * @brief Abandon a segment file being written
+ *
+ * @param writer The writer handle, freed
+ * @return 0 on success, non-zero on failure
+ */
+int segment_writer_abort(void* handle) {
+    segment_writer_t* writer = (segment_writer_t*)handle;
+    if (!writer) {
+        return -1;
+    }
+    
+    int result = writer->stage ? file_stage_abort(writer->stage) : 0;
+    free_writer(writer);
+    return result;
+}
+
+/**
+ * @brief Free a segment's memory and close its file
+ *
+ * @param segment The segment
+ * @return 0 on success, non-zero if closing the file failed
+ */
+static int free_segment(segment_t* segment) {
+    int result = segment->file ? file_close(segment->file) : 0;
+    free(segment->columns);
+    free(segment->groups);
+    free(segment->chunks);
+    free(segment->zones);
+    free(segment->column_zones);
+    free(segment->strings);
+    free(segment);
+    return result;
+}
+
+/**
+ * @brief Read exactly a number of bytes at an offset
+ *
+ * @param file The file handle
+ * @param buf Receives the bytes
+ * @param len Number of bytes
+ * @param offset File offset
+ * @return 0 on success, non-zero on failure or a short read
+ */
+static int read_exact(void* file, void* buf, size_t len, uint64_t offset) {
+    return file_pread(file, buf, len, offset) == (long long)len ? 0 : -1;
+}
+
+/**
+ * @brief Load and validate a zone map record
+ *
+ * @param in The record
+ * @param type The column type
+ * @param rows Rows covered
+ * @param null_count Null values among them
+ * @param zone Filled with the zone map
+ * @return 0 on success, non-zero if the record is malformed
+ */
+static int get_zone(const uint8_t* in, retldb_type_t type, uint64_t rows, uint64_t null_count,
+                    segment_zone_t* zone) {
+    segment_zone_rec_t rec;
+    memcpy(&rec, in, sizeof(rec));
+    
+    uint32_t width = (uint32_t)segment_type_width(type);
+    uint32_t all = SEGMENT_ZONE_BOUNDS | SEGMENT_ZONE_ASCENDING | SEGMENT_ZONE_DESCENDING |
+                   SEGMENT_ZONE_MAX_TRUNCATED;
+    if ((rec.flags & ~all) != 0 || rec.reserved != 0 || rec.min_size > SEGMENT_ZONE_BYTES ||
+        rec.max_size > SEGMENT_ZONE_BYTES || rec.distinct > rows - null_count) {
+        return -1;
+    }
+    if (rec.flags & SEGMENT_ZONE_BOUNDS) {
+        if (width > 0 && (rec.min_size != width || rec.max_size != width ||
+                          (rec.flags & SEGMENT_ZONE_MAX_TRUNCATED))) {
+            return -1;
+        }
+        if ((rec.flags & SEGMENT_ZONE_MAX_TRUNCATED) && rec.max_size != SEGMENT_ZONE_BYTES) {
+            return -1;
+        }
+    } else if (rec.min_size != 0 || rec.max_size != 0 ||
+               (rec.flags & SEGMENT_ZONE_MAX_TRUNCATED)) {
+        return -1;
+    }
+    
+    zone->null_count = null_count;
+    zone->distinct = rec.distinct;
+    zone->flags = rec.flags;
+    zone->min_size = rec.min_size;
+    zone->max_size = rec.max_size;
+    memcpy(zone->min, rec.min, sizeof(zone->min));
+    memcpy(zone->max, rec.max, sizeof(zone->max));
+    return 0;
+}
+
+/**
+ * @brief Parse and validate a footer
+ *
+ * @param segment The segment being opened
+ * @param footer The footer bytes
+ * @param footer_size Bytes of the footer
+ * @param data_start First byte after the header block
+ * @param data_end First byte of the footer
+ * @param alignment Chunk alignment from the header
+ * @return 0 on success, non-zero if the footer is malformed
+ */
+static int parse_footer(segment_t* segment, const uint8_t* footer, uint64_t footer_size,
+                        uint64_t data_start, uint64_t data_end, uint64_t alignment) {
+    segment_footer_t head;
+    if (footer_size < sizeof(head)) {
+        return -1;
+    }
+    memcpy(&head, footer, sizeof(head));
+    
+    uint64_t columns = head.column_count;
+    uint64_t groups = head.row_group_count;
+    uint64_t records = sizeof(head) + columns * sizeof(segment_column_rec_t) +
+                       groups * sizeof(segment_row_group_rec_t) +
+                       groups * columns * sizeof(segment_chunk_rec_t) +
+                       (groups * columns + columns) * sizeof(segment_zone_rec_t);
+    if (columns == 0 || head.strings_size == 0 || records + head.strings_size != footer_size) {
+        return -1;
+    }
+    
+    const uint8_t* in = footer + sizeof(head);
+    const char* names = (const char*)footer + records;
+    if (names[head.strings_size - 1] != '\0') {
+        return -1;
+    }
+    segment->strings = (char*)malloc((size_t)head.strings_size);
+    segment->columns = (segment_column_t*)calloc((size_t)columns, sizeof(segment_column_t));
+    segment->groups = (segment_row_group_rec_t*)calloc(groups ? (size_t)groups : 1,
+                                                       sizeof(segment_row_group_rec_t));
+    segment->chunks = (segment_chunk_t*)calloc(groups ? (size_t)(groups * columns) : 1,
+                                               sizeof(segment_chunk_t));
+    segment->zones = (segment_zone_t*)calloc(groups ? (size_t)(groups * columns) : 1,
+                                             sizeof(segment_zone_t));
+    segment->column_zones = (segment_zone_t*)calloc((size_t)columns, sizeof(segment_zone_t));
+    if (!segment->strings || !segment->columns || !segment->groups || !segment->chunks ||
+        !segment->zones || !segment->column_zones) {
+        return -1;
+    }
+    memcpy(segment->strings, names, (size_t)head.strings_size);
+    segment->column_count = (size_t)columns;
+    segment->group_count = (size_t)groups;
+    segment->row_count = head.row_count;
+    
+    for (size_t i = 0; i < columns; i++) {
+        segment_column_rec_t rec;
+        memcpy(&rec, in, sizeof(rec));
+        in += sizeof(rec);
+        if (rec.name >= head.strings_size || !type_supported((retldb_type_t)rec.type) ||
+            rec.nullable > 1) {
+            return -1;
+        }
+        segment->columns[i].name = segment->strings + rec.name;
+        segment->columns[i].type = (retldb_type_t)rec.type;
+        segment->columns[i].nullable = (int)rec.nullable;
+    }
+    
+    uint64_t next_row = 0;
+    for (size_t g = 0; g < groups; g++) {
+        segment_row_group_rec_t rec;
+        memcpy(&rec, in, sizeof(rec));
+        in += sizeof(rec);
+        if (rec.first_row != next_row || rec.rows == 0 || rec.rows > UINT32_MAX) {
+            return -1;
+        }
+        segment->groups[g] = rec;
+        next_row += rec.rows;
+    }
+    if (next_row != head.row_count) {
+        return -1;
+    }
+    
+    for (size_t g = 0; g < groups; g++) {
+        for (size_t i = 0; i < columns; i++) {
+            segment_chunk_rec_t rec;
+            memcpy(&rec, in, sizeof(rec));
+            in += sizeof(rec);
+            if (rec.offset % alignment != 0 || rec.offset < data_start || rec.offset > data_end ||
+                rec.size > data_end - rec.offset || rec.null_count > segment->groups[g].rows ||
+                (rec.null_count > 0 && !segment->columns[i].nullable) ||
+                !encoding_supports(rec.encoding, segment->columns[i].type) ||
+                !compress_supported(rec.compression) ||
+                (rec.compression == SEGMENT_COMPRESSION_NONE && rec.encoded_size != rec.size) ||
+                (rec.encoding == SEGMENT_ENCODING_PLAIN && rec.decoded_size != rec.encoded_size)) {
+                return -1;
+            }
+            segment_chunk_t* chunk = &segment->chunks[g * columns + i];
+            chunk->offset = rec.offset;
+            chunk->size = rec.size;
+            chunk->rows = segment->groups[g].rows;
+            chunk->null_count = rec.null_count;
+            chunk->encoded_size = rec.encoded_size;
+            chunk->decoded_size = rec.decoded_size;
+            chunk->encoding = rec.encoding;
+            chunk->compression = rec.compression;
+            chunk->checksum = rec.checksum;
+        }
+    }
+    
+    for (size_t g = 0; g < groups; g++) {
+        for (size_t i = 0; i < columns; i++) {
+            const segment_chunk_t* chunk = &segment->chunks[g * columns + i];
+            if (get_zone(in, segment->columns[i].type, chunk->rows, chunk->null_count,
+                         &segment->zones[g * columns + i]) != 0) {
+                return -1;
+            }
+            in += sizeof(segment_zone_rec_t);
+        }
+    }
+    for (size_t i = 0; i < columns; i++) {
+        uint64_t nulls = 0;
+        for (size_t g = 0; g < groups; g++) {
+            nulls += segment->chunks[g * columns + i].null_count;
+        }
+        if (get_zone(in, segment->columns[i].type, head.row_count, nulls,
+                     &segment->column_zones[i]) != 0) {
+            return -1;
+        }
+        in += sizeof(segment_zone_rec_t);
+    }
+    return 0;
+}
+
+/**
+ * @brief Open a segment file and load its footer
+ *
+ * Reads the header, the trailer and the footer, and verifies the footer's
+ * checksum. No column data is read.
+ *
+ * @param filename The segment file
+ * @return Segment handle on success, NULL on failure
+ */
+void* segment_open(const char* filename) {
+    if (!filename) {
+        return NULL;
+    }
+    
+    segment_t* segment = (segment_t*)calloc(1, sizeof(segment_t));
+    if (!segment) {
+        return NULL;
+    }
+    segment->file = file_open_flags(filename, FILE_READ);
+    if (!segment->file) {
+        free_segment(segment);
+        return NULL;
+    }
+    
+    uint64_t size = 0;
+    segment_header_t header;
+    segment_trailer_t trailer;
+    if (file_size(segment->file, &size) != 0 ||
+        size < sizeof(header) + sizeof(segment_footer_t) + sizeof(trailer) ||
+        read_exact(segment->file, &header, sizeof(header), 0) != 0 ||
+        read_exact(segment->file, &trailer, sizeof(trailer), size - sizeof(trailer)) != 0) {
+        free_segment(segment);
+        return NULL;
+    }
+    
+    uint64_t alignment = header.alignment;
+    uint64_t footer_end = size - sizeof(trailer);
+    if (memcmp(header.magic, SEGMENT_MAGIC, sizeof(header.magic)) != 0 ||
+        memcmp(trailer.magic, SEGMENT_MAGIC, sizeof(trailer.magic)) != 0 ||
+        header.version != SEGMENT_VERSION || header.header_size != sizeof(header) ||
+        alignment < 8 || (alignment & (alignment - 1)) != 0 ||
+        trailer.footer_offset < alignment || trailer.footer_offset > footer_end ||
+        trailer.footer_size != footer_end - trailer.footer_offset) {
+        free_segment(segment);
+        return NULL;
+    }
+    
+    uint8_t* footer = (uint8_t*)malloc((size_t)trailer.footer_size);
+    if (!footer || read_exact(segment->file, footer, (size_t)trailer.footer_size,
+                              trailer.footer_offset) != 0 ||
+        checksum64(footer, (size_t)trailer.footer_size) != trailer.footer_checksum ||
+        parse_footer(segment, footer, trailer.footer_size, alignment,
+                     trailer.footer_offset, alignment) != 0) {
+        free(footer);
+        free_segment(segment);
+        return NULL;
+    }
+    free(footer);
+    
+    segment->footer_bytes = sizeof(header) + sizeof(trailer) + trailer.footer_size;
+    segment->fingerprint = trailer.footer_checksum;
+    return segment;
+}
+
+/**
+ * @brief Close a segment file
+ *
+ * @param segment The segment handle
+ * @return 0 on success, non-zero on failure
+ */
+int segment_close(void* handle) {
+    segment_t* segment = (segment_t*)handle;
+    if (!segment) {
+        return -1;
+    }
+    return free_segment(segment);
+}
+
+/**
+ * @brief Get the number of rows in a segment
+ *
+ * @param segment The segment handle
+ * @return Number of rows
+ */
+uint64_t segment_row_count(const void* handle) {
+    const segment_t* segment = (const segment_t*)handle;
+    return segment ? segment->row_count : 0;
+}
+
+/**
+ * @brief Get the number of row groups in a segment
+ *
+ * @param segment The segment handle
+ * @return Number of row groups
+ */
+size_t segment_row_group_count(const void* handle) {
+    const segment_t* segment = (const segment_t*)handle;
+    return segment ? segment->group_count : 0;
+}
+
+/**
+ * @brief Get the rows of a row group
+ *
+ * @param segment The segment handle
+ * @param row_group Row group index
+ * @param first_row Receives the index of the group's first row in the segment (may be NULL)
+ * @param rows Receives the number of rows in the group
+ * @return 0 on success, non-zero on failure
+ */
+int segment_row_group(const void* handle, size_t row_group, uint64_t* first_row, uint64_t* rows) {
+    const segment_t* segment = (const segment_t*)handle;
+    if (!segment || !rows || row_group >= segment->group_count) {
+        return -1;
+    }
+    
+    if (first_row) {
+        *first_row = segment->groups[row_group].first_row;
+    }
+    *rows = segment->groups[row_group].rows;
+    return 0;
+}
+
+/**
+ * @brief Get the number of columns in a segment
+ *
+ * @param segment The segment handle
+ * @return Number of columns
+ */
+size_t segment_column_count(const void* handle) {
+    const segment_t* segment = (const segment_t*)handle;
+    return segment ? segment->column_count : 0;
+}
+
+/**
+ * @brief Get a column of a segment
+ *
+ * @param segment The segment handle
+ * @param column Column index
+ * @return The column, NULL if the index is out of range
+ */
+const segment_column_t* segment_column(const void* handle, size_t column) {
+    const segment_t* segment = (const segment_t*)handle;
+    if (!segment || column >= segment->column_count) {
+        return NULL;
+    }
+    return &segment->columns[column];
+}
+
+/**
+ * @brief Find a column by name
+ *
+ * @param segment The segment handle
+ * @param name The column name
+ * @return Column index, -1 if there is no such column
+ */
+int segment_find_column(const void* handle, const char* name) {
+    const segment_t* segment = (const segment_t*)handle;
+    if (!segment || !name) {
+        return -1;
+    }
+    
+    for (size_t i = 0; i < segment->column_count && i <= INT32_MAX; i++) {
+        if (strcmp(segment->columns[i].name, name) == 0) {
+            return (int)i;
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief Look up a chunk
+ *
+ * @param segment The segment
+ * @param row_group Row group index
+ * @param column Column index
+ * @return The chunk, NULL if an index is out of range
+ */
+static const segment_chunk_t* find_chunk(const segment_t* segment, size_t row_group,
+                                         size_t column) {
+    if (!segment || row_group >= segment->group_count || column >= segment->column_count) {
+        return NULL;
+    }
+    return &segment->chunks[row_group * segment->column_count + column];
+}
+
+/**
+ * @brief Describe a column chunk
+ *
+ * @param segment The segment handle
+ * @param row_group Row group index
+ * @param column Column index
+ * @param chunk Filled with the chunk
+ * @return 0 on success, non-zero on failure
+ */
+int segment_chunk(const void* handle, size_t row_group, size_t column, segment_chunk_t* chunk) {
+    const segment_chunk_t* found = find_chunk((const segment_t*)handle, row_group, column);
+    if (!found || !chunk) {
+        return -1;
+    }
+    *chunk = *found;
+    return 0;
+}
+
+/**
+ * @brief Read a column chunk and verify its checksum
+ *
+ * @param segment The segment handle
+ * @param row_group Row group index
+ * @param column Column index
+ * @param buf Receives the chunk; at least segment_chunk() size bytes
+ * @return 0 on success, non-zero on failure
+ */
+int segment_read_chunk(void* handle, size_t row_group, size_t column, void* buf) {
+    segment_t* segment = (segment_t*)handle;
+    const segment_chunk_t* chunk = find_chunk(segment, row_group, column);
+    if (!chunk || !buf) {
+        return -1;
+    }
+    
+    if (read_exact(segment->file, buf, (size_t)chunk->size, chunk->offset) != 0 ||
+        checksum64(buf, (size_t)chunk->size) != chunk->checksum) {
+        return -1;
+    }
+    retldb_atomic_fetch_add_u64(&segment->chunk_bytes, chunk->size);
+    retldb_atomic_fetch_add_u64(&segment->chunks_read, 1);
+    return 0;
+}
+
+/**
+ * @brief Get the scratch space segment_decode_chunk() needs for a chunk
+ *
+ * @param chunk The chunk, as filled by segment_chunk()
+ * @return Bytes of scratch, 0 for a PLAIN uncompressed chunk
+ */
+size_t segment_scratch_size(const segment_chunk_t* chunk) {
+    if (!chunk) {
+        return 0;
+    }
+    
+    uint64_t size = 0;
+    if (chunk->compression != SEGMENT_COMPRESSION_NONE) {
+        size += align_up(chunk->encoded_size, 8);
+    }
+    if (chunk->encoding != SEGMENT_ENCODING_PLAIN) {
+        size += chunk->decoded_size;
+    }
+    return (size_t)size;
+}
+
+/**
+ * @brief Decode a column chunk into a vector
+ *
+ * The vector points into data and scratch, which must stay valid while it
+ * is used. Works on bytes from segment_read_chunk() as well as on a mapping
+ * of the chunk's range. PLAIN uncompressed chunks are used in place; other
+ * chunks are decompressed and decoded into scratch.
+ *
+ * @param segment The segment handle
+ * @param row_group Row group index
+ * @param column Column index
+ * @param data The chunk's stored bytes
+ * @param scratch At least segment_scratch_size() bytes, 8-byte aligned (may
+ *        be NULL when that is 0)
+ * @param vector Filled with the values
+ * @return 0 on success, non-zero if the chunk is malformed
+ */
+int segment_decode_chunk(const void* handle, size_t row_group, size_t column,
+                         const void* data, void* scratch, segment_vector_t* vector) {
+    const segment_t* segment = (const segment_t*)handle;
+    const segment_chunk_t* chunk = find_chunk(segment, row_group, column);
+    if (!chunk || !data || !vector) {
+        return -1;
+    }
+    
+    // Decompress into the front of scratch, decode into the rest
+    const uint8_t* in = (const uint8_t*)data;
+    uint8_t* out = (uint8_t*)scratch;
+    if (chunk->compression != SEGMENT_COMPRESSION_NONE) {
+        if (!out || decompress_block(chunk->compression, in, (size_t)chunk->size, out,
+                                     (size_t)chunk->encoded_size) != 0) {
+            return -1;
+        }
+        in = out;
+        out += align_up(chunk->encoded_size, 8);
+    }
+    
+    uint64_t rows = chunk->rows;
+    uint64_t pos = 0;
+    memset(vector, 0, sizeof(*vector));
+    if (chunk->null_count > 0) {
+        pos = bitmap_size(rows);
+        if (pos > chunk->encoded_size || pos > chunk->decoded_size) {
+            return -1;
+        }
+        vector->validity = in;
+    }
+    
+    // From here on, values holds size bytes in the PLAIN layout
+    retldb_type_t type = segment->columns[column].type;
+    const uint8_t* values = in + pos;
+    uint64_t size = chunk->encoded_size - pos;
+    if (chunk->encoding != SEGMENT_ENCODING_PLAIN) {
+        size = chunk->decoded_size - pos;
+        if (!out || encoding_decode(chunk->encoding, type, values,
+                                    (size_t)(chunk->encoded_size - pos), (size_t)rows, out,
+                                    (size_t)size) != 0) {
+            return -1;
+        }
+        values = out;
+    }
+    
+    size_t width = segment_type_width(type);
+    if (width > 0) {
+        if (rows * width != size) {
+            return -1;
+        }
+        vector->values = values;
+        return 0;
+    }
+    
+    if ((rows + 1) * sizeof(uint32_t) > size) {
+        return -1;
+    }
+    const uint32_t* offsets = (const uint32_t*)values;
+    pos = (rows + 1) * sizeof(uint32_t);
+    if (offsets[0] != 0 || offsets[rows] != size - pos) {
+        return -1;
+    }
+    for (uint64_t i = 0; i < rows; i++) {
+        if (offsets[i + 1] < offsets[i]) {
+            return -1;
+        }
+    }
+    vector->offsets = offsets;
+    vector->values = values + pos;
+    return 0;
+}
+
+/**
+ * @brief Get the bytes a segment reader has read so far
+ *
+ * @param segment The segment handle
+ * @param stats Filled with the counters
+ * @return 0 on success, non-zero on failure
+ */
+int segment_stats(const void* handle, segment_stats_t* stats) {
+    const segment_t* segment = (const segment_t*)handle;
+    if (!segment || !stats) {
+        return -1;
+    }
+    
+    stats->footer_bytes = segment->footer_bytes;
+    stats->chunk_bytes = retldb_atomic_load_u64(&segment->chunk_bytes);
+    stats->chunks_read = retldb_atomic_load_u64(&segment->chunks_read);
+    return 0;
+}
+
+/**
+ * @brief Get a fingerprint of a segment's contents
+ *
+ * The checksum of the footer, which covers the position and checksum of
+ * every chunk: segments with equal fingerprints hold the same data.
+ *
+ * @param segment The segment handle
+ * @return The fingerprint, 0 on failure
+ */
+uint64_t segment_fingerprint(const void* handle) {
+    const segment_t* segment = (const segment_t*)handle;
+    return segment ? segment->fingerprint : 0;
+}
+
+/**
+ * @brief Get the zone map of a column chunk
+ *
+ * Every row group keeps one per column, so this is also the row group's
+ * zone map for that column.
+ *
+ * @param segment The segment handle
+ * @param row_group Row group index
+ * @param column Column index
+ * @param zone Filled with the statistics
+ * @return 0 on success, non-zero on failure
+ */
+int segment_chunk_zone(const void* handle, size_t row_group, size_t column,
+                       segment_zone_t* zone) {
+    const segment_t* segment = (const segment_t*)handle;
+    if (!find_chunk(segment, row_group, column) || !zone) {
+        return -1;
+    }
+    *zone = segment->zones[row_group * segment->column_count + column];
+    return 0;
+}
+
+/**
+ * @brief Get the zone map of a column over the whole segment
+ *
+ * Sorted flags hold only if the column is sorted across row groups too.
+ *
+ * @param segment The segment handle
+ * @param column Column index
+ * @param zone Filled with the statistics
+ * @return 0 on success, non-zero on failure
+ */
+int segment_column_zone(const void* handle, size_t column, segment_zone_t* zone) {
+    const segment_t* segment = (const segment_t*)handle;
+    if (!segment || column >= segment->column_count || !zone) {
+        return -1;
+    }
+    *zone = segment->column_zones[column];
+    return 0;
+}
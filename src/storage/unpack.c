@@ -0,0 +1,525 @@
+/**
+ * @file unpack.c
+ * @brief Implementation of the decode kernels for rETL DB
+ *
+ * The vector kernels unpack a group of 8 (AVX2) or 16 (AVX-512) fields at
+ * a time. A group of 8 fields of b bits spans exactly b bytes, so groups
+ * start on byte boundaries and every group of a given width has the same
+ * layout: each 128-bit quarter of the register is loaded from the byte
+ * holding its first field, a byte shuffle moves the four bytes under each
+ * field into its 32-bit lane, and a per-lane shift and mask finish it.
+ * Fields of 26 to 31 bits can straddle five bytes; a second shuffle brings
+ * in the fifth. Dictionary gathers use the hardware gather instructions
+ * once every index has been checked against the dictionary size.
+ */
+
+/* Define _POSIX_C_SOURCE to make pthread_once available */
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "retldb/storage.h"
+#include "storage/unpack.h"
+#include "common/sync.h"
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define UNPACK_X86 1
+#include <immintrin.h>
+#endif
+
+static retldb_once_t kernel_once = RETLDB_ONCE_INIT;
+static int kernel_supported = SEGMENT_KERNEL_SCALAR;  // Best level the CPU runs
+static int kernel_level = SEGMENT_KERNEL_SCALAR;      // Level in use
+
+/**
+ * @brief Find the best kernels the CPU supports and start using them
+ */
+static void detect_kernels(void) {
+#ifdef UNPACK_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw")) {
+        kernel_supported = SEGMENT_KERNEL_AVX512;
+    } else if (__builtin_cpu_supports("avx2")) {
+        kernel_supported = SEGMENT_KERNEL_AVX2;
+    }
+#endif
+    retldb_atomic_store_int(&kernel_level, kernel_supported);
+}
+
+/**
+ * @brief Get the kernel level in use
+ *
+ * @return SEGMENT_KERNEL_*
+ */
+static int current_level(void) {
+    retldb_once(&kernel_once, detect_kernels);
+    return retldb_atomic_load_int(&kernel_level);
+}
+
+/**
+ * @brief Unpack fields one at a time
+ *
+ * @param in The bit-packed fields, followed by at least 8 spare bytes
+ * @param start Index of the first field
+ * @param count Number of fields
+ * @param bits Bits per field, 1 to 32
+ * @param out Receives one value per field
+ */
+static void unpack_scalar(const uint8_t* in, size_t start, size_t count, unsigned bits,
+                          uint32_t* out) {
+    uint64_t mask = (UINT64_C(1) << bits) - 1;
+    uint64_t bit = (uint64_t)start * bits;
+    for (size_t i = 0; i < count; i++, bit += bits) {
+        uint64_t word;
+        memcpy(&word, in + (bit >> 3), sizeof(word));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        word = __builtin_bswap64(word);
+#endif
+        out[i] = (uint32_t)((word >> (bit & 7)) & mask);
+    }
+}
+
+/**
+ * @brief Copy dictionary entries one at a time
+ *
+ * @param dict The entries
+ * @param width Bytes per entry
+ * @param indexes Entry indexes, all in range
+ * @param count Number of values
+ * @param out Receives count * width bytes
+ */
+static void gather_scalar(const uint8_t* dict, size_t width, const uint32_t* indexes,
+                          size_t count, uint8_t* out) {
+    switch (width) {
+        case 1:
+            for (size_t i = 0; i < count; i++) {
+                out[i] = dict[indexes[i]];
+            }
+            break;
+        case 2:
+            for (size_t i = 0; i < count; i++) {
+                memcpy(out + i * 2, dict + (size_t)indexes[i] * 2, 2);
+            }
+            break;
+        case 4:
+            for (size_t i = 0; i < count; i++) {
+                memcpy(out + i * 4, dict + (size_t)indexes[i] * 4, 4);
+            }
+            break;
+        default:
+            for (size_t i = 0; i < count; i++) {
+                memcpy(out + i * 8, dict + (size_t)indexes[i] * 8, 8);
+            }
+            break;
+    }
+}
+
+#ifdef UNPACK_X86
+/**
+ * @brief Shuffles and shifts unpacking one group of fields of a given width
+ */
+typedef struct {
+    uint8_t low[64];             // Bytes under each field, by position in its quarter
+    uint8_t high[64];            // Fifth byte of each field that needs one
+    uint32_t shift[16];          // Bit position of each field in its first byte
+    uint32_t back[16];           // Where the fifth byte lands after the shift
+    size_t quarter[4];           // Byte each 128-bit quarter is loaded from
+    int wide;                    // Whether any field needs a fifth byte
+} unpack_plan_t;
+
+/**
+ * @brief Work out how to unpack a group of fields with byte shuffles
+ *
+ * @param bits Bits per field, 1 to 32
+ * @param lanes Fields per group (8 or 16)
+ * @param plan Receives the shuffles and shifts
+ * @return 0 on success, non-zero if a field does not fit its quarter
+ */
+static int plan_unpack(unsigned bits, size_t lanes, unpack_plan_t* plan) {
+    memset(plan->low, 0x80, sizeof(plan->low));
+    memset(plan->high, 0x80, sizeof(plan->high));
+    plan->wide = 0;
+    for (size_t q = 0; q < lanes / 4; q++) {
+        plan->quarter[q] = (4 * q * bits) >> 3;
+    }
+    
+    for (size_t k = 0; k < lanes; k++) {
+        size_t bit = k * bits;
+        size_t first = (bit >> 3) - plan->quarter[k / 4];
+        unsigned shift = (unsigned)(bit & 7);
+        size_t need = (shift + bits + 7) / 8;
+        for (size_t j = 0; j < 4 && j < need; j++) {
+            if (first + j >= 16) {
+                return -1;
+            }
+            plan->low[k * 4 + j] = (uint8_t)(first + j);
+        }
+        if (need > 4) {
+            if (first + 4 >= 16) {
+                return -1;
+            }
+            plan->high[k * 4] = (uint8_t)(first + 4);
+            plan->wide = 1;
+        }
+        plan->shift[k] = shift;
+        plan->back[k] = 32 - shift;
+    }
+    return 0;
+}
+
+/**
+ * @brief Get the mask of a field's bits
+ *
+ * @param bits Bits per field, 1 to 32
+ * @return The mask as a signed lane value
+ */
+static int field_mask(unsigned bits) {
+    uint32_t mask = UINT32_MAX >> (32 - bits);
+    int lane;
+    memcpy(&lane, &mask, sizeof(lane));
+    return lane;
+}
+
+/**
+ * @brief Unpack groups of 8 fields with AVX2
+ *
+ * @param in The bit-packed fields
+ * @param in_size Bytes readable from in
+ * @param start Index of the first field, a multiple of 8
+ * @param count Number of fields
+ * @param bits Bits per field, 1 to 32
+ * @param out Receives one value per field
+ * @return Number of fields unpacked; the caller does the rest
+ */
+__attribute__((target("avx2")))
+static size_t unpack_avx2(const uint8_t* in, size_t in_size, size_t start, size_t count,
+                          unsigned bits, uint32_t* out) {
+    unpack_plan_t plan;
+    if (plan_unpack(bits, 8, &plan) != 0) {
+        return 0;
+    }
+    
+    const __m256i low = _mm256_loadu_si256((const __m256i*)plan.low);
+    const __m256i high = _mm256_loadu_si256((const __m256i*)plan.high);
+    const __m256i shift = _mm256_loadu_si256((const __m256i*)plan.shift);
+    const __m256i back = _mm256_loadu_si256((const __m256i*)plan.back);
+    const __m256i mask = _mm256_set1_epi32(field_mask(bits));
+    size_t done = 0;
+    for (; count - done >= 8; done += 8) {
+        size_t offset = (start + done) / 8 * bits;
+        if (offset + plan.quarter[1] + 16 > in_size) {
+            break;
+        }
+        const uint8_t* p = in + offset;
+        __m256i v = _mm256_inserti128_si256(
+            _mm256_castsi128_si256(_mm_loadu_si128((const __m128i*)p)),
+            _mm_loadu_si128((const __m128i*)(p + plan.quarter[1])), 1);
+        __m256i w = _mm256_srlv_epi32(_mm256_shuffle_epi8(v, low), shift);
+        if (plan.wide) {
+            w = _mm256_or_si256(w, _mm256_sllv_epi32(_mm256_shuffle_epi8(v, high), back));
+        }
+        _mm256_storeu_si256((__m256i*)(out + done), _mm256_and_si256(w, mask));
+    }
+    return done;
+}
+
+/**
+ * @brief Unpack groups of 16 fields with AVX-512
+ *
+ * @param in The bit-packed fields
+ * @param in_size Bytes readable from in
+ * @param start Index of the first field, a multiple of 16
+ * @param count Number of fields
+ * @param bits Bits per field, 1 to 32
+ * @param out Receives one value per field
+ * @return Number of fields unpacked; the caller does the rest
+ */
+__attribute__((target("avx512f,avx512bw")))
+static size_t unpack_avx512(const uint8_t* in, size_t in_size, size_t start, size_t count,
+                            unsigned bits, uint32_t* out) {
+    unpack_plan_t plan;
+    if (plan_unpack(bits, 16, &plan) != 0) {
+        return 0;
+    }
+    
+    const __m512i low = _mm512_loadu_si512(plan.low);
+    const __m512i high = _mm512_loadu_si512(plan.high);
+    const __m512i shift = _mm512_loadu_si512(plan.shift);
+    const __m512i back = _mm512_loadu_si512(plan.back);
+    const __m512i mask = _mm512_set1_epi32(field_mask(bits));
+    size_t done = 0;
+    for (; count - done >= 16; done += 16) {
+        size_t offset = (start + done) / 8 * bits;
+        if (offset + plan.quarter[3] + 16 > in_size) {
+            break;
+        }
+        const uint8_t* p = in + offset;
+        __m512i v = _mm512_castsi128_si512(_mm_loadu_si128((const __m128i*)p));
+        v = _mm512_inserti32x4(v, _mm_loadu_si128((const __m128i*)(p + plan.quarter[1])), 1);
+        v = _mm512_inserti32x4(v, _mm_loadu_si128((const __m128i*)(p + plan.quarter[2])), 2);
+        v = _mm512_inserti32x4(v, _mm_loadu_si128((const __m128i*)(p + plan.quarter[3])), 3);
+        __m512i w = _mm512_srlv_epi32(_mm512_shuffle_epi8(v, low), shift);
+        if (plan.wide) {
+            w = _mm512_or_si512(w, _mm512_sllv_epi32(_mm512_shuffle_epi8(v, high), back));
+        }
+        _mm512_storeu_si512(out + done, _mm512_and_si512(w, mask));
+    }
+    return done;
+}
+
+/**
+ * @brief Get the largest index with AVX2
+ *
+ * @param indexes The indexes
+ * @param count Number of indexes
+ * @return The largest index
+ */
+__attribute__((target("avx2")))
+static uint32_t max_index_avx2(const uint32_t* indexes, size_t count) {
+    __m256i top = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; count - i >= 8; i += 8) {
+        top = _mm256_max_epu32(top, _mm256_loadu_si256((const __m256i*)(indexes + i)));
+    }
+    uint32_t lanes[8];
+    _mm256_storeu_si256((__m256i*)lanes, top);
+    uint32_t max = 0;
+    for (size_t k = 0; k < 8; k++) {
+        max = lanes[k] > max ? lanes[k] : max;
+    }
+    for (; i < count; i++) {
+        max = indexes[i] > max ? indexes[i] : max;
+    }
+    return max;
+}
+
+/**
+ * @brief Gather dictionary entries 8 at a time with AVX2
+ *
+ * @param dict The entries, followed by at least 8 readable bytes
+ * @param width Bytes per entry
+ * @param indexes Entry indexes, all in range and below 2^31
+ * @param count Number of values
+ * @param out Receives count * width bytes
+ * @return Number of values gathered; the caller does the rest
+ */
+__attribute__((target("avx2")))
+static size_t gather_avx2(const uint8_t* dict, size_t width, const uint32_t* indexes,
+                          size_t count, uint8_t* out) {
+    const __m256i pick16 = _mm256_setr_epi8(0, 1, 4, 5, 8, 9, 12, 13, -1, -1, -1, -1, -1, -1,
+                                            -1, -1, 0, 1, 4, 5, 8, 9, 12, 13, -1, -1, -1, -1,
+                                            -1, -1, -1, -1);
+    const __m256i pick8 = _mm256_setr_epi8(0, 4, 8, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+                                           -1, -1, 0, 4, 8, 12, -1, -1, -1, -1, -1, -1, -1, -1,
+                                           -1, -1, -1, -1);
+    const __m256i join8 = _mm256_setr_epi32(0, 4, 0, 0, 0, 0, 0, 0);
+    size_t done = 0;
+    for (; count - done >= 8; done += 8) {
+        __m256i index = _mm256_loadu_si256((const __m256i*)(indexes + done));
+        switch (width) {
+            case 1: {
+                __m256i v = _mm256_i32gather_epi32((const int*)dict, index, 1);
+                v = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(v, pick8), join8);
+                _mm_storel_epi64((__m128i*)(out + done), _mm256_castsi256_si128(v));
+                break;
+            }
+            case 2: {
+                __m256i v = _mm256_i32gather_epi32((const int*)dict, index, 2);
+                v = _mm256_permute4x64_epi64(_mm256_shuffle_epi8(v, pick16), 0x08);
+                _mm_storeu_si128((__m128i*)(out + done * 2), _mm256_castsi256_si128(v));
+                break;
+            }
+            case 4:
+                _mm256_storeu_si256((__m256i*)(out + done * 4),
+                                    _mm256_i32gather_epi32((const int*)dict, index, 4));
+                break;
+            default:
+                _mm256_storeu_si256((__m256i*)(out + done * 8),
+                                    _mm256_i32gather_epi64((const long long*)dict,
+                                                           _mm256_castsi256_si128(index), 8));
+                _mm256_storeu_si256((__m256i*)(out + done * 8 + 32),
+                                    _mm256_i32gather_epi64((const long long*)dict,
+                                                           _mm256_extracti128_si256(index, 1), 8));
+                break;
+        }
+    }
+    return done;
+}
+
+/**
+ * @brief Get the largest index with AVX-512
+ *
+ * @param indexes The indexes
+ * @param count Number of indexes
+ * @return The largest index
+ */
+__attribute__((target("avx512f")))
+static uint32_t max_index_avx512(const uint32_t* indexes, size_t count) {
+    __m512i top = _mm512_setzero_si512();
+    size_t i = 0;
+    for (; count - i >= 16; i += 16) {
+        top = _mm512_max_epu32(top, _mm512_loadu_si512(indexes + i));
+    }
+    uint32_t max = (uint32_t)_mm512_reduce_max_epu32(top);
+    for (; i < count; i++) {
+        max = indexes[i] > max ? indexes[i] : max;
+    }
+    return max;
+}
+
+/**
+ * @brief Gather dictionary entries 16 at a time with AVX-512
+ *
+ * @param dict The entries, followed by at least 8 readable bytes
+ * @param width Bytes per entry
+ * @param indexes Entry indexes, all in range and below 2^31
+ * @param count Number of values
+ * @param out Receives count * width bytes
+ * @return Number of values gathered; the caller does the rest
+ */
+__attribute__((target("avx512f")))
+static size_t gather_avx512(const uint8_t* dict, size_t width, const uint32_t* indexes,
+                            size_t count, uint8_t* out) {
+    size_t done = 0;
+    for (; count - done >= 16; done += 16) {
+        __m512i index = _mm512_loadu_si512(indexes + done);
+        switch (width) {
+            case 1:
+                _mm_storeu_si128((__m128i*)(out + done),
+                                 _mm512_cvtepi32_epi8(_mm512_i32gather_epi32(index, dict, 1)));
+                break;
+            case 2:
+                _mm256_storeu_si256((__m256i*)(out + done * 2),
+                                    _mm512_cvtepi32_epi16(_mm512_i32gather_epi32(index, dict, 2)));
+                break;
+            case 4:
+                _mm512_storeu_si512(out + done * 4, _mm512_i32gather_epi32(index, dict, 4));
+                break;
+            default:
+                _mm512_storeu_si512(out + done * 8,
+                                    _mm512_i32gather_epi64(_mm512_castsi512_si256(index), dict, 8));
+                _mm512_storeu_si512(out + done * 8 + 64,
+                                    _mm512_i32gather_epi64(_mm512_extracti64x4_epi64(index, 1),
+                                                           dict, 8));
+                break;
+        }
+    }
+    return done;
+}
+#endif
+
+/**
+ * @brief Unpack fields of up to 32 bits
+ *
+ * Fields are stored least significant bit first, as written by the
+ * encodings. Starting at a multiple of 16 lets the vector kernels work
+ * from the first value.
+ *
+ * @param in The bit-packed fields, followed by at least 8 spare bytes
+ * @param in_size Bytes readable from in, spare bytes included
+ * @param start Index of the first field to unpack
+ * @param count Number of fields
+ * @param bits Bits per field, 0 to 32
+ * @param out Receives one value per field
+ */
+void unpack_bits(const uint8_t* in, size_t in_size, size_t start, size_t count, unsigned bits,
+                 uint32_t* out) {
+    if (bits == 0) {
+        memset(out, 0, count * sizeof(uint32_t));
+        return;
+    }
+    
+    // Line up with a group boundary, then let the vector kernel take what it can
+    size_t done = (16 - start % 16) % 16;
+    done = done < count ? done : count;
+    unpack_scalar(in, start, done, bits, out);
+    switch (current_level()) {
+#ifdef UNPACK_X86
+        case SEGMENT_KERNEL_AVX512:
+            done += unpack_avx512(in, in_size, start + done, count - done, bits, out + done);
+            break;
+        case SEGMENT_KERNEL_AVX2:
+            done += unpack_avx2(in, in_size, start + done, count - done, bits, out + done);
+            break;
+#endif
+        default:
+            (void)in_size;
+            break;
+    }
+    unpack_scalar(in, start + done, count - done, bits, out + done);
+}
+
+/**
+ * @brief Copy dictionary entries into a vector by index
+ *
+ * Every index is checked before anything is read from the dictionary.
+ *
+ * @param dict Fixed-width entries, followed by at least 8 readable bytes
+ * @param entries Number of entries
+ * @param width Bytes per entry: 1, 2, 4 or 8
+ * @param indexes One entry index per value
+ * @param count Number of values
+ * @param out Receives count * width bytes
+ * @return 0 on success, non-zero if an index is out of range
+ */
+int unpack_gather(const uint8_t* dict, size_t entries, size_t width, const uint32_t* indexes,
+                  size_t count, uint8_t* out) {
+    if (count == 0) {
+        return 0;
+    }
+    
+    // Gather instructions take signed 32-bit indexes
+    int level = entries <= (size_t)INT32_MAX + 1 ? current_level() : SEGMENT_KERNEL_SCALAR;
+    size_t done = 0;
+    switch (level) {
+#ifdef UNPACK_X86
+        case SEGMENT_KERNEL_AVX512:
+            if (max_index_avx512(indexes, count) >= entries) {
+                return -1;
+            }
+            done = gather_avx512(dict, width, indexes, count, out);
+            break;
+        case SEGMENT_KERNEL_AVX2:
+            if (max_index_avx2(indexes, count) >= entries) {
+                return -1;
+            }
+            done = gather_avx2(dict, width, indexes, count, out);
+            break;
+#endif
+        default:
+            for (size_t i = 0; i < count; i++) {
+                if (indexes[i] >= entries) {
+                    return -1;
+                }
+            }
+            break;
+    }
+    gather_scalar(dict, width, indexes + done, count - done, out + done * width);
+    return 0;
+}
+
+/**
+ * @brief Get the instruction set segment decoding uses
+ *
+ * @return SEGMENT_KERNEL_*
+ */
+uint32_t segment_kernel_level(void) {
+    return (uint32_t)current_level();
+}
+
+/**
+ * @brief Choose the instruction set segment decoding uses
+ *
+ * @param level SEGMENT_KERNEL_*, at most what the CPU supports
+ * @return 0 on success, non-zero if the CPU lacks the instructions
+ */
+int segment_set_kernel_level(uint32_t level) {
+    retldb_once(&kernel_once, detect_kernels);
+    if (level > (uint32_t)kernel_supported) {
+        return -1;
+    }
+    retldb_atomic_store_int(&kernel_level, (int)level);
+    return 0;
+}
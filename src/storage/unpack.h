@@ -0,0 +1,53 @@
+/**
+ * @file unpack.h
+ * @brief Internal decode kernels for rETL DB
+ *
+ * The inner loops of bit-packed and dictionary decoding: unpacking fields
+ * of up to 32 bits and gathering dictionary entries by index. Each comes
+ * in a portable version and, on x86-64, AVX2 and AVX-512 versions; the
+ * fastest one the CPU supports is picked at run time and can be lowered
+ * with segment_set_kernel_level().
+ */
+
+#ifndef RETLDB_UNPACK_H
+#define RETLDB_UNPACK_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define UNPACK_BLOCK 1024               // Values callers unpack per call, sized for the stack
+
+/**
+ * @brief Unpack fields of up to 32 bits
+ *
+ * Fields are stored least significant bit first, as written by the
+ * encodings. Starting at a multiple of 16 lets the vector kernels work
+ * from the first value.
+ *
+ * @param in The bit-packed fields, followed by at least 8 spare bytes
+ * @param in_size Bytes readable from in, spare bytes included
+ * @param start Index of the first field to unpack
+ * @param count Number of fields
+ * @param bits Bits per field, 0 to 32
+ * @param out Receives one value per field
+ */
+void unpack_bits(const uint8_t* in, size_t in_size, size_t start, size_t count, unsigned bits,
+                 uint32_t* out);
+
+/**
+ * @brief Copy dictionary entries into a vector by index
+ *
+ * Every index is checked before anything is read from the dictionary.
+ *
+ * @param dict Fixed-width entries, followed by at least 8 readable bytes
+ * @param entries Number of entries
+ * @param width Bytes per entry: 1, 2, 4 or 8
+ * @param indexes One entry index per value
+ * @param count Number of values
+ * @param out Receives count * width bytes
+ * @return 0 on success, non-zero if an index is out of range
+ */
+int unpack_gather(const uint8_t* dict, size_t entries, size_t width, const uint32_t* indexes,
+                  size_t count, uint8_t* out);
+
+#endif /* RETLDB_UNPACK_H */
@@ -0,0 +1,482 @@
+/**
+ * @file zone.c
+ * @brief Implementation of zone maps for rETL DB
+ *
+ * Fixed-width values are compared through keys: unsigned integers that
+ * sort like the values (sign bit flipped for signed integers, IEEE order
+ * for floating point with -0 folded into +0). STRING and BINARY values
+ * compare byte by byte, a shorter value before any value it prefixes.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "storage/zone.h"
+#include "common/checksum.h"
+
+#define SIGN64 (UINT64_C(1) << 63)      // Sign bit of a 64-bit key
+
+/**
+ * @brief Map a fixed-width value to a key that sorts like the value
+ *
+ * @param type The column type
+ * @param p The value
+ * @param key Receives the key
+ * @return 0 on success, non-zero for a NaN (which has no place in the order)
+ */
+static int value_key(retldb_type_t type, const uint8_t* p, uint64_t* key) {
+    switch (type) {
+        case RETLDB_TYPE_INT8:
+            *key = (uint64_t)(int64_t)(int8_t)*p ^ SIGN64;
+            return 0;
+        case RETLDB_TYPE_INT16: {
+            int16_t v;
+            memcpy(&v, p, sizeof(v));
+            *key = (uint64_t)(int64_t)v ^ SIGN64;
+            return 0;
+        }
+        case RETLDB_TYPE_INT32: {
+            int32_t v;
+            memcpy(&v, p, sizeof(v));
+            *key = (uint64_t)(int64_t)v ^ SIGN64;
+            return 0;
+        }
+        case RETLDB_TYPE_INT64:
+        case RETLDB_TYPE_TIMESTAMP: {
+            uint64_t v;
+            memcpy(&v, p, sizeof(v));
+            *key = v ^ SIGN64;
+            return 0;
+        }
+        case RETLDB_TYPE_UINT16: {
+            uint16_t v;
+            memcpy(&v, p, sizeof(v));
+            *key = v;
+            return 0;
+        }
+        case RETLDB_TYPE_UINT32: {
+            uint32_t v;
+            memcpy(&v, p, sizeof(v));
+            *key = v;
+            return 0;
+        }
+        case RETLDB_TYPE_UINT64:
+            memcpy(key, p, sizeof(*key));
+            return 0;
+        case RETLDB_TYPE_FLOAT: {
+            uint32_t bits;
+            memcpy(&bits, p, sizeof(bits));
+            if ((bits & 0x7fffffffu) > 0x7f800000u) {
+                return -1;
+            }
+            if (bits == 0x80000000u) {
+                bits = 0;
+            }
+            *key = (bits & 0x80000000u) ? (uint64_t)(~bits) : (uint64_t)(bits | 0x80000000u);
+            return 0;
+        }
+        case RETLDB_TYPE_DOUBLE: {
+            uint64_t bits;
+            memcpy(&bits, p, sizeof(bits));
+            if ((bits & ~SIGN64) > UINT64_C(0x7ff0000000000000)) {
+                return -1;
+            }
+            if (bits == SIGN64) {
+                bits = 0;
+            }
+            *key = (bits & SIGN64) ? ~bits : bits | SIGN64;
+            return 0;
+        }
+        default:
+            *key = *p;
+            return 0;
+    }
+}
+
+/**
+ * @brief Compare two byte strings
+ *
+ * @return Negative, zero or positive as a sorts before, with or after b
+ */
+static int compare_bytes(const uint8_t* a, size_t a_size, const uint8_t* b, size_t b_size) {
+    size_t n = a_size < b_size ? a_size : b_size;
+    int c = n > 0 ? memcmp(a, b, n) : 0;
+    if (c != 0) {
+        return c;
+    }
+    return a_size < b_size ? -1 : a_size > b_size;
+}
+
+/**
+ * @brief Compare two zone bounds
+ *
+ * @param type The column type
+ * @param a First bound
+ * @param a_size Bytes of a
+ * @param b Second bound
+ * @param b_size Bytes of b
+ * @return Negative, zero or positive as a sorts before, with or after b
+ */
+static int compare_bound(retldb_type_t type, const uint8_t* a, size_t a_size, const uint8_t* b,
+                         size_t b_size) {
+    if (segment_type_width(type) == 0) {
+        return compare_bytes(a, a_size, b, b_size);
+    }
+    uint64_t x = 0;
+    uint64_t y = 0;
+    value_key(type, a, &x);
+    value_key(type, b, &y);
+    return x < y ? -1 : x > y;
+}
+
+/**
+ * @brief Check whether every value of one zone sorts no later than every value of another
+ *
+ * @param type The column type
+ * @param lower The zone expected first, with bounds
+ * @param upper The zone expected second, with bounds
+ * @return Non-zero if so for certain
+ */
+static int zone_before(retldb_type_t type, const segment_zone_t* lower,
+                       const segment_zone_t* upper) {
+    if (!(lower->flags & SEGMENT_ZONE_MAX_TRUNCATED)) {
+        return compare_bound(type, lower->max, lower->max_size, upper->min,
+                             upper->min_size) <= 0;
+    }
+    // Only a difference within the prefix settles it
+    size_t n = lower->max_size < upper->min_size ? lower->max_size : upper->min_size;
+    return n > 0 && memcmp(lower->max, upper->min, n) < 0;
+}
+
+/**
+ * @brief Scramble a key into a hash (a bijection, so distinct keys stay distinct)
+ *
+ * @param x The key
+ * @return The hash
+ */
+static uint64_t mix(uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x;
+}
+
+/**
+ * @brief Add a hash to a sketch
+ *
+ * @param sketch The sketch
+ * @param hash The hash of a value
+ */
+static void sketch_add(zone_sketch_t* sketch, uint64_t hash) {
+    size_t count = sketch->count;
+    if (count == ZONE_SKETCH_SIZE && hash >= sketch->hashes[count - 1]) {
+        return;
+    }
+    
+    size_t low = 0;
+    size_t high = count;
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+        if (sketch->hashes[mid] < hash) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    if (low < count && sketch->hashes[low] == hash) {
+        return;
+    }
+    if (count == ZONE_SKETCH_SIZE) {
+        count--;
+    }
+    memmove(&sketch->hashes[low + 1], &sketch->hashes[low], (count - low) * sizeof(uint64_t));
+    sketch->hashes[low] = hash;
+    sketch->count = count + 1;
+}
+
+/**
+ * @brief Check whether a value is present
+ *
+ * @param validity The bitmap, NULL when nothing is null
+ * @param i Value index
+ * @return Non-zero if present
+ */
+static int is_present(const uint8_t* validity, size_t i) {
+    return !validity || ((validity[i / 8] >> (i % 8)) & 1);
+}
+
+/**
+ * @brief Gather the zone map of a chunk
+ *
+ * @param type The column type
+ * @param values The values
+ * @param rows Number of values
+ * @param zone Filled with the statistics, the distinct estimate included
+ * @param sketch Filled with the chunk's distinct-count sketch
+ */
+void zone_collect(retldb_type_t type, const segment_vector_t* values, size_t rows,
+                  segment_zone_t* zone, zone_sketch_t* sketch) {
+    memset(zone, 0, sizeof(*zone));
+    sketch->count = 0;
+    zone->flags = SEGMENT_ZONE_ASCENDING | SEGMENT_ZONE_DESCENDING;
+    
+    size_t width = segment_type_width(type);
+    const uint8_t* data = (const uint8_t*)values->values;
+    size_t present = 0;
+    int seen = 0;
+    if (width > 0) {
+        uint64_t min = 0;
+        uint64_t max = 0;
+        uint64_t last = 0;
+        size_t min_row = 0;
+        size_t max_row = 0;
+        for (size_t i = 0; i < rows; i++) {
+            uint64_t key;
+            if (!is_present(values->validity, i)) {
+                continue;
+            }
+            present++;
+            if (value_key(type, data + i * width, &key) != 0) {
+                continue;
+            }
+            sketch_add(sketch, mix(key));
+            if (!seen) {
+                min = max = key;
+                min_row = max_row = i;
+                seen = 1;
+            } else {
+                if (key < last) {
+                    zone->flags &= ~(uint32_t)SEGMENT_ZONE_ASCENDING;
+                }
+                if (key > last) {
+                    zone->flags &= ~(uint32_t)SEGMENT_ZONE_DESCENDING;
+                }
+                if (key < min) {
+                    min = key;
+                    min_row = i;
+                }
+                if (key > max) {
+                    max = key;
+                    max_row = i;
+                }
+            }
+            last = key;
+        }
+        if (seen) {
+            zone->flags |= SEGMENT_ZONE_BOUNDS;
+            zone->min_size = zone->max_size = (uint32_t)width;
+            memcpy(zone->min, data + min_row * width, width);
+            memcpy(zone->max, data + max_row * width, width);
+        }
+    } else {
+        const uint8_t* min = NULL;
+        const uint8_t* max = NULL;
+        const uint8_t* last = NULL;
+        size_t min_len = 0;
+        size_t max_len = 0;
+        size_t last_len = 0;
+        for (size_t i = 0; i < rows; i++) {
+            if (!is_present(values->validity, i)) {
+                continue;
+            }
+            present++;
+            const uint8_t* p = data + values->offsets[i];
+            size_t len = values->offsets[i + 1] - values->offsets[i];
+            sketch_add(sketch, checksum64(p, len));
+            if (!seen) {
+                min = max = p;
+                min_len = max_len = len;
+                seen = 1;
+            } else {
+                int c = compare_bytes(p, len, last, last_len);
+                if (c < 0) {
+                    zone->flags &= ~(uint32_t)SEGMENT_ZONE_ASCENDING;
+                }
+                if (c > 0) {
+                    zone->flags &= ~(uint32_t)SEGMENT_ZONE_DESCENDING;
+                }
+                if (compare_bytes(p, len, min, min_len) < 0) {
+                    min = p;
+                    min_len = len;
+                }
+                if (compare_bytes(p, len, max, max_len) > 0) {
+                    max = p;
+                    max_len = len;
+                }
+            }
+            last = p;
+            last_len = len;
+        }
+        if (seen) {
+            zone->flags |= SEGMENT_ZONE_BOUNDS;
+            zone->min_size = (uint32_t)(min_len < SEGMENT_ZONE_BYTES ? min_len : SEGMENT_ZONE_BYTES);
+            zone->max_size = (uint32_t)(max_len < SEGMENT_ZONE_BYTES ? max_len : SEGMENT_ZONE_BYTES);
+            memcpy(zone->min, min, zone->min_size);
+            memcpy(zone->max, max, zone->max_size);
+            if (max_len > SEGMENT_ZONE_BYTES) {
+                zone->flags |= SEGMENT_ZONE_MAX_TRUNCATED;
+            }
+        }
+    }
+    
+    zone->null_count = rows - present;
+    zone->distinct = zone_sketch_estimate(sketch);
+    if (zone->distinct > present) {
+        zone->distinct = present;
+    }
+}
+
+/**
+ * @brief Start a zone map that chunks are merged into
+ *
+ * @param zone The zone map, left with no values
+ */
+void zone_init(segment_zone_t* zone) {
+    memset(zone, 0, sizeof(*zone));
+    zone->flags = SEGMENT_ZONE_ASCENDING | SEGMENT_ZONE_DESCENDING;
+}
+
+/**
+ * @brief Merge the zone map of the next chunk of a column
+ *
+ * The distinct estimate is left alone; merge the sketches for that.
+ *
+ * @param type The column type
+ * @param into Statistics of the chunks so far, in row order
+ * @param from Statistics of the next chunk
+ */
+void zone_merge(retldb_type_t type, segment_zone_t* into, const segment_zone_t* from) {
+    into->null_count += from->null_count;
+    if (!(from->flags & SEGMENT_ZONE_BOUNDS)) {
+        return;
+    }
+    
+    uint32_t order = into->flags & from->flags &
+                     (SEGMENT_ZONE_ASCENDING | SEGMENT_ZONE_DESCENDING);
+    if (!(into->flags & SEGMENT_ZONE_BOUNDS)) {
+        into->flags = (from->flags & ~(uint32_t)(SEGMENT_ZONE_ASCENDING |
+                                                 SEGMENT_ZONE_DESCENDING)) | order;
+        into->min_size = from->min_size;
+        into->max_size = from->max_size;
+        memcpy(into->min, from->min, sizeof(into->min));
+        memcpy(into->max, from->max, sizeof(into->max));
+        return;
+    }
+    
+    // Sorted within each chunk and in order at the seams means sorted throughout
+    if ((order & SEGMENT_ZONE_ASCENDING) && !zone_before(type, into, from)) {
+        order &= ~(uint32_t)SEGMENT_ZONE_ASCENDING;
+    }
+    if ((order & SEGMENT_ZONE_DESCENDING) && !zone_before(type, from, into)) {
+        order &= ~(uint32_t)SEGMENT_ZONE_DESCENDING;
+    }
+    
+    if (compare_bound(type, from->min, from->min_size, into->min, into->min_size) < 0) {
+        into->min_size = from->min_size;
+        memcpy(into->min, from->min, sizeof(into->min));
+    }
+    uint32_t truncated = into->flags & SEGMENT_ZONE_MAX_TRUNCATED;
+    int c = compare_bound(type, from->max, from->max_size, into->max, into->max_size);
+    if (c > 0) {
+        into->max_size = from->max_size;
+        memcpy(into->max, from->max, sizeof(into->max));
+        truncated = from->flags & SEGMENT_ZONE_MAX_TRUNCATED;
+    } else if (c == 0) {
+        truncated |= from->flags & SEGMENT_ZONE_MAX_TRUNCATED;
+    }
+    into->flags = SEGMENT_ZONE_BOUNDS | order | truncated;
+}
+
+/**
+ * @brief Merge a sketch into another
+ *
+ * @param into The sketch to add to
+ * @param from The sketch to add
+ */
+void zone_sketch_merge(zone_sketch_t* into, const zone_sketch_t* from) {
+    for (size_t i = 0; i < from->count; i++) {
+        sketch_add(into, from->hashes[i]);
+    }
+}
+
+/**
+ * @brief Estimate the distinct values a sketch has seen
+ *
+ * @param sketch The sketch
+ * @return The estimate, exact below ZONE_SKETCH_SIZE
+ */
+uint64_t zone_sketch_estimate(const zone_sketch_t* sketch) {
+    if (sketch->count < ZONE_SKETCH_SIZE) {
+        return sketch->count;
+    }
+    
+    // The k-th smallest of n uniform hashes sits near k / n of the range
+    double range = 18446744073709551616.0;
+    double kth = (double)sketch->hashes[ZONE_SKETCH_SIZE - 1] + 1.0;
+    double estimate = (double)(ZONE_SKETCH_SIZE - 1) * range / kth;
+    return estimate > (double)ZONE_SKETCH_SIZE ? (uint64_t)estimate : ZONE_SKETCH_SIZE;
+}
+
+/**
+ * @brief Check whether a zone may hold a value in a range
+ *
+ * Bounds are inclusive and given like the values of a vector of the type:
+ * one fixed-width value, or the bytes of a STRING or BINARY value. Passing
+ * the same value as both bounds checks a point lookup.
+ *
+ * @param zone The zone map
+ * @param type The column type
+ * @param low Smallest value wanted, NULL for no lower bound
+ * @param low_size Bytes of low (ignored for fixed-width types)
+ * @param high Largest value wanted, NULL for no upper bound
+ * @param high_size Bytes of high (ignored for fixed-width types)
+ * @return 1 if a present value may be in the range, 0 if none is, -1 on
+ *         invalid arguments
+ */
+int segment_zone_may_match(const segment_zone_t* zone, retldb_type_t type, const void* low,
+                           size_t low_size, const void* high, size_t high_size) {
+    size_t width = segment_type_width(type);
+    if (!zone || (width == 0 && type != RETLDB_TYPE_STRING && type != RETLDB_TYPE_BINARY)) {
+        return -1;
+    }
+    if (!(zone->flags & SEGMENT_ZONE_BOUNDS)) {
+        return 0;
+    }
+    
+    if (width > 0) {
+        uint64_t min;
+        uint64_t max;
+        uint64_t from = 0;
+        uint64_t to = UINT64_MAX;
+        if (value_key(type, zone->min, &min) != 0 || value_key(type, zone->max, &max) != 0) {
+            return -1;
+        }
+        // Nothing compares equal to NaN, so a NaN bound matches nothing
+        if ((low && value_key(type, (const uint8_t*)low, &from) != 0) ||
+            (high && value_key(type, (const uint8_t*)high, &to) != 0)) {
+            return 0;
+        }
+        return from <= to && from <= max && to >= min;
+    }
+    
+    const uint8_t* from = (const uint8_t*)low;
+    const uint8_t* to = (const uint8_t*)high;
+    if (from && to && compare_bytes(from, low_size, to, high_size) > 0) {
+        return 0;
+    }
+    if (to && compare_bytes(to, high_size, zone->min, zone->min_size) < 0) {
+        return 0;
+    }
+    if (from) {
+        if (!(zone->flags & SEGMENT_ZONE_MAX_TRUNCATED)) {
+            return compare_bytes(from, low_size, zone->max, zone->max_size) <= 0;
+        }
+        // Past the prefix only if it differs within the prefix
+        size_t n = low_size < zone->max_size ? low_size : zone->max_size;
+        return !(n > 0 && memcmp(from, zone->max, n) > 0);
+    }
+    return 1;
+}
@@ -0,0 +1,76 @@
+/**
+ * @file zone.h
+ * @brief Internal zone map collection for rETL DB
+ *
+ * Zone maps are gathered by the segment writer for every chunk as it is
+ * encoded, and merged per column into statistics for the whole segment.
+ * Distinct counts come from a k-minimum-values sketch: the smallest
+ * ZONE_SKETCH_SIZE distinct hashes, which count exactly below that and
+ * merge across chunks by keeping the smallest of both.
+ */
+
+#ifndef RETLDB_ZONE_H
+#define RETLDB_ZONE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "retldb/storage.h"
+
+#define ZONE_SKETCH_SIZE 256            // Smallest hashes a distinct-count sketch keeps
+
+/**
+ * @brief Distinct-count sketch
+ */
+typedef struct {
+    uint64_t hashes[ZONE_SKETCH_SIZE];  // Smallest distinct hashes seen, ascending
+    size_t count;                       // Hashes held
+} zone_sketch_t;
+
+/**
+ * @brief Gather the zone map of a chunk
+ *
+ * @param type The column type
+ * @param values The values
+ * @param rows Number of values
+ * @param zone Filled with the statistics, the distinct estimate included
+ * @param sketch Filled with the chunk's distinct-count sketch
+ */
+void zone_collect(retldb_type_t type, const segment_vector_t* values, size_t rows,
+                  segment_zone_t* zone, zone_sketch_t* sketch);
+
+/**
+ * @brief Start a zone map that chunks are merged into
+ *
+ * @param zone The zone map, left with no values
+ */
+void zone_init(segment_zone_t* zone);
+
+/**
+ * @brief Merge the zone map of the next chunk of a column
+ *
+ * The distinct estimate is left alone; merge the sketches for that.
+ *
+ * @param type The column type
+ * @param into Statistics of the chunks so far, in row order
+ * @param from Statistics of the next chunk
+ */
+void zone_merge(retldb_type_t type, segment_zone_t* into, const segment_zone_t* from);
+
+/**
+ * @brief Merge a sketch into another
+ *
+ * @param into The sketch to add to
+ * @param from The sketch to add
+ */
+void zone_sketch_merge(zone_sketch_t* into, const zone_sketch_t* from);
+
+/**
+ * @brief Estimate the distinct values a sketch has seen
+ *
+ * @param sketch The sketch
+ * @return The estimate, exact below ZONE_SKETCH_SIZE
+ */
+uint64_t zone_sketch_estimate(const zone_sketch_t* sketch);
+
+#endif /* RETLDB_ZONE_H */
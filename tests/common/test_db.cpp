@@ -0,0 +1,356 @@
+#include <gtest/gtest.h>
+#include <stdio.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#ifdef _WIN32
+#include <direct.h>
+#define rmdir _rmdir
+#else
+#include <unistd.h>
+#endif
+#include "retldb.h"
+
+// Remove a database directory left by a test
+static void remove_db(const char* path) {
+    std::string base(path);
+    remove((base + "/LOCK").c_str());
+    remove((base + "/READERS").c_str());
+    remove((base + "/MANIFEST").c_str());
+    rmdir(path);
+}
+
+TEST(DbTest, OpenClose) {
+    const char* path = "test_db";
+    remove_db(path);
+    
+    retldb_db_t* db = NULL;
+    ASSERT_EQ(RETLDB_OK, retldb_db_open(path, &db));
+    ASSERT_NE(nullptr, db);
+    EXPECT_EQ(nullptr, retldb_db_buffer_pool(db));
+    EXPECT_EQ(RETLDB_OK, retldb_db_close(db));
+    
+    EXPECT_EQ(RETLDB_ERROR_INVALID_ARGUMENT, retldb_db_open(NULL, &db));
+    EXPECT_EQ(RETLDB_ERROR_INVALID_ARGUMENT, retldb_db_close(NULL));
+    
+    remove_db(path);
+}
+
+TEST(DbTest, OwnedBufferPool) {
+    const char* path = "test_db";
+    const char* filename = "test_db_owned_pool.dat";
+    remove_db(path);
+    remove(filename);
+    
+    retldb_db_t* db = NULL;
+    ASSERT_EQ(RETLDB_OK, retldb_db_open(path, &db));
+    
+    buffer_config_t config;
+    buffer_config_default(&config);
+    config.capacity = 16;
+    EXPECT_EQ(RETLDB_ERROR_INVALID_ARGUMENT, retldb_db_create_buffer_pool(db, NULL));
+    ASSERT_EQ(RETLDB_OK, retldb_db_create_buffer_pool(db, &config));
+    EXPECT_EQ(RETLDB_ERROR_ALREADY_EXISTS, retldb_db_create_buffer_pool(db, &config));
+    
+    void* pool = retldb_db_buffer_pool(db);
+    ASSERT_NE(nullptr, pool);
+    EXPECT_NE(0, buffer_pool_destroy(pool));
+    
+    void* buffer = buffer_pool_get(pool, filename, 0, BUFFER_ACCESS_NORMAL);
+    ASSERT_NE(nullptr, buffer);
+    memset(buffer_get_data(buffer), 'd', 4096);
+    ASSERT_EQ(0, buffer_mark_dirty(buffer));
+    ASSERT_EQ(0, buffer_unpin(buffer));
+    
+    // Closing the database writes the pool back and frees it
+    EXPECT_EQ(RETLDB_OK, retldb_db_close(db));
+    FILE* fp = fopen(filename, "rb");
+    ASSERT_NE(nullptr, fp);
+    char page[4096];
+    EXPECT_EQ(sizeof(page), fread(page, 1, sizeof(page), fp));
+    fclose(fp);
+    EXPECT_EQ('d', page[0]);
+    EXPECT_EQ('d', page[4095]);
+    
+    remove_db(path);
+    remove(filename);
+}
+
+TEST(DbTest, SharedBufferPool) {
+    remove_db("test_db_first");
+    remove_db("test_db_second");
+    
+    buffer_config_t config;
+    buffer_config_default(&config);
+    config.capacity = 16;
+    void* pool = buffer_pool_create(&config);
+    ASSERT_NE(nullptr, pool);
+    
+    retldb_db_t* first = NULL;
+    retldb_db_t* second = NULL;
+    ASSERT_EQ(RETLDB_OK, retldb_db_open("test_db_first", &first));
+    ASSERT_EQ(RETLDB_OK, retldb_db_open("test_db_second", &second));
+    EXPECT_EQ(RETLDB_ERROR_INVALID_ARGUMENT, retldb_db_attach_buffer_pool(first, NULL));
+    ASSERT_EQ(RETLDB_OK, retldb_db_attach_buffer_pool(first, pool));
+    ASSERT_EQ(RETLDB_OK, retldb_db_attach_buffer_pool(second, pool));
+    EXPECT_EQ(RETLDB_ERROR_ALREADY_EXISTS, retldb_db_attach_buffer_pool(second, pool));
+    EXPECT_EQ(pool, retldb_db_buffer_pool(first));
+    EXPECT_EQ(pool, retldb_db_buffer_pool(second));
+    
+    // The pool outlives the databases that share it
+    EXPECT_NE(0, buffer_pool_destroy(pool));
+    EXPECT_EQ(RETLDB_OK, retldb_db_close(first));
+    EXPECT_NE(0, buffer_pool_destroy(pool));
+    EXPECT_EQ(RETLDB_OK, retldb_db_close(second));
+    EXPECT_EQ(0, buffer_pool_destroy(pool));
+    
+    remove_db("test_db_first");
+    remove_db("test_db_second");
+}
+
+TEST(DbTest, WriterLease) {
+    const char* path = "test_db_lease";
+    remove_db(path);
+    
+    // Readers need an existing database
+    retldb_db_t* reader = NULL;
+    EXPECT_EQ(RETLDB_ERROR_NOT_FOUND, retldb_db_open_flags(path, RETLDB_OPEN_READ_ONLY, &reader));
+    
+    retldb_db_t* writer = NULL;
+    ASSERT_EQ(RETLDB_OK, retldb_db_open(path, &writer));
+    EXPECT_EQ(0, retldb_db_is_read_only(writer));
+    
+    // One writer at a time
+    retldb_db_t* other = NULL;
+    EXPECT_EQ(RETLDB_ERROR_BUSY, retldb_db_open(path, &other));
+    EXPECT_EQ(RETLDB_ERROR_BUSY, retldb_db_open_flags(path, RETLDB_OPEN_EXCLUSIVE, &other));
+    
+    // Readers share the directory with the writer and with each other
+    retldb_db_t* second_reader = NULL;
+    ASSERT_EQ(RETLDB_OK, retldb_db_open_flags(path, RETLDB_OPEN_READ_ONLY, &reader));
+    ASSERT_EQ(RETLDB_OK, retldb_db_open_flags(path, RETLDB_OPEN_READ_ONLY, &second_reader));
+    EXPECT_NE(0, retldb_db_is_read_only(reader));
+    
+    // The lease is free again once the writer closes
+    EXPECT_EQ(RETLDB_OK, retldb_db_close(writer));
+    ASSERT_EQ(RETLDB_OK, retldb_db_open(path, &writer));
+    EXPECT_EQ(RETLDB_OK, retldb_db_close(writer));
+    
+    // An exclusive open waits out the readers, and keeps new ones out
+    EXPECT_EQ(RETLDB_ERROR_BUSY, retldb_db_open_flags(path, RETLDB_OPEN_EXCLUSIVE, &other));
+    EXPECT_EQ(RETLDB_OK, retldb_db_close(reader));
+    EXPECT_EQ(RETLDB_OK, retldb_db_close(second_reader));
+    ASSERT_EQ(RETLDB_OK, retldb_db_open_flags(path, RETLDB_OPEN_EXCLUSIVE, &other));
+    EXPECT_EQ(RETLDB_ERROR_BUSY, retldb_db_open_flags(path, RETLDB_OPEN_READ_ONLY, &reader));
+    EXPECT_EQ(RETLDB_ERROR_BUSY, retldb_db_open(path, &writer));
+    EXPECT_EQ(RETLDB_OK, retldb_db_close(other));
+    
+    EXPECT_EQ(RETLDB_ERROR_INVALID_ARGUMENT,
+              retldb_db_open_flags(path, RETLDB_OPEN_READ_ONLY | RETLDB_OPEN_EXCLUSIVE, &other));
+    remove_db(path);
+}
+
+TEST(DbTest, WaitForLease) {
+    const char* path = "test_db_wait";
+    remove_db(path);
+    
+    retldb_db_t* writer = NULL;
+    ASSERT_EQ(RETLDB_OK, retldb_db_open(path, &writer));
+    
+    std::atomic<bool> acquired(false);
+    std::thread waiter([&]() {
+        retldb_db_t* next = NULL;
+        ASSERT_EQ(RETLDB_OK, retldb_db_open_flags(path, RETLDB_OPEN_WAIT, &next));
+        acquired = true;
+        EXPECT_EQ(RETLDB_OK, retldb_db_close(next));
+    });
+    
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    EXPECT_FALSE(acquired);
+    EXPECT_EQ(RETLDB_OK, retldb_db_close(writer));
+    waiter.join();
+    EXPECT_TRUE(acquired);
+    
+    remove_db(path);
+}
+
+TEST(DbTest, Catalog) {
+    const char* path = "test_db_catalog";
+    remove((std::string(path) + "/seg-1.dat").c_str());
+    remove_db(path);
+    
+    retldb_db_t* db = NULL;
+    ASSERT_EQ(RETLDB_OK, retldb_db_create(path, &db));
+    EXPECT_EQ(1u, retldb_db_generation(db));
+    EXPECT_EQ(0u, retldb_db_table_count(db));
+    
+    retldb_column_def_t columns[] = {
+        { "user_id", RETLDB_TYPE_INT64, 0 },
+        { "email", RETLDB_TYPE_STRING, 1 },
+    };
+    ASSERT_EQ(RETLDB_OK, retldb_db_create_table(db, "users", columns, 2));
+    EXPECT_EQ(RETLDB_ERROR_ALREADY_EXISTS, retldb_db_create_table(db, "users", columns, 2));
+    EXPECT_EQ(RETLDB_ERROR_INVALID_ARGUMENT, retldb_db_create_table(db, "empty", columns, 0));
+    
+    uint64_t first = 0, second = 0;
+    ASSERT_EQ(RETLDB_OK, retldb_db_add_segment(db, "users", "2024-01-01", "seg-1.dat", 10, 4096, &first));
+    ASSERT_EQ(RETLDB_OK, retldb_db_add_segment(db, "users", "2024-01-01", "seg-2.dat", 20, 8192, &second));
+    ASSERT_EQ(RETLDB_OK, retldb_db_add_segment(db, "users", "2024-01-02", "seg-3.dat", 30, 512, NULL));
+    EXPECT_NE(first, second);
+    EXPECT_EQ(RETLDB_ERROR_NOT_FOUND, retldb_db_add_segment(db, "missing", "p", "f", 1, 1, NULL));
+    ASSERT_EQ(RETLDB_OK, retldb_db_commit(db));
+    EXPECT_EQ(2u, retldb_db_generation(db));
+    
+    // Uncommitted changes are dropped on close
+    ASSERT_EQ(RETLDB_OK, retldb_db_create_table(db, "scratch", columns, 1));
+    EXPECT_EQ(RETLDB_OK, retldb_db_close(db));
+    EXPECT_EQ(RETLDB_ERROR_ALREADY_EXISTS, retldb_db_create(path, &db));
+    
+    retldb_db_t* reader = NULL;
+    ASSERT_EQ(RETLDB_OK, retldb_db_open_flags(path, RETLDB_OPEN_READ_ONLY, &reader));
+    EXPECT_EQ(2u, retldb_db_generation(reader));
+    ASSERT_EQ(1u, retldb_db_table_count(reader));
+    EXPECT_STREQ("users", retldb_db_table_name(reader, 0));
+    EXPECT_EQ(nullptr, retldb_db_table_name(reader, 1));
+    
+    const retldb_column_def_t* loaded = NULL;
+    size_t num_columns = 0;
+    ASSERT_EQ(RETLDB_OK, retldb_db_table_columns(reader, "users", &loaded, &num_columns));
+    ASSERT_EQ(2u, num_columns);
+    EXPECT_STREQ("email", loaded[1].name);
+    EXPECT_EQ(RETLDB_TYPE_STRING, loaded[1].type);
+    EXPECT_EQ(1, loaded[1].nullable);
+    EXPECT_EQ(RETLDB_ERROR_NOT_FOUND, retldb_db_table_columns(reader, "scratch", &loaded, &num_columns));
+    
+    size_t count = 0;
+    ASSERT_EQ(RETLDB_OK, retldb_db_partition_count(reader, "users", &count));
+    EXPECT_EQ(2u, count);
+    EXPECT_STREQ("2024-01-02", retldb_db_partition_name(reader, "users", 1));
+    ASSERT_EQ(RETLDB_OK, retldb_db_segment_count(reader, "users", "2024-01-01", &count));
+    EXPECT_EQ(2u, count);
+    
+    retldb_segment_info_t info;
+    ASSERT_EQ(RETLDB_OK, retldb_db_segment_info(reader, "users", "2024-01-01", 1, &info));
+    EXPECT_STREQ("seg-2.dat", info.filename);
+    EXPECT_EQ(second, info.id);
+    EXPECT_EQ(20u, info.rows);
+    EXPECT_EQ(8192u, info.bytes);
+    EXPECT_EQ(RETLDB_ERROR_NOT_FOUND, retldb_db_segment_info(reader, "users", "2024-01-01", 2, &info));
+    
+    // Segment files are opened on demand
+    FILE* fp = fopen((std::string(path) + "/seg-1.dat").c_str(), "wb");
+    ASSERT_NE(nullptr, fp);
+    fputs("segment one", fp);
+    fclose(fp);
+    void* file = NULL;
+    ASSERT_EQ(RETLDB_OK, retldb_db_segment_acquire(reader, "users", "2024-01-01", 0, &file));
+    char buf[16] = {0};
+    EXPECT_EQ(11, file_pread(file, buf, sizeof(buf), 0));
+    EXPECT_STREQ("segment one", buf);
+    EXPECT_EQ(RETLDB_OK, retldb_db_segment_release(reader, file));
+    EXPECT_EQ(RETLDB_ERROR_IO, retldb_db_segment_acquire(reader, "users", "2024-01-01", 1, &file));
+    
+    // Readers cannot change the catalog
+    EXPECT_EQ(RETLDB_ERROR_NOT_SUPPORTED, retldb_db_create_table(reader, "t", columns, 1));
+    EXPECT_EQ(RETLDB_ERROR_NOT_SUPPORTED, retldb_db_drop_partition(reader, "users", "2024-01-01"));
+    EXPECT_EQ(RETLDB_ERROR_NOT_SUPPORTED, retldb_db_commit(reader));
+    
+    // A dropped partition disappears for databases opened after the commit
+    ASSERT_EQ(RETLDB_OK, retldb_db_open(path, &db));
+    ASSERT_EQ(RETLDB_OK, retldb_db_drop_partition(db, "users", "2024-01-01"));
+    EXPECT_EQ(RETLDB_ERROR_NOT_FOUND, retldb_db_drop_partition(db, "users", "2024-01-01"));
+    ASSERT_EQ(RETLDB_OK, retldb_db_commit(db));
+    EXPECT_EQ(RETLDB_OK, retldb_db_close(db));
+    ASSERT_EQ(RETLDB_OK, retldb_db_segment_count(reader, "users", "2024-01-01", &count));
+    EXPECT_EQ(2u, count);
+    EXPECT_EQ(RETLDB_OK, retldb_db_close(reader));
+    
+    ASSERT_EQ(RETLDB_OK, retldb_db_open_flags(path, RETLDB_OPEN_READ_ONLY, &reader));
+    EXPECT_EQ(3u, retldb_db_generation(reader));
+    EXPECT_EQ(RETLDB_ERROR_NOT_FOUND, retldb_db_segment_count(reader, "users", "2024-01-01", &count));
+    ASSERT_EQ(RETLDB_OK, retldb_db_segment_info(reader, "users", "2024-01-02", 0, &info));
+    EXPECT_STREQ("seg-3.dat", info.filename);
+    EXPECT_EQ(RETLDB_OK, retldb_db_close(reader));
+    
+    remove((std::string(path) + "/seg-1.dat").c_str());
+    remove_db(path);
+}
+
+TEST(DbTest, CorruptCatalog) {
+    const char* path = "test_db_corrupt";
+    remove_db(path);
+    
+    retldb_db_t* db = NULL;
+    ASSERT_EQ(RETLDB_OK, retldb_db_create(path, &db));
+    retldb_column_def_t column = { "id", RETLDB_TYPE_INT64, 0 };
+    ASSERT_EQ(RETLDB_OK, retldb_db_create_table(db, "t", &column, 1));
+    ASSERT_EQ(RETLDB_OK, retldb_db_commit(db));
+    EXPECT_EQ(RETLDB_OK, retldb_db_close(db));
+    
+    // Flip one byte in the body
+    std::string manifest = std::string(path) + "/MANIFEST";
+    FILE* fp = fopen(manifest.c_str(), "r+b");
+    ASSERT_NE(nullptr, fp);
+    ASSERT_EQ(0, fseek(fp, -2, SEEK_END));
+    int byte = fgetc(fp);
+    ASSERT_EQ(0, fseek(fp, -2, SEEK_END));
+    fputc(byte ^ 0x20, fp);
+    fclose(fp);
+    
+    EXPECT_EQ(RETLDB_ERROR_CORRUPT_DATA, retldb_db_open_flags(path, RETLDB_OPEN_READ_ONLY, &db));
+    EXPECT_EQ(RETLDB_ERROR_CORRUPT_DATA, retldb_db_open(path, &db));
+    
+    // A truncated catalog is rejected too
+    fp = fopen(manifest.c_str(), "wb");
+    ASSERT_NE(nullptr, fp);
+    fputs("RETLDBMF", fp);
+    fclose(fp);
+    EXPECT_EQ(RETLDB_ERROR_CORRUPT_DATA, retldb_db_open_flags(path, RETLDB_OPEN_READ_ONLY, &db));
+    
+    remove_db(path);
+}
+
+TEST(DbTest, LargeCatalog) {
+    const char* path = "test_db_large";
+    remove_db(path);
+    
+    retldb_db_t* db = NULL;
+    ASSERT_EQ(RETLDB_OK, retldb_db_create(path, &db));
+    retldb_column_def_t column = { "id", RETLDB_TYPE_INT64, 0 };
+    ASSERT_EQ(RETLDB_OK, retldb_db_create_table(db, "events", &column, 1));
+    
+    // 100k segments that do not exist on disk: opening must not touch them
+    char partition[32];
+    char filename[32];
+    for (int p = 0; p < 100; p++) {
+        snprintf(partition, sizeof(partition), "p%03d", p);
+        for (int s = 0; s < 1000; s++) {
+            snprintf(filename, sizeof(filename), "events-%03d-%04d.seg", p, s);
+            ASSERT_EQ(RETLDB_OK, retldb_db_add_segment(db, "events", partition, filename, s, 4096, NULL));
+        }
+    }
+    ASSERT_EQ(RETLDB_OK, retldb_db_commit(db));
+    EXPECT_EQ(RETLDB_OK, retldb_db_close(db));
+    
+    auto start = std::chrono::steady_clock::now();
+    ASSERT_EQ(RETLDB_OK, retldb_db_open_flags(path, RETLDB_OPEN_READ_ONLY, &db));
+    auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - start);
+    RecordProperty("open_us", (int)elapsed.count());
+    
+    size_t count = 0;
+    ASSERT_EQ(RETLDB_OK, retldb_db_partition_count(db, "events", &count));
+    EXPECT_EQ(100u, count);
+    ASSERT_EQ(RETLDB_OK, retldb_db_segment_count(db, "events", "p042", &count));
+    EXPECT_EQ(1000u, count);
+    retldb_segment_info_t info;
+    ASSERT_EQ(RETLDB_OK, retldb_db_segment_info(db, "events", "p042", 999, &info));
+    EXPECT_STREQ("events-042-0999.seg", info.filename);
+    EXPECT_EQ(999u, info.rows);
+    EXPECT_EQ(RETLDB_OK, retldb_db_close(db));
+    
+    remove_db(path);
+}
+
@@ -10,6 +10,7 @@ TEST(ErrorTest, ErrorStringValid) {
     EXPECT_STREQ("Item not found", retldb_error_string(RETLDB_ERROR_NOT_FOUND));
     EXPECT_STREQ("Item already exists", retldb_error_string(RETLDB_ERROR_ALREADY_EXISTS));
     EXPECT_STREQ("Operation not supported", retldb_error_string(RETLDB_ERROR_NOT_SUPPORTED));
+    EXPECT_STREQ("Resource busy", retldb_error_string(RETLDB_ERROR_BUSY));
     EXPECT_STREQ("Unknown error", retldb_error_string(RETLDB_ERROR_UNKNOWN));
 }
 
@@ -2,8 +2,97 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <set>
+#include <string>
+#include <chrono>
+#include <thread>
+#include <vector>
 #include "retldb/storage.h"
 
+// Read a whole file into a string
+static std::string read_file(const char* filename) {
+    std::string contents;
+    FILE* fp = fopen(filename, "rb");
+    if (fp) {
+        char chunk[4096];
+        size_t n;
+        while ((n = fread(chunk, 1, sizeof(chunk), fp)) > 0) {
+            contents.append(chunk, n);
+        }
+        fclose(fp);
+    }
+    return contents;
+}
+
+// Fetch a page and release it straight away
+static bool touch(const char* filename, size_t offset,
+                  buffer_access_t hint = BUFFER_ACCESS_NORMAL) {
+    void* buffer = buffer_get_hint(filename, offset, hint);
+    return buffer && buffer_unpin(buffer) == 0;
+}
+
+// Write a file of whole pages, each filled with its page number plus one
+static void write_pages(const char* filename, int pages) {
+    FILE* fp = fopen(filename, "wb");
+    ASSERT_NE(nullptr, fp);
+    for (int p = 0; p < pages; p++) {
+        std::string page(4096, (char)(p + 1));
+        fwrite(page.data(), 1, page.size(), fp);
+    }
+    fclose(fp);
+}
+
+// Wait for a page to become resident without loading it
+static bool wait_resident(const char* filename, int page) {
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    uint64_t version;
+    while (!buffer_peek(filename, (size_t)page * 4096, &version)) {
+        if (std::chrono::steady_clock::now() > deadline) {
+            return false;
+        }
+        std::this_thread::yield();
+    }
+    return true;
+}
+
+#ifdef __linux__
+// Sum the resident bytes of the mappings holding the given addresses, and
+// whether all of them were mapped without reserving memory
+static size_t mapped_resident(const std::vector<void*>& addrs, bool* noreserve) {
+    std::set<unsigned long> seen;
+    size_t resident = 0;
+    bool holding = false;
+    *noreserve = true;
+    
+    FILE* fp = fopen("/proc/self/smaps", "r");
+    if (!fp) {
+        *noreserve = false;
+        return 0;
+    }
+    char line[512];
+    while (fgets(line, sizeof(line), fp)) {
+        unsigned long start, end;
+        size_t kb;
+        if (sscanf(line, "%lx-%lx ", &start, &end) == 2) {
+            // A new mapping; adjacent arenas may have been merged into one
+            holding = false;
+            for (void* addr : addrs) {
+                unsigned long a = (unsigned long)addr;
+                if (a >= start && a < end && seen.insert(start).second) {
+                    holding = true;
+                }
+            }
+        } else if (holding && sscanf(line, "Rss: %zu kB", &kb) == 1) {
+            resident += kb * 1024;
+        } else if (holding && strncmp(line, "VmFlags:", 8) == 0 && !strstr(line, " nr")) {
+            *noreserve = false;
+        }
+    }
+    fclose(fp);
+    return resident;
+}
+#endif
+
 // Test fixture
 class BufferTest : public ::testing::Test {
 protected:
@@ -56,6 +145,11 @@ TEST_F(BufferTest, BufferAllocation) {
     EXPECT_NE(nullptr, buffer4);
     EXPECT_NE(buffer1, buffer4);
     EXPECT_NE(buffer3, buffer4);
+    
+    EXPECT_EQ(0, buffer_unpin(buffer1));
+    EXPECT_EQ(0, buffer_unpin(buffer2));
+    EXPECT_EQ(0, buffer_unpin(buffer3));
+    EXPECT_EQ(0, buffer_unpin(buffer4));
 }
 
 // Test buffer eviction with a realistic LRU policy
@@ -67,6 +161,7 @@ TEST_F(BufferTest, BufferEviction) {
         sprintf(filename, "test%d.dat", i);
         buffers[i] = buffer_get(filename, 0);
         EXPECT_NE(nullptr, buffers[i]);
+        buffer_unpin(buffers[i]);
     }
     
     // The first 5 buffers should have been evicted due to LRU policy
@@ -74,8 +169,7 @@ TEST_F(BufferTest, BufferEviction) {
     for (int i = 0; i < 5; i++) {
         char filename[32];
         sprintf(filename, "test%d.dat", i);
-        void* buffer = buffer_get(filename, 0);
-        EXPECT_NE(nullptr, buffer);
+        EXPECT_TRUE(touch(filename, 0));
         
         // The buffer might be the same or different, depending on implementation
         // What matters is that it's a valid buffer
@@ -85,24 +179,21 @@ TEST_F(BufferTest, BufferEviction) {
     for (int i = 14; i >= 5; i--) {
         char filename[32];
         sprintf(filename, "test%d.dat", i);
-        void* buffer = buffer_get(filename, 0);
-        EXPECT_NE(nullptr, buffer);
+        EXPECT_TRUE(touch(filename, 0));
     }
     
     // Now add 5 more buffers, which should evict the first 5 again
     for (int i = 15; i < 20; i++) {
         char filename[32];
         sprintf(filename, "test%d.dat", i);
-        void* buffer = buffer_get(filename, 0);
-        EXPECT_NE(nullptr, buffer);
+        EXPECT_TRUE(touch(filename, 0));
     }
     
     // The buffers 5-14 should still be accessible
     for (int i = 5; i < 15; i++) {
         char filename[32];
         sprintf(filename, "test%d.dat", i);
-        void* buffer = buffer_get(filename, 0);
-        EXPECT_NE(nullptr, buffer);
+        EXPECT_TRUE(touch(filename, 0));
     }
 }
 
@@ -124,4 +215,1158 @@ TEST_F(BufferTest, DirtyBuffers) {
     // Test error handling
     EXPECT_NE(0, buffer_mark_dirty(nullptr));
     EXPECT_NE(0, buffer_flush(nullptr));
-} 
\ No newline at end of file
+    EXPECT_EQ(0, buffer_unpin(buffer));
+    
+    // Flushing wrote the page out
+    remove("test.dat");
+} 
+// Test lookups in a pool large enough to be split into shards
+TEST_F(BufferTest, ShardedLookup) {
+    EXPECT_EQ(0, buffer_cleanup());
+    ASSERT_EQ(0, buffer_init(4096, 4096));
+    
+    // Spread pages over several files so they land in different shards
+    void* buffers[8][64];
+    for (int f = 0; f < 8; f++) {
+        char filename[32];
+        sprintf(filename, "shard%d.dat", f);
+        for (int p = 0; p < 64; p++) {
+            buffers[f][p] = buffer_get(filename, (size_t)p * 4096);
+            ASSERT_NE(nullptr, buffers[f][p]);
+        }
+    }
+    
+    // Every page is still resident and resolves to the same buffer,
+    // including lookups through unaligned offsets
+    for (int f = 0; f < 8; f++) {
+        char filename[32];
+        sprintf(filename, "shard%d.dat", f);
+        for (int p = 0; p < 64; p++) {
+            void* buffer = buffer_get(filename, (size_t)p * 4096 + 17);
+            EXPECT_EQ(buffers[f][p], buffer);
+            buffer_unpin(buffer);
+            buffer_unpin(buffers[f][p]);
+        }
+    }
+}
+
+// Test invalid pool parameters
+TEST_F(BufferTest, InvalidParameters) {
+    EXPECT_EQ(0, buffer_cleanup());
+    EXPECT_NE(0, buffer_init(0, 4096));
+    EXPECT_NE(0, buffer_init(10, 0));
+    
+    // Restore the pool for TearDown
+    ASSERT_EQ(0, buffer_init(10, 4096));
+    EXPECT_EQ(nullptr, buffer_get(nullptr, 0));
+}
+
+// Test that pages are read from the backing file
+TEST_F(BufferTest, ReadsFromFile) {
+    const char* filename = "test_buffer_read.dat";
+    
+    // Two and a half pages, each page filled with its page number plus one
+    FILE* fp = fopen(filename, "wb");
+    ASSERT_NE(nullptr, fp);
+    for (int i = 0; i < 4096 * 2 + 2048; i++) {
+        fputc(i / 4096 + 1, fp);
+    }
+    fclose(fp);
+    
+    void* buffer = buffer_get(filename, 4096);
+    ASSERT_NE(nullptr, buffer);
+    ASSERT_EQ(4096u, buffer_get_size(buffer));
+    unsigned char* data = (unsigned char*)buffer_get_data(buffer);
+    ASSERT_NE(nullptr, data);
+    for (int i = 0; i < 4096; i++) {
+        ASSERT_EQ(2, data[i]);
+    }
+    EXPECT_EQ(0, buffer_unpin(buffer));
+    
+    // The partial last page is zero-filled past the end of the file
+    buffer = buffer_get(filename, 4096 * 2);
+    ASSERT_NE(nullptr, buffer);
+    data = (unsigned char*)buffer_get_data(buffer);
+    EXPECT_EQ(3, data[0]);
+    EXPECT_EQ(3, data[2047]);
+    EXPECT_EQ(0, data[2048]);
+    EXPECT_EQ(0, data[4095]);
+    EXPECT_EQ(0, buffer_unpin(buffer));
+    
+    EXPECT_EQ(nullptr, buffer_get_data(nullptr));
+    EXPECT_EQ(0u, buffer_get_size(nullptr));
+    
+    remove(filename);
+}
+
+// Test that flushing writes dirty pages to the file
+TEST_F(BufferTest, FlushWritesPages) {
+    const char* filename = "test_buffer_flush.dat";
+    remove(filename);
+    
+    // Dirty four adjacent pages and one detached page
+    for (int p = 0; p < 4; p++) {
+        void* buffer = buffer_get(filename, (size_t)p * 4096);
+        ASSERT_NE(nullptr, buffer);
+        memset(buffer_get_data(buffer), 'a' + p, 4096);
+        EXPECT_EQ(0, buffer_mark_dirty(buffer));
+        EXPECT_EQ(0, buffer_unpin(buffer));
+    }
+    void* buffer = buffer_get(filename, 6 * 4096);
+    ASSERT_NE(nullptr, buffer);
+    memset(buffer_get_data(buffer), 'z', 4096);
+    EXPECT_EQ(0, buffer_mark_dirty(buffer));
+    
+    EXPECT_EQ(0, buffer_flush_all());
+    
+    std::string contents = read_file(filename);
+    ASSERT_EQ(7u * 4096, contents.size());
+    for (int p = 0; p < 4; p++) {
+        EXPECT_EQ(std::string(4096, (char)('a' + p)), contents.substr((size_t)p * 4096, 4096));
+    }
+    EXPECT_EQ(std::string(2 * 4096, '\0'), contents.substr(4 * 4096, 2 * 4096));
+    EXPECT_EQ(std::string(4096, 'z'), contents.substr(6 * 4096, 4096));
+    
+    // A single-page flush overwrites in place
+    memset(buffer_get_data(buffer), 'y', 4096);
+    EXPECT_EQ(0, buffer_mark_dirty(buffer));
+    EXPECT_EQ(0, buffer_flush(buffer));
+    EXPECT_EQ(std::string(4096, 'y'), read_file(filename).substr(6 * 4096, 4096));
+    EXPECT_EQ(0, buffer_unpin(buffer));
+    
+    remove(filename);
+}
+
+// Test that a flush reports, rather than waits for, pages being modified
+TEST_F(BufferTest, FlushSkipsLatchedPages) {
+    const char* filename = "test_buffer_flush_latched.dat";
+    remove(filename);
+    
+    void* pages[2];
+    for (int p = 0; p < 2; p++) {
+        pages[p] = buffer_get(filename, (size_t)p * 4096);
+        ASSERT_NE(nullptr, pages[p]);
+        memset(buffer_get_data(pages[p]), 'a' + p, 4096);
+        ASSERT_EQ(0, buffer_mark_dirty(pages[p]));
+    }
+    
+    // The latched page stays dirty; the other one is written
+    ASSERT_EQ(0, buffer_latch_exclusive(pages[1]));
+    EXPECT_EQ(RETLDB_ERROR_BUSY, buffer_flush_all());
+    EXPECT_EQ(std::string(4096, 'a'), read_file(filename));
+    
+    buffer_stats_t stats;
+    ASSERT_EQ(0, buffer_stats_snapshot(&stats));
+    EXPECT_EQ(4096u, stats.dirty_bytes);
+    
+    ASSERT_EQ(0, buffer_unlatch_exclusive(pages[1]));
+    EXPECT_EQ(0, buffer_flush_all());
+    std::string contents = read_file(filename);
+    ASSERT_EQ(2u * 4096, contents.size());
+    EXPECT_EQ(std::string(4096, 'b'), contents.substr(4096));
+    ASSERT_EQ(0, buffer_stats_snapshot(&stats));
+    EXPECT_EQ(0u, stats.dirty_bytes);
+    
+    for (int p = 0; p < 2; p++) {
+        EXPECT_EQ(0, buffer_unpin(pages[p]));
+    }
+    
+    remove(filename);
+}
+
+// Test that flushing a buffer under its own exclusive latch does not hang
+TEST_F(BufferTest, FlushLatchedBuffer) {
+    const char* filename = "test_buffer_flush_self.dat";
+    remove(filename);
+    
+    void* buffer = buffer_get(filename, 0);
+    ASSERT_NE(nullptr, buffer);
+    ASSERT_EQ(0, buffer_latch_exclusive(buffer));
+    memset(buffer_get_data(buffer), 'x', 4096);
+    ASSERT_EQ(0, buffer_mark_dirty(buffer));
+    EXPECT_EQ(RETLDB_ERROR_BUSY, buffer_flush(buffer));
+    EXPECT_EQ("", read_file(filename));
+    
+    ASSERT_EQ(0, buffer_unlatch_exclusive(buffer));
+    EXPECT_EQ(0, buffer_flush(buffer));
+    EXPECT_EQ(std::string(4096, 'x'), read_file(filename));
+    EXPECT_EQ(0, buffer_unpin(buffer));
+    
+    remove(filename);
+}
+
+// Test that evicting a dirty page writes it back first
+TEST_F(BufferTest, EvictionWritesBack) {
+    const char* filename = "test_buffer_evict.dat";
+    remove(filename);
+    
+    void* buffer = buffer_get(filename, 0);
+    ASSERT_NE(nullptr, buffer);
+    memset(buffer_get_data(buffer), 'x', 4096);
+    EXPECT_EQ(0, buffer_mark_dirty(buffer));
+    EXPECT_EQ(0, buffer_unpin(buffer));
+    
+    // Push the dirty page out of the 10-page pool
+    for (int p = 1; p <= 10; p++) {
+        ASSERT_TRUE(touch(filename, (size_t)p * 4096));
+    }
+    EXPECT_EQ(std::string(4096, 'x'), read_file(filename));
+    
+    // Reloading the page reads the written data back
+    buffer = buffer_get(filename, 0);
+    ASSERT_NE(nullptr, buffer);
+    EXPECT_EQ('x', ((char*)buffer_get_data(buffer))[4095]);
+    EXPECT_EQ(0, buffer_unpin(buffer));
+    
+    remove(filename);
+}
+
+// Stamp a resident page in memory only; the stamp is lost if the page is
+// evicted and read back from the file
+static void stamp_page(const char* filename, int page) {
+    void* buffer = buffer_get(filename, (size_t)page * 4096);
+    ASSERT_NE(nullptr, buffer);
+    ((char*)buffer_get_data(buffer))[0] = 'H';
+    buffer_unpin(buffer);
+}
+
+static bool page_stamped(const char* filename, int page) {
+    void* buffer = buffer_get_hint(filename, (size_t)page * 4096, BUFFER_ACCESS_ONCE);
+    if (!buffer) {
+        return false;
+    }
+    bool stamped = ((char*)buffer_get_data(buffer))[0] == 'H';
+    buffer_unpin(buffer);
+    return stamped;
+}
+
+// Test configuration defaults and validation
+TEST_F(BufferTest, Configuration) {
+    buffer_config_t config;
+    buffer_config_default(&config);
+    EXPECT_EQ(BUFFER_POLICY_LRU, config.policy);
+    EXPECT_GT(config.capacity, 0u);
+    EXPECT_GT(config.buffer_size, 0u);
+    
+    EXPECT_EQ(0, buffer_cleanup());
+    EXPECT_NE(0, buffer_init_config(nullptr));
+    config.policy = (buffer_policy_t)42;
+    EXPECT_NE(0, buffer_init_config(&config));
+    
+    config.policy = BUFFER_POLICY_2Q;
+    ASSERT_EQ(0, buffer_init_config(&config));
+    EXPECT_NE(0, buffer_init_config(&config));
+}
+
+// Test that single-use pages do not displace hot pages under LRU
+TEST_F(BufferTest, AccessHintOnce) {
+    for (int p = 0; p < 5; p++) {
+        stamp_page("hot.dat", p);
+    }
+    
+    // Scan far more pages than the pool holds
+    for (int p = 0; p < 100; p++) {
+        ASSERT_TRUE(touch("scan.dat", (size_t)p * 4096, BUFFER_ACCESS_ONCE));
+    }
+    
+    for (int p = 0; p < 5; p++) {
+        EXPECT_TRUE(page_stamped("hot.dat", p)) << "page " << p;
+    }
+}
+
+// Test that 2Q keeps re-referenced pages through an unhinted scan
+TEST_F(BufferTest, TwoQueueScanResistance) {
+    EXPECT_EQ(0, buffer_cleanup());
+    buffer_config_t config;
+    buffer_config_default(&config);
+    config.capacity = 10;
+    config.buffer_size = 4096;
+    config.policy = BUFFER_POLICY_2Q;
+    config.num_shards = 1;
+    ASSERT_EQ(0, buffer_init_config(&config));
+    
+    // First touch lands the hot pages in probation; pushing them out and
+    // touching them again promotes them to the hot queue
+    for (int p = 0; p < 4; p++) {
+        ASSERT_TRUE(touch("hot.dat", (size_t)p * 4096));
+    }
+    for (int p = 0; p < 10; p++) {
+        ASSERT_TRUE(touch("warmup.dat", (size_t)p * 4096));
+    }
+    for (int p = 0; p < 4; p++) {
+        stamp_page("hot.dat", p);
+    }
+    
+    // A plain scan only cycles through probation
+    for (int p = 0; p < 100; p++) {
+        ASSERT_TRUE(touch("scan.dat", (size_t)p * 4096));
+    }
+    
+    for (int p = 0; p < 4; p++) {
+        EXPECT_TRUE(page_stamped("hot.dat", p)) << "page " << p;
+    }
+}
+
+// Test that plain LRU loses hot pages to the same scan
+TEST_F(BufferTest, LruScanEvictsHotPages) {
+    for (int p = 0; p < 4; p++) {
+        stamp_page("hot.dat", p);
+    }
+    for (int p = 0; p < 100; p++) {
+        ASSERT_TRUE(touch("scan.dat", (size_t)p * 4096));
+    }
+    
+    EXPECT_FALSE(page_stamped("hot.dat", 0));
+}
+
+// Test that frames come from a fixed, aligned arena
+TEST_F(BufferTest, FrameArena) {
+    std::set<void*> frames;
+    for (int p = 0; p < 100; p++) {
+        void* buffer = buffer_get("arena.dat", (size_t)p * 4096);
+        ASSERT_NE(nullptr, buffer);
+        void* data = buffer_get_data(buffer);
+        EXPECT_EQ(0u, (uintptr_t)data % 4096);
+        frames.insert(data);
+        buffer_unpin(buffer);
+    }
+    
+    // Evictions recycle the same 10 frames
+    EXPECT_EQ(10u, frames.size());
+}
+
+// Test huge-page and direct I/O configurations
+TEST_F(BufferTest, ArenaOptions) {
+    const char* filename = "test_buffer_direct.dat";
+    remove(filename);
+    
+    EXPECT_EQ(0, buffer_cleanup());
+    buffer_config_t config;
+    buffer_config_default(&config);
+    config.capacity = 16;
+    config.huge_pages = 1;
+    config.direct_io = 1;
+    
+    // Direct I/O needs block-sized buffers
+    config.buffer_size = 1000;
+    EXPECT_NE(0, buffer_init_config(&config));
+    
+    // Huge pages and O_DIRECT fall back quietly where unavailable
+    config.buffer_size = 4096;
+    ASSERT_EQ(0, buffer_init_config(&config));
+    
+    void* buffer = buffer_get(filename, 4096);
+    ASSERT_NE(nullptr, buffer);
+    memset(buffer_get_data(buffer), 'd', 4096);
+    EXPECT_EQ(0, buffer_mark_dirty(buffer));
+    EXPECT_EQ(0, buffer_flush_all());
+    EXPECT_EQ(0, buffer_unpin(buffer));
+    
+    std::string contents = read_file(filename);
+    ASSERT_EQ(2u * 4096, contents.size());
+    EXPECT_EQ(std::string(4096, 'd'), contents.substr(4096));
+    
+    remove(filename);
+}
+
+// Test that odd buffer sizes still get distinct, non-overlapping frames
+TEST_F(BufferTest, SmallFrames) {
+    EXPECT_EQ(0, buffer_cleanup());
+    ASSERT_EQ(0, buffer_init(4, 100));
+    
+    char* data[4];
+    for (int p = 0; p < 4; p++) {
+        void* buffer = buffer_get("small.dat", (size_t)p * 100);
+        ASSERT_NE(nullptr, buffer);
+        EXPECT_EQ(100u, buffer_get_size(buffer));
+        data[p] = (char*)buffer_get_data(buffer);
+        memset(data[p], 'a' + p, 100);
+    }
+    for (int p = 0; p < 4; p++) {
+        EXPECT_EQ('a' + p, data[p][0]);
+        EXPECT_EQ('a' + p, data[p][99]);
+    }
+}
+
+// Test that pinned pages are never chosen for eviction
+TEST_F(BufferTest, PinnedPagesStayResident) {
+    void* buffers[10];
+    for (int p = 0; p < 10; p++) {
+        buffers[p] = buffer_get("pinned.dat", (size_t)p * 4096);
+        ASSERT_NE(nullptr, buffers[p]);
+        ((char*)buffer_get_data(buffers[p]))[0] = 'P';
+    }
+    
+    // Every frame is pinned, so a miss has nowhere to go
+    EXPECT_EQ(nullptr, buffer_get("other.dat", 0));
+    
+    // Releasing one frame makes room for exactly that miss
+    EXPECT_EQ(0, buffer_unpin(buffers[3]));
+    void* other = buffer_get("other.dat", 0);
+    ASSERT_NE(nullptr, other);
+    EXPECT_EQ(buffers[3], other);
+    EXPECT_EQ(0, buffer_unpin(other));
+    
+    for (int p = 0; p < 10; p++) {
+        if (p != 3) {
+            EXPECT_EQ('P', ((char*)buffer_get_data(buffers[p]))[0]);
+            EXPECT_EQ(0, buffer_unpin(buffers[p]));
+        }
+    }
+}
+
+// Test pin counting and its error cases
+TEST_F(BufferTest, PinCounting) {
+    void* buffer = buffer_get("pins.dat", 0);
+    ASSERT_NE(nullptr, buffer);
+    EXPECT_EQ(0, buffer_pin(buffer));
+    EXPECT_EQ(0, buffer_unpin(buffer));
+    EXPECT_EQ(0, buffer_unpin(buffer));
+    
+    // The last pin is gone
+    EXPECT_NE(0, buffer_unpin(buffer));
+    EXPECT_NE(0, buffer_pin(buffer));
+    
+    EXPECT_NE(0, buffer_pin(nullptr));
+    EXPECT_NE(0, buffer_unpin(nullptr));
+    EXPECT_NE(0, buffer_latch_shared(nullptr));
+    EXPECT_NE(0, buffer_latch_exclusive(nullptr));
+}
+
+// Test optimistic reads through buffer_peek
+TEST_F(BufferTest, OptimisticReads) {
+    uint64_t version;
+    EXPECT_EQ(nullptr, buffer_peek("peek.dat", 0, &version));
+    
+    void* buffer = buffer_get("peek.dat", 0);
+    ASSERT_NE(nullptr, buffer);
+    EXPECT_EQ(0, buffer_unpin(buffer));
+    
+    void* peeked = buffer_peek("peek.dat", 100, &version);
+    ASSERT_EQ(buffer, peeked);
+    EXPECT_EQ(1, buffer_validate(peeked, version));
+    
+    // Shared latches leave optimistic readers alone
+    buffer = buffer_get("peek.dat", 0);
+    ASSERT_EQ(0, buffer_latch_shared(buffer));
+    EXPECT_EQ(1, buffer_validate(peeked, version));
+    ASSERT_EQ(0, buffer_unlatch_shared(buffer));
+    
+    // A writer invalidates the read, and the page cannot be peeked until it is done
+    ASSERT_EQ(0, buffer_latch_exclusive(buffer));
+    EXPECT_EQ(0, buffer_validate(peeked, version));
+    uint64_t during;
+    EXPECT_EQ(nullptr, buffer_peek("peek.dat", 0, &during));
+    ASSERT_EQ(0, buffer_unlatch_exclusive(buffer));
+    EXPECT_EQ(0, buffer_unpin(buffer));
+    
+    // Replacing the page in its frame invalidates the read as well
+    peeked = buffer_peek("peek.dat", 0, &version);
+    ASSERT_NE(nullptr, peeked);
+    for (int p = 0; p < 20; p++) {
+        ASSERT_TRUE(touch("evict.dat", (size_t)p * 4096));
+    }
+    EXPECT_EQ(0, buffer_validate(peeked, version));
+    EXPECT_EQ(0, buffer_validate(nullptr, 0));
+}
+
+// Test concurrent readers and writers on a small pool
+TEST_F(BufferTest, ConcurrentAccess) {
+    EXPECT_EQ(0, buffer_cleanup());
+    ASSERT_EQ(0, buffer_init(16, 4096));
+    
+    // Twice as many pages as frames, so pages are evicted, written back and
+    // reloaded while other threads wait on them
+    const char* filename = "test_buffer_concurrent.dat";
+    remove(filename);
+    
+    // Each thread bumps a counter at the start of every page it touches;
+    // the exclusive latch keeps the increments from being lost
+    const int threads = 8;
+    const int rounds = 2000;
+    const int pages = 32;
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; t++) {
+        workers.emplace_back([=]() {
+            for (int i = 0; i < rounds; i++) {
+                int page = (i * 7 + t) % pages;
+                void* buffer = buffer_get(filename, (size_t)page * 4096);
+                ASSERT_NE(nullptr, buffer);
+                ASSERT_EQ(0, buffer_latch_exclusive(buffer));
+                ++*(int*)buffer_get_data(buffer);
+                ASSERT_EQ(0, buffer_mark_dirty(buffer));
+                ASSERT_EQ(0, buffer_unlatch_exclusive(buffer));
+                ASSERT_EQ(0, buffer_unpin(buffer));
+            }
+        });
+    }
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+    
+    long total = 0;
+    for (int p = 0; p < pages; p++) {
+        void* buffer = buffer_get(filename, (size_t)p * 4096);
+        ASSERT_NE(nullptr, buffer);
+        ASSERT_EQ(0, buffer_latch_shared(buffer));
+        total += *(int*)buffer_get_data(buffer);
+        ASSERT_EQ(0, buffer_unlatch_shared(buffer));
+        ASSERT_EQ(0, buffer_unpin(buffer));
+    }
+    EXPECT_EQ((long)threads * rounds, total);
+    
+    remove(filename);
+}
+
+// Prefetch a whole file through the given backend and check every page
+static void check_prefetch(buffer_io_t backend) {
+    const char* filename = "test_buffer_prefetch.dat";
+    write_pages(filename, 64);
+    
+    buffer_config_t config;
+    buffer_config_default(&config);
+    config.capacity = 128;
+    config.io_backend = backend;
+    ASSERT_EQ(0, buffer_init_config(&config));
+    
+    ASSERT_EQ(0, buffer_prefetch(filename, 0, 64 * 4096));
+    for (int p = 0; p < 64; p++) {
+        EXPECT_TRUE(wait_resident(filename, p)) << "page " << p;
+    }
+    
+    // Every page was filled from the file
+    for (int p = 0; p < 64; p++) {
+        void* buffer = buffer_get(filename, (size_t)p * 4096);
+        ASSERT_NE(nullptr, buffer);
+        const char* data = (const char*)buffer_get_data(buffer);
+        EXPECT_EQ(p + 1, data[0]);
+        EXPECT_EQ(p + 1, data[4095]);
+        EXPECT_EQ(0, buffer_unpin(buffer));
+    }
+    
+    EXPECT_EQ(0, buffer_cleanup());
+    remove(filename);
+}
+
+// Test asynchronous prefetch
+TEST_F(BufferTest, Prefetch) {
+    EXPECT_EQ(0, buffer_cleanup());
+    check_prefetch(BUFFER_IO_AUTO);
+    check_prefetch(BUFFER_IO_THREADS);
+    
+    // Restore the pool for TearDown
+    ASSERT_EQ(0, buffer_init(10, 4096));
+}
+
+// Test prefetch argument handling and interaction with demand reads
+TEST_F(BufferTest, PrefetchEdgeCases) {
+    const char* filename = "test_buffer_prefetch_edge.dat";
+    write_pages(filename, 2);
+    
+    EXPECT_NE(0, buffer_prefetch(nullptr, 0, 4096));
+    EXPECT_EQ(0, buffer_prefetch(filename, 0, 0));
+    
+    // A demand read right behind a prefetch waits for it
+    ASSERT_EQ(0, buffer_prefetch(filename, 0, 4 * 4096));
+    void* buffer = buffer_get(filename, 4096);
+    ASSERT_NE(nullptr, buffer);
+    EXPECT_EQ(2, ((char*)buffer_get_data(buffer))[0]);
+    EXPECT_EQ(0, buffer_unpin(buffer));
+    
+    // Pages past the end of the file arrive zero-filled
+    ASSERT_TRUE(wait_resident(filename, 3));
+    buffer = buffer_get(filename, 3 * 4096);
+    ASSERT_NE(nullptr, buffer);
+    EXPECT_EQ(0, ((char*)buffer_get_data(buffer))[0]);
+    EXPECT_EQ(0, buffer_unpin(buffer));
+    
+    // Prefetching never writes back dirty pages to make room
+    for (int p = 0; p < 10; p++) {
+        buffer = buffer_get("dirty.dat", (size_t)p * 4096);
+        ASSERT_NE(nullptr, buffer);
+        EXPECT_EQ(0, buffer_mark_dirty(buffer));
+        EXPECT_EQ(0, buffer_unpin(buffer));
+    }
+    EXPECT_EQ(0, buffer_prefetch(filename, 0, 2 * 4096));
+    uint64_t version;
+    for (int p = 0; p < 10; p++) {
+        EXPECT_NE(nullptr, buffer_peek("dirty.dat", (size_t)p * 4096, &version));
+    }
+    
+    EXPECT_EQ(0, buffer_cleanup());
+    ASSERT_EQ(0, buffer_init(10, 4096));
+    remove("dirty.dat");
+    remove(filename);
+}
+
+// Test that sequential access triggers read-ahead
+TEST_F(BufferTest, SequentialReadahead) {
+    const char* filename = "test_buffer_readahead.dat";
+    write_pages(filename, 64);
+    
+    EXPECT_EQ(0, buffer_cleanup());
+    buffer_config_t config;
+    buffer_config_default(&config);
+    config.capacity = 64;
+    config.readahead = 8;
+    ASSERT_EQ(0, buffer_init_config(&config));
+    
+    uint64_t version;
+    for (int p = 0; p < 3; p++) {
+        ASSERT_TRUE(touch(filename, (size_t)p * 4096));
+    }
+    EXPECT_EQ(nullptr, buffer_peek(filename, 3 * 4096, &version));
+    
+    // The fourth sequential page starts the window
+    ASSERT_TRUE(touch(filename, 3 * 4096));
+    for (int p = 4; p < 12; p++) {
+        EXPECT_TRUE(wait_resident(filename, p)) << "page " << p;
+    }
+    EXPECT_EQ(nullptr, buffer_peek(filename, 12 * 4096, &version));
+    
+    // Reading into the window keeps it topped up
+    for (int p = 4; p < 9; p++) {
+        ASSERT_TRUE(touch(filename, (size_t)p * 4096));
+    }
+    EXPECT_TRUE(wait_resident(filename, 16));
+    
+    // Random access does not read ahead
+    ASSERT_TRUE(touch(filename, 40 * 4096));
+    ASSERT_TRUE(touch(filename, 30 * 4096));
+    EXPECT_EQ(nullptr, buffer_peek(filename, 41 * 4096, &version));
+    EXPECT_EQ(nullptr, buffer_peek(filename, 31 * 4096, &version));
+    
+    remove(filename);
+}
+
+// Count the pages of a file that hold the expected fill byte
+static int pages_written(const char* filename, int pages, char fill) {
+    std::string contents = read_file(filename);
+    int count = 0;
+    for (int p = 0; p < pages; p++) {
+        if (contents.size() >= (size_t)(p + 1) * 4096 && contents[(size_t)p * 4096] == fill) {
+            count++;
+        }
+    }
+    return count;
+}
+
+// Dirty pages of a file with a fill byte and release them
+static void dirty_pages(const char* filename, int pages, char fill) {
+    for (int p = 0; p < pages; p++) {
+        void* buffer = buffer_get(filename, (size_t)p * 4096);
+        ASSERT_NE(nullptr, buffer);
+        memset(buffer_get_data(buffer), fill, 4096);
+        ASSERT_EQ(0, buffer_mark_dirty(buffer));
+        ASSERT_EQ(0, buffer_unpin(buffer));
+    }
+}
+
+// Test cleaner configuration validation
+TEST_F(BufferTest, CleanerConfiguration) {
+    EXPECT_EQ(0, buffer_cleanup());
+    buffer_config_t config;
+    buffer_config_default(&config);
+    EXPECT_EQ(0u, config.dirty_high);
+    
+    config.dirty_high = 101;
+    EXPECT_NE(0, buffer_init_config(&config));
+    config.dirty_high = 20;
+    config.dirty_low = 20;
+    EXPECT_NE(0, buffer_init_config(&config));
+    
+    config.dirty_low = 5;
+    ASSERT_EQ(0, buffer_init_config(&config));
+    
+    // The default low watermark follows a high one of any size
+    EXPECT_EQ(0, buffer_cleanup());
+    buffer_config_default(&config);
+    config.dirty_high = 5;
+    ASSERT_EQ(0, buffer_init_config(&config));
+}
+
+// Test that the cleaner writes dirty pages down to the low watermark
+TEST_F(BufferTest, CleanerWatermarks) {
+    const char* filename = "test_buffer_cleaner.dat";
+    remove(filename);
+    
+    EXPECT_EQ(0, buffer_cleanup());
+    buffer_config_t config;
+    buffer_config_default(&config);
+    config.capacity = 100;
+    config.dirty_high = 20;
+    config.dirty_low = 5;
+    ASSERT_EQ(0, buffer_init_config(&config));
+    
+    // 30% dirty crosses the high watermark; the cleaner brings it to 5%
+    dirty_pages(filename, 30, 'c');
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while (pages_written(filename, 30, 'c') < 25 && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    EXPECT_GE(pages_written(filename, 30, 'c'), 25);
+    
+    remove(filename);
+}
+
+// Test that the cleaner honours its rate limit
+TEST_F(BufferTest, CleanerRateLimit) {
+    const char* filename = "test_buffer_cleaner_rate.dat";
+    remove(filename);
+    
+    EXPECT_EQ(0, buffer_cleanup());
+    buffer_config_t config;
+    buffer_config_default(&config);
+    config.capacity = 100;
+    config.dirty_high = 10;
+    config.dirty_low = 0;
+    config.clean_rate = 10;
+    ASSERT_EQ(0, buffer_init_config(&config));
+    
+    // At ten pages a second, a few hundred milliseconds cover only a few pages
+    dirty_pages(filename, 40, 'r');
+    std::this_thread::sleep_for(std::chrono::milliseconds(300));
+    int written = pages_written(filename, 40, 'r');
+    EXPECT_GT(written, 0);
+    EXPECT_LT(written, 20);
+    
+    // Cleanup still writes everything
+    EXPECT_EQ(0, buffer_cleanup());
+    EXPECT_EQ(40, pages_written(filename, 40, 'r'));
+    ASSERT_EQ(0, buffer_init(10, 4096));
+    
+    remove(filename);
+}
+
+// Test that background writes never lose concurrent updates
+TEST_F(BufferTest, CleanerConcurrentUpdates) {
+    const char* filename = "test_buffer_cleaner_concurrent.dat";
+    remove(filename);
+    
+    EXPECT_EQ(0, buffer_cleanup());
+    buffer_config_t config;
+    buffer_config_default(&config);
+    config.capacity = 16;
+    config.dirty_high = 10;
+    config.dirty_low = 0;
+    ASSERT_EQ(0, buffer_init_config(&config));
+    
+    const int threads = 4;
+    const int rounds = 2000;
+    const int pages = 32;
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; t++) {
+        workers.emplace_back([=]() {
+            for (int i = 0; i < rounds; i++) {
+                int page = (i * 5 + t) % pages;
+                void* buffer = buffer_get(filename, (size_t)page * 4096);
+                ASSERT_NE(nullptr, buffer);
+                ASSERT_EQ(0, buffer_latch_exclusive(buffer));
+                ++*(int*)buffer_get_data(buffer);
+                ASSERT_EQ(0, buffer_mark_dirty(buffer));
+                ASSERT_EQ(0, buffer_unlatch_exclusive(buffer));
+                ASSERT_EQ(0, buffer_unpin(buffer));
+            }
+        });
+    }
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+    
+    // Everything reaches the file, whoever wrote it
+    EXPECT_EQ(0, buffer_cleanup());
+    std::string contents = read_file(filename);
+    ASSERT_EQ((size_t)pages * 4096, contents.size());
+    long total = 0;
+    for (int p = 0; p < pages; p++) {
+        int value;
+        memcpy(&value, contents.data() + (size_t)p * 4096, sizeof(value));
+        total += value;
+    }
+    EXPECT_EQ((long)threads * rounds, total);
+    
+    ASSERT_EQ(0, buffer_init(10, 4096));
+    remove(filename);
+}
+
+// Test statistics counters
+TEST_F(BufferTest, Statistics) {
+    const char* filename = "test_buffer_stats.dat";
+    write_pages(filename, 12);
+    
+    buffer_stats_t stats;
+    EXPECT_NE(0, buffer_stats_snapshot(nullptr));
+    ASSERT_EQ(0, buffer_stats_snapshot(&stats));
+    EXPECT_EQ(0u, stats.hits);
+    EXPECT_EQ(0u, stats.misses);
+    EXPECT_EQ(10u, stats.capacity);
+    EXPECT_EQ(0u, stats.resident);
+    
+    // Twelve misses through ten frames evict two pages
+    for (int p = 0; p < 12; p++) {
+        ASSERT_TRUE(touch(filename, (size_t)p * 4096));
+    }
+    ASSERT_TRUE(touch(filename, 11 * 4096));
+    
+    void* buffer = buffer_get(filename, 11 * 4096);
+    ASSERT_NE(nullptr, buffer);
+    ASSERT_EQ(0, buffer_mark_dirty(buffer));
+    ASSERT_EQ(0, buffer_stats_snapshot(&stats));
+    EXPECT_EQ(4096u, stats.dirty_bytes);
+    ASSERT_EQ(0, buffer_flush(buffer));
+    ASSERT_EQ(0, buffer_unpin(buffer));
+    
+    ASSERT_EQ(0, buffer_stats_snapshot(&stats));
+    EXPECT_EQ(2u, stats.hits);
+    EXPECT_EQ(12u, stats.misses);
+    EXPECT_EQ(2u, stats.evictions);
+    EXPECT_EQ(12u * 4096, stats.read_bytes);
+    EXPECT_EQ(1u, stats.dirty_writes);
+    EXPECT_EQ(4096u, stats.write_bytes);
+    EXPECT_EQ(0u, stats.pin_waits);
+    EXPECT_EQ(10u, stats.resident);
+    EXPECT_EQ(10u * 4096, stats.memory_budget);
+    EXPECT_EQ(10u * 4096, stats.memory_used);
+    EXPECT_EQ(0u, stats.dirty_bytes);
+    
+    // Every miss lands in exactly one latency bucket
+    uint64_t timed = 0;
+    for (int b = 0; b < BUFFER_LATENCY_BUCKETS; b++) {
+        timed += stats.miss_latency[b];
+    }
+    EXPECT_EQ(stats.misses, timed);
+    
+    ASSERT_EQ(0, buffer_stats_reset());
+    ASSERT_EQ(0, buffer_stats_snapshot(&stats));
+    EXPECT_EQ(0u, stats.hits);
+    EXPECT_EQ(0u, stats.misses);
+    EXPECT_EQ(0u, stats.write_bytes);
+    EXPECT_EQ(10u, stats.resident);
+    
+    EXPECT_EQ(0, buffer_cleanup());
+    EXPECT_NE(0, buffer_stats_snapshot(&stats));
+    EXPECT_NE(0, buffer_stats_reset());
+    ASSERT_EQ(0, buffer_init(10, 4096));
+    
+    remove(filename);
+}
+
+// Test that misses which fail still count, as misses and as errors
+TEST_F(BufferTest, StatisticsCountFailures) {
+    const char* filename = "test_buffer_stats_failed.dat";
+    write_pages(filename, 11);
+    
+    // With every frame pinned the eleventh page has nowhere to go
+    void* buffers[10];
+    for (int p = 0; p < 10; p++) {
+        buffers[p] = buffer_get(filename, (size_t)p * 4096);
+        ASSERT_NE(nullptr, buffers[p]);
+    }
+    EXPECT_EQ(nullptr, buffer_get(filename, 10 * 4096));
+    
+    buffer_stats_t stats;
+    ASSERT_EQ(0, buffer_stats_snapshot(&stats));
+    EXPECT_EQ(11u, stats.misses);
+    EXPECT_EQ(1u, stats.errors);
+    uint64_t timed = 0;
+    for (int b = 0; b < BUFFER_LATENCY_BUCKETS; b++) {
+        timed += stats.miss_latency[b];
+    }
+    EXPECT_EQ(stats.misses, timed);
+    
+    for (int p = 0; p < 10; p++) {
+        EXPECT_EQ(0, buffer_unpin(buffers[p]));
+    }
+    ASSERT_EQ(0, buffer_stats_reset());
+    ASSERT_EQ(0, buffer_stats_snapshot(&stats));
+    EXPECT_EQ(0u, stats.errors);
+    
+    remove(filename);
+}
+
+// Test that lookups waiting on another thread's load are counted
+TEST_F(BufferTest, StatisticsUnderConcurrency) {
+    const char* filename = "test_buffer_stats_concurrent.dat";
+    write_pages(filename, 4);
+    
+    const int threads = 8;
+    const int rounds = 500;
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; t++) {
+        workers.emplace_back([=]() {
+            for (int i = 0; i < rounds; i++) {
+                ASSERT_TRUE(touch(filename, (size_t)((i + t) % 4) * 4096));
+            }
+        });
+    }
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+    
+    buffer_stats_t stats;
+    ASSERT_EQ(0, buffer_stats_snapshot(&stats));
+    EXPECT_EQ(4u, stats.misses);
+    EXPECT_EQ((uint64_t)threads * rounds, stats.hits + stats.misses);
+    EXPECT_EQ(0u, stats.evictions);
+    
+    remove(filename);
+}
+
+// Test size class configuration
+TEST_F(BufferTest, SizeClassConfiguration) {
+    EXPECT_EQ(0, buffer_cleanup());
+    buffer_config_t config;
+    buffer_config_default(&config);
+    config.capacity = 64;
+    
+    // Listed twice
+    config.page_classes[0] = 65536;
+    config.page_classes[1] = 65536;
+    EXPECT_NE(0, buffer_init_config(&config));
+    
+    // Larger than the whole budget
+    config.page_classes[1] = 1024 * 1024;
+    EXPECT_NE(0, buffer_init_config(&config));
+    
+    // Direct I/O needs whole blocks in every class
+    config.page_classes[1] = 1000;
+    config.direct_io = 1;
+    EXPECT_NE(0, buffer_init_config(&config));
+    
+    config.direct_io = 0;
+    ASSERT_EQ(0, buffer_init_config(&config));
+    
+    // Only configured sizes, and only before the file is used
+    EXPECT_NE(0, buffer_set_page_size("test_buffer_classes.dat", 8192));
+    EXPECT_EQ(0, buffer_set_page_size("test_buffer_classes.dat", 1000));
+    EXPECT_EQ(0, buffer_set_page_size("test_buffer_classes.dat", 65536));
+    ASSERT_TRUE(touch("test_buffer_classes.dat", 0));
+    EXPECT_EQ(0, buffer_set_page_size("test_buffer_classes.dat", 65536));
+    EXPECT_NE(0, buffer_set_page_size("test_buffer_classes.dat", 4096));
+    
+    remove("test_buffer_classes.dat");
+}
+
+// Test pages of different sizes sharing one budget
+TEST_F(BufferTest, SizeClasses) {
+    const char* index_file = "test_buffer_index.dat";
+    const char* chunk_file = "test_buffer_chunks.dat";
+    remove(index_file);
+    
+    // Four 64 KiB chunks, each filled with its number plus one
+    FILE* fp = fopen(chunk_file, "wb");
+    ASSERT_NE(nullptr, fp);
+    for (int c = 0; c < 4; c++) {
+        std::string chunk(65536, (char)(c + 1));
+        fwrite(chunk.data(), 1, chunk.size(), fp);
+    }
+    fclose(fp);
+    
+    EXPECT_EQ(0, buffer_cleanup());
+    buffer_config_t config;
+    buffer_config_default(&config);
+    config.capacity = 64;
+    config.num_shards = 1;
+    config.page_classes[0] = 65536;
+    ASSERT_EQ(0, buffer_init_config(&config));
+    ASSERT_EQ(0, buffer_set_page_size(chunk_file, 65536));
+    
+    // Index pages fill the whole budget
+    for (int p = 0; p < 64; p++) {
+        void* buffer = buffer_get(index_file, (size_t)p * 4096);
+        ASSERT_NE(nullptr, buffer);
+        EXPECT_EQ(4096u, buffer_get_size(buffer));
+        memset(buffer_get_data(buffer), 'i', 4096);
+        ASSERT_EQ(0, buffer_mark_dirty(buffer));
+        ASSERT_EQ(0, buffer_unpin(buffer));
+    }
+    
+    // A chunk is one frame, cut at its own page size, and displaces
+    // sixteen index pages
+    void* chunk = buffer_get(chunk_file, 65536 + 100);
+    ASSERT_NE(nullptr, chunk);
+    EXPECT_EQ(65536u, buffer_get_size(chunk));
+    EXPECT_EQ(2, ((char*)buffer_get_data(chunk))[0]);
+    EXPECT_EQ(2, ((char*)buffer_get_data(chunk))[65535]);
+    
+    buffer_stats_t stats;
+    ASSERT_EQ(0, buffer_stats_snapshot(&stats));
+    EXPECT_EQ(49u, stats.resident);
+    EXPECT_EQ(16u, stats.evictions);
+    EXPECT_EQ(64u * 4096, stats.memory_used);
+    EXPECT_EQ(64u * 4096, stats.memory_budget);
+    
+    // Dirty chunks go back to their own offsets
+    memset(buffer_get_data(chunk), 'c', 65536);
+    ASSERT_EQ(0, buffer_mark_dirty(chunk));
+    ASSERT_EQ(0, buffer_unpin(chunk));
+    
+    // The remaining chunks push out every index page
+    for (int c = 0; c < 4; c++) {
+        ASSERT_TRUE(touch(chunk_file, (size_t)c * 65536));
+    }
+    ASSERT_EQ(0, buffer_stats_snapshot(&stats));
+    EXPECT_EQ(4u, stats.resident);
+    EXPECT_EQ(64u * 4096, stats.memory_used);
+    EXPECT_EQ(64u * 4096, stats.write_bytes);
+    
+    // And index pages can take the memory back
+    ASSERT_TRUE(touch(index_file, 0));
+    ASSERT_EQ(0, buffer_stats_snapshot(&stats));
+    EXPECT_EQ(4u, stats.resident);
+    EXPECT_EQ(49u * 4096, stats.memory_used);
+    
+    EXPECT_EQ(0, buffer_cleanup());
+    std::string contents = read_file(chunk_file);
+    ASSERT_EQ(4u * 65536, contents.size());
+    EXPECT_EQ(std::string(65536, 1), contents.substr(0, 65536));
+    EXPECT_EQ(std::string(65536, 'c'), contents.substr(65536, 65536));
+    EXPECT_EQ(std::string(65536, 3), contents.substr(2 * 65536, 65536));
+    EXPECT_EQ(std::string(64 * 4096, 'i'), read_file(index_file));
+    ASSERT_EQ(0, buffer_init(10, 4096));
+    
+    remove(index_file);
+    remove(chunk_file);
+}
+
+#ifdef __linux__
+// Test that several size classes together stay within one memory budget
+TEST_F(BufferTest, SizeClassesShareMemory) {
+    const char* files[3] = { "test_buffer_share_4k.dat", "test_buffer_share_16k.dat",
+                             "test_buffer_share_64k.dat" };
+    const size_t sizes[3] = { 4096, 16384, 65536 };
+    
+    EXPECT_EQ(0, buffer_cleanup());
+    buffer_config_t config;
+    buffer_config_default(&config);
+    config.capacity = 64;
+    config.num_shards = 1;
+    config.page_classes[0] = 16384;
+    config.page_classes[1] = 65536;
+    ASSERT_EQ(0, buffer_init_config(&config));
+    for (int c = 1; c < 3; c++) {
+        ASSERT_EQ(0, buffer_set_page_size(files[c], sizes[c]));
+    }
+    
+    // Each class in turn takes the whole budget, twice over
+    std::vector<void*> frames;
+    for (int round = 0; round < 2; round++) {
+        for (int c = 0; c < 3; c++) {
+            for (size_t p = 0; p < 64 * 4096 / sizes[c]; p++) {
+                void* buffer = buffer_get(files[c], p * sizes[c]);
+                ASSERT_NE(nullptr, buffer);
+                frames.push_back(buffer_get_data(buffer));
+                ASSERT_EQ(0, buffer_unpin(buffer));
+            }
+        }
+    }
+    
+    // The arenas reserve no memory, and only the budget is ever backed
+    bool noreserve;
+    size_t resident = mapped_resident(frames, &noreserve);
+    EXPECT_TRUE(noreserve);
+    EXPECT_GT(resident, 0u);
+    EXPECT_LE(resident, 64u * 4096);
+    
+    EXPECT_EQ(0, buffer_cleanup());
+    ASSERT_EQ(0, buffer_init(10, 4096));
+    
+    for (int c = 0; c < 3; c++) {
+        remove(files[c]);
+    }
+}
+#endif
+
+// Test that memory handed to another size class fails optimistic readers
+TEST_F(BufferTest, SizeClassEvictionInvalidatesPeek) {
+    const char* small_file = "test_buffer_peek_small.dat";
+    const char* large_file = "test_buffer_peek_large.dat";
+    write_pages(small_file, 1);
+    write_pages(large_file, 2);
+    
+    EXPECT_EQ(0, buffer_cleanup());
+    buffer_config_t config;
+    buffer_config_default(&config);
+    config.capacity = 2;
+    config.num_shards = 1;
+    config.page_classes[0] = 8192;
+    ASSERT_EQ(0, buffer_init_config(&config));
+    ASSERT_EQ(0, buffer_set_page_size(large_file, 8192));
+    
+    ASSERT_TRUE(touch(small_file, 0));
+    uint64_t version;
+    void* peeked = buffer_peek(small_file, 0, &version);
+    ASSERT_NE(nullptr, peeked);
+    EXPECT_EQ(1, buffer_validate(peeked, version));
+    
+    // The large page takes the whole budget, releasing the small frame
+    ASSERT_TRUE(touch(large_file, 0));
+    uint64_t after;
+    EXPECT_EQ(nullptr, buffer_peek(small_file, 0, &after));
+    EXPECT_EQ(0, buffer_validate(peeked, version));
+    
+    EXPECT_EQ(0, buffer_cleanup());
+    ASSERT_EQ(0, buffer_init(10, 4096));
+    
+    remove(small_file);
+    remove(large_file);
+}
+
+// Test that separate pools never evict each other's pages
+TEST_F(BufferTest, IndependentPools) {
+    const char* hot_file = "test_buffer_pool_hot.dat";
+    const char* bulk_file = "test_buffer_pool_bulk.dat";
+    write_pages(hot_file, 8);
+    
+    buffer_config_t config;
+    buffer_config_default(&config);
+    config.capacity = 16;
+    void* serving = buffer_pool_create(&config);
+    void* refresh = buffer_pool_create(&config);
+    ASSERT_NE(nullptr, serving);
+    ASSERT_NE(nullptr, refresh);
+    
+    for (int p = 0; p < 8; p++) {
+        void* buffer = buffer_pool_get(serving, hot_file, (size_t)p * 4096, BUFFER_ACCESS_NORMAL);
+        ASSERT_NE(nullptr, buffer);
+        EXPECT_EQ(p + 1, ((char*)buffer_get_data(buffer))[0]);
+        ASSERT_EQ(0, buffer_unpin(buffer));
+    }
+    
+    // A bulk refresh streams far more pages than either pool holds
+    for (int p = 0; p < 200; p++) {
+        void* buffer = buffer_pool_get(refresh, bulk_file, (size_t)p * 4096, BUFFER_ACCESS_NORMAL);
+        ASSERT_NE(nullptr, buffer);
+        memset(buffer_get_data(buffer), 'b', 4096);
+        ASSERT_EQ(0, buffer_mark_dirty(buffer));
+        ASSERT_EQ(0, buffer_unpin(buffer));
+    }
+    
+    uint64_t version;
+    for (int p = 0; p < 8; p++) {
+        EXPECT_NE(nullptr, buffer_pool_peek(serving, hot_file, (size_t)p * 4096, &version));
+        EXPECT_EQ(nullptr, buffer_peek(hot_file, (size_t)p * 4096, &version));
+    }
+    
+    buffer_stats_t stats;
+    ASSERT_EQ(0, buffer_pool_stats_snapshot(serving, &stats));
+    EXPECT_EQ(0u, stats.evictions);
+    EXPECT_EQ(8u, stats.resident);
+    ASSERT_EQ(0, buffer_pool_stats_snapshot(refresh, &stats));
+    EXPECT_EQ(184u, stats.evictions);
+    ASSERT_EQ(0, buffer_stats_snapshot(&stats));
+    EXPECT_EQ(0u, stats.misses);
+    
+    // Attached pools survive destruction attempts
+    ASSERT_EQ(0, buffer_pool_attach(refresh));
+    EXPECT_NE(0, buffer_pool_destroy(refresh));
+    ASSERT_EQ(0, buffer_pool_detach(refresh));
+    EXPECT_NE(0, buffer_pool_detach(refresh));
+    
+    EXPECT_EQ(0, buffer_pool_destroy(serving));
+    EXPECT_EQ(0, buffer_pool_destroy(refresh));
+    EXPECT_EQ(std::string(200 * 4096, 'b'), read_file(bulk_file));
+    
+    remove(hot_file);
+    remove(bulk_file);
+}
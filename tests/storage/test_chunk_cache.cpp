@@ -0,0 +1,197 @@
+#include <gtest/gtest.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <thread>
+#include <vector>
+#include "retldb/storage.h"
+
+// Test fixture
+class ChunkCacheTest : public ::testing::Test {
+protected:
+    static const size_t rows = 4096;
+    static const size_t row_groups = 4;
+    const char* filename = "test_chunk_cache.seg";
+    std::vector<int64_t> values;
+
+    void SetUp() override {
+        file_init();
+
+        // One LZ4-compressed, delta-encoded column and one plain column
+        values.resize(rows);
+        for (size_t i = 0; i < rows; i++) {
+            values[i] = (int64_t)(i * 3 + (i % 7));
+        }
+        segment_column_t columns[] = {
+            {"packed", RETLDB_TYPE_INT64, 0},
+            {"plain", RETLDB_TYPE_INT64, 0},
+        };
+        void* writer = segment_writer_create(filename, columns, 2, 0);
+        ASSERT_NE(nullptr, writer);
+        ASSERT_EQ(0, segment_writer_set_compression(writer, 0, SEGMENT_COMPRESSION_LZ4));
+        ASSERT_EQ(0, segment_writer_set_encoding(writer, 1, SEGMENT_ENCODING_PLAIN));
+        segment_vector_t vectors[] = {
+            {values.data(), nullptr, nullptr},
+            {values.data(), nullptr, nullptr},
+        };
+        for (size_t g = 0; g < row_groups; g++) {
+            ASSERT_EQ(0, segment_writer_append(writer, vectors, rows));
+        }
+        ASSERT_EQ(0, segment_writer_finish(writer, nullptr));
+    }
+
+    void TearDown() override {
+        remove(filename);
+    }
+
+    void expect_values(const segment_vector_t& vector) {
+        EXPECT_EQ(0, memcmp(values.data(), vector.values, rows * sizeof(int64_t)));
+    }
+};
+
+// Test that a hot chunk is read and decoded only once
+TEST_F(ChunkCacheTest, HitsAndMisses) {
+    void* segment = segment_open(filename);
+    ASSERT_NE(nullptr, segment);
+    void* cache = chunk_cache_create(0);
+    ASSERT_NE(nullptr, cache);
+
+    for (int n = 0; n < 10; n++) {
+        for (size_t c = 0; c < 2; c++) {
+            segment_vector_t vector;
+            const void* chunk = chunk_cache_acquire(cache, segment, 1, c, &vector);
+            ASSERT_NE(nullptr, chunk);
+            expect_values(vector);
+            EXPECT_EQ(0, chunk_cache_release(cache, chunk));
+        }
+    }
+
+    segment_stats_t io;
+    ASSERT_EQ(0, segment_stats(segment, &io));
+    EXPECT_EQ(2u, io.chunks_read);
+
+    chunk_cache_stats_t stats;
+    ASSERT_EQ(0, chunk_cache_stats(cache, &stats));
+    EXPECT_EQ(18u, stats.hits);
+    EXPECT_EQ(2u, stats.misses);
+    EXPECT_EQ(2u, stats.entries);
+    EXPECT_EQ(0u, stats.pinned);
+    EXPECT_GE(stats.bytes, 2 * rows * sizeof(int64_t));
+
+    // A second handle on the same file shares the cached chunks
+    void* again = segment_open(filename);
+    ASSERT_NE(nullptr, again);
+    EXPECT_EQ(segment_fingerprint(segment), segment_fingerprint(again));
+    segment_vector_t vector;
+    const void* chunk = chunk_cache_acquire(cache, again, 1, 0, &vector);
+    ASSERT_NE(nullptr, chunk);
+    EXPECT_EQ(0, chunk_cache_release(cache, chunk));
+    ASSERT_EQ(0, segment_stats(again, &io));
+    EXPECT_EQ(0u, io.chunks_read);
+
+    EXPECT_EQ(nullptr, chunk_cache_acquire(cache, segment, row_groups, 0, &vector));
+    EXPECT_EQ(0, chunk_cache_destroy(cache));
+    EXPECT_EQ(0, segment_close(again));
+    EXPECT_EQ(0, segment_close(segment));
+}
+
+// Test that idle chunks are dropped least recently used first and pinned ones are kept
+TEST_F(ChunkCacheTest, Eviction) {
+    void* segment = segment_open(filename);
+    ASSERT_NE(nullptr, segment);
+
+    // Room for two decoded chunks, not three
+    size_t chunk_bytes = rows * sizeof(int64_t);
+    void* cache = chunk_cache_create(chunk_bytes * 5 / 2);
+    ASSERT_NE(nullptr, cache);
+
+    segment_vector_t vector;
+    const void* pinned = chunk_cache_acquire(cache, segment, 0, 0, &vector);
+    ASSERT_NE(nullptr, pinned);
+    for (size_t g = 1; g < row_groups; g++) {
+        const void* chunk = chunk_cache_acquire(cache, segment, g, 0, &vector);
+        ASSERT_NE(nullptr, chunk);
+        expect_values(vector);
+        EXPECT_EQ(0, chunk_cache_release(cache, chunk));
+    }
+
+    chunk_cache_stats_t stats;
+    ASSERT_EQ(0, chunk_cache_stats(cache, &stats));
+    EXPECT_EQ(2u, stats.entries);
+    EXPECT_EQ(2u, stats.evictions);
+    EXPECT_EQ(1u, stats.pinned);
+    EXPECT_LE(stats.bytes, stats.capacity);
+    EXPECT_NE(0, chunk_cache_destroy(cache));
+
+    // The pinned chunk survived; the most recent idle one too
+    const void* chunk = chunk_cache_acquire(cache, segment, 3, 0, &vector);
+    ASSERT_NE(nullptr, chunk);
+    EXPECT_EQ(0, chunk_cache_release(cache, chunk));
+    ASSERT_EQ(0, chunk_cache_stats(cache, &stats));
+    EXPECT_EQ(1u, stats.hits);
+
+    EXPECT_EQ(0, chunk_cache_release(cache, pinned));
+    EXPECT_NE(0, chunk_cache_release(cache, pinned));
+    EXPECT_EQ(0, chunk_cache_set_capacity(cache, 0));
+    ASSERT_EQ(0, chunk_cache_stats(cache, &stats));
+    EXPECT_EQ(0u, stats.entries);
+    EXPECT_EQ(0u, stats.bytes);
+
+    // A stale handle to a freed chunk is refused without being read
+    EXPECT_NE(0, chunk_cache_release(cache, pinned));
+
+    EXPECT_EQ(0, chunk_cache_destroy(cache));
+    EXPECT_EQ(0, segment_close(segment));
+}
+
+// Test concurrent acquisitions from several threads
+TEST_F(ChunkCacheTest, Concurrent) {
+    void* segment = segment_open(filename);
+    ASSERT_NE(nullptr, segment);
+    void* cache = chunk_cache_create(rows * sizeof(int64_t) * 3);
+    ASSERT_NE(nullptr, cache);
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; t++) {
+        threads.emplace_back([this, cache, segment, t]() {
+            for (int n = 0; n < 200; n++) {
+                size_t g = (size_t)(n * 3 + t) % row_groups;
+                segment_vector_t vector;
+                const void* chunk = chunk_cache_acquire(cache, segment, g, (size_t)n % 2, &vector);
+                ASSERT_NE(nullptr, chunk);
+                EXPECT_EQ(values[rows - 1], ((const int64_t*)vector.values)[rows - 1]);
+                ASSERT_EQ(0, chunk_cache_release(cache, chunk));
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    chunk_cache_stats_t stats;
+    ASSERT_EQ(0, chunk_cache_stats(cache, &stats));
+    EXPECT_EQ(800u, stats.hits + stats.misses);
+    EXPECT_EQ(0u, stats.pinned);
+    EXPECT_LE(stats.bytes, stats.capacity);
+    EXPECT_EQ(0, chunk_cache_destroy(cache));
+    EXPECT_EQ(0, segment_close(segment));
+}
+
+// Test invalid arguments
+TEST_F(ChunkCacheTest, InvalidArguments) {
+    segment_vector_t vector;
+    chunk_cache_stats_t stats;
+    EXPECT_EQ(nullptr, chunk_cache_acquire(nullptr, nullptr, 0, 0, &vector));
+    EXPECT_NE(0, chunk_cache_release(nullptr, nullptr));
+    EXPECT_NE(0, chunk_cache_set_capacity(nullptr, 1));
+    EXPECT_NE(0, chunk_cache_stats(nullptr, &stats));
+    EXPECT_NE(0, chunk_cache_destroy(nullptr));
+
+    void* cache = chunk_cache_create(0);
+    ASSERT_NE(nullptr, cache);
+    EXPECT_EQ(nullptr, chunk_cache_acquire(cache, nullptr, 0, 0, &vector));
+    ASSERT_EQ(0, chunk_cache_stats(cache, &stats));
+    EXPECT_EQ((size_t)256 << 20, stats.capacity);
+    EXPECT_EQ(0, chunk_cache_destroy(cache));
+}
@@ -2,6 +2,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <string>
 #include "retldb/storage.h"
 
 // Test fixture
@@ -60,4 +61,267 @@ TEST_F(FileTest, OpenAndCloseFile) {
     
     // Cleanup
     remove(test_filename);
-} 
\ No newline at end of file
+} 
+
+// Test positioned reads and writes through a descriptor handle
+TEST_F(FileTest, PositionedIO) {
+    const char* test_filename = "test_positioned.dat";
+    void* file = file_open_flags(test_filename, FILE_READ | FILE_WRITE | FILE_CREATE | FILE_TRUNCATE);
+    ASSERT_NE(nullptr, file);
+    EXPECT_EQ(1u, file_alignment(file));
+    
+    // Writes land at their offset, leaving a hole that reads as zeros
+    EXPECT_EQ(5, file_pwrite(file, "hello", 5, 100));
+    EXPECT_EQ(5, file_pwrite(file, "world", 5, 0));
+    uint64_t size = 0;
+    EXPECT_EQ(0, file_size(file, &size));
+    EXPECT_EQ(105u, size);
+    
+    char buf[16];
+    EXPECT_EQ(5, file_pread(file, buf, 5, 100));
+    EXPECT_EQ(0, memcmp(buf, "hello", 5));
+    EXPECT_EQ(3, file_pread(file, buf, 3, 5));
+    EXPECT_EQ(0, buf[0]);
+    
+    // Short only at the end of the file
+    EXPECT_EQ(5, file_pread(file, buf, sizeof(buf), 100));
+    EXPECT_EQ(0, file_pread(file, buf, sizeof(buf), 200));
+    
+    EXPECT_EQ(0, file_sync(file));
+    EXPECT_EQ(0, file_truncate(file, 5));
+    EXPECT_EQ(0, file_size(file, &size));
+    EXPECT_EQ(5u, size);
+    EXPECT_EQ(0, file_close(file));
+    
+    // The data survives reopening read-only, which refuses writes
+    file = file_open(test_filename, "rb");
+    ASSERT_NE(nullptr, file);
+    EXPECT_EQ(5, file_pread(file, buf, sizeof(buf), 0));
+    EXPECT_EQ(0, memcmp(buf, "world", 5));
+    EXPECT_EQ(-1, file_pwrite(file, "x", 1, 0));
+    EXPECT_EQ(0, file_close(file));
+    
+    remove(test_filename);
+}
+
+// Test scatter/gather I/O and preallocation
+TEST_F(FileTest, VectoredIO) {
+    const char* test_filename = "test_vectored.dat";
+    void* file = file_open(test_filename, "w+b");
+    ASSERT_NE(nullptr, file);
+    
+    char a[] = "abc";
+    char b[] = "defgh";
+    file_iovec_t out[2] = { { a, 3 }, { b, 5 } };
+    EXPECT_EQ(8, file_pwritev(file, out, 2, 10));
+    
+    char x[4] = {0};
+    char y[4] = {0};
+    file_iovec_t in[2] = { { x, 4 }, { y, 4 } };
+    EXPECT_EQ(8, file_preadv(file, in, 2, 10));
+    EXPECT_EQ(0, memcmp(x, "abcd", 4));
+    EXPECT_EQ(0, memcmp(y, "efgh", 4));
+    
+    // Reserving space leaves the size alone
+    EXPECT_EQ(0, file_allocate(file, 0, 1 << 20));
+    uint64_t size = 0;
+    EXPECT_EQ(0, file_size(file, &size));
+    EXPECT_EQ(18u, size);
+    EXPECT_EQ(0, file_close(file));
+    
+    remove(test_filename);
+}
+
+// Test direct I/O with aligned buffers, falling back where unsupported
+TEST_F(FileTest, DirectIO) {
+    const char* test_filename = "test_direct.dat";
+    void* file = file_open_flags(test_filename, FILE_READ | FILE_WRITE | FILE_CREATE | FILE_DIRECT);
+    ASSERT_NE(nullptr, file);
+    size_t align = file_alignment(file);
+    ASSERT_GE(align, 1u);
+    
+    size_t len = 4096 > align ? 4096 : align;
+    void* buf = nullptr;
+#ifdef _WIN32
+    buf = _aligned_malloc(len, 4096);
+#else
+    ASSERT_EQ(0, posix_memalign(&buf, 4096, len));
+#endif
+    memset(buf, 0x5A, len);
+    EXPECT_EQ((long long)len, file_pwrite(file, buf, len, 0));
+    memset(buf, 0, len);
+    EXPECT_EQ((long long)len, file_pread(file, buf, len, 0));
+    EXPECT_EQ(0x5A, ((unsigned char*)buf)[len - 1]);
+    EXPECT_EQ(0, file_close(file));
+#ifdef _WIN32
+    _aligned_free(buf);
+#else
+    free(buf);
+#endif
+    
+    remove(test_filename);
+}
+
+// Test error handling
+TEST_F(FileTest, ErrorHandling) {
+    EXPECT_EQ(nullptr, file_open_flags(nullptr, FILE_READ));
+    EXPECT_EQ(nullptr, file_open_flags("nonexistent_file.dat", FILE_READ));
+    EXPECT_EQ(nullptr, file_open_flags("test_no_access.dat", FILE_CREATE));
+    EXPECT_EQ(nullptr, file_open("nonexistent_file.dat", "x"));
+    
+    char buf[4];
+    EXPECT_EQ(-1, file_pread(nullptr, buf, sizeof(buf), 0));
+    EXPECT_EQ(-1, file_pwrite(nullptr, buf, sizeof(buf), 0));
+    EXPECT_EQ(-1, file_preadv(nullptr, nullptr, 0, 0));
+    EXPECT_EQ(-1, file_sync(nullptr));
+    EXPECT_EQ(0u, file_alignment(nullptr));
+    EXPECT_EQ(-1, file_descriptor(nullptr));
+    EXPECT_NE(0, file_close(nullptr));
+}
+
+// Read a whole small file into a string
+static std::string read_all(const char* filename) {
+    std::string data;
+    FILE* fp = fopen(filename, "rb");
+    if (fp) {
+        char buf[4096];
+        size_t n;
+        while ((n = fread(buf, 1, sizeof(buf), fp)) > 0) {
+            data.append(buf, n);
+        }
+        fclose(fp);
+    }
+    return data;
+}
+
+// Test that append mode writes at the end whatever the offset
+TEST_F(FileTest, AppendMode) {
+    const char* test_filename = "test_append.dat";
+    void* file = file_open(test_filename, "wb");
+    ASSERT_NE(nullptr, file);
+    EXPECT_EQ(3, file_pwrite(file, "abc", 3, 0));
+    EXPECT_EQ(0, file_close(file));
+    
+    file = file_open(test_filename, "ab");
+    ASSERT_NE(nullptr, file);
+    EXPECT_EQ(3, file_pwrite(file, "def", 3, 0));
+    char g[] = "g";
+    char h[] = "hi";
+    file_iovec_t out[2] = { { g, 1 }, { h, 2 } };
+    EXPECT_EQ(3, file_pwritev(file, out, 2, 0));
+    EXPECT_EQ(0, file_close(file));
+    
+    EXPECT_EQ("abcdefghi", read_all(test_filename));
+    
+    remove(test_filename);
+}
+
+// Test replacing a file through a staged write
+TEST_F(FileTest, StagedReplace) {
+    const char* test_filename = "test_staged.dat";
+    FILE* fp = fopen(test_filename, "wb");
+    ASSERT_NE(nullptr, fp);
+    fputs("old contents", fp);
+    fclose(fp);
+    
+    void* stage = file_stage_open(test_filename, 0);
+    ASSERT_NE(nullptr, stage);
+    std::string temp = file_stage_path(stage);
+    EXPECT_NE(std::string(test_filename), temp);
+    
+    // Small appends are buffered; a large one goes straight through
+    std::string expected;
+    for (int i = 0; i < 1000; i++) {
+        std::string line = "row " + std::to_string(i) + "\n";
+        ASSERT_EQ(0, file_stage_write(stage, line.data(), line.size()));
+        expected += line;
+    }
+    std::string big(3 << 20, 'z');
+    ASSERT_EQ(0, file_stage_write(stage, big.data(), big.size()));
+    expected += big;
+    
+    // Nothing is visible under the target name before the commit
+    EXPECT_EQ("old contents", read_all(test_filename));
+    
+    file_stage_stats_t stats;
+    ASSERT_EQ(0, file_stage_commit(stage, &stats));
+    EXPECT_EQ(expected.size(), stats.bytes);
+    EXPECT_EQ(expected, read_all(test_filename));
+    EXPECT_EQ(nullptr, fopen(temp.c_str(), "rb"));
+    
+    remove(test_filename);
+}
+
+// Test that an aborted stage leaves the target alone
+TEST_F(FileTest, StagedAbort) {
+    const char* test_filename = "test_staged_abort.dat";
+    FILE* fp = fopen(test_filename, "wb");
+    ASSERT_NE(nullptr, fp);
+    fputs("keep me", fp);
+    fclose(fp);
+    
+    void* stage = file_stage_open(test_filename, 0);
+    ASSERT_NE(nullptr, stage);
+    std::string temp = file_stage_path(stage);
+    ASSERT_EQ(0, file_stage_write(stage, "discard", 7));
+    EXPECT_EQ(0, file_stage_abort(stage));
+    
+    EXPECT_EQ("keep me", read_all(test_filename));
+    EXPECT_EQ(nullptr, fopen(temp.c_str(), "rb"));
+    
+    EXPECT_EQ(nullptr, file_stage_open(nullptr, 0));
+    EXPECT_EQ(nullptr, file_stage_open(test_filename, FILE_WRITE));
+    EXPECT_NE(0, file_stage_write(nullptr, "x", 1));
+    EXPECT_NE(0, file_stage_commit(nullptr, nullptr));
+    EXPECT_NE(0, file_sync_directory("nonexistent_directory"));
+    
+    remove(test_filename);
+}
+
+// Test a staged direct-I/O write whose size is not a multiple of the block
+TEST_F(FileTest, StagedDirect) {
+    const char* test_filename = "test_staged_direct.dat";
+    remove(test_filename);
+    
+    void* stage = file_stage_open(test_filename, FILE_DIRECT);
+    ASSERT_NE(nullptr, stage);
+    std::string expected;
+    for (int i = 0; i < 5000; i++) {
+        expected += (char)('a' + i % 26);
+    }
+    expected += std::string((1 << 20) + 123, 'q');
+    ASSERT_EQ(0, file_stage_write(stage, expected.data(), 5000));
+    ASSERT_EQ(0, file_stage_write(stage, expected.data() + 5000, expected.size() - 5000));
+    ASSERT_EQ(0, file_stage_commit(stage, nullptr));
+    
+    EXPECT_EQ(expected, read_all(test_filename));
+    remove(test_filename);
+}
+
+// Test advisory locks between handles of the same process
+TEST_F(FileTest, AdvisoryLock) {
+    const char* test_filename = "test_lock.dat";
+    remove(test_filename);
+    
+    void* first = nullptr;
+    void* second = nullptr;
+    ASSERT_EQ(RETLDB_OK, file_lock(test_filename, FILE_LOCK_SHARED, &first));
+    ASSERT_EQ(RETLDB_OK, file_lock(test_filename, FILE_LOCK_SHARED, &second));
+    
+    void* exclusive = nullptr;
+    EXPECT_EQ(RETLDB_ERROR_BUSY, file_lock(test_filename, FILE_LOCK_EXCLUSIVE, &exclusive));
+    EXPECT_EQ(0, file_unlock(first));
+    EXPECT_EQ(RETLDB_ERROR_BUSY, file_lock(test_filename, FILE_LOCK_EXCLUSIVE, &exclusive));
+    EXPECT_EQ(0, file_unlock(second));
+    
+    ASSERT_EQ(RETLDB_OK, file_lock(test_filename, FILE_LOCK_EXCLUSIVE, &exclusive));
+    EXPECT_EQ(RETLDB_ERROR_BUSY, file_lock(test_filename, FILE_LOCK_SHARED, &first));
+    EXPECT_EQ(0, file_unlock(exclusive));
+    
+    EXPECT_EQ(RETLDB_ERROR_INVALID_ARGUMENT, file_lock(test_filename, 0, &first));
+    EXPECT_EQ(RETLDB_ERROR_INVALID_ARGUMENT,
+              file_lock(test_filename, FILE_LOCK_SHARED | FILE_LOCK_EXCLUSIVE, &first));
+    EXPECT_EQ(RETLDB_ERROR_INVALID_ARGUMENT, file_lock(nullptr, FILE_LOCK_SHARED, &first));
+    
+    remove(test_filename);
+}
@@ -0,0 +1,196 @@
+#include <gtest/gtest.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <thread>
+#include <vector>
+#include "retldb/storage.h"
+
+// Test fixture
+class FileCacheTest : public ::testing::Test {
+protected:
+    static const int file_count = 8;
+    
+    void SetUp() override {
+        // Create small files, each holding its own name
+        for (int i = 0; i < file_count; i++) {
+            std::string name = filename(i);
+            FILE* fp = fopen(name.c_str(), "wb");
+            ASSERT_NE(nullptr, fp);
+            fputs(name.c_str(), fp);
+            fclose(fp);
+        }
+    }
+    
+    void TearDown() override {
+        for (int i = 0; i < file_count; i++) {
+            remove(filename(i).c_str());
+        }
+    }
+    
+    static std::string filename(int i) {
+        return "test_file_cache_" + std::to_string(i) + ".dat";
+    }
+    
+    // Check that a handle reads back the file it was acquired for
+    static void expect_contents(void* file, int i) {
+        std::string name = filename(i);
+        char buf[64] = {0};
+        EXPECT_EQ((long long)name.size(), file_pread(file, buf, sizeof(buf) - 1, 0));
+        EXPECT_EQ(name, std::string(buf));
+    }
+};
+
+// Test that repeated acquisitions reuse the open file
+TEST_F(FileCacheTest, HitsAndMisses) {
+    void* cache = file_cache_create(4, 0);
+    ASSERT_NE(nullptr, cache);
+    
+    void* first = file_cache_acquire(cache, filename(0).c_str());
+    ASSERT_NE(nullptr, first);
+    expect_contents(first, 0);
+    EXPECT_EQ(0, file_cache_release(cache, first));
+    
+    void* second = file_cache_acquire(cache, filename(0).c_str());
+    EXPECT_EQ(first, second);
+    void* third = file_cache_acquire(cache, filename(0).c_str());
+    EXPECT_EQ(first, third);
+    EXPECT_EQ(0, file_cache_release(cache, second));
+    EXPECT_EQ(0, file_cache_release(cache, third));
+    EXPECT_NE(0, file_cache_release(cache, third));
+    
+    file_cache_stats_t stats;
+    ASSERT_EQ(0, file_cache_stats(cache, &stats));
+    EXPECT_EQ(2u, stats.hits);
+    EXPECT_EQ(1u, stats.misses);
+    EXPECT_EQ(1u, stats.open);
+    EXPECT_EQ(0u, stats.pinned);
+    EXPECT_EQ(4u, stats.capacity);
+    
+    EXPECT_EQ(nullptr, file_cache_acquire(cache, "nonexistent_file.dat"));
+    EXPECT_EQ(0, file_cache_destroy(cache));
+}
+
+// Test that idle files are closed least recently used first
+TEST_F(FileCacheTest, LruClosing) {
+    void* cache = file_cache_create(3, FILE_READ);
+    ASSERT_NE(nullptr, cache);
+    
+    for (int i = 0; i < 3; i++) {
+        void* file = file_cache_acquire(cache, filename(i).c_str());
+        ASSERT_NE(nullptr, file);
+        EXPECT_EQ(0, file_cache_release(cache, file));
+    }
+    
+    // Touch file 0 so file 1 becomes the least recently used
+    void* file = file_cache_acquire(cache, filename(0).c_str());
+    EXPECT_EQ(0, file_cache_release(cache, file));
+    file = file_cache_acquire(cache, filename(3).c_str());
+    EXPECT_EQ(0, file_cache_release(cache, file));
+    
+    file_cache_stats_t stats;
+    ASSERT_EQ(0, file_cache_stats(cache, &stats));
+    EXPECT_EQ(3u, stats.open);
+    EXPECT_EQ(1u, stats.evictions);
+    
+    // 0, 2 and 3 are still open; 1 has to be reopened
+    for (int i : {0, 2, 3, 1}) {
+        file = file_cache_acquire(cache, filename(i).c_str());
+        EXPECT_EQ(0, file_cache_release(cache, file));
+    }
+    ASSERT_EQ(0, file_cache_stats(cache, &stats));
+    EXPECT_EQ(4u, stats.hits);
+    EXPECT_EQ(5u, stats.misses);
+    
+    // Shrinking closes idle files at once
+    EXPECT_EQ(0, file_cache_set_capacity(cache, 1));
+    ASSERT_EQ(0, file_cache_stats(cache, &stats));
+    EXPECT_EQ(1u, stats.open);
+    
+    EXPECT_EQ(0, file_cache_destroy(cache));
+}
+
+// Test that acquired files stay open over capacity and across eviction
+TEST_F(FileCacheTest, PinnedFiles) {
+    void* cache = file_cache_create(2, 0);
+    ASSERT_NE(nullptr, cache);
+    
+    void* files[4];
+    for (int i = 0; i < 4; i++) {
+        files[i] = file_cache_acquire(cache, filename(i).c_str());
+        ASSERT_NE(nullptr, files[i]);
+    }
+    
+    file_cache_stats_t stats;
+    ASSERT_EQ(0, file_cache_stats(cache, &stats));
+    EXPECT_EQ(4u, stats.open);
+    EXPECT_EQ(4u, stats.pinned);
+    EXPECT_NE(0, file_cache_destroy(cache));
+    
+    // An evicted file keeps working for its user, but is not handed out again
+    EXPECT_EQ(0, file_cache_evict(cache, filename(0).c_str()));
+    expect_contents(files[0], 0);
+    void* reopened = file_cache_acquire(cache, filename(0).c_str());
+    ASSERT_NE(nullptr, reopened);
+    EXPECT_EQ(0, file_cache_release(cache, reopened));
+    
+    for (int i = 0; i < 4; i++) {
+        expect_contents(files[i], i);
+        EXPECT_EQ(0, file_cache_release(cache, files[i]));
+    }
+    
+    ASSERT_EQ(0, file_cache_stats(cache, &stats));
+    EXPECT_EQ(2u, stats.open);
+    EXPECT_EQ(0u, stats.pinned);
+    
+    EXPECT_EQ(0, file_cache_evict(cache, "never_cached.dat"));
+    EXPECT_EQ(0, file_cache_destroy(cache));
+}
+
+// Test concurrent acquisitions from several threads
+TEST_F(FileCacheTest, Concurrent) {
+    void* cache = file_cache_create(3, 0);
+    ASSERT_NE(nullptr, cache);
+    
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; t++) {
+        threads.emplace_back([cache, t]() {
+            for (int n = 0; n < 500; n++) {
+                int i = (n * 7 + t) % file_count;
+                void* file = file_cache_acquire(cache, filename(i).c_str());
+                ASSERT_NE(nullptr, file);
+                expect_contents(file, i);
+                ASSERT_EQ(0, file_cache_release(cache, file));
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    
+    file_cache_stats_t stats;
+    ASSERT_EQ(0, file_cache_stats(cache, &stats));
+    EXPECT_EQ(2000u, stats.hits + stats.misses);
+    EXPECT_LE(stats.open, 3u);
+    EXPECT_EQ(0u, stats.pinned);
+    EXPECT_EQ(0, file_cache_destroy(cache));
+}
+
+// Test the default capacity and invalid arguments
+TEST_F(FileCacheTest, Defaults) {
+    void* cache = file_cache_create(0, 0);
+    ASSERT_NE(nullptr, cache);
+    
+    file_cache_stats_t stats;
+    ASSERT_EQ(0, file_cache_stats(cache, &stats));
+    EXPECT_GT(stats.capacity, 0u);
+    EXPECT_EQ(0, file_cache_destroy(cache));
+    
+    EXPECT_EQ(nullptr, file_cache_acquire(nullptr, "x"));
+    EXPECT_NE(0, file_cache_release(nullptr, nullptr));
+    EXPECT_NE(0, file_cache_evict(nullptr, "x"));
+    EXPECT_NE(0, file_cache_set_capacity(nullptr, 1));
+    EXPECT_NE(0, file_cache_stats(nullptr, &stats));
+    EXPECT_NE(0, file_cache_destroy(nullptr));
+}
@@ -2,8 +2,39 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+#ifndef _WIN32
+#include <signal.h>
+#endif
 #include "retldb/storage.h"
 
+#ifdef __linux__
+// Whether the mapping holding the given address is locked in memory
+static bool mapping_locked(const void* addr) {
+    bool holding = false;
+    bool locked = false;
+    
+    FILE* fp = fopen("/proc/self/smaps", "r");
+    if (!fp) {
+        return false;
+    }
+    char line[512];
+    while (fgets(line, sizeof(line), fp)) {
+        unsigned long start, end;
+        if (sscanf(line, "%lx-%lx ", &start, &end) == 2) {
+            unsigned long a = (unsigned long)addr;
+            holding = a >= start && a < end;
+        } else if (holding && strncmp(line, "VmFlags:", 8) == 0) {
+            locked = strstr(line, " lo") != nullptr;
+        }
+    }
+    fclose(fp);
+    return locked;
+}
+#endif
+
 // Test fixture
 class MmapTest : public ::testing::Test {
 protected:
@@ -103,4 +134,393 @@ TEST_F(MmapTest, ErrorHandling) {
     EXPECT_EQ(nullptr, mmap_get_addr(nullptr));
     EXPECT_EQ(0, mmap_get_size(nullptr));
     EXPECT_NE(0, mmap_unmap(nullptr));
-} 
\ No newline at end of file
+} 
+
+// Write a file of the given size, byte i holding i % 251
+static void write_pattern(const char* filename, size_t size) {
+    FILE* fp = fopen(filename, "wb");
+    ASSERT_NE(nullptr, fp);
+    for (size_t i = 0; i < size; i++) {
+        fputc((int)(i % 251), fp);
+    }
+    fclose(fp);
+}
+
+// Test mapping a window in the middle of a file
+TEST_F(MmapTest, MapWindow) {
+    const char* filename = "test_mmap_window.dat";
+    size_t granule = mmap_granularity();
+    ASSERT_GT(granule, 0u);
+    write_pattern(filename, 4 * granule);
+    
+    void* handle = mmap_file_range(filename, 2 * granule, granule, 1);
+    ASSERT_NE(nullptr, handle);
+    EXPECT_EQ(2 * granule, mmap_get_offset(handle));
+    EXPECT_EQ(granule, mmap_get_size(handle));
+    unsigned char* data = (unsigned char*)mmap_get_addr(handle);
+    for (size_t i = 0; i < granule; i++) {
+        ASSERT_EQ((unsigned char)((2 * granule + i) % 251), data[i]);
+    }
+    EXPECT_EQ(0, mmap_unmap(handle));
+    
+    // Size 0 maps the rest of the file
+    handle = mmap_file_range(filename, 3 * granule, 0, 1);
+    ASSERT_NE(nullptr, handle);
+    EXPECT_EQ(granule, mmap_get_size(handle));
+    EXPECT_EQ(0, mmap_unmap(handle));
+    
+    // Offsets must be aligned and, for the rest of the file, inside it
+    EXPECT_EQ(nullptr, mmap_file_range(filename, 100, granule, 1));
+    EXPECT_EQ(nullptr, mmap_file_range(filename, 4 * granule, 0, 1));
+    EXPECT_EQ(0u, mmap_get_offset(nullptr));
+    
+    remove(filename);
+}
+
+// Test writing through a window
+TEST_F(MmapTest, WriteWindow) {
+    const char* filename = "test_mmap_write_window.dat";
+    size_t granule = mmap_granularity();
+    write_pattern(filename, 3 * granule);
+    
+    void* handle = mmap_file_range(filename, granule, granule, 0);
+    ASSERT_NE(nullptr, handle);
+    memset(mmap_get_addr(handle), 0xAB, granule);
+    EXPECT_EQ(0, mmap_unmap(handle));
+    
+    handle = mmap_file(filename, 0, 1);
+    ASSERT_NE(nullptr, handle);
+    unsigned char* data = (unsigned char*)mmap_get_addr(handle);
+    EXPECT_EQ((unsigned char)((granule - 1) % 251), data[granule - 1]);
+    EXPECT_EQ(0xAB, data[granule]);
+    EXPECT_EQ(0xAB, data[2 * granule - 1]);
+    EXPECT_EQ((unsigned char)((2 * granule) % 251), data[2 * granule]);
+    EXPECT_EQ(0, mmap_unmap(handle));
+    
+    remove(filename);
+}
+
+// Test growing and shrinking a mapping as the file grows
+TEST_F(MmapTest, Remap) {
+    const char* filename = "test_mmap_remap.dat";
+    size_t granule = mmap_granularity();
+    write_pattern(filename, 2 * granule);
+    
+    void* handle = mmap_file_range(filename, granule, 0, 1);
+    ASSERT_NE(nullptr, handle);
+    EXPECT_EQ(granule, mmap_get_size(handle));
+    EXPECT_EQ(0, mmap_remap(handle, 0)); // Nothing to do
+    
+    // Append three more granules
+    FILE* fp = fopen(filename, "ab");
+    ASSERT_NE(nullptr, fp);
+    for (size_t i = 0; i < 3 * granule; i++) {
+        fputc(0x5A, fp);
+    }
+    fclose(fp);
+    
+    ASSERT_EQ(0, mmap_remap(handle, 0));
+    EXPECT_EQ(4 * granule, mmap_get_size(handle));
+    EXPECT_EQ(granule, mmap_get_offset(handle));
+    unsigned char* data = (unsigned char*)mmap_get_addr(handle);
+    EXPECT_EQ((unsigned char)(granule % 251), data[0]);
+    EXPECT_EQ(0x5A, data[granule]);
+    EXPECT_EQ(0x5A, data[4 * granule - 1]);
+    
+    ASSERT_EQ(0, mmap_remap(handle, granule));
+    EXPECT_EQ(granule, mmap_get_size(handle));
+    data = (unsigned char*)mmap_get_addr(handle);
+    EXPECT_EQ((unsigned char)((2 * granule - 1) % 251), data[granule - 1]);
+    
+    EXPECT_NE(0, mmap_remap(nullptr, granule));
+    EXPECT_EQ(0, mmap_unmap(handle));
+    
+    remove(filename);
+}
+
+// Test access pattern hints on a whole window and on ranges of it
+TEST_F(MmapTest, Advise) {
+    size_t granule = mmap_granularity();
+    
+    void* handle = mmap_file_hinted(test_filename, 0, 0, 1, MMAP_ADVICE_SEQUENTIAL, MMAP_POPULATE);
+    ASSERT_NE(nullptr, handle);
+    EXPECT_EQ(test_file_size, mmap_get_size(handle));
+    unsigned char* data = (unsigned char*)mmap_get_addr(handle);
+    EXPECT_EQ(255, data[test_file_size - 1]);
+    
+    EXPECT_EQ(0, mmap_advise(handle, 0, 0, MMAP_ADVICE_RANDOM));
+    EXPECT_EQ(0, mmap_advise(handle, 100, 200, MMAP_ADVICE_WILLNEED)); // Rounded to a page
+    EXPECT_EQ(0, mmap_advise(handle, 0, test_file_size, MMAP_ADVICE_DONTNEED));
+    EXPECT_EQ(0, mmap_advise(handle, 0, 0, MMAP_ADVICE_NORMAL));
+    
+    // Dropped pages read back from the file
+    EXPECT_EQ(128, data[128]);
+    
+    // Ranges must stay inside the window
+    EXPECT_NE(0, mmap_advise(handle, test_file_size, 0, MMAP_ADVICE_RANDOM));
+    EXPECT_NE(0, mmap_advise(handle, 0, test_file_size + 1, MMAP_ADVICE_RANDOM));
+    EXPECT_NE(0, mmap_advise(handle, 0, 0, (mmap_advice_t)42));
+    EXPECT_NE(0, mmap_advise(nullptr, 0, 0, MMAP_ADVICE_RANDOM));
+    EXPECT_EQ(0, mmap_unmap(handle));
+    
+    EXPECT_EQ(nullptr, mmap_file_hinted(test_filename, 0, 0, 1, (mmap_advice_t)42, 0));
+    EXPECT_EQ(nullptr, mmap_file_hinted(nullptr, 0, granule, 1, MMAP_ADVICE_RANDOM, 0));
+}
+
+// Test keeping a window resident, including across a remap
+TEST_F(MmapTest, Lock) {
+    void* handle = mmap_file_hinted(test_filename, 0, 0, 0, MMAP_ADVICE_RANDOM,
+                                    MMAP_POPULATE | MMAP_LOCK);
+    if (!handle) {
+        GTEST_SKIP() << "Locking is not permitted here";
+    }
+    
+    unsigned char* data = (unsigned char*)mmap_get_addr(handle);
+    data[0] = 0x7F;
+    EXPECT_EQ(0, mmap_remap(handle, test_file_size / 2));
+    EXPECT_EQ(0x7F, ((unsigned char*)mmap_get_addr(handle))[0]);
+    EXPECT_EQ(0, mmap_lock(handle, 0));
+    EXPECT_EQ(0, mmap_lock(handle, 1));
+    EXPECT_EQ(0, mmap_unmap(handle));
+    
+    EXPECT_NE(0, mmap_lock(nullptr, 1));
+}
+
+#ifdef __linux__
+// Test that one holder releasing its lock leaves a shared window locked
+TEST_F(MmapTest, SharedLock) {
+    void* first = mmap_file(test_filename, 0, 1);
+    void* second = mmap_file(test_filename, 0, 1);
+    ASSERT_NE(nullptr, first);
+    ASSERT_EQ(first, second);
+    void* addr = mmap_get_addr(first);
+    
+    // Nothing to release before anyone locked it
+    EXPECT_NE(0, mmap_lock(first, 0));
+    // Sanitizers turn mlock() into a no-op that smaps cannot see
+    if (mmap_lock(first, 1) != 0 || !mapping_locked(addr)) {
+        mmap_unmap(second);
+        mmap_unmap(first);
+        GTEST_SKIP() << "Locking is not permitted or not observable here";
+    }
+    EXPECT_EQ(0, mmap_lock(second, 1));
+    EXPECT_TRUE(mapping_locked(addr));
+    
+    EXPECT_EQ(0, mmap_lock(first, 0));
+    EXPECT_TRUE(mapping_locked(addr));
+    EXPECT_EQ(0, mmap_lock(second, 0));
+    EXPECT_FALSE(mapping_locked(addr));
+    EXPECT_NE(0, mmap_lock(second, 0));
+    
+    EXPECT_EQ(0, mmap_unmap(second));
+    EXPECT_EQ(0, mmap_unmap(first));
+}
+#endif
+
+// Test that mapping the same window twice shares one mapping
+TEST_F(MmapTest, SharedMapping) {
+    void* first = mmap_file(test_filename, 0, 1);
+    void* second = mmap_file(test_filename, 0, 1);
+    ASSERT_NE(nullptr, first);
+    EXPECT_EQ(first, second);
+    EXPECT_EQ(mmap_get_addr(first), mmap_get_addr(second));
+    
+    // A shared window cannot move under its other holder
+    EXPECT_NE(0, mmap_remap(first, test_file_size / 2));
+    
+    // Different protection or hints get their own mapping
+    void* writable = mmap_file(test_filename, 0, 0);
+    void* hinted = mmap_file_hinted(test_filename, 0, 0, 1, MMAP_ADVICE_RANDOM, 0);
+    ASSERT_NE(nullptr, writable);
+    ASSERT_NE(nullptr, hinted);
+    EXPECT_NE(first, writable);
+    EXPECT_NE(first, hinted);
+    EXPECT_EQ(0, mmap_unmap(writable));
+    EXPECT_EQ(0, mmap_unmap(hinted));
+    
+    // Dropping one reference leaves the mapping to the other
+    EXPECT_EQ(0, mmap_unmap(second));
+    unsigned char* data = (unsigned char*)mmap_get_addr(first);
+    EXPECT_EQ(255, data[test_file_size - 1]);
+    EXPECT_EQ(0, mmap_remap(first, test_file_size / 2));
+    EXPECT_EQ(0, mmap_unmap(first));
+}
+
+// Test that a grown or replaced file is not served a stale mapping
+TEST_F(MmapTest, SharedMappingIdentity) {
+    void* old_handle = mmap_file(test_filename, 0, 1);
+    ASSERT_NE(nullptr, old_handle);
+    
+    FILE* fp = fopen(test_filename, "ab");
+    ASSERT_NE(nullptr, fp);
+    fputc(0x11, fp);
+    fclose(fp);
+    
+    void* grown = mmap_file(test_filename, 0, 1);
+    ASSERT_NE(nullptr, grown);
+    EXPECT_NE(old_handle, grown);
+    EXPECT_EQ(test_file_size + 1, mmap_get_size(grown));
+    EXPECT_EQ(0, mmap_unmap(grown));
+    
+    // Replace the file under the same name
+    const char* replacement = "test_mmap_replacement.dat";
+    write_pattern(replacement, test_file_size);
+    ASSERT_EQ(0, rename(replacement, test_filename));
+    
+    void* replaced = mmap_file(test_filename, test_file_size, 1);
+    ASSERT_NE(nullptr, replaced);
+    EXPECT_NE(old_handle, replaced);
+    EXPECT_EQ(0, ((unsigned char*)mmap_get_addr(replaced))[251]); // 251 in the old file
+    EXPECT_EQ(0, mmap_unmap(replaced));
+    EXPECT_EQ(0, mmap_unmap(old_handle));
+}
+
+// Test many threads mapping and unmapping the same file
+TEST_F(MmapTest, SharedMappingConcurrent) {
+    const int thread_count = 8;
+    std::atomic<int> errors(0);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < thread_count; t++) {
+        threads.emplace_back([&]() {
+            for (int i = 0; i < 500; i++) {
+                void* handle = mmap_file(test_filename, 0, 1);
+                if (!handle) {
+                    errors++;
+                    continue;
+                }
+                unsigned char* data = (unsigned char*)mmap_get_addr(handle);
+                if (data[i % test_file_size] != (unsigned char)(i % test_file_size % 256)) {
+                    errors++;
+                }
+                if (mmap_unmap(handle) != 0) {
+                    errors++;
+                }
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    EXPECT_EQ(0, errors.load());
+}
+
+// Test huge-page hints and preloading a window into anonymous memory
+TEST_F(MmapTest, HugePages) {
+    void* hinted = mmap_file_hinted(test_filename, 0, 0, 1, MMAP_ADVICE_RANDOM, MMAP_HUGE_PAGES);
+    ASSERT_NE(nullptr, hinted);
+    EXPECT_EQ(128, ((unsigned char*)mmap_get_addr(hinted))[128]);
+    EXPECT_EQ(mmap_granularity(), mmap_page_size(hinted));
+    
+    void* preloaded = mmap_file_hinted(test_filename, 0, 0, 1, MMAP_ADVICE_RANDOM,
+                                       MMAP_PRELOAD | MMAP_HUGE_PAGES);
+    ASSERT_NE(nullptr, preloaded);
+    EXPECT_NE(mmap_get_addr(hinted), mmap_get_addr(preloaded));
+    EXPECT_EQ(test_file_size, mmap_get_size(preloaded));
+    EXPECT_GE(mmap_page_size(preloaded), mmap_granularity());
+    EXPECT_EQ(0, memcmp(mmap_get_addr(hinted), mmap_get_addr(preloaded), test_file_size));
+    
+    // The copy is a snapshot; growing it copies the new bytes too
+    FILE* fp = fopen(test_filename, "ab");
+    ASSERT_NE(nullptr, fp);
+    fputc(0x42, fp);
+    fclose(fp);
+    ASSERT_EQ(0, mmap_remap(preloaded, 0));
+    EXPECT_EQ(test_file_size + 1, mmap_get_size(preloaded));
+    EXPECT_EQ(0x42, ((unsigned char*)mmap_get_addr(preloaded))[test_file_size]);
+    EXPECT_EQ(0, ((unsigned char*)mmap_get_addr(preloaded))[256]);
+    
+    // Without MMAP_HUGE_PAGES a copy stays on regular pages
+    void* copy = mmap_file_hinted(test_filename, 0, 0, 1, MMAP_ADVICE_RANDOM, MMAP_PRELOAD);
+    ASSERT_NE(nullptr, copy);
+    EXPECT_EQ(mmap_granularity(), mmap_page_size(copy));
+    EXPECT_EQ(0, memcmp(mmap_get_addr(hinted), mmap_get_addr(copy), test_file_size));
+    EXPECT_EQ(0, mmap_unmap(copy));
+    
+    EXPECT_EQ(0, mmap_unmap(preloaded));
+    EXPECT_EQ(0, mmap_unmap(hinted));
+    
+    // A private copy cannot be written back
+    EXPECT_EQ(nullptr, mmap_file_hinted(test_filename, 0, 0, 0, MMAP_ADVICE_NORMAL, MMAP_PRELOAD));
+    EXPECT_EQ(0u, mmap_page_size(nullptr));
+}
+
+// Sum the bytes of a window in place
+static void sum_bytes(const void* data, size_t size, void* arg) {
+    const unsigned char* bytes = (const unsigned char*)data;
+    uint64_t sum = 0;
+    for (size_t i = 0; i < size; i++) {
+        sum += bytes[i];
+    }
+    *(uint64_t*)arg = sum;
+}
+
+// Test reading a window in place and by copy under the fault guard
+TEST_F(MmapTest, GuardedRead) {
+    void* handle = mmap_file(test_filename, 0, 1);
+    ASSERT_NE(nullptr, handle);
+    
+    uint64_t sum = 0;
+    EXPECT_EQ(RETLDB_OK, mmap_guarded(handle, sum_bytes, &sum));
+    EXPECT_EQ((uint64_t)(test_file_size / 256) * (255 * 256 / 2), sum);
+    
+    unsigned char bytes[16];
+    EXPECT_EQ(RETLDB_OK, mmap_read(handle, 100, bytes, sizeof(bytes)));
+    EXPECT_EQ(100, bytes[0]);
+    EXPECT_EQ(115, bytes[15]);
+    EXPECT_EQ(RETLDB_ERROR_INVALID_ARGUMENT, mmap_read(handle, test_file_size - 8, bytes, 16));
+    EXPECT_EQ(RETLDB_ERROR_INVALID_ARGUMENT, mmap_guarded(handle, nullptr, nullptr));
+    EXPECT_EQ(RETLDB_OK, mmap_fault_error(handle));
+    
+    EXPECT_EQ(0, mmap_unmap(handle));
+}
+
+// Test that reading a truncated file retires the window instead of crashing
+TEST_F(MmapTest, TruncatedFile) {
+    const char* filename = "test_mmap_truncated.dat";
+    size_t granule = mmap_granularity();
+    write_pattern(filename, 3 * granule);
+    
+    void* handle = mmap_file(filename, 0, 1);
+    ASSERT_NE(nullptr, handle);
+    void* other = mmap_file(filename, 0, 1);
+    EXPECT_EQ(handle, other);
+    
+    // Cut the file down to its first granule under the mapping
+    FILE* fp = fopen(filename, "wb");
+    ASSERT_NE(nullptr, fp);
+    for (size_t i = 0; i < granule; i++) {
+        fputc((int)(i % 251), fp);
+    }
+    fclose(fp);
+    
+    unsigned char byte = 0;
+    EXPECT_EQ(RETLDB_OK, mmap_read(handle, granule - 1, &byte, 1));
+    EXPECT_EQ(RETLDB_ERROR_CORRUPT_DATA, mmap_read(handle, 2 * granule, &byte, 1));
+    EXPECT_EQ(RETLDB_ERROR_CORRUPT_DATA, mmap_fault_error(handle));
+    
+#ifndef _WIN32
+    // Jumping out of the fault leaves SIGBUS deliverable for the next one
+    sigset_t blocked;
+    ASSERT_EQ(0, pthread_sigmask(SIG_SETMASK, nullptr, &blocked));
+    EXPECT_FALSE(sigismember(&blocked, SIGBUS));
+#endif
+    
+    // Retired: later reads fail, raw access reads zeros, remapping is refused
+    uint64_t sum = 1;
+    EXPECT_EQ(RETLDB_ERROR_CORRUPT_DATA, mmap_guarded(handle, sum_bytes, &sum));
+    EXPECT_EQ(1u, sum);
+    EXPECT_EQ(0, ((unsigned char*)mmap_get_addr(handle))[2 * granule]);
+    EXPECT_NE(0, mmap_remap(handle, granule));
+    
+    // Mapping the file again gets a fresh window
+    void* fresh = mmap_file(filename, 0, 1);
+    ASSERT_NE(nullptr, fresh);
+    EXPECT_NE(handle, fresh);
+    EXPECT_EQ(granule, mmap_get_size(fresh));
+    EXPECT_EQ(RETLDB_OK, mmap_fault_error(fresh));
+    
+    EXPECT_EQ(0, mmap_unmap(fresh));
+    EXPECT_EQ(0, mmap_unmap(other));
+    EXPECT_EQ(0, mmap_unmap(handle));
+    remove(filename);
+}
@@ -0,0 +1,819 @@
+#include <gtest/gtest.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include "retldb/storage.h"
+
+// Test fixture
+class SegmentTest : public ::testing::Test {
+protected:
+    const char* filename = "test_segment.seg";
+    
+    void SetUp() override {
+        file_init();
+        mmap_init();
+        remove(filename);
+    }
+    
+    void TearDown() override {
+        remove(filename);
+    }
+    
+    // Read and decode one chunk, keeping the bytes alive in buf
+    static void read_column(void* segment, size_t rg, size_t col, std::vector<uint64_t>& buf,
+                            segment_vector_t* vector) {
+        segment_chunk_t chunk;
+        ASSERT_EQ(0, segment_chunk(segment, rg, col, &chunk));
+        size_t stored = chunk.size / 8 + 1;
+        buf.assign(stored + segment_scratch_size(&chunk) / 8 + 1, 0);
+        ASSERT_EQ(0, segment_read_chunk(segment, rg, col, buf.data()));
+        ASSERT_EQ(0, segment_decode_chunk(segment, rg, col, buf.data(), buf.data() + stored,
+                                          vector));
+    }
+};
+
+// Test writing and reading back integers, nullable doubles and strings
+TEST_F(SegmentTest, RoundTrip) {
+    segment_column_t columns[] = {
+        {"id", RETLDB_TYPE_INT64, 0},
+        {"score", RETLDB_TYPE_DOUBLE, 1},
+        {"name", RETLDB_TYPE_STRING, 1},
+    };
+    void* writer = segment_writer_create(filename, columns, 3, 0);
+    ASSERT_NE(nullptr, writer);
+    
+    // Two row groups of 10 and 5 rows; every third score is null
+    std::vector<std::string> names;
+    for (int g = 0; g < 2; g++) {
+        size_t rows = g == 0 ? 10 : 5;
+        std::vector<int64_t> ids;
+        std::vector<double> scores;
+        uint8_t validity[2] = {0, 0};
+        std::string bytes;
+        std::vector<uint32_t> offsets = {0};
+        for (size_t i = 0; i < rows; i++) {
+            int64_t id = (int64_t)(g * 10 + i);
+            ids.push_back(id);
+            scores.push_back(id * 1.5);
+            if (id % 3 != 0) {
+                validity[i / 8] |= (uint8_t)(1 << (i % 8));
+            }
+            names.push_back("row-" + std::to_string(id));
+            bytes += names.back();
+            offsets.push_back((uint32_t)bytes.size());
+        }
+        segment_vector_t vectors[3] = {
+            {ids.data(), nullptr, nullptr},
+            {scores.data(), nullptr, validity},
+            {bytes.data(), offsets.data(), nullptr},
+        };
+        ASSERT_EQ(0, segment_writer_append(writer, vectors, rows));
+    }
+    uint64_t size = 0;
+    ASSERT_EQ(0, segment_writer_finish(writer, &size));
+    EXPECT_GT(size, 0u);
+    
+    void* segment = segment_open(filename);
+    ASSERT_NE(nullptr, segment);
+    EXPECT_EQ(15u, segment_row_count(segment));
+    ASSERT_EQ(2u, segment_row_group_count(segment));
+    ASSERT_EQ(3u, segment_column_count(segment));
+    EXPECT_STREQ("score", segment_column(segment, 1)->name);
+    EXPECT_EQ(RETLDB_TYPE_STRING, segment_column(segment, 2)->type);
+    EXPECT_EQ(2, segment_find_column(segment, "name"));
+    EXPECT_EQ(-1, segment_find_column(segment, "missing"));
+    
+    uint64_t first = 0, rows = 0;
+    ASSERT_EQ(0, segment_row_group(segment, 1, &first, &rows));
+    EXPECT_EQ(10u, first);
+    EXPECT_EQ(5u, rows);
+    
+    for (size_t g = 0; g < 2; g++) {
+        ASSERT_EQ(0, segment_row_group(segment, g, &first, &rows));
+        std::vector<uint64_t> id_buf, score_buf, name_buf;
+        segment_vector_t ids, scores, strings;
+        read_column(segment, g, 0, id_buf, &ids);
+        read_column(segment, g, 1, score_buf, &scores);
+        read_column(segment, g, 2, name_buf, &strings);
+        EXPECT_EQ(nullptr, ids.validity);
+        EXPECT_EQ(nullptr, strings.validity);
+        ASSERT_NE(nullptr, scores.validity);
+        
+        segment_chunk_t chunk;
+        ASSERT_EQ(0, segment_chunk(segment, g, 1, &chunk));
+        EXPECT_EQ(g == 0 ? 4u : 1u, chunk.null_count);
+        
+        for (size_t i = 0; i < rows; i++) {
+            int64_t id = ((const int64_t*)ids.values)[i];
+            EXPECT_EQ((int64_t)(first + i), id);
+            bool present = (scores.validity[i / 8] >> (i % 8)) & 1;
+            EXPECT_EQ(id % 3 != 0, present);
+            if (present) {
+                EXPECT_EQ(id * 1.5, ((const double*)scores.values)[i]);
+            }
+            std::string name((const char*)strings.values + strings.offsets[i],
+                             strings.offsets[i + 1] - strings.offsets[i]);
+            EXPECT_EQ(names[first + i], name);
+        }
+    }
+    EXPECT_EQ(0, segment_close(segment));
+}
+
+// Test that reading a few columns of a wide segment reads only their chunks
+TEST_F(SegmentTest, ColumnProjection) {
+    const size_t column_count = 200;
+    const size_t rows = 1000;
+    std::vector<std::string> names;
+    std::vector<segment_column_t> columns;
+    for (size_t c = 0; c < column_count; c++) {
+        names.push_back("c" + std::to_string(c));
+    }
+    for (size_t c = 0; c < column_count; c++) {
+        columns.push_back({names[c].c_str(), RETLDB_TYPE_INT32, 0});
+    }
+    
+    std::vector<std::vector<int32_t>> values(column_count, std::vector<int32_t>(rows));
+    std::vector<segment_vector_t> vectors;
+    for (size_t c = 0; c < column_count; c++) {
+        for (size_t i = 0; i < rows; i++) {
+            values[c][i] = (int32_t)(c * rows + i);
+        }
+        vectors.push_back({values[c].data(), nullptr, nullptr});
+    }
+    
+    void* writer = segment_writer_create(filename, columns.data(), column_count, 0);
+    ASSERT_NE(nullptr, writer);
+    ASSERT_EQ(0, segment_writer_append(writer, vectors.data(), rows));
+    uint64_t size = 0;
+    ASSERT_EQ(0, segment_writer_finish(writer, &size));
+    
+    void* segment = segment_open(filename);
+    ASSERT_NE(nullptr, segment);
+    segment_stats_t stats;
+    ASSERT_EQ(0, segment_stats(segment, &stats));
+    EXPECT_EQ(0u, stats.chunk_bytes);
+    EXPECT_LT(stats.footer_bytes, size / 10);
+    
+    uint64_t expected = 0;
+    for (const char* name : {"c7", "c100", "c199"}) {
+        int col = segment_find_column(segment, name);
+        ASSERT_GE(col, 0);
+        std::vector<uint64_t> buf;
+        segment_vector_t vector;
+        read_column(segment, 0, (size_t)col, buf, &vector);
+        EXPECT_EQ((int32_t)(col * rows + 999), ((const int32_t*)vector.values)[999]);
+        segment_chunk_t chunk;
+        ASSERT_EQ(0, segment_chunk(segment, 0, (size_t)col, &chunk));
+        expected += chunk.size;
+    }
+    ASSERT_EQ(0, segment_stats(segment, &stats));
+    EXPECT_EQ(3u, stats.chunks_read);
+    EXPECT_EQ(expected, stats.chunk_bytes);
+    EXPECT_EQ(0, segment_close(segment));
+}
+
+// Test that chunks are aligned and can be mapped in place
+TEST_F(SegmentTest, AlignedChunks) {
+    size_t alignment = mmap_granularity();
+    segment_column_t columns[] = {
+        {"a", RETLDB_TYPE_INT16, 0},
+        {"b", RETLDB_TYPE_BINARY, 0},
+    };
+    std::vector<int16_t> shorts(3000);
+    for (size_t i = 0; i < shorts.size(); i++) {
+        shorts[i] = (int16_t)i;
+    }
+    // A window of a larger buffer, with offsets not starting at zero
+    const char blob[] = "xxabcdef";
+    uint32_t offsets[] = {2, 2, 5, 8};
+    
+    void* writer = segment_writer_create(filename, columns, 2, alignment);
+    ASSERT_NE(nullptr, writer);
+    ASSERT_EQ(0, segment_writer_set_encoding(writer, 0, SEGMENT_ENCODING_PLAIN));
+    ASSERT_EQ(0, segment_writer_set_encoding(writer, 1, SEGMENT_ENCODING_PLAIN));
+    for (int g = 0; g < 3; g++) {
+        segment_vector_t vectors[2] = {
+            {shorts.data(), nullptr, nullptr},
+            {blob, offsets, nullptr},
+        };
+        ASSERT_EQ(0, segment_writer_append(writer, vectors, 3));
+    }
+    ASSERT_EQ(0, segment_writer_finish(writer, nullptr));
+    
+    void* segment = segment_open(filename);
+    ASSERT_NE(nullptr, segment);
+    for (size_t g = 0; g < 3; g++) {
+        for (size_t c = 0; c < 2; c++) {
+            segment_chunk_t chunk;
+            ASSERT_EQ(0, segment_chunk(segment, g, c, &chunk));
+            EXPECT_EQ(0u, chunk.offset % alignment);
+            EXPECT_EQ(SEGMENT_ENCODING_PLAIN, chunk.encoding);
+            EXPECT_EQ(SEGMENT_COMPRESSION_NONE, chunk.compression);
+        }
+    }
+    
+    segment_chunk_t chunk;
+    ASSERT_EQ(0, segment_chunk(segment, 2, 1, &chunk));
+    void* map = mmap_file_range(filename, chunk.offset, (size_t)chunk.size, 1);
+    ASSERT_NE(nullptr, map);
+    segment_vector_t vector;
+    ASSERT_EQ(0, segment_decode_chunk(segment, 2, 1, mmap_get_addr(map), nullptr, &vector));
+    EXPECT_EQ(0u, vector.offsets[0]);
+    EXPECT_EQ(0, memcmp("abcdef", vector.values, 6));
+    EXPECT_EQ(0, mmap_unmap(map));
+    EXPECT_EQ(0, segment_close(segment));
+}
+
+// Test that every encoding round-trips every type it supports
+TEST_F(SegmentTest, Encodings) {
+    const size_t rows = 1000;
+    segment_column_t columns[] = {
+        {"i8", RETLDB_TYPE_INT8, 1},
+        {"u16", RETLDB_TYPE_UINT16, 0},
+        {"i32", RETLDB_TYPE_INT32, 0},
+        {"u64", RETLDB_TYPE_UINT64, 0},
+        {"ts", RETLDB_TYPE_TIMESTAMP, 0},
+        {"f64", RETLDB_TYPE_DOUBLE, 0},
+        {"str", RETLDB_TYPE_STRING, 1},
+    };
+    const size_t column_count = sizeof(columns) / sizeof(columns[0]);
+    
+    // Values with runs, repeats, negative steps and full-range outliers
+    std::vector<int8_t> i8(rows);
+    std::vector<uint16_t> u16(rows);
+    std::vector<int32_t> i32(rows);
+    std::vector<uint64_t> u64(rows);
+    std::vector<int64_t> ts(rows);
+    std::vector<double> f64(rows);
+    std::string bytes;
+    std::vector<uint32_t> offsets = {0};
+    std::vector<uint8_t> validity(rows / 8, 0);
+    for (size_t i = 0; i < rows; i++) {
+        i8[i] = (int8_t)((i / 10) % 7 - 3);
+        u16[i] = (uint16_t)(60000 + i % 5);
+        i32[i] = i == 500 ? INT32_MIN : (int32_t)(1000 - i * 3);
+        u64[i] = i == 999 ? UINT64_MAX : (uint64_t)(i / 100);
+        ts[i] = 1700000000000LL + (int64_t)i * 1000 + (i % 3 == 0 ? 1 : 0);
+        f64[i] = (double)(i % 4) / 3.0;
+        bytes += "value-" + std::to_string(i % 13);
+        offsets.push_back((uint32_t)bytes.size());
+        if (i % 5 != 0) {
+            validity[i / 8] |= (uint8_t)(1 << (i % 8));
+        }
+    }
+    segment_vector_t vectors[] = {
+        {i8.data(), nullptr, validity.data()},
+        {u16.data(), nullptr, nullptr},
+        {i32.data(), nullptr, nullptr},
+        {u64.data(), nullptr, nullptr},
+        {ts.data(), nullptr, nullptr},
+        {f64.data(), nullptr, nullptr},
+        {bytes.data(), offsets.data(), validity.data()},
+    };
+    
+    const uint32_t encodings[] = {
+        SEGMENT_ENCODING_PLAIN, SEGMENT_ENCODING_DICTIONARY, SEGMENT_ENCODING_RLE,
+        SEGMENT_ENCODING_BITPACK, SEGMENT_ENCODING_DELTA, SEGMENT_ENCODING_DELTA_DELTA,
+    };
+    for (uint32_t encoding : encodings) {
+        SCOPED_TRACE(encoding);
+        void* writer = segment_writer_create(filename, columns, column_count, 64);
+        ASSERT_NE(nullptr, writer);
+        std::vector<bool> forced(column_count);
+        for (size_t c = 0; c < column_count; c++) {
+            forced[c] = segment_writer_set_encoding(writer, c, encoding) == 0;
+        }
+        // Integers take every encoding; doubles no integer ones; strings neither RLE
+        EXPECT_TRUE(forced[0] && forced[4]);
+        EXPECT_EQ(encoding <= SEGMENT_ENCODING_RLE, (bool)forced[5]);
+        EXPECT_EQ(encoding <= SEGMENT_ENCODING_DICTIONARY, (bool)forced[6]);
+        ASSERT_EQ(0, segment_writer_append(writer, vectors, rows));
+        ASSERT_EQ(0, segment_writer_append(writer, vectors, 1));
+        ASSERT_EQ(0, segment_writer_finish(writer, nullptr));
+        
+        void* segment = segment_open(filename);
+        ASSERT_NE(nullptr, segment);
+        for (size_t g = 0; g < 2; g++) {
+            uint64_t group_rows = 0;
+            ASSERT_EQ(0, segment_row_group(segment, g, nullptr, &group_rows));
+            for (size_t c = 0; c < column_count; c++) {
+                segment_chunk_t chunk;
+                ASSERT_EQ(0, segment_chunk(segment, g, c, &chunk));
+                if (!forced[c]) {
+                    continue;
+                }
+                // A forced encoding only gives way to PLAIN
+                EXPECT_TRUE(chunk.encoding == encoding ||
+                            chunk.encoding == SEGMENT_ENCODING_PLAIN);
+                
+                std::vector<uint64_t> buf;
+                segment_vector_t vector;
+                read_column(segment, g, c, buf, &vector);
+                size_t width = segment_type_width(columns[c].type);
+                if (width > 0) {
+                    EXPECT_EQ(0, memcmp(vectors[c].values, vector.values, group_rows * width));
+                } else {
+                    for (size_t i = 0; i <= group_rows; i++) {
+                        ASSERT_EQ(offsets[i], vector.offsets[i]);
+                    }
+                    EXPECT_EQ(0, memcmp(bytes.data(), vector.values, offsets[group_rows]));
+                }
+                if (columns[c].nullable) {
+                    ASSERT_NE(nullptr, vector.validity);
+                    for (size_t i = 0; i < group_rows; i++) {
+                        EXPECT_EQ(i % 5 != 0, (bool)((vector.validity[i / 8] >> (i % 8)) & 1));
+                    }
+                }
+            }
+        }
+        EXPECT_EQ(0, segment_close(segment));
+    }
+}
+
+// Test that every decode kernel the CPU runs gives the same values
+TEST_F(SegmentTest, DecodeKernels) {
+    const size_t rows = 3001;
+    const size_t packed_columns = 32;
+    std::vector<std::string> names;
+    std::vector<segment_column_t> columns;
+    for (size_t b = 1; b <= packed_columns; b++) {
+        names.push_back("b" + std::to_string(b));
+    }
+    for (size_t b = 0; b < packed_columns; b++) {
+        columns.push_back({names[b].c_str(), RETLDB_TYPE_INT64, 0});
+    }
+    columns.push_back({"delta", RETLDB_TYPE_INT64, 0});
+    columns.push_back({"d8", RETLDB_TYPE_INT8, 0});
+    columns.push_back({"d16", RETLDB_TYPE_INT16, 0});
+    columns.push_back({"d32", RETLDB_TYPE_INT32, 0});
+    columns.push_back({"d64", RETLDB_TYPE_INT64, 0});
+    
+    // Bit widths 1 to 32 with both ends of the range present, and dictionaries
+    std::vector<std::vector<int64_t>> packed(packed_columns, std::vector<int64_t>(rows));
+    std::vector<int64_t> delta(rows);
+    std::vector<int8_t> d8(rows);
+    std::vector<int16_t> d16(rows);
+    std::vector<int32_t> d32(rows);
+    std::vector<int64_t> d64(rows);
+    uint64_t state = 0x9e3779b97f4a7c15ULL;
+    for (size_t i = 0; i < rows; i++) {
+        state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+        uint64_t r = state >> 16;
+        for (size_t b = 0; b < packed_columns; b++) {
+            uint64_t mask = (1ULL << (b + 1)) - 1;
+            packed[b][i] = (int64_t)(i == 0 ? mask : i == 1 ? 0 : (r * (b + 7)) & mask);
+        }
+        delta[i] = (int64_t)(i * 1000 + r % 500);
+        d8[i] = (int8_t)(r % 37 - 18);
+        d16[i] = (int16_t)((r % 101) * 300 - 15000);
+        d32[i] = (int32_t)((r % 211) * 10000000 - 1000000000);
+        d64[i] = (int64_t)(r % 300) * 1000000000000LL - 7;
+    }
+    std::vector<segment_vector_t> vectors;
+    for (size_t b = 0; b < packed_columns; b++) {
+        vectors.push_back({packed[b].data(), nullptr, nullptr});
+    }
+    vectors.push_back({delta.data(), nullptr, nullptr});
+    vectors.push_back({d8.data(), nullptr, nullptr});
+    vectors.push_back({d16.data(), nullptr, nullptr});
+    vectors.push_back({d32.data(), nullptr, nullptr});
+    vectors.push_back({d64.data(), nullptr, nullptr});
+    
+    void* writer = segment_writer_create(filename, columns.data(), columns.size(), 64);
+    ASSERT_NE(nullptr, writer);
+    for (size_t c = 0; c < columns.size(); c++) {
+        uint32_t encoding = c < packed_columns ? SEGMENT_ENCODING_BITPACK
+                          : c == packed_columns ? SEGMENT_ENCODING_DELTA
+                          : SEGMENT_ENCODING_DICTIONARY;
+        ASSERT_EQ(0, segment_writer_set_encoding(writer, c, encoding));
+    }
+    ASSERT_EQ(0, segment_writer_append(writer, vectors.data(), rows));
+    ASSERT_EQ(0, segment_writer_finish(writer, nullptr));
+    
+    void* segment = segment_open(filename);
+    ASSERT_NE(nullptr, segment);
+    for (size_t c = 0; c < columns.size(); c++) {
+        segment_chunk_t chunk;
+        ASSERT_EQ(0, segment_chunk(segment, 0, c, &chunk));
+        EXPECT_NE((uint32_t)SEGMENT_ENCODING_PLAIN, chunk.encoding) << columns[c].name;
+    }
+    
+    uint32_t best = segment_kernel_level();
+    for (uint32_t level : {SEGMENT_KERNEL_SCALAR, SEGMENT_KERNEL_AVX2, SEGMENT_KERNEL_AVX512}) {
+        SCOPED_TRACE(level);
+        if (segment_set_kernel_level(level) != 0) {
+            EXPECT_GT(level, best);
+            continue;
+        }
+        EXPECT_EQ(level, segment_kernel_level());
+        for (size_t c = 0; c < columns.size(); c++) {
+            SCOPED_TRACE(columns[c].name);
+            std::vector<uint64_t> buf;
+            segment_vector_t vector;
+            read_column(segment, 0, c, buf, &vector);
+            size_t width = segment_type_width(columns[c].type);
+            EXPECT_EQ(0, memcmp(vectors[c].values, vector.values, rows * width));
+        }
+    }
+    EXPECT_NE(0, segment_set_kernel_level(SEGMENT_KERNEL_AVX512 + 1));
+    EXPECT_EQ(0, segment_set_kernel_level(best));
+    EXPECT_EQ(best, segment_kernel_level());
+    EXPECT_EQ(0, segment_close(segment));
+}
+
+// Test that encodings are picked from the data and shrink typical columns
+TEST_F(SegmentTest, AutoEncoding) {
+    const size_t rows = 100000;
+    segment_column_t columns[] = {
+        {"ts", RETLDB_TYPE_TIMESTAMP, 0},
+        {"status", RETLDB_TYPE_STRING, 0},
+        {"region", RETLDB_TYPE_INT32, 0},
+        {"qty", RETLDB_TYPE_INT64, 0},
+        {"price", RETLDB_TYPE_DOUBLE, 0},
+    };
+    std::vector<int64_t> ts(rows), qty(rows);
+    std::vector<int32_t> region(rows);
+    std::vector<double> price(rows);
+    const char* statuses[] = {"shipped", "pending", "cancelled", "returned"};
+    std::string bytes;
+    std::vector<uint32_t> offsets = {0};
+    uint64_t state = 12345;
+    for (size_t i = 0; i < rows; i++) {
+        state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+        ts[i] = 1700000000000000LL + (int64_t)i * 250000;
+        region[i] = (int32_t)(i / 5000);
+        qty[i] = (int64_t)(state >> 58);
+        price[i] = (double)(state >> 11) / 9007199254740992.0;
+        bytes += statuses[(state >> 40) % 4];
+        offsets.push_back((uint32_t)bytes.size());
+    }
+    segment_vector_t vectors[] = {
+        {ts.data(), nullptr, nullptr},
+        {bytes.data(), offsets.data(), nullptr},
+        {region.data(), nullptr, nullptr},
+        {qty.data(), nullptr, nullptr},
+        {price.data(), nullptr, nullptr},
+    };
+    
+    void* writer = segment_writer_create(filename, columns, 5, 0);
+    ASSERT_NE(nullptr, writer);
+    ASSERT_EQ(0, segment_writer_append(writer, vectors, rows));
+    ASSERT_EQ(0, segment_writer_finish(writer, nullptr));
+    
+    void* segment = segment_open(filename);
+    ASSERT_NE(nullptr, segment);
+    const uint32_t expected[] = {
+        SEGMENT_ENCODING_DELTA, SEGMENT_ENCODING_DICTIONARY, SEGMENT_ENCODING_RLE,
+        SEGMENT_ENCODING_BITPACK, SEGMENT_ENCODING_PLAIN,
+    };
+    uint64_t stored = 0, decoded = 0;
+    for (size_t c = 0; c < 5; c++) {
+        segment_chunk_t chunk;
+        ASSERT_EQ(0, segment_chunk(segment, 0, c, &chunk));
+        EXPECT_EQ(expected[c], chunk.encoding) << columns[c].name;
+        stored += chunk.size;
+        decoded += chunk.decoded_size;
+        
+        std::vector<uint64_t> buf;
+        segment_vector_t vector;
+        read_column(segment, 0, c, buf, &vector);
+        size_t width = segment_type_width(columns[c].type);
+        if (width > 0) {
+            EXPECT_EQ(0, memcmp(vectors[c].values, vector.values, rows * width));
+        } else {
+            EXPECT_EQ(0, memcmp(offsets.data(), vector.offsets, (rows + 1) * sizeof(uint32_t)));
+            EXPECT_EQ(0, memcmp(bytes.data(), vector.values, bytes.size()));
+        }
+    }
+    // Everything but the random doubles compresses well
+    segment_chunk_t price_chunk;
+    ASSERT_EQ(0, segment_chunk(segment, 0, 4, &price_chunk));
+    EXPECT_LT((stored - price_chunk.size) * 8, decoded - price_chunk.decoded_size);
+    EXPECT_EQ(0, segment_close(segment));
+}
+
+// Test per-column block compression on top of the encodings
+TEST_F(SegmentTest, Compression) {
+    const size_t rows = 20000;
+    segment_column_t columns[] = {
+        {"plain", RETLDB_TYPE_STRING, 1},
+        {"lz4", RETLDB_TYPE_STRING, 1},
+        {"snappy", RETLDB_TYPE_STRING, 1},
+        {"encoded", RETLDB_TYPE_INT64, 0},
+    };
+    // Repetitive text that the dictionary cannot take (every value distinct)
+    std::string bytes;
+    std::vector<uint32_t> offsets = {0};
+    std::vector<int64_t> numbers(rows);
+    std::vector<uint8_t> validity((rows + 7) / 8, 0xff);
+    validity[3] = 0x0f;
+    for (size_t i = 0; i < rows; i++) {
+        bytes += "customer-" + std::to_string(i) + "@example.com";
+        offsets.push_back((uint32_t)bytes.size());
+        numbers[i] = (int64_t)(i * 7919 % 1000);
+    }
+    segment_vector_t vectors[] = {
+        {bytes.data(), offsets.data(), validity.data()},
+        {bytes.data(), offsets.data(), validity.data()},
+        {bytes.data(), offsets.data(), validity.data()},
+        {numbers.data(), nullptr, nullptr},
+    };
+    
+    void* writer = segment_writer_create(filename, columns, 4, mmap_granularity());
+    ASSERT_NE(nullptr, writer);
+    EXPECT_NE(0, segment_writer_set_compression(writer, 0, 42));
+    EXPECT_NE(0, segment_writer_set_compression(writer, 4, SEGMENT_COMPRESSION_LZ4));
+    ASSERT_EQ(0, segment_writer_set_compression(writer, 1, SEGMENT_COMPRESSION_LZ4));
+    ASSERT_EQ(0, segment_writer_set_compression(writer, 2, SEGMENT_COMPRESSION_SNAPPY));
+    ASSERT_EQ(0, segment_writer_set_compression(writer, 3, SEGMENT_COMPRESSION_LZ4));
+    ASSERT_EQ(0, segment_writer_append(writer, vectors, rows));
+    ASSERT_EQ(0, segment_writer_finish(writer, nullptr));
+    
+    void* segment = segment_open(filename);
+    ASSERT_NE(nullptr, segment);
+    segment_chunk_t chunks[4];
+    for (size_t c = 0; c < 4; c++) {
+        ASSERT_EQ(0, segment_chunk(segment, 0, c, &chunks[c]));
+    }
+    EXPECT_EQ(SEGMENT_COMPRESSION_NONE, chunks[0].compression);
+    EXPECT_EQ(0u, segment_scratch_size(&chunks[0]));
+    EXPECT_EQ(SEGMENT_COMPRESSION_LZ4, chunks[1].compression);
+    EXPECT_LT(chunks[1].size * 2, chunks[0].size);
+    EXPECT_EQ(chunks[0].size, chunks[1].encoded_size);
+    // A codec that does not shrink the chunk is not used
+    EXPECT_TRUE(chunks[2].compression == SEGMENT_COMPRESSION_SNAPPY ||
+                chunks[2].size == chunks[2].encoded_size);
+    EXPECT_NE(SEGMENT_ENCODING_PLAIN, chunks[3].encoding);
+    EXPECT_LE(chunks[3].size, chunks[3].encoded_size);
+    
+    for (size_t c = 0; c < 4; c++) {
+        std::vector<uint64_t> buf;
+        segment_vector_t vector;
+        read_column(segment, 0, c, buf, &vector);
+        if (c == 3) {
+            EXPECT_EQ(0, memcmp(numbers.data(), vector.values, rows * sizeof(int64_t)));
+            continue;
+        }
+        ASSERT_NE(nullptr, vector.validity);
+        EXPECT_EQ(0x0f, vector.validity[3]);
+        EXPECT_EQ(0, memcmp(offsets.data(), vector.offsets, (rows + 1) * sizeof(uint32_t)));
+        EXPECT_EQ(0, memcmp(bytes.data(), vector.values, bytes.size()));
+    }
+    
+    // A compressed chunk decodes from a mapping too
+    void* map = mmap_file_range(filename, chunks[1].offset, (size_t)chunks[1].size, 1);
+    ASSERT_NE(nullptr, map);
+    std::vector<uint64_t> scratch(segment_scratch_size(&chunks[1]) / 8 + 1);
+    segment_vector_t vector;
+    EXPECT_NE(0, segment_decode_chunk(segment, 0, 1, mmap_get_addr(map), nullptr, &vector));
+    ASSERT_EQ(0, segment_decode_chunk(segment, 0, 1, mmap_get_addr(map), scratch.data(),
+                                      &vector));
+    EXPECT_EQ(0, memcmp(bytes.data(), vector.values, bytes.size()));
+    EXPECT_EQ(0, mmap_unmap(map));
+    EXPECT_EQ(0, segment_close(segment));
+}
+
+// Test zone maps: bounds, null and distinct counts, sort order and pruning
+TEST_F(SegmentTest, ZoneMaps) {
+    segment_column_t columns[] = {
+        {"id", RETLDB_TYPE_INT64, 0},
+        {"score", RETLDB_TYPE_DOUBLE, 1},
+        {"name", RETLDB_TYPE_STRING, 0},
+        {"flag", RETLDB_TYPE_UINT8, 0},
+        {"ts", RETLDB_TYPE_TIMESTAMP, 0},
+    };
+    void* writer = segment_writer_create(filename, columns, 5, 0);
+    ASSERT_NE(nullptr, writer);
+    
+    // Four row groups of 1000 rows: scores have nulls and a NaN in groups 0
+    // and 1, are all null in group 2 and all zero (some -0.0) in group 3;
+    // names are ascending except for one long value in group 1
+    const size_t rows = 1000;
+    const std::string longest(50, 'z');
+    for (size_t g = 0; g < 4; g++) {
+        std::vector<int64_t> ids, stamps;
+        std::vector<double> scores;
+        std::vector<uint8_t> flags(rows, 7);
+        std::vector<uint8_t> validity(rows / 8, 0);
+        std::string bytes;
+        std::vector<uint32_t> offsets = {0};
+        for (size_t i = 0; i < rows; i++) {
+            int64_t id = (int64_t)(g * rows + i);
+            ids.push_back(id);
+            stamps.push_back(1000000000 - id);
+            double score = (double)(i % 10) - 5.0;
+            if (i % 10 == 5 || g == 3) {
+                score = i % 2 ? -0.0 : 0.0;
+            }
+            if (i == 7 && g < 2) {
+                score = NAN;
+            }
+            scores.push_back(score);
+            if ((i % 4 != 0 && g < 2) || g == 3) {
+                validity[i / 8] |= (uint8_t)(1 << (i % 8));
+            }
+            char name[16];
+            snprintf(name, sizeof(name), "k%04d", (int)id);
+            bytes += g == 1 && i == 500 ? longest : std::string(name);
+            offsets.push_back((uint32_t)bytes.size());
+        }
+        segment_vector_t vectors[5] = {
+            {ids.data(), nullptr, nullptr},
+            {scores.data(), nullptr, validity.data()},
+            {bytes.data(), offsets.data(), nullptr},
+            {flags.data(), nullptr, nullptr},
+            {stamps.data(), nullptr, nullptr},
+        };
+        ASSERT_EQ(0, segment_writer_append(writer, vectors, rows));
+    }
+    ASSERT_EQ(0, segment_writer_finish(writer, nullptr));
+    
+    void* segment = segment_open(filename);
+    ASSERT_NE(nullptr, segment);
+    segment_zone_t zone;
+    EXPECT_NE(0, segment_chunk_zone(segment, 4, 0, &zone));
+    EXPECT_NE(0, segment_chunk_zone(segment, 0, 5, &zone));
+    EXPECT_NE(0, segment_column_zone(segment, 5, &zone));
+    EXPECT_NE(0, segment_column_zone(segment, 0, nullptr));
+    
+    // Distinct counts are exact for small cardinalities and close for large ones
+    int64_t value;
+    for (size_t g = 0; g < 4; g++) {
+        ASSERT_EQ(0, segment_chunk_zone(segment, g, 0, &zone));
+        EXPECT_EQ(SEGMENT_ZONE_BOUNDS | SEGMENT_ZONE_ASCENDING, zone.flags);
+        EXPECT_EQ(0u, zone.null_count);
+        EXPECT_NEAR(1000.0, (double)zone.distinct, 150.0);
+        ASSERT_EQ(8u, zone.min_size);
+        memcpy(&value, zone.min, sizeof(value));
+        EXPECT_EQ((int64_t)(g * rows), value);
+        memcpy(&value, zone.max, sizeof(value));
+        EXPECT_EQ((int64_t)(g * rows + rows - 1), value);
+    }
+    ASSERT_EQ(0, segment_column_zone(segment, 0, &zone));
+    EXPECT_EQ(SEGMENT_ZONE_BOUNDS | SEGMENT_ZONE_ASCENDING, zone.flags);
+    EXPECT_NEAR(4000.0, (double)zone.distinct, 600.0);
+    memcpy(&value, zone.max, sizeof(value));
+    EXPECT_EQ(3999, value);
+    
+    ASSERT_EQ(0, segment_column_zone(segment, 4, &zone));
+    EXPECT_EQ(SEGMENT_ZONE_BOUNDS | SEGMENT_ZONE_DESCENDING, zone.flags);
+    memcpy(&value, zone.min, sizeof(value));
+    EXPECT_EQ(1000000000 - 3999, value);
+    ASSERT_EQ(0, segment_column_zone(segment, 3, &zone));
+    EXPECT_EQ(SEGMENT_ZONE_BOUNDS | SEGMENT_ZONE_ASCENDING | SEGMENT_ZONE_DESCENDING, zone.flags);
+    EXPECT_EQ(1u, zone.distinct);
+    EXPECT_EQ(7, zone.min[0]);
+    EXPECT_EQ(7, zone.max[0]);
+    
+    // NaN is present but out of the bounds; -0.0 and 0.0 are one value
+    double score;
+    ASSERT_EQ(0, segment_chunk_zone(segment, 0, 1, &zone));
+    EXPECT_EQ(250u, zone.null_count);
+    EXPECT_EQ(10u, zone.distinct);
+    EXPECT_EQ((uint32_t)SEGMENT_ZONE_BOUNDS, zone.flags);
+    memcpy(&score, zone.min, sizeof(score));
+    EXPECT_EQ(-5.0, score);
+    memcpy(&score, zone.max, sizeof(score));
+    EXPECT_EQ(4.0, score);
+    ASSERT_EQ(0, segment_chunk_zone(segment, 2, 1, &zone));
+    EXPECT_EQ(1000u, zone.null_count);
+    EXPECT_EQ(0u, zone.distinct);
+    EXPECT_EQ(0u, zone.flags & SEGMENT_ZONE_BOUNDS);
+    EXPECT_EQ(0, segment_zone_may_match(&zone, RETLDB_TYPE_DOUBLE, nullptr, 0, nullptr, 0));
+    ASSERT_EQ(0, segment_chunk_zone(segment, 3, 1, &zone));
+    EXPECT_EQ(SEGMENT_ZONE_BOUNDS | SEGMENT_ZONE_ASCENDING | SEGMENT_ZONE_DESCENDING, zone.flags);
+    EXPECT_EQ(1u, zone.distinct);
+    ASSERT_EQ(0, segment_column_zone(segment, 1, &zone));
+    EXPECT_EQ(1500u, zone.null_count);
+    EXPECT_EQ(10u, zone.distinct);
+    double low = 4.5, nan = NAN;
+    EXPECT_EQ(0, segment_zone_may_match(&zone, RETLDB_TYPE_DOUBLE, &low, 0, nullptr, 0));
+    EXPECT_EQ(1, segment_zone_may_match(&zone, RETLDB_TYPE_DOUBLE, nullptr, 0, &low, 0));
+    EXPECT_EQ(0, segment_zone_may_match(&zone, RETLDB_TYPE_DOUBLE, &nan, 0, nullptr, 0));
+    
+    // A long name leaves only a prefix of the maximum
+    ASSERT_EQ(0, segment_chunk_zone(segment, 0, 2, &zone));
+    EXPECT_EQ(SEGMENT_ZONE_BOUNDS | SEGMENT_ZONE_ASCENDING, zone.flags);
+    EXPECT_EQ(std::string("k0000"), std::string((const char*)zone.min, zone.min_size));
+    EXPECT_EQ(std::string("k0999"), std::string((const char*)zone.max, zone.max_size));
+    ASSERT_EQ(0, segment_column_zone(segment, 2, &zone));
+    EXPECT_EQ(SEGMENT_ZONE_BOUNDS | SEGMENT_ZONE_MAX_TRUNCATED, zone.flags);
+    EXPECT_EQ(std::string(32, 'z'), std::string((const char*)zone.max, zone.max_size));
+    EXPECT_NEAR(4000.0, (double)zone.distinct, 600.0);
+    EXPECT_EQ(1, segment_zone_may_match(&zone, RETLDB_TYPE_STRING, longest.data(),
+                                        longest.size(), longest.data(), longest.size()));
+    EXPECT_EQ(0, segment_zone_may_match(&zone, RETLDB_TYPE_STRING, "{", 1, nullptr, 0));
+    EXPECT_EQ(0, segment_zone_may_match(&zone, RETLDB_TYPE_STRING, nullptr, 0, "a", 1));
+    EXPECT_EQ(0, segment_zone_may_match(&zone, RETLDB_TYPE_STRING, "k2", 2, "k1", 2));
+    
+    // Point lookups rule out row groups without reading a chunk; the name
+    // prefix kept for group 1's long value cannot rule that group out
+    const char* name = "k2500";
+    value = 2500;
+    size_t matches = 0;
+    for (size_t g = 0; g < 4; g++) {
+        ASSERT_EQ(0, segment_chunk_zone(segment, g, 0, &zone));
+        int id_match = segment_zone_may_match(&zone, RETLDB_TYPE_INT64, &value, 0, &value, 0);
+        ASSERT_EQ(0, segment_chunk_zone(segment, g, 2, &zone));
+        int name_match = segment_zone_may_match(&zone, RETLDB_TYPE_STRING, name, 5, name, 5);
+        EXPECT_EQ(g == 2 ? 1 : 0, id_match);
+        EXPECT_EQ(g == 1 || g == 2 ? 1 : 0, name_match);
+        matches += (size_t)(id_match && name_match);
+    }
+    EXPECT_EQ(1u, matches);
+    segment_stats_t stats;
+    ASSERT_EQ(0, segment_stats(segment, &stats));
+    EXPECT_EQ(0u, stats.chunks_read);
+    
+    EXPECT_EQ(-1, segment_zone_may_match(nullptr, RETLDB_TYPE_INT64, nullptr, 0, nullptr, 0));
+    EXPECT_EQ(-1, segment_zone_may_match(&zone, RETLDB_TYPE_ARRAY, nullptr, 0, nullptr, 0));
+    EXPECT_EQ(0, segment_close(segment));
+}
+
+// Test that damaged files and damaged chunks are rejected
+TEST_F(SegmentTest, Corruption) {
+    segment_column_t columns[] = {{"v", RETLDB_TYPE_UINT64, 0}};
+    std::vector<uint64_t> values(100, 42);
+    segment_vector_t vectors[] = {{values.data(), nullptr, nullptr}};
+    void* writer = segment_writer_create(filename, columns, 1, 64);
+    ASSERT_NE(nullptr, writer);
+    ASSERT_EQ(0, segment_writer_append(writer, vectors, values.size()));
+    uint64_t size = 0;
+    ASSERT_EQ(0, segment_writer_finish(writer, &size));
+    
+    // Flip a byte of the chunk: the footer is fine, the chunk is not
+    void* file = file_open_flags(filename, FILE_READ | FILE_WRITE);
+    ASSERT_NE(nullptr, file);
+    uint8_t byte = 0;
+    ASSERT_EQ(1, file_pread(file, &byte, 1, 64));
+    byte ^= 0xff;
+    ASSERT_EQ(1, file_pwrite(file, &byte, 1, 64));
+    
+    void* segment = segment_open(filename);
+    ASSERT_NE(nullptr, segment);
+    std::vector<uint64_t> buf(100);
+    EXPECT_NE(0, segment_read_chunk(segment, 0, 0, buf.data()));
+    EXPECT_NE(0, segment_read_chunk(segment, 1, 0, buf.data()));
+    EXPECT_EQ(0, segment_close(segment));
+    
+    // Files from an older layout version are refused, then the header is restored
+    uint32_t version = 0;
+    ASSERT_EQ(4, file_pread(file, &version, 4, 8));
+    uint32_t older = version - 1;
+    ASSERT_EQ(4, file_pwrite(file, &older, 4, 8));
+    EXPECT_EQ(nullptr, segment_open(filename));
+    ASSERT_EQ(4, file_pwrite(file, &version, 4, 8));
+    segment = segment_open(filename);
+    ASSERT_NE(nullptr, segment);
+    EXPECT_EQ(0, segment_close(segment));
+    
+    // Flip a byte of the footer
+    ASSERT_EQ(1, file_pread(file, &byte, 1, size - 40));
+    byte ^= 0xff;
+    ASSERT_EQ(1, file_pwrite(file, &byte, 1, size - 40));
+    EXPECT_EQ(nullptr, segment_open(filename));
+    
+    // Cut the trailer off
+    ASSERT_EQ(0, file_truncate(file, size - 8));
+    EXPECT_EQ(0, file_close(file));
+    EXPECT_EQ(nullptr, segment_open(filename));
+    EXPECT_EQ(nullptr, segment_open("nonexistent.seg"));
+}
+
+// Test invalid writers and abandoned writes
+TEST_F(SegmentTest, WriterErrors) {
+    segment_column_t columns[] = {{"v", RETLDB_TYPE_INT32, 0}};
+    segment_column_t nested[] = {{"v", RETLDB_TYPE_ARRAY, 0}};
+    EXPECT_EQ(nullptr, segment_writer_create(filename, nested, 1, 0));
+    EXPECT_EQ(nullptr, segment_writer_create(filename, columns, 0, 0));
+    EXPECT_EQ(nullptr, segment_writer_create(filename, columns, 1, 100));
+    
+    void* writer = segment_writer_create(filename, columns, 1, 0);
+    ASSERT_NE(nullptr, writer);
+    int32_t values[8] = {0};
+    uint8_t validity[1] = {0x7f};
+    segment_vector_t with_nulls[] = {{values, nullptr, validity}};
+    EXPECT_NE(0, segment_writer_append(writer, with_nulls, 8));
+    EXPECT_EQ(0, segment_writer_abort(writer));
+    
+    FILE* fp = fopen(filename, "rb");
+    EXPECT_EQ(nullptr, fp);
+    if (fp) {
+        fclose(fp);
+    }
+    
+    // An empty segment is valid
+    writer = segment_writer_create(filename, columns, 1, 0);
+    ASSERT_NE(nullptr, writer);
+    ASSERT_EQ(0, segment_writer_finish(writer, nullptr));
+    void* segment = segment_open(filename);
+    ASSERT_NE(nullptr, segment);
+    EXPECT_EQ(0u, segment_row_count(segment));
+    EXPECT_EQ(0u, segment_row_group_count(segment));
+    segment_chunk_t chunk;
+    EXPECT_NE(0, segment_chunk(segment, 0, 0, &chunk));
+    EXPECT_EQ(0, segment_close(segment));
+}